@@ -100,7 +100,7 @@ GlobalStuff *g = NULL;
     // Draw initial interface
     DrawBorder();
     if (g->interfaceBackGWorld && self.gameView) {
-        [self.gameView setNeedsDisplay:YES];
+        [self.gameView setNeedsRedraw];
     }
     
     // Start the game timer
@@ -134,8 +134,8 @@ GlobalStuff *g = NULL;
     // Call the game's frame update
     DoFrame();
     
-    // Trigger view redraw
-    [self.gameView setNeedsDisplay:YES];
+    // Start presenting the frame, and trigger view redraw
+    [self.gameView setNeedsRedraw];
 }
 
 // Called when turbo preference changes
@@ -11,7 +11,12 @@
 
 extern GlobalStuff *g;
 
-@implementation GameView
+@implementation GameView {
+    // Converts the GWorld on show to host-order pixels, into two buffers in turn
+    PresenterPtr presenter;
+    void *presentBuffers[2];
+    int presentWidth, presentHeight;
+}
 
 - (instancetype)initWithFrame:(NSRect)frameRect {
     self = [super initWithFrame:frameRect];
@@ -41,7 +46,64 @@ extern GlobalStuff *g;
     return self;
 }
 
+- (void)dealloc {
+    [self disposePresenter];
+#if !__has_feature(objc_arc)
+    [super dealloc];
+#endif
+}
+
+- (void)disposePresenter {
+    if (presenter) {
+        DisposePresenter(presenter);
+        presenter = NULL;
+    }
+    free(presentBuffers[0]);
+    free(presentBuffers[1]);
+    presentBuffers[0] = presentBuffers[1] = NULL;
+}
+
+// The GWorld to show based on game state
+- (GWorldPtr)gworldToDraw {
+    if (!g) return NULL;
+    
+    GWorldPtr gworldToDraw = g->swapGWorld;
+    if (!g->inGame && g->interfaceBackGWorld) {
+        gworldToDraw = g->interfaceBackGWorld;
+    }
+    return gworldToDraw;
+}
+
+// Starts converting what changed in the GWorld since it was last presented.
+// This runs in the background until the GWorld is drawn into again, so it
+// overlaps with the start of the next frame.
+- (void)presentGWorld {
+    GWorldPtr gworldToDraw = [self gworldToDraw];
+    if (!gworldToDraw) return;
+    
+    int width = gworldToDraw->portRect.right - gworldToDraw->portRect.left;
+    int height = gworldToDraw->portRect.bottom - gworldToDraw->portRect.top;
+    
+    if (!presenter || width != presentWidth || height != presentHeight) {
+        [self disposePresenter];
+        
+        // B, G, R, A bytes: what Core Graphics reads fastest on little-endian Macs
+        presentBuffers[0] = malloc(width * height * 4);
+        presentBuffers[1] = malloc(width * height * 4);
+        if (NewPresenter(&presenter, width, height, pommePresentBGRA,
+                         presentBuffers[0], presentBuffers[1], width * 4) != noErr) {
+            [self disposePresenter];
+            return;
+        }
+        presentWidth = width;
+        presentHeight = height;
+    }
+    
+    PresentPort(presenter, gworldToDraw);
+}
+
 - (void)setNeedsRedraw {
+    [self presentGWorld];
     [self setNeedsDisplay:YES];
 }
 
@@ -52,50 +114,37 @@ extern GlobalStuff *g;
     [[NSColor blackColor] setFill];
     NSRectFill(dirtyRect);
     
-    if (!g) return;
-    
-    // Draw the appropriate GWorld based on game state
-    GWorldPtr gworldToDraw = g->swapGWorld;
-    if (!g->inGame && g->interfaceBackGWorld) {
-        gworldToDraw = g->interfaceBackGWorld;
+    if (!presenter) {
+        [self presentGWorld];
+        if (!presenter) return;
     }
     
-    if (!gworldToDraw) return;
-    
-    // Get pixel data from GWorld (Pomme stores ARGB32)
-    PixMapHandle pixMap = GetGWorldPixMap(gworldToDraw);
-    if (!pixMap) return;
-    
-    LockPixels(pixMap);
-    
-    // Get dimensions from the PixMap structure
-    PixMap *pm = *pixMap;
-    int width = pm->bounds.right - pm->bounds.left;
-    int height = pm->bounds.bottom - pm->bounds.top;
+    // Show the latest frame that's done converting; only wait if there's none yet
+    void *pixels = GetPresentedFrame(presenter, false);
+    if (!pixels) pixels = GetPresentedFrame(presenter, true);
+    if (!pixels) return;
     
-    // Pomme stores 32-bit ARGB data
-    Ptr baseAddr = GetPixBaseAddr(pixMap);
-    int rowBytes = width * 4;  // 32-bit = 4 bytes per pixel
+    int width = presentWidth;
+    int height = presentHeight;
     
-    // Create CGImage from ARGB32 pixel data
+    // Create CGImage straight from the presented pixels, without copying them
     CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, pixels, width * height * 4, NULL);
     
-    // Pomme uses ARGB format (Alpha in high byte)
-    // On little-endian (Intel/ARM), this is stored as BGRA in memory
-    CGBitmapInfo bitmapInfo = kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little;
-    
-    CGContextRef bitmapContext = CGBitmapContextCreate(
-        baseAddr,
-        width,
-        height,
-        8,              // bits per component
-        rowBytes,
-        colorSpace,
-        bitmapInfo
-    );
-    
-    if (bitmapContext) {
-        CGImageRef image = CGBitmapContextCreateImage(bitmapContext);
+    if (provider) {
+        CGImageRef image = CGImageCreate(
+            width,
+            height,
+            8,                  // bits per component
+            32,                 // bits per pixel
+            width * 4,
+            colorSpace,
+            kCGImageAlphaNoneSkipFirst | kCGBitmapByteOrder32Little,
+            provider,
+            NULL,
+            false,
+            kCGRenderingIntentDefault
+        );
         
         if (image) {
             CGContextRef viewContext = [[NSGraphicsContext currentContext] CGContext];
@@ -118,11 +167,10 @@ extern GlobalStuff *g;
             CGImageRelease(image);
         }
         
-        CGContextRelease(bitmapContext);
+        CGDataProviderRelease(provider);
     }
     
     CGColorSpaceRelease(colorSpace);
-    UnlockPixels(pixMap);
 }
 
 #pragma mark - Keyboard Input
@@ -196,7 +244,7 @@ extern GlobalStuff *g;
         short option = GetInterfaceOption(pt.h, pt.v);
         if (option) {
             g->clickedOnOption = option;
-            [self setNeedsDisplay:YES];
+            [self setNeedsRedraw];
         }
     } else {
         // Game mode - fire weapon
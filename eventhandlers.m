@@ -412,6 +412,9 @@ void DoFrame(void)
         {
             g->sheepArrowsThisFrame = 0;
             
+            // Blits and fills into the swap GWorld are replayed over bands of rows in parallel
+            BeginBandedFrame(g->swapGWorld);
+            
             switch (g->gameState)
             {
                 case kLevelStart:
@@ -462,6 +465,8 @@ void DoFrame(void)
                     DrawCompletedScreenStuff(g->swapGWorld);
                     break;
             }
+            
+            EndBandedFrame();
         }
         else
         {
@@ -479,7 +484,7 @@ void DoFrame(void)
     CheckKeys();
     
     // Note: Actual drawing to window happens via GameView's drawRect:
-    // which is triggered by setNeedsDisplay:YES in AppDelegate's doFrame
+    // which is triggered by setNeedsRedraw in AppDelegate's doFrame
     
     if (lastTime > 0) {
         g->fps = 1.0 / (thisTime - lastTime);
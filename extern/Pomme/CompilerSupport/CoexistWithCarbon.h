@@ -3,25 +3,42 @@
 
 #define AddResource				Pomme_AddResource
 #define BackColor				Pomme_BackColor
+#define BeginBandedFrame		Pomme_BeginBandedFrame
+#define BeginStaticLayer		Pomme_BeginStaticLayer
 #define BlockMove				Pomme_BlockMove
 #define BlockMoveData			Pomme_BlockMoveData
 #define ChangedResource			Pomme_ChangedResource
 #define ClearPortDamage			Pomme_ClearPortDamage
+#define ClipRect				Pomme_ClipRect
 #define CloseResFile			Pomme_CloseResFile
+#define CompactMem				Pomme_CompactMem
 #define CopyBits				Pomme_CopyBits
+#define CopyRgn					Pomme_CopyRgn
 #define Count1Resources			Pomme_Count1Resources
 #define Count1Types				Pomme_Count1Types
 #define CurResFile				Pomme_CurResFile
 #define DamagePortRegion		Pomme_DamagePortRegion
 #define DetachResource			Pomme_DetachResource
+#define DiffRgn					Pomme_DiffRgn
 #define DirCreate				Pomme_DirCreate
 #define DisposeGWorld			Pomme_DisposeGWorld
 #define DisposeHandle			Pomme_DisposeHandle
+#define DisposePresenter		Pomme_DisposePresenter
 #define DisposePtr				Pomme_DisposePtr
+#define DisposeRgn				Pomme_DisposeRgn
+#define DisposeStaticLayer		Pomme_DisposeStaticLayer
 #define DrawChar				Pomme_DrawChar
 #define DrawPicture				Pomme_DrawPicture
+#define DrawSpriteBatch			Pomme_DrawSpriteBatch
+#define DrawStaticLayer			Pomme_DrawStaticLayer
+#define EmptyHandle				Pomme_EmptyHandle
+#define EmptyRgn				Pomme_EmptyRgn
+#define EndBandedFrame			Pomme_EndBandedFrame
+#define EndStaticLayer			Pomme_EndStaticLayer
+#define EqualRgn				Pomme_EqualRgn
 #define EraseRect				Pomme_EraseRect
 #define ExitToShell				Pomme_ExitToShell
+#define FreeMem					Pomme_FreeMem
 #define FSClose					Pomme_FSClose
 #define FSMakeFSSpec			Pomme_FSMakeFSSpec
 #define FSRead					Pomme_FSRead
@@ -38,6 +55,7 @@
 #define FrameRect				Pomme_FrameRect
 #define Get1IndResource			Pomme_Get1IndResource
 #define Get1IndType				Pomme_Get1IndType
+#define GetClip					Pomme_GetClip
 #define GetDamagePortRegion		Pomme_GetDamagePortRegion
 #define GetDateTime				Pomme_GetDateTime
 #define GetDefaultOutputVolume	Pomme_GetDefaultOutputVolume
@@ -49,47 +67,78 @@
 #define GetHandleSize			Pomme_GetHandleSize
 #define GetPicture				Pomme_GetPicture
 #define GetPixBaseAddr			Pomme_GetPixBaseAddr
+#define GetPixBaseAddrForReading	Pomme_GetPixBaseAddrForReading
 #define GetPort					Pomme_GetPort
 #define GetPortBitMapForCopyBits	Pomme_GetPortBitMapForCopyBits
 #define GetPortBounds			Pomme_GetPortBounds
+#define GetPresentedFrame		Pomme_GetPresentedFrame
 #define GetPtrSize				Pomme_GetPtrSize
+#define GetRegionBounds			Pomme_GetRegionBounds
 #define GetResInfo				Pomme_GetResInfo
 #define GetResource				Pomme_GetResource
 #define GetResourceSizeOnDisk	Pomme_GetResourceSizeOnDisk
 #define GetScreenPort			Pomme_GetScreenPort
 #define GetSoundHeaderOffset	Pomme_GetSoundHeaderOffset
+#define GetStaticLayerGWorld	Pomme_GetStaticLayerGWorld
 #define GetWindowPort			Pomme_GetWindowPort
+#define HGetState				Pomme_HGetState
 #define HideCursor				Pomme_HideCursor
+#define HLock					Pomme_HLock
+#define HLockHi					Pomme_HLockHi
+#define HNoPurge				Pomme_HNoPurge
+#define HPurge					Pomme_HPurge
+#define HSetState				Pomme_HSetState
+#define HUnlock					Pomme_HUnlock
 #define InitCursor				Pomme_InitCursor
+#define InvalidateStaticLayer	Pomme_InvalidateStaticLayer
 #define IsPortDamaged			Pomme_IsPortDamaged
 #define LineTo					Pomme_LineTo
+#define LoadResource			Pomme_LoadResource
+#define MaxMem					Pomme_MaxMem
+#define MemError				Pomme_MemError
 #define Microseconds			Pomme_Microseconds
+#define MoveHHi					Pomme_MoveHHi
 #define MoveTo					Pomme_MoveTo
 #define NewGWorld				Pomme_NewGWorld
 #define NewHandle				Pomme_NewHandle
 #define NewHandleClear			Pomme_NewHandleClear
+#define NewPresenter			Pomme_NewPresenter
 #define NewPtr					Pomme_NewPtr
 #define NewPtrClear				Pomme_NewPtrClear
+#define NewRgn					Pomme_NewRgn
+#define NewStaticLayer			Pomme_NewStaticLayer
 #define NumToString				Pomme_NumToString
 #define OffsetRect				Pomme_OffsetRect
+#define OffsetRgn				Pomme_OffsetRgn
 #define PaintRect				Pomme_PaintRect
 #define PenNormal				Pomme_PenNormal
 #define PenSize					Pomme_PenSize
+#define PresentPort				Pomme_PresentPort
+#define PtInRgn					Pomme_PtInRgn
 #define PtrToHand				Pomme_PtrToHand
+#define PurgeMem				Pomme_PurgeMem
 #define QDError					Pomme_QDError
+#define ReallocateHandle		Pomme_ReallocateHandle
 #define RGBBackColor			Pomme_RGBBackColor
 #define RGBForeColor			Pomme_RGBForeColor
+#define RectInRgn				Pomme_RectInRgn
+#define RectRgn					Pomme_RectRgn
 #define ReleaseResource			Pomme_ReleaseResource
 #define RemoveResource			Pomme_RemoveResource
 #define ResError				Pomme_ResError
 #define ResolveAlias			Pomme_ResolveAlias
+#define SectRgn					Pomme_SectRgn
+#define SetClip					Pomme_SetClip
 #define SetDefaultOutputVolume	Pomme_SetDefaultOutputVolume
 #define SetEOF					Pomme_SetEOF
+#define SetEmptyRgn				Pomme_SetEmptyRgn
 #define SetFPos					Pomme_SetFPos
 #define SetGWorld				Pomme_SetGWorld
 #define SetHandleSize			Pomme_SetHandleSize
 #define SetPort					Pomme_SetPort
 #define SetRect					Pomme_SetRect
+#define SetRectRgn				Pomme_SetRectRgn
+#define SetStringCacheEnabled	Pomme_SetStringCacheEnabled
 #define ShowCursor				Pomme_ShowCursor
 #define SndChannelStatus		Pomme_SndChannelStatus
 #define SndDisposeChannel		Pomme_SndDisposeChannel
@@ -100,5 +149,7 @@
 #define SysBeep					Pomme_SysBeep
 #define TempNewHandle			Pomme_TempNewHandle
 #define TickCount				Pomme_TickCount
+#define UnionRgn				Pomme_UnionRgn
 #define UseResFile				Pomme_UseResFile
 #define WriteResource			Pomme_WriteResource
+#define XorRgn					Pomme_XorRgn
@@ -24,7 +24,10 @@ using namespace Pomme::Files;
 //-----------------------------------------------------------------------------
 // State
 
-static Pomme::GrowablePool<std::unique_ptr<ForkHandle>, SInt16, 0x7FFF> openFiles;
+// refNums carry a generation number in their high bits, so that a stale refNum
+// to a closed file can't be used to read another file that reuses its slot.
+// 1024 slots leave 5 bits of generation in a positive SInt16.
+static Pomme::GrowablePool<std::unique_ptr<ForkHandle>, SInt16, 1024> openFiles;
 
 static std::vector<std::unique_ptr<Volume>> volumes;
 
@@ -38,11 +41,12 @@ bool Pomme::Files::IsRefNumLegal(short refNum)
 
 std::iostream& Pomme::Files::GetStream(short refNum)
 {
-	if (!IsRefNumLegal(refNum))
+	auto* handle = openFiles.TryGet(refNum);
+	if (!handle || !*handle)
 	{
 		throw std::runtime_error("illegal refNum");
 	}
-	return openFiles[refNum]->GetStream();
+	return (*handle)->GetStream();
 }
 
 const FSSpec& Pomme::Files::GetSpec(short refNum)
@@ -38,6 +38,22 @@ static void ResourceAssert(bool condition, const char* message)
 	}
 }
 
+// Reads a resource's data into a handle whose block is already meta.size bytes,
+// and tags the block so the resource can be reloaded if the handle gets purged.
+static void ReadResourceData(Handle handle, const ResourceMetadata& meta)
+{
+	auto& forkStream = Pomme::Files::GetStream(meta.forkRefNum);
+
+	auto* block = Pomme::Memory::BlockDescriptor::HandleToBlock(handle);
+	block->SetResourceMetadata(&meta);
+
+	forkStream.seekg(meta.dataOffset, std::ios::beg);
+	forkStream.read(*handle, meta.size);
+
+	if (meta.flags & resPurgeable)
+		HPurge(handle);
+}
+
 static ResourceFork& GetCurRF()
 {
 	return gResForkStack[gResForkStackIndex];
@@ -193,6 +209,7 @@ void CloseResFile(short refNum)
 	ResourceAssert(IsStreamOpen(refNum), "CloseResFile: Resource stream not open");
 
 	//UpdateResFile(refNum); // MMT:1-110
+	Pomme::Memory::ForgetResourceFork(refNum);
 	Pomme::Files::CloseStream(refNum);
 
 	auto it = gResForkStack.begin();
@@ -261,17 +278,9 @@ Handle GetResource(ResType theType, short theID)
 
 		// Found it!
 		const auto& meta = fork.resourceMap.at(theType).at(theID);
-		auto& forkStream = Pomme::Files::GetStream(gResForkStack[i].fileRefNum);
 
-		// Allocate handle
 		Handle handle = NewHandle(meta.size);
-
-		// Set pointer to resource metadata
-		Pomme::Memory::BlockDescriptor::HandleToBlock(handle)->rezMeta = &meta;
-
-		forkStream.seekg(meta.dataOffset, std::ios::beg);
-		forkStream.read(*handle, meta.size);
-
+		ReadResourceData(handle, meta);
 		return handle;
 	}
 
@@ -327,6 +336,43 @@ void GetResInfo(Handle theResource, short* theID, ResType* theType, char* name25
 		snprintf(name256, 256, "%s", blockDescriptor->rezMeta->name.c_str());
 }
 
+void LoadResource(Handle theResource)
+{
+	gLastResError = noErr;
+
+	if (!theResource)
+	{
+		gLastResError = nilHandleErr;
+		return;
+	}
+
+	if (*theResource)
+	{
+		// Still in memory -- just mark it as recently used
+		if (Pomme::Memory::BlockDescriptor::HandleToBlock(theResource)->flags & Pomme::Memory::kBlockPurgeable)
+			Pomme::Memory::TouchHandle(theResource);
+		return;
+	}
+
+	const auto* meta = Pomme::Memory::GetPurgedResource(theResource);
+	if (!meta)
+	{
+		gLastResError = resNotFound;
+		return;
+	}
+
+	LOG << "Reloading purged resource " << Pomme::FourCCString(meta->type) << " #" << meta->id << "\n";
+
+	ReallocateHandle(theResource, meta->size);
+	if (MemError() != noErr)
+	{
+		gLastResError = MemError();
+		return;
+	}
+
+	ReadResourceData(theResource, *meta);
+}
+
 void ReleaseResource(Handle theResource)
 {
 	DisposeHandle(theResource);
@@ -371,7 +417,7 @@ void DetachResource(Handle theResource)
 	if (!blockDescriptor->rezMeta)
 		gLastResError = resNotFound;
 
-	blockDescriptor->rezMeta = nullptr;
+	blockDescriptor->SetResourceMetadata(nullptr);
 }
 
 long GetResourceSizeOnDisk(Handle theResource)
@@ -1,5 +1,7 @@
 #include "PommeGraphics.h"
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 
 using namespace Pomme::Graphics;
 
@@ -71,3 +73,64 @@ void ARGBPixmap::WriteTGA(const char* path) const
 	DumpTGA(path, width, height, (const char*) data.data());
 }
 
+//-----------------------------------------------------------------------------
+// Packed pixmap
+
+// Rows are padded to a multiple of 8 bytes (QuickDraw only needs an even rowBytes)
+// so that blitters can work on whole 32/64-bit chunks of a row. The buffer has
+// a few spare bytes at the end so that reading a chunk that straddles the end
+// of the last row stays within the allocation.
+static constexpr int kPackedRowAlign = 8;
+static constexpr int kPackedTailSlack = 8;
+
+PackedPixmap::PackedPixmap()
+	: depth(0)
+	, rgb565(false)
+	, width(0)
+	, height(0)
+	, rowBytes(0)
+	, data(0)
+{
+}
+
+PackedPixmap::PackedPixmap(int depth, int w, int h, bool rgb565)
+	: depth(depth)
+	, rgb565(rgb565 && depth == 16)
+	, width(w)
+	, height(h)
+	, rowBytes(((w * depth + 7) / 8 + kPackedRowAlign - 1) & ~(kPackedRowAlign - 1))
+	, data(rowBytes * h + kPackedTailSlack, 0)
+{
+	if (depth != 1 && depth != 8 && depth != 16)
+	{
+		throw std::invalid_argument("PackedPixmap: unsupported depth");
+	}
+}
+
+void PackedPixmap::FillBits(int left, int top, int right, int bottom, bool black)
+{
+	if (left >= right)
+		return;
+
+	const int firstByte = left >> 3;
+	const int lastByte = (right - 1) >> 3;
+	const Byte firstMask = 0xFF >> (left & 7);
+	const Byte lastMask = 0xFF << (7 - ((right - 1) & 7));
+
+	for (int y = top; y < bottom; y++)
+	{
+		Byte* row = GetRow(y);
+
+		if (firstByte == lastByte)
+		{
+			Byte m = firstMask & lastMask;
+			row[firstByte] = black ? (row[firstByte] | m) : (row[firstByte] & ~m);
+			continue;
+		}
+
+		row[firstByte] = black ? (row[firstByte] | firstMask) : (row[firstByte] & ~firstMask);
+		memset(row + firstByte + 1, black ? 0xFF : 0x00, lastByte - firstByte - 1);
+		row[lastByte] = black ? (row[lastByte] | lastMask) : (row[lastByte] & ~lastMask);
+	}
+}
+
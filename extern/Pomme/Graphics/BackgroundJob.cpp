@@ -0,0 +1,84 @@
+#include "Graphics/BackgroundJob.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace Pomme::Graphics;
+
+struct BackgroundJob::State
+{
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	std::function<void()> job;
+	bool busy = false;
+	bool quit = false;
+
+	void WorkerLoop()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		while (true)
+		{
+			wake.wait(lock, [&]() { return quit || busy; });
+			if (quit)
+				return;
+
+			lock.unlock();
+			job();
+			lock.lock();
+
+			job = nullptr;
+			busy = false;
+			done.notify_all();
+		}
+	}
+};
+
+BackgroundJob::BackgroundJob()
+	: state(std::make_unique<State>())
+{
+}
+
+BackgroundJob::~BackgroundJob()
+{
+	Wait();
+
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->quit = true;
+	}
+	state->wake.notify_all();
+
+	if (state->thread.joinable())
+		state->thread.join();
+}
+
+void BackgroundJob::Start(std::function<void()> fn)
+{
+	Wait();
+
+	if (!state->thread.joinable())
+		state->thread = std::thread([s = state.get()]() { s->WorkerLoop(); });
+
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->job = std::move(fn);
+		state->busy = true;
+	}
+	state->wake.notify_all();
+}
+
+bool BackgroundJob::IsDone() const
+{
+	std::lock_guard<std::mutex> lock(state->mutex);
+	return !state->busy;
+}
+
+void BackgroundJob::Wait()
+{
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->done.wait(lock, [&]() { return !state->busy; });
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+
+namespace Pomme::Graphics
+{
+	// Runs one job at a time on a thread of its own, so that the caller can get
+	// on with other work in the meantime. The thread is started on first use and
+	// lives as long as the BackgroundJob.
+	class BackgroundJob
+	{
+	public:
+		BackgroundJob();
+
+		// Waits for the current job, if any, before stopping the thread.
+		~BackgroundJob();
+
+		BackgroundJob(const BackgroundJob&) = delete;
+		BackgroundJob& operator=(const BackgroundJob&) = delete;
+
+		// Waits for the previous job, then starts fn and returns right away.
+		void Start(std::function<void()> fn);
+
+		// True if no job is running.
+		bool IsDone() const;
+
+		// Returns once the current job, if any, is done.
+		void Wait();
+
+	private:
+		struct State;
+		std::unique_ptr<State> state;
+	};
+}
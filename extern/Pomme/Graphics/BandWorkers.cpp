@@ -0,0 +1,142 @@
+#include "Graphics/BandWorkers.h"
+#include "PommeTypes.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace Pomme::Graphics;
+
+static constexpr int kMaxBandThreads = 8;
+
+namespace
+{
+	// Worker threads are started on first use and live until exit.
+	// A job is handed out band by band through an atomic counter, so that
+	// threads that finish early pick up the remaining bands.
+	class BandPool
+	{
+	public:
+		explicit BandPool(int workerCount)
+		{
+			for (int i = 0; i < workerCount; i++)
+				threads.emplace_back([this]() { WorkerLoop(); });
+		}
+
+		~BandPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				quit = true;
+			}
+			wake.notify_all();
+
+			for (auto& thread : threads)
+				thread.join();
+		}
+
+		void Run(int count, const std::function<void(int)>& fn)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				job = &fn;
+				bandCount = count;
+				nextBand = 0;
+				pending = count;
+				jobID++;
+			}
+			wake.notify_all();
+
+			const int finished = RunSome();
+
+			std::unique_lock<std::mutex> lock(mutex);
+			pending -= finished;
+
+			// Wait for the last bands, and for every worker to be out of RunSome
+			// so that none of them can pick up a band of the next job with this one
+			done.wait(lock, [&]() { return pending == 0 && busyWorkers == 0; });
+			job = nullptr;
+		}
+
+	private:
+		int RunSome()
+		{
+			int finished = 0;
+			for (int band; (band = nextBand.fetch_add(1)) < bandCount; finished++)
+				(*job)(band);
+			return finished;
+		}
+
+		void WorkerLoop()
+		{
+			UInt64 seenJobID = 0;
+			std::unique_lock<std::mutex> lock(mutex);
+
+			while (true)
+			{
+				wake.wait(lock, [&]() { return quit || (job && jobID != seenJobID); });
+				if (quit)
+					return;
+
+				seenJobID = jobID;
+				busyWorkers++;
+				lock.unlock();
+
+				const int finished = RunSome();
+
+				lock.lock();
+				busyWorkers--;
+				pending -= finished;
+				if (pending == 0 && busyWorkers == 0)
+					done.notify_all();
+			}
+		}
+
+		std::vector<std::thread> threads;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::condition_variable done;
+		const std::function<void(int)>* job = nullptr;
+		int bandCount = 0;
+		std::atomic<int> nextBand = 0;
+		int pending = 0;
+		int busyWorkers = 0;
+		UInt64 jobID = 0;
+		bool quit = false;
+	};
+}
+
+int Pomme::Graphics::GetBandThreadCount()
+{
+	static const int count = []
+	{
+		// Set POMME_BAND_THREADS=n in the environment to pin the thread count,
+		// e.g. to check banded frames against sequential ones on any machine
+		const char* override = getenv("POMME_BAND_THREADS");
+		int n = override ? atoi(override) : 0;
+		if (n <= 0)
+			n = (int) std::thread::hardware_concurrency();
+		return std::clamp(n, 1, kMaxBandThreads);
+	}();
+	return count;
+}
+
+void Pomme::Graphics::RunBands(int bandCount, const std::function<void(int band)>& fn)
+{
+	if (bandCount <= 0)
+		return;
+
+	if (bandCount == 1 || GetBandThreadCount() == 1)
+	{
+		for (int band = 0; band < bandCount; band++)
+			fn(band);
+		return;
+	}
+
+	static BandPool pool(GetBandThreadCount() - 1);
+	pool.Run(bandCount, fn);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <functional>
+
+namespace Pomme::Graphics
+{
+	// Number of threads that RunBands spreads bands over, including the calling thread.
+	// One per core, unless the POMME_BAND_THREADS environment variable says otherwise.
+	int GetBandThreadCount();
+
+	// Calls fn(band) once for every band in [0, bandCount), spread over a pool
+	// of worker threads and the calling thread, and returns once all of them
+	// are done. Bands run in no particular order, so fn must only touch state
+	// that belongs to its band. Calls aren't reentrant: fn must not call RunBands.
+	void RunBands(int bandCount, const std::function<void(int band)>& fn);
+}
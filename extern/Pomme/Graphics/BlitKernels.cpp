@@ -0,0 +1,1703 @@
+#include "Graphics/BlitKernels.h"
+#include "PommeEnums.h"
+#include "PommeGraphics.h"
+#include "Utilities/structpack.h"
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64)
+	#define POMME_BLIT_X86 1
+	#include <immintrin.h>
+	#if _MSC_VER
+		#include <intrin.h>
+	#endif
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+	#define POMME_BLIT_NEON 1
+	#include <arm_neon.h>
+	#if _MSC_VER
+		#include <intrin.h>
+	#endif
+#endif
+
+// GCC and Clang need AVX2 code to be marked as such when the rest of the
+// file isn't built with -mavx2. MSVC accepts AVX2 intrinsics anywhere.
+#if POMME_BLIT_X86 && (__GNUC__ || __clang__)
+	#define POMME_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+	#define POMME_TARGET_AVX2
+#endif
+
+using namespace Pomme::Graphics::Blit;
+
+// Sign bits of the R, G and B bytes of a big-endian ARGB pixel, as seen when
+// the pixel is loaded as a native UInt32.
+#if __BIG_ENDIAN__
+static constexpr UInt32 kRGBHighBits = 0x00808080;
+static constexpr UInt32 kRGBBits = 0x00FFFFFF;
+#else
+static constexpr UInt32 kRGBHighBits = 0x80808000;
+static constexpr UInt32 kRGBBits = 0xFFFFFF00;
+#endif
+
+//-----------------------------------------------------------------------------
+// Scalar
+
+static void CopyTransparentRow_Scalar(UInt32* dst, const UInt32* src, int count, UInt32 transparentColor)
+{
+	for (int x = 0; x < count; x++)
+	{
+		if (src[x] != transparentColor)
+			dst[x] = src[x];
+	}
+}
+
+static void CopyMaskedRow_Scalar(UInt32* dst, const UInt32* src, const UInt32* mask, int count)
+{
+	for (int x = 0; x < count; x++)
+	{
+		// A channel is below 128 iff its top bit is clear
+		if (~mask[x] & kRGBHighBits)
+			dst[x] = src[x];
+	}
+}
+
+// Boolean transfer modes (see BooleanRowFunc)
+template<int mode>
+static inline UInt32 BooleanPixel(UInt32 d, UInt32 s)
+{
+	UInt32 r;
+	switch (mode)
+	{
+		case srcCopy:		return s;
+		case srcOr:			r = d & s;		break;
+		case srcXor:		r = d ^ ~s;		break;
+		case srcBic:		r = d | ~s;		break;
+		case notSrcCopy:	r = ~s;			break;
+		case notSrcOr:		r = d & ~s;		break;
+		case notSrcXor:		r = d ^ s;		break;
+		case notSrcBic:		r = d | s;		break;
+	}
+	return (r & kRGBBits) | (d & ~kRGBBits);
+}
+
+template<int mode>
+static void BooleanRow_Scalar(UInt32* dst, const UInt32* src, int count)
+{
+	for (int x = 0; x < count; x++)
+		dst[x] = BooleanPixel<mode>(dst[x], src[x]);
+}
+
+// Rounded x / 255, exact for 0 <= x <= 255 * 255
+static inline int Div255(int x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+// Arithmetic transfer modes (see ArithmeticRowFunc) on one color component
+template<int mode>
+static inline Byte ArithmeticComponent(int d, int s, int op)
+{
+	switch (mode)
+	{
+		case blend:		return Byte(Div255(s * op + d * (255 - op)));
+		case addPin:	return Byte(std::min({s + d, 255, op}));
+		case addOver:	return Byte(s + d);
+		case subPin:	return Byte(std::max({d - s, 0, op}));
+		case subOver:	return Byte(d - s);
+		case adMax:		return Byte(std::max(d, s));
+		case adMin:		return Byte(std::min(d, s));
+	}
+}
+
+template<int mode>
+static void ArithmeticRow_Scalar(UInt32* dst, const UInt32* src, int count, UInt32 opColor)
+{
+	const Byte* op = (const Byte*) &opColor;
+
+	for (int x = 0; x < count; x++)
+	{
+		Byte* d = (Byte*) &dst[x];
+		const Byte* s = (const Byte*) &src[x];
+
+		// d[0] is alpha
+		d[1] = ArithmeticComponent<mode>(d[1], s[1], op[1]);
+		d[2] = ArithmeticComponent<mode>(d[2], s[2], op[2]);
+		d[3] = ArithmeticComponent<mode>(d[3], s[3], op[3]);
+	}
+}
+
+static void AlphaCompositeRow_Scalar(UInt32* dst, const UInt32* src, int count)
+{
+	for (int x = 0; x < count; x++)
+	{
+		const Byte* s = (const Byte*) &src[x];
+		const int a = s[0];
+
+		if (a == 0xFF)
+		{
+			dst[x] = src[x];
+		}
+		else if (a != 0)
+		{
+			// Same as blending with weight a, where the source's own alpha counts as 255
+			Byte* d = (Byte*) &dst[x];
+			d[0] = Byte(Div255(255  * a + d[0] * (255 - a)));
+			d[1] = Byte(Div255(s[1] * a + d[1] * (255 - a)));
+			d[2] = Byte(Div255(s[2] * a + d[2] * (255 - a)));
+			d[3] = Byte(Div255(s[3] * a + d[3] * (255 - a)));
+		}
+	}
+}
+
+// Scaling
+
+static void GatherRow_Scalar(UInt32* dst, const UInt32* src, const int* index, int count)
+{
+	for (int x = 0; x < count; x++)
+		dst[x] = src[index[x]];
+}
+
+static void ReplicateRow_Scalar(UInt32* dst, const UInt32* src, int srcCount, int factor)
+{
+	for (int i = 0; i < srcCount; i++)
+	{
+		for (int j = 0; j < factor; j++)
+			*dst++ = src[i];
+	}
+}
+
+static inline UInt32 LerpPixel(UInt32 a, UInt32 b, int weight)
+{
+	UInt32 r = 0;
+	for (int shift = 0; shift < 32; shift += 8)
+	{
+		int ca = (a >> shift) & 0xFF;
+		int cb = (b >> shift) & 0xFF;
+		r |= UInt32((ca * (256 - weight) + cb * weight + 128) >> 8) << shift;
+	}
+	return r;
+}
+
+static void LerpRow_Scalar(UInt32* dst, const UInt32* a, const UInt32* b, int count, int weight)
+{
+	for (int x = 0; x < count; x++)
+		dst[x] = LerpPixel(a[x], b[x], weight);
+}
+
+static void LerpGatherRow_Scalar(UInt32* dst, const UInt32* src, const int* index, const UInt16* weight, int count)
+{
+	for (int x = 0; x < count; x++)
+		dst[x] = LerpPixel(src[index[x]], src[index[x] + 1], weight[x]);
+}
+
+static void FillRow_Scalar(UInt32* dst, int count, UInt32 color)
+{
+	for (int x = 0; x < count; x++)
+		dst[x] = color;
+}
+
+// Byte order conversions for presenting. Each pixel is read whole before it's
+// written, so that they work in place.
+
+static void ARGBToBGRARow_Scalar(UInt32* dst, const UInt32* src, int count)
+{
+	for (int x = 0; x < count; x++)
+	{
+		const Byte* p = (const Byte*) (src + x);
+		const Byte a = p[0], r = p[1], g = p[2], b = p[3];
+		Byte* q = (Byte*) (dst + x);
+		q[0] = b;
+		q[1] = g;
+		q[2] = r;
+		q[3] = a;
+	}
+}
+
+static void ARGBToRGBARow_Scalar(UInt32* dst, const UInt32* src, int count)
+{
+	for (int x = 0; x < count; x++)
+	{
+		const Byte* p = (const Byte*) (src + x);
+		const Byte a = p[0], r = p[1], g = p[2], b = p[3];
+		Byte* q = (Byte*) (dst + x);
+		q[0] = r;
+		q[1] = g;
+		q[2] = b;
+		q[3] = a;
+	}
+}
+
+// 16-bit conversions on the raw bytes of big-endian pixels
+
+static void ARGBToRGB555Row_Scalar(Byte* dst, const UInt32* src, int count)
+{
+	const Byte* p = (const Byte*) src;
+	for (int x = 0; x < count; x++, p += 4, dst += 2)
+	{
+		// 0RRRRRGG GGGBBBBB
+		dst[0] = Byte(((p[1] >> 3) << 2) | (p[2] >> 6));
+		dst[1] = Byte(((p[2] << 2) & 0xE0) | (p[3] >> 3));
+	}
+}
+
+static void ARGBToRGB565Row_Scalar(Byte* dst, const UInt32* src, int count)
+{
+	const Byte* p = (const Byte*) src;
+	for (int x = 0; x < count; x++, p += 4, dst += 2)
+	{
+		// RRRRRGGG GGGBBBBB
+		dst[0] = Byte((p[1] & 0xF8) | (p[2] >> 5));
+		dst[1] = Byte(((p[2] << 3) & 0xE0) | (p[3] >> 3));
+	}
+}
+
+static void RGB555ToARGBRow_Scalar(UInt32* dst, const Byte* src, int count)
+{
+	Byte* p = (Byte*) dst;
+	for (int x = 0; x < count; x++, p += 4, src += 2)
+	{
+		int r = (src[0] >> 2) & 0x1F;
+		int g = ((src[0] & 0x03) << 3) | (src[1] >> 5);
+		int b = src[1] & 0x1F;
+		p[0] = 0xFF;
+		p[1] = Byte((r << 3) | (r >> 2));
+		p[2] = Byte((g << 3) | (g >> 2));
+		p[3] = Byte((b << 3) | (b >> 2));
+	}
+}
+
+static void RGB565ToARGBRow_Scalar(UInt32* dst, const Byte* src, int count)
+{
+	Byte* p = (Byte*) dst;
+	for (int x = 0; x < count; x++, p += 4, src += 2)
+	{
+		int r = src[0] >> 3;
+		int g = ((src[0] & 0x07) << 3) | (src[1] >> 5);
+		int b = src[1] & 0x1F;
+		p[0] = 0xFF;
+		p[1] = Byte((r << 3) | (r >> 2));
+		p[2] = Byte((g << 2) | (g >> 4));
+		p[3] = Byte((b << 3) | (b >> 2));
+	}
+}
+
+//-----------------------------------------------------------------------------
+// SSE2 (baseline on x86-64)
+
+#if POMME_BLIT_X86
+
+// dst = select ? src : dst
+static inline __m128i Select_SSE2(__m128i select, __m128i src, __m128i dst)
+{
+	return _mm_or_si128(_mm_and_si128(select, src), _mm_andnot_si128(select, dst));
+}
+
+static void CopyTransparentRow_SSE2(UInt32* dst, const UInt32* src, int count, UInt32 transparentColor)
+{
+	const __m128i key = _mm_set1_epi32((int) transparentColor);
+
+	int x = 0;
+	for (; x + 4 <= count; x += 4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*) (src + x));
+		__m128i d = _mm_loadu_si128((const __m128i*) (dst + x));
+		__m128i isKey = _mm_cmpeq_epi32(s, key);
+		_mm_storeu_si128((__m128i*) (dst + x), Select_SSE2(isKey, d, s));
+	}
+
+	CopyTransparentRow_Scalar(dst + x, src + x, count - x, transparentColor);
+}
+
+static void CopyMaskedRow_SSE2(UInt32* dst, const UInt32* src, const UInt32* mask, int count)
+{
+	const __m128i highBits = _mm_set1_epi32((int) kRGBHighBits);
+	const __m128i zero = _mm_setzero_si128();
+
+	int x = 0;
+	for (; x + 4 <= count; x += 4)
+	{
+		__m128i m = _mm_loadu_si128((const __m128i*) (mask + x));
+		__m128i s = _mm_loadu_si128((const __m128i*) (src + x));
+		__m128i d = _mm_loadu_si128((const __m128i*) (dst + x));
+		// Lanes where all of R, G, B have their top bit set keep the destination
+		__m128i isLight = _mm_cmpeq_epi32(_mm_andnot_si128(m, highBits), zero);
+		_mm_storeu_si128((__m128i*) (dst + x), Select_SSE2(isLight, d, s));
+	}
+
+	CopyMaskedRow_Scalar(dst + x, src + x, mask + x, count - x);
+}
+
+// Same as BooleanPixel, on 4 pixels. `rgb` has kRGBBits in every lane.
+template<int mode>
+static inline __m128i BooleanPixels_SSE2(__m128i d, __m128i s, __m128i rgb)
+{
+	__m128i r;
+	switch (mode)
+	{
+		case srcCopy:		return s;
+		case srcOr:			r = _mm_and_si128(d, s);						break;
+		case srcXor:		r = _mm_xor_si128(d, _mm_xor_si128(s, rgb));	break;	// ~s within the RGB bits
+		case srcBic:		r = _mm_or_si128(d, _mm_andnot_si128(s, rgb));	break;
+		case notSrcCopy:	r = _mm_andnot_si128(s, rgb);					break;
+		case notSrcOr:		r = _mm_andnot_si128(s, d);						break;
+		case notSrcXor:		r = _mm_xor_si128(d, s);						break;
+		case notSrcBic:		r = _mm_or_si128(d, s);							break;
+	}
+	return Select_SSE2(rgb, r, d);
+}
+
+template<int mode>
+static void BooleanRow_SSE2(UInt32* dst, const UInt32* src, int count)
+{
+	const __m128i rgb = _mm_set1_epi32((int) kRGBBits);
+
+	int x = 0;
+	for (; x + 4 <= count; x += 4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*) (src + x));
+		__m128i d = _mm_loadu_si128((const __m128i*) (dst + x));
+		_mm_storeu_si128((__m128i*) (dst + x), BooleanPixels_SSE2<mode>(d, s, rgb));
+	}
+
+	BooleanRow_Scalar<mode>(dst + x, src + x, count - x);
+}
+
+// Div255(s * w + d * (255 - w)) on 16-bit lanes
+static inline __m128i Blend16_SSE2(__m128i s, __m128i d, __m128i w)
+{
+	const __m128i k255 = _mm_set1_epi16(255);
+	const __m128i k128 = _mm_set1_epi16(128);
+	__m128i x = _mm_add_epi16(_mm_mullo_epi16(s, w), _mm_mullo_epi16(d, _mm_sub_epi16(k255, w)));
+	x = _mm_add_epi16(x, k128);
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// Same as ArithmeticComponent, on every byte of 4 pixels. `op` has opColor in every lane.
+template<int mode>
+static inline __m128i ArithmeticPixels_SSE2(__m128i d, __m128i s, __m128i op)
+{
+	switch (mode)
+	{
+		case blend:
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i w = _mm_unpacklo_epi8(op, zero);
+			__m128i lo = Blend16_SSE2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), w);
+			__m128i hi = Blend16_SSE2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), w);
+			return _mm_packus_epi16(lo, hi);
+		}
+		case addPin:	return _mm_min_epu8(_mm_adds_epu8(d, s), op);
+		case addOver:	return _mm_add_epi8(d, s);
+		case subPin:	return _mm_max_epu8(_mm_subs_epu8(d, s), op);
+		case subOver:	return _mm_sub_epi8(d, s);
+		case adMax:		return _mm_max_epu8(d, s);
+		case adMin:		return _mm_min_epu8(d, s);
+	}
+}
+
+template<int mode>
+static void ArithmeticRow_SSE2(UInt32* dst, const UInt32* src, int count, UInt32 opColor)
+{
+	const __m128i rgb = _mm_set1_epi32((int) kRGBBits);
+	const __m128i op = _mm_set1_epi32((int) opColor);
+
+	int x = 0;
+	for (; x + 4 <= count; x += 4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*) (src + x));
+		__m128i d = _mm_loadu_si128((const __m128i*) (dst + x));
+		_mm_storeu_si128((__m128i*) (dst + x), Select_SSE2(rgb, ArithmeticPixels_SSE2<mode>(d, s, op), d));
+	}
+
+	ArithmeticRow_Scalar<mode>(dst + x, src + x, count - x, opColor);
+}
+
+// Composites 2 pixels widened to 16-bit lanes (alpha in lanes 0 and 4)
+static inline __m128i AlphaComposite16_SSE2(__m128i s, __m128i d)
+{
+	const __m128i alphaLanes = _mm_set_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+	__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0), 0);
+	return Blend16_SSE2(_mm_or_si128(s, alphaLanes), d, a);
+}
+
+static void AlphaCompositeRow_SSE2(UInt32* dst, const UInt32* src, int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	int x = 0;
+	for (; x + 4 <= count; x += 4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*) (src + x));
+		__m128i d = _mm_loadu_si128((const __m128i*) (dst + x));
+		__m128i lo = AlphaComposite16_SSE2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+		__m128i hi = AlphaComposite16_SSE2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+		_mm_storeu_si128((__m128i*) (dst + x), _mm_packus_epi16(lo, hi));
+	}
+
+	AlphaCompositeRow_Scalar(dst + x, src + x, count - x);
+}
+
+static void ReplicateRow_SSE2(UInt32* dst, const UInt32* src, int srcCount, int factor)
+{
+	// A 4-pixel store per source pixel would run past the end of dst
+	if (factor <= 1)
+	{
+		ReplicateRow_Scalar(dst, src, srcCount, factor);
+		return;
+	}
+
+	int i = 0;
+
+	if (factor == 2)
+	{
+		for (; i + 4 <= srcCount; i += 4)
+		{
+			__m128i s = _mm_loadu_si128((const __m128i*) (src + i));
+			_mm_storeu_si128((__m128i*) (dst + 2 * i), _mm_unpacklo_epi32(s, s));
+			_mm_storeu_si128((__m128i*) (dst + 2 * i + 4), _mm_unpackhi_epi32(s, s));
+		}
+	}
+	else
+	{
+		// Write each pixel 4 at a time. Here factor >= 3, so the overshoot (at most
+		// 3 pixels) lands within the next pixel's run and gets overwritten by it.
+		// The last pixel has no next one, so it's left to the scalar loop.
+		for (; i + 1 < srcCount; i++)
+		{
+			__m128i v = _mm_set1_epi32((int) src[i]);
+			UInt32* d = dst + i * factor;
+			for (int j = 0; j < factor; j += 4)
+				_mm_storeu_si128((__m128i*) (d + j), v);
+		}
+	}
+
+	ReplicateRow_Scalar(dst + i * factor, src + i, srcCount - i, factor);
+}
+
+// (a * wa + b * wb + 128) >> 8 on 16-bit lanes
+static inline __m128i Lerp16_SSE2(__m128i a, __m128i b, __m128i wa, __m128i wb)
+{
+	__m128i x = _mm_add_epi16(_mm_mullo_epi16(a, wa), _mm_mullo_epi16(b, wb));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_set1_epi16(128)), 8);
+}
+
+static void LerpRow_SSE2(UInt32* dst, const UInt32* a, const UInt32* b, int count, int weight)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i wa = _mm_set1_epi16(short(256 - weight));
+	const __m128i wb = _mm_set1_epi16(short(weight));
+
+	int x = 0;
+	for (; x + 4 <= count; x += 4)
+	{
+		__m128i pa = _mm_loadu_si128((const __m128i*) (a + x));
+		__m128i pb = _mm_loadu_si128((const __m128i*) (b + x));
+		__m128i lo = Lerp16_SSE2(_mm_unpacklo_epi8(pa, zero), _mm_unpacklo_epi8(pb, zero), wa, wb);
+		__m128i hi = Lerp16_SSE2(_mm_unpackhi_epi8(pa, zero), _mm_unpackhi_epi8(pb, zero), wa, wb);
+		_mm_storeu_si128((__m128i*) (dst + x), _mm_packus_epi16(lo, hi));
+	}
+
+	LerpRow_Scalar(dst + x, a + x, b + x, count - x, weight);
+}
+
+static void LerpGatherRow_SSE2(UInt32* dst, const UInt32* src, const int* index, const UInt16* weight, int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i k128 = _mm_set1_epi16(128);
+
+	int x = 0;
+	for (; x + 2 <= count; x += 2)
+	{
+		// Each load brings in a pixel and its right neighbor: 4 lanes each once widened
+		__m128i p0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (src + index[x])), zero);
+		__m128i p1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (src + index[x + 1])), zero);
+
+		const short w0 = short(weight[x]);
+		const short w1 = short(weight[x + 1]);
+		__m128i m0 = _mm_mullo_epi16(p0, _mm_set_epi16(w0, w0, w0, w0, 256 - w0, 256 - w0, 256 - w0, 256 - w0));
+		__m128i m1 = _mm_mullo_epi16(p1, _mm_set_epi16(w1, w1, w1, w1, 256 - w1, 256 - w1, 256 - w1, 256 - w1));
+
+		// Add up each pixel's left and right terms
+		__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(m0, m1), _mm_unpackhi_epi64(m0, m1));
+		sum = _mm_srli_epi16(_mm_add_epi16(sum, k128), 8);
+		_mm_storel_epi64((__m128i*) (dst + x), _mm_packus_epi16(sum, sum));
+	}
+
+	LerpGatherRow_Scalar(dst + x, src, index + x, weight + x, count - x);
+}
+
+static void FillRow_SSE2(UInt32* dst, int count, UInt32 color)
+{
+	const __m128i c = _mm_set1_epi32(int(color));
+
+	int x = 0;
+	for (; x + 16 <= count; x += 16)
+	{
+		_mm_storeu_si128((__m128i*) (dst + x +  0), c);
+		_mm_storeu_si128((__m128i*) (dst + x +  4), c);
+		_mm_storeu_si128((__m128i*) (dst + x +  8), c);
+		_mm_storeu_si128((__m128i*) (dst + x + 12), c);
+	}
+	for (; x + 4 <= count; x += 4)
+		_mm_storeu_si128((__m128i*) (dst + x), c);
+
+	FillRow_Scalar(dst + x, count - x, color);
+}
+
+// The 16-bit converters below work on little-endian loads, where a big-endian
+// ARGB pixel reads as 0xBBGGRRAA, and a big-endian 16-bit pixel has its bytes swapped.
+
+static inline __m128i ByteswapU16_SSE2(__m128i v)
+{
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+// Packs two vectors of 32-bit lanes holding 16-bit values into one vector of 16-bit lanes
+static inline __m128i PackU32ToU16_SSE2(__m128i lo, __m128i hi)
+{
+	// packs_epi32 saturates signed values, so sign-extend the low halves first
+	lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+	hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+	return _mm_packs_epi32(lo, hi);
+}
+
+static inline __m128i ARGBToRGB555_SSE2(__m128i p)
+{
+	__m128i r = _mm_and_si128(_mm_srli_epi32(p, 1), _mm_set1_epi32(0x7C00));
+	__m128i g = _mm_and_si128(_mm_srli_epi32(p, 14), _mm_set1_epi32(0x03E0));
+	__m128i b = _mm_srli_epi32(p, 27);
+	return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+static inline __m128i ARGBToRGB565_SSE2(__m128i p)
+{
+	__m128i r = _mm_and_si128(p, _mm_set1_epi32(0xF800));
+	__m128i g = _mm_and_si128(_mm_srli_epi32(p, 13), _mm_set1_epi32(0x07E0));
+	__m128i b = _mm_srli_epi32(p, 27);
+	return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+template<__m128i (*Convert)(__m128i)>
+static inline void PackRow_SSE2(Byte* dst, const UInt32* src, int& x, int count)
+{
+	for (; x + 8 <= count; x += 8)
+	{
+		__m128i lo = Convert(_mm_loadu_si128((const __m128i*) (src + x)));
+		__m128i hi = Convert(_mm_loadu_si128((const __m128i*) (src + x + 4)));
+		_mm_storeu_si128((__m128i*) (dst + 2 * x), ByteswapU16_SSE2(PackU32ToU16_SSE2(lo, hi)));
+	}
+}
+
+static void ARGBToRGB555Row_SSE2(Byte* dst, const UInt32* src, int count)
+{
+	int x = 0;
+	PackRow_SSE2<ARGBToRGB555_SSE2>(dst, src, x, count);
+	ARGBToRGB555Row_Scalar(dst + 2 * x, src + x, count - x);
+}
+
+static void ARGBToRGB565Row_SSE2(Byte* dst, const UInt32* src, int count)
+{
+	int x = 0;
+	PackRow_SSE2<ARGBToRGB565_SSE2>(dst, src, x, count);
+	ARGBToRGB565Row_Scalar(dst + 2 * x, src + x, count - x);
+}
+
+// Widens 5-bit (or 6-bit) components sitting in the low bits of each lane to 8 bits
+static inline __m128i Widen5_SSE2(__m128i c)
+{
+	return _mm_or_si128(_mm_slli_epi32(c, 3), _mm_srli_epi32(c, 2));
+}
+
+static inline __m128i Widen6_SSE2(__m128i c)
+{
+	return _mm_or_si128(_mm_slli_epi32(c, 2), _mm_srli_epi32(c, 4));
+}
+
+// Takes 32-bit lanes holding native 16-bit pixels and returns LE-loaded ARGB (0xBBGGRRAA)
+static inline __m128i RGB555ToARGB_SSE2(__m128i v)
+{
+	const __m128i m5 = _mm_set1_epi32(0x1F);
+	__m128i r = Widen5_SSE2(_mm_and_si128(_mm_srli_epi32(v, 10), m5));
+	__m128i g = Widen5_SSE2(_mm_and_si128(_mm_srli_epi32(v, 5), m5));
+	__m128i b = Widen5_SSE2(_mm_and_si128(v, m5));
+	__m128i argb = _mm_or_si128(_mm_slli_epi32(r, 8), _mm_or_si128(_mm_slli_epi32(g, 16), _mm_slli_epi32(b, 24)));
+	return _mm_or_si128(argb, _mm_set1_epi32(0xFF));
+}
+
+static inline __m128i RGB565ToARGB_SSE2(__m128i v)
+{
+	const __m128i m5 = _mm_set1_epi32(0x1F);
+	__m128i r = Widen5_SSE2(_mm_and_si128(_mm_srli_epi32(v, 11), m5));
+	__m128i g = Widen6_SSE2(_mm_and_si128(_mm_srli_epi32(v, 5), _mm_set1_epi32(0x3F)));
+	__m128i b = Widen5_SSE2(_mm_and_si128(v, m5));
+	__m128i argb = _mm_or_si128(_mm_slli_epi32(r, 8), _mm_or_si128(_mm_slli_epi32(g, 16), _mm_slli_epi32(b, 24)));
+	return _mm_or_si128(argb, _mm_set1_epi32(0xFF));
+}
+
+template<__m128i (*Convert)(__m128i)>
+static inline void UnpackRow_SSE2(UInt32* dst, const Byte* src, int& x, int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	for (; x + 8 <= count; x += 8)
+	{
+		__m128i v = ByteswapU16_SSE2(_mm_loadu_si128((const __m128i*) (src + 2 * x)));
+		_mm_storeu_si128((__m128i*) (dst + x), Convert(_mm_unpacklo_epi16(v, zero)));
+		_mm_storeu_si128((__m128i*) (dst + x + 4), Convert(_mm_unpackhi_epi16(v, zero)));
+	}
+}
+
+static void RGB555ToARGBRow_SSE2(UInt32* dst, const Byte* src, int count)
+{
+	int x = 0;
+	UnpackRow_SSE2<RGB555ToARGB_SSE2>(dst, src, x, count);
+	RGB555ToARGBRow_Scalar(dst + x, src + 2 * x, count - x);
+}
+
+static void RGB565ToARGBRow_SSE2(UInt32* dst, const Byte* src, int count)
+{
+	int x = 0;
+	UnpackRow_SSE2<RGB565ToARGB_SSE2>(dst, src, x, count);
+	RGB565ToARGBRow_Scalar(dst + x, src + 2 * x, count - x);
+}
+
+// SSE2 has no byte shuffle, so the swizzles are done with shifts. Loaded
+// little-endian, ARGB reads as 0xBBGGRRAA; BGRA is its byteswap (0xAARRGGBB),
+// and RGBA is it rotated right by a byte (0xAABBGGRR).
+
+static inline __m128i ARGBToBGRA_SSE2(__m128i v)
+{
+	v = ByteswapU16_SSE2(v);
+	return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+static inline __m128i ARGBToRGBA_SSE2(__m128i v)
+{
+	return _mm_or_si128(_mm_srli_epi32(v, 8), _mm_slli_epi32(v, 24));
+}
+
+template<__m128i (*Swizzle)(__m128i)>
+static inline void SwizzleRow_SSE2(UInt32* dst, const UInt32* src, int& x, int count)
+{
+	for (; x + 4 <= count; x += 4)
+		_mm_storeu_si128((__m128i*) (dst + x), Swizzle(_mm_loadu_si128((const __m128i*) (src + x))));
+}
+
+static void ARGBToBGRARow_SSE2(UInt32* dst, const UInt32* src, int count)
+{
+	int x = 0;
+	SwizzleRow_SSE2<ARGBToBGRA_SSE2>(dst, src, x, count);
+	ARGBToBGRARow_Scalar(dst + x, src + x, count - x);
+}
+
+static void ARGBToRGBARow_SSE2(UInt32* dst, const UInt32* src, int count)
+{
+	int x = 0;
+	SwizzleRow_SSE2<ARGBToRGBA_SSE2>(dst, src, x, count);
+	ARGBToRGBARow_Scalar(dst + x, src + x, count - x);
+}
+
+//-----------------------------------------------------------------------------
+// AVX2
+
+POMME_TARGET_AVX2
+static void CopyTransparentRow_AVX2(UInt32* dst, const UInt32* src, int count, UInt32 transparentColor)
+{
+	const __m256i key = _mm256_set1_epi32((int) transparentColor);
+
+	int x = 0;
+	for (; x + 8 <= count; x += 8)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i*) (src + x));
+		__m256i d = _mm256_loadu_si256((const __m256i*) (dst + x));
+		__m256i isKey = _mm256_cmpeq_epi32(s, key);
+		_mm256_storeu_si256((__m256i*) (dst + x), _mm256_blendv_epi8(s, d, isKey));
+	}
+
+	CopyTransparentRow_Scalar(dst + x, src + x, count - x, transparentColor);
+}
+
+POMME_TARGET_AVX2
+static void CopyMaskedRow_AVX2(UInt32* dst, const UInt32* src, const UInt32* mask, int count)
+{
+	const __m256i highBits = _mm256_set1_epi32((int) kRGBHighBits);
+	const __m256i zero = _mm256_setzero_si256();
+
+	int x = 0;
+	for (; x + 8 <= count; x += 8)
+	{
+		__m256i m = _mm256_loadu_si256((const __m256i*) (mask + x));
+		__m256i s = _mm256_loadu_si256((const __m256i*) (src + x));
+		__m256i d = _mm256_loadu_si256((const __m256i*) (dst + x));
+		__m256i isLight = _mm256_cmpeq_epi32(_mm256_andnot_si256(m, highBits), zero);
+		_mm256_storeu_si256((__m256i*) (dst + x), _mm256_blendv_epi8(s, d, isLight));
+	}
+
+	CopyMaskedRow_Scalar(dst + x, src + x, mask + x, count - x);
+}
+
+template<int mode>
+POMME_TARGET_AVX2
+static inline __m256i BooleanPixels_AVX2(__m256i d, __m256i s, __m256i rgb)
+{
+	__m256i r;
+	switch (mode)
+	{
+		case srcCopy:		return s;
+		case srcOr:			r = _mm256_and_si256(d, s);							break;
+		case srcXor:		r = _mm256_xor_si256(d, _mm256_xor_si256(s, rgb));	break;
+		case srcBic:		r = _mm256_or_si256(d, _mm256_andnot_si256(s, rgb));	break;
+		case notSrcCopy:	r = _mm256_andnot_si256(s, rgb);					break;
+		case notSrcOr:		r = _mm256_andnot_si256(s, d);						break;
+		case notSrcXor:		r = _mm256_xor_si256(d, s);							break;
+		case notSrcBic:		r = _mm256_or_si256(d, s);							break;
+	}
+	return _mm256_blendv_epi8(d, r, rgb);
+}
+
+template<int mode>
+POMME_TARGET_AVX2
+static void BooleanRow_AVX2(UInt32* dst, const UInt32* src, int count)
+{
+	const __m256i rgb = _mm256_set1_epi32((int) kRGBBits);
+
+	int x = 0;
+	for (; x + 8 <= count; x += 8)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i*) (src + x));
+		__m256i d = _mm256_loadu_si256((const __m256i*) (dst + x));
+		_mm256_storeu_si256((__m256i*) (dst + x), BooleanPixels_AVX2<mode>(d, s, rgb));
+	}
+
+	BooleanRow_Scalar<mode>(dst + x, src + x, count - x);
+}
+
+POMME_TARGET_AVX2
+static inline __m256i Blend16_AVX2(__m256i s, __m256i d, __m256i w)
+{
+	const __m256i k255 = _mm256_set1_epi16(255);
+	const __m256i k128 = _mm256_set1_epi16(128);
+	__m256i x = _mm256_add_epi16(_mm256_mullo_epi16(s, w), _mm256_mullo_epi16(d, _mm256_sub_epi16(k255, w)));
+	x = _mm256_add_epi16(x, k128);
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+template<int mode>
+POMME_TARGET_AVX2
+static inline __m256i ArithmeticPixels_AVX2(__m256i d, __m256i s, __m256i op)
+{
+	switch (mode)
+	{
+		case blend:
+		{
+			// Unpacking and packing both work within 128-bit halves, so pixels stay in order
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i w = _mm256_unpacklo_epi8(op, zero);
+			__m256i lo = Blend16_AVX2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero), w);
+			__m256i hi = Blend16_AVX2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero), w);
+			return _mm256_packus_epi16(lo, hi);
+		}
+		case addPin:	return _mm256_min_epu8(_mm256_adds_epu8(d, s), op);
+		case addOver:	return _mm256_add_epi8(d, s);
+		case subPin:	return _mm256_max_epu8(_mm256_subs_epu8(d, s), op);
+		case subOver:	return _mm256_sub_epi8(d, s);
+		case adMax:		return _mm256_max_epu8(d, s);
+		case adMin:		return _mm256_min_epu8(d, s);
+	}
+}
+
+template<int mode>
+POMME_TARGET_AVX2
+static void ArithmeticRow_AVX2(UInt32* dst, const UInt32* src, int count, UInt32 opColor)
+{
+	const __m256i rgb = _mm256_set1_epi32((int) kRGBBits);
+	const __m256i op = _mm256_set1_epi32((int) opColor);
+
+	int x = 0;
+	for (; x + 8 <= count; x += 8)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i*) (src + x));
+		__m256i d = _mm256_loadu_si256((const __m256i*) (dst + x));
+		_mm256_storeu_si256((__m256i*) (dst + x), _mm256_blendv_epi8(d, ArithmeticPixels_AVX2<mode>(d, s, op), rgb));
+	}
+
+	ArithmeticRow_Scalar<mode>(dst + x, src + x, count - x, opColor);
+}
+
+POMME_TARGET_AVX2
+static inline __m256i AlphaComposite16_AVX2(__m256i s, __m256i d)
+{
+	const __m256i alphaLanes = _mm256_set_epi16(0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255);
+	__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0), 0);
+	return Blend16_AVX2(_mm256_or_si256(s, alphaLanes), d, a);
+}
+
+POMME_TARGET_AVX2
+static void AlphaCompositeRow_AVX2(UInt32* dst, const UInt32* src, int count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+
+	int x = 0;
+	for (; x + 8 <= count; x += 8)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i*) (src + x));
+		__m256i d = _mm256_loadu_si256((const __m256i*) (dst + x));
+		__m256i lo = AlphaComposite16_AVX2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+		__m256i hi = AlphaComposite16_AVX2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+		_mm256_storeu_si256((__m256i*) (dst + x), _mm256_packus_epi16(lo, hi));
+	}
+
+	AlphaCompositeRow_Scalar(dst + x, src + x, count - x);
+}
+
+POMME_TARGET_AVX2
+static void GatherRow_AVX2(UInt32* dst, const UInt32* src, const int* index, int count)
+{
+	int x = 0;
+	for (; x + 8 <= count; x += 8)
+	{
+		__m256i i = _mm256_loadu_si256((const __m256i*) (index + x));
+		_mm256_storeu_si256((__m256i*) (dst + x), _mm256_i32gather_epi32((const int*) src, i, 4));
+	}
+
+	GatherRow_Scalar(dst + x, src, index + x, count - x);
+}
+
+POMME_TARGET_AVX2
+static inline __m256i Lerp16_AVX2(__m256i a, __m256i b, __m256i wa, __m256i wb)
+{
+	__m256i x = _mm256_add_epi16(_mm256_mullo_epi16(a, wa), _mm256_mullo_epi16(b, wb));
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_set1_epi16(128)), 8);
+}
+
+POMME_TARGET_AVX2
+static void LerpRow_AVX2(UInt32* dst, const UInt32* a, const UInt32* b, int count, int weight)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i wa = _mm256_set1_epi16(short(256 - weight));
+	const __m256i wb = _mm256_set1_epi16(short(weight));
+
+	int x = 0;
+	for (; x + 8 <= count; x += 8)
+	{
+		__m256i pa = _mm256_loadu_si256((const __m256i*) (a + x));
+		__m256i pb = _mm256_loadu_si256((const __m256i*) (b + x));
+		__m256i lo = Lerp16_AVX2(_mm256_unpacklo_epi8(pa, zero), _mm256_unpacklo_epi8(pb, zero), wa, wb);
+		__m256i hi = Lerp16_AVX2(_mm256_unpackhi_epi8(pa, zero), _mm256_unpackhi_epi8(pb, zero), wa, wb);
+		_mm256_storeu_si256((__m256i*) (dst + x), _mm256_packus_epi16(lo, hi));
+	}
+
+	LerpRow_Scalar(dst + x, a + x, b + x, count - x, weight);
+}
+
+POMME_TARGET_AVX2
+static void FillRow_AVX2(UInt32* dst, int count, UInt32 color)
+{
+	const __m256i c = _mm256_set1_epi32(int(color));
+
+	int x = 0;
+	for (; x + 32 <= count; x += 32)
+	{
+		_mm256_storeu_si256((__m256i*) (dst + x +  0), c);
+		_mm256_storeu_si256((__m256i*) (dst + x +  8), c);
+		_mm256_storeu_si256((__m256i*) (dst + x + 16), c);
+		_mm256_storeu_si256((__m256i*) (dst + x + 24), c);
+	}
+	for (; x + 8 <= count; x += 8)
+		_mm256_storeu_si256((__m256i*) (dst + x), c);
+
+	FillRow_SSE2(dst + x, count - x, color);
+}
+
+// `order` gives, for each output byte of a pixel, the input byte it comes from
+template<int b0, int b1, int b2, int b3>
+POMME_TARGET_AVX2
+static void SwizzleRow_AVX2(UInt32* dst, const UInt32* src, int count)
+{
+	const __m256i order = _mm256_setr_epi8(
+		b0, b1, b2, b3, b0 + 4, b1 + 4, b2 + 4, b3 + 4, b0 + 8, b1 + 8, b2 + 8, b3 + 8, b0 + 12, b1 + 12, b2 + 12, b3 + 12,
+		b0, b1, b2, b3, b0 + 4, b1 + 4, b2 + 4, b3 + 4, b0 + 8, b1 + 8, b2 + 8, b3 + 8, b0 + 12, b1 + 12, b2 + 12, b3 + 12);
+
+	int x = 0;
+	for (; x + 16 <= count; x += 16)
+	{
+		__m256i lo = _mm256_loadu_si256((const __m256i*) (src + x));
+		__m256i hi = _mm256_loadu_si256((const __m256i*) (src + x + 8));
+		_mm256_storeu_si256((__m256i*) (dst + x), _mm256_shuffle_epi8(lo, order));
+		_mm256_storeu_si256((__m256i*) (dst + x + 8), _mm256_shuffle_epi8(hi, order));
+	}
+	for (; x + 8 <= count; x += 8)
+		_mm256_storeu_si256((__m256i*) (dst + x), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*) (src + x)), order));
+
+	for (; x < count; x++)
+	{
+		const Byte* p = (const Byte*) (src + x);
+		const Byte in[4] = {p[0], p[1], p[2], p[3]};
+		Byte* q = (Byte*) (dst + x);
+		q[0] = in[b0];
+		q[1] = in[b1];
+		q[2] = in[b2];
+		q[3] = in[b3];
+	}
+}
+
+static bool HasAVX2()
+{
+#if _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	const bool osxsave = info[2] & (1 << 27);
+	const bool avx = info[2] & (1 << 28);
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)	// OS must save the YMM registers
+		return false;
+	__cpuidex(info, 7, 0);
+	return info[1] & (1 << 5);
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // POMME_BLIT_X86
+
+//-----------------------------------------------------------------------------
+// NEON
+
+#if POMME_BLIT_NEON
+
+static void CopyTransparentRow_NEON(UInt32* dst, const UInt32* src, int count, UInt32 transparentColor)
+{
+	const uint32x4_t key = vdupq_n_u32(transparentColor);
+
+	int x = 0;
+	for (; x + 4 <= count; x += 4)
+	{
+		uint32x4_t s = vld1q_u32(src + x);
+		uint32x4_t d = vld1q_u32(dst + x);
+		uint32x4_t isKey = vceqq_u32(s, key);
+		vst1q_u32(dst + x, vbslq_u32(isKey, d, s));
+	}
+
+	CopyTransparentRow_Scalar(dst + x, src + x, count - x, transparentColor);
+}
+
+static void CopyMaskedRow_NEON(UInt32* dst, const UInt32* src, const UInt32* mask, int count)
+{
+	const uint32x4_t highBits = vdupq_n_u32(kRGBHighBits);
+
+	int x = 0;
+	for (; x + 4 <= count; x += 4)
+	{
+		uint32x4_t m = vld1q_u32(mask + x);
+		uint32x4_t s = vld1q_u32(src + x);
+		uint32x4_t d = vld1q_u32(dst + x);
+		uint32x4_t isDark = vtstq_u32(vmvnq_u32(m), highBits);
+		vst1q_u32(dst + x, vbslq_u32(isDark, s, d));
+	}
+
+	CopyMaskedRow_Scalar(dst + x, src + x, mask + x, count - x);
+}
+
+template<int mode>
+static inline uint32x4_t BooleanPixels_NEON(uint32x4_t d, uint32x4_t s, uint32x4_t rgb)
+{
+	uint32x4_t r;
+	switch (mode)
+	{
+		case srcCopy:		return s;
+		case srcOr:			r = vandq_u32(d, s);		break;
+		case srcXor:		r = veorq_u32(d, vmvnq_u32(s));	break;
+		case srcBic:		r = vornq_u32(d, s);		break;
+		case notSrcCopy:	r = vmvnq_u32(s);			break;
+		case notSrcOr:		r = vbicq_u32(d, s);		break;
+		case notSrcXor:		r = veorq_u32(d, s);		break;
+		case notSrcBic:		r = vorrq_u32(d, s);		break;
+	}
+	return vbslq_u32(rgb, r, d);
+}
+
+template<int mode>
+static void BooleanRow_NEON(UInt32* dst, const UInt32* src, int count)
+{
+	const uint32x4_t rgb = vdupq_n_u32(kRGBBits);
+
+	int x = 0;
+	for (; x + 4 <= count; x += 4)
+	{
+		uint32x4_t s = vld1q_u32(src + x);
+		uint32x4_t d = vld1q_u32(dst + x);
+		vst1q_u32(dst + x, BooleanPixels_NEON<mode>(d, s, rgb));
+	}
+
+	BooleanRow_Scalar<mode>(dst + x, src + x, count - x);
+}
+
+// Div255(s * w + d * (255 - w)) on 8 bytes
+static inline uint8x8_t Blend8_NEON(uint8x8_t s, uint8x8_t d, uint8x8_t w)
+{
+	uint16x8_t x = vmlal_u8(vmull_u8(s, w), d, vsub_u8(vdup_n_u8(255), w));
+	x = vaddq_u16(x, vdupq_n_u16(128));
+	return vshrn_n_u16(vaddq_u16(x, vshrq_n_u16(x, 8)), 8);
+}
+
+template<int mode>
+static inline uint8x16_t ArithmeticPixels_NEON(uint8x16_t d, uint8x16_t s, uint8x16_t op)
+{
+	switch (mode)
+	{
+		case blend:
+			return vcombine_u8(
+				Blend8_NEON(vget_low_u8(s), vget_low_u8(d), vget_low_u8(op)),
+				Blend8_NEON(vget_high_u8(s), vget_high_u8(d), vget_high_u8(op)));
+		case addPin:	return vminq_u8(vqaddq_u8(d, s), op);
+		case addOver:	return vaddq_u8(d, s);
+		case subPin:	return vmaxq_u8(vqsubq_u8(d, s), op);
+		case subOver:	return vsubq_u8(d, s);
+		case adMax:		return vmaxq_u8(d, s);
+		case adMin:		return vminq_u8(d, s);
+	}
+}
+
+template<int mode>
+static void ArithmeticRow_NEON(UInt32* dst, const UInt32* src, int count, UInt32 opColor)
+{
+	const uint32x4_t rgb = vdupq_n_u32(kRGBBits);
+	const uint8x16_t op = vreinterpretq_u8_u32(vdupq_n_u32(opColor));
+
+	int x = 0;
+	for (; x + 4 <= count; x += 4)
+	{
+		uint8x16_t s = vreinterpretq_u8_u32(vld1q_u32(src + x));
+		uint8x16_t d = vreinterpretq_u8_u32(vld1q_u32(dst + x));
+		uint32x4_t r = vreinterpretq_u32_u8(ArithmeticPixels_NEON<mode>(d, s, op));
+		vst1q_u32(dst + x, vbslq_u32(rgb, r, vreinterpretq_u32_u8(d)));
+	}
+
+	ArithmeticRow_Scalar<mode>(dst + x, src + x, count - x, opColor);
+}
+
+// Composites 2 pixels
+static inline uint8x8_t AlphaComposite8_NEON(uint8x8_t s, uint8x8_t d)
+{
+	static const Byte kAlphaIndex[8] = {0, 0, 0, 0, 4, 4, 4, 4};
+	static const Byte kAlphaLanes[8] = {255, 0, 0, 0, 255, 0, 0, 0};
+	uint8x8_t a = vtbl1_u8(s, vld1_u8(kAlphaIndex));
+	return Blend8_NEON(vorr_u8(s, vld1_u8(kAlphaLanes)), d, a);
+}
+
+static void AlphaCompositeRow_NEON(UInt32* dst, const UInt32* src, int count)
+{
+	int x = 0;
+	for (; x + 4 <= count; x += 4)
+	{
+		uint8x16_t s = vreinterpretq_u8_u32(vld1q_u32(src + x));
+		uint8x16_t d = vreinterpretq_u8_u32(vld1q_u32(dst + x));
+		uint8x16_t r = vcombine_u8(
+			AlphaComposite8_NEON(vget_low_u8(s), vget_low_u8(d)),
+			AlphaComposite8_NEON(vget_high_u8(s), vget_high_u8(d)));
+		vst1q_u32(dst + x, vreinterpretq_u32_u8(r));
+	}
+
+	AlphaCompositeRow_Scalar(dst + x, src + x, count - x);
+}
+
+static void LerpRow_NEON(UInt32* dst, const UInt32* a, const UInt32* b, int count, int weight)
+{
+	const uint16x8_t wa = vdupq_n_u16(uint16_t(256 - weight));
+	const uint16x8_t wb = vdupq_n_u16(uint16_t(weight));
+	const uint16x8_t k128 = vdupq_n_u16(128);
+
+	int x = 0;
+	for (; x + 4 <= count; x += 4)
+	{
+		uint8x16_t pa = vreinterpretq_u8_u32(vld1q_u32(a + x));
+		uint8x16_t pb = vreinterpretq_u8_u32(vld1q_u32(b + x));
+		uint16x8_t lo = vmlaq_u16(vmulq_u16(vmovl_u8(vget_low_u8(pa)), wa), vmovl_u8(vget_low_u8(pb)), wb);
+		uint16x8_t hi = vmlaq_u16(vmulq_u16(vmovl_u8(vget_high_u8(pa)), wa), vmovl_u8(vget_high_u8(pb)), wb);
+		uint8x16_t r = vcombine_u8(vshrn_n_u16(vaddq_u16(lo, k128), 8), vshrn_n_u16(vaddq_u16(hi, k128), 8));
+		vst1q_u32(dst + x, vreinterpretq_u32_u8(r));
+	}
+
+	LerpRow_Scalar(dst + x, a + x, b + x, count - x, weight);
+}
+
+static void FillRow_NEON(UInt32* dst, int count, UInt32 color)
+{
+	const uint32x4_t c = vdupq_n_u32(color);
+
+	int x = 0;
+	for (; x + 16 <= count; x += 16)
+	{
+		vst1q_u32(dst + x +  0, c);
+		vst1q_u32(dst + x +  4, c);
+		vst1q_u32(dst + x +  8, c);
+		vst1q_u32(dst + x + 12, c);
+	}
+	for (; x + 4 <= count; x += 4)
+		vst1q_u32(dst + x, c);
+
+	FillRow_Scalar(dst + x, count - x, color);
+}
+
+// vld4/vst4 (de)interleave the A, R, G, B bytes; vld2/vst2 the high and low bytes of 16-bit pixels
+
+static void ARGBToRGB555Row_NEON(Byte* dst, const UInt32* src, int count)
+{
+	int x = 0;
+	for (; x + 8 <= count; x += 8)
+	{
+		uint8x8x4_t p = vld4_u8((const uint8_t*) (src + x));
+		uint8x8x2_t out;
+		out.val[0] = vorr_u8(vshl_n_u8(vshr_n_u8(p.val[1], 3), 2), vshr_n_u8(p.val[2], 6));
+		out.val[1] = vorr_u8(vand_u8(vshl_n_u8(p.val[2], 2), vdup_n_u8(0xE0)), vshr_n_u8(p.val[3], 3));
+		vst2_u8(dst + 2 * x, out);
+	}
+	ARGBToRGB555Row_Scalar(dst + 2 * x, src + x, count - x);
+}
+
+static void ARGBToRGB565Row_NEON(Byte* dst, const UInt32* src, int count)
+{
+	int x = 0;
+	for (; x + 8 <= count; x += 8)
+	{
+		uint8x8x4_t p = vld4_u8((const uint8_t*) (src + x));
+		uint8x8x2_t out;
+		out.val[0] = vorr_u8(vand_u8(p.val[1], vdup_n_u8(0xF8)), vshr_n_u8(p.val[2], 5));
+		out.val[1] = vorr_u8(vand_u8(vshl_n_u8(p.val[2], 3), vdup_n_u8(0xE0)), vshr_n_u8(p.val[3], 3));
+		vst2_u8(dst + 2 * x, out);
+	}
+	ARGBToRGB565Row_Scalar(dst + 2 * x, src + x, count - x);
+}
+
+static inline uint8x8_t Widen5_NEON(uint8x8_t c)
+{
+	return vorr_u8(vshl_n_u8(c, 3), vshr_n_u8(c, 2));
+}
+
+static void RGB555ToARGBRow_NEON(UInt32* dst, const Byte* src, int count)
+{
+	int x = 0;
+	for (; x + 8 <= count; x += 8)
+	{
+		uint8x8x2_t v = vld2_u8(src + 2 * x);
+		uint8x8_t r = vand_u8(vshr_n_u8(v.val[0], 2), vdup_n_u8(0x1F));
+		uint8x8_t g = vorr_u8(vshl_n_u8(vand_u8(v.val[0], vdup_n_u8(0x03)), 3), vshr_n_u8(v.val[1], 5));
+		uint8x8_t b = vand_u8(v.val[1], vdup_n_u8(0x1F));
+		uint8x8x4_t p;
+		p.val[0] = vdup_n_u8(0xFF);
+		p.val[1] = Widen5_NEON(r);
+		p.val[2] = Widen5_NEON(g);
+		p.val[3] = Widen5_NEON(b);
+		vst4_u8((uint8_t*) (dst + x), p);
+	}
+	RGB555ToARGBRow_Scalar(dst + x, src + 2 * x, count - x);
+}
+
+static void RGB565ToARGBRow_NEON(UInt32* dst, const Byte* src, int count)
+{
+	int x = 0;
+	for (; x + 8 <= count; x += 8)
+	{
+		uint8x8x2_t v = vld2_u8(src + 2 * x);
+		uint8x8_t r = vshr_n_u8(v.val[0], 3);
+		uint8x8_t g = vorr_u8(vshl_n_u8(vand_u8(v.val[0], vdup_n_u8(0x07)), 3), vshr_n_u8(v.val[1], 5));
+		uint8x8_t b = vand_u8(v.val[1], vdup_n_u8(0x1F));
+		uint8x8x4_t p;
+		p.val[0] = vdup_n_u8(0xFF);
+		p.val[1] = Widen5_NEON(r);
+		p.val[2] = vorr_u8(vshl_n_u8(g, 2), vshr_n_u8(g, 4));
+		p.val[3] = Widen5_NEON(b);
+		vst4_u8((uint8_t*) (dst + x), p);
+	}
+	RGB565ToARGBRow_Scalar(dst + x, src + 2 * x, count - x);
+}
+
+static void ARGBToBGRARow_NEON(UInt32* dst, const UInt32* src, int count)
+{
+	int x = 0;
+	for (; x + 4 <= count; x += 4)
+		vst1q_u8((uint8_t*) (dst + x), vrev32q_u8(vld1q_u8((const uint8_t*) (src + x))));
+	ARGBToBGRARow_Scalar(dst + x, src + x, count - x);
+}
+
+static void ARGBToRGBARow_NEON(UInt32* dst, const UInt32* src, int count)
+{
+	int x = 0;
+	for (; x + 16 <= count; x += 16)
+	{
+		uint8x16x4_t p = vld4q_u8((const uint8_t*) (src + x));
+		uint8x16x4_t q;
+		q.val[0] = p.val[1];
+		q.val[1] = p.val[2];
+		q.val[2] = p.val[3];
+		q.val[3] = p.val[0];
+		vst4q_u8((uint8_t*) (dst + x), q);
+	}
+	ARGBToRGBARow_Scalar(dst + x, src + x, count - x);
+}
+
+#endif // POMME_BLIT_NEON
+
+//-----------------------------------------------------------------------------
+// 1-bit rows
+
+// Returns the 32 pixels starting at x, leftmost pixel in the most significant bit.
+// May read up to 4 bytes past the last pixel (PackedPixmap has slack for this).
+static inline UInt32 LoadBits32(const Byte* row, int x)
+{
+	const Byte* p = row + (x >> 3);
+	uint64_t w = (uint64_t(p[0]) << 32) | (uint64_t(p[1]) << 24) | (uint64_t(p[2]) << 16) | (uint64_t(p[3]) << 8) | p[4];
+	return UInt32(w >> (8 - (x & 7)));
+}
+
+// Replaces the pixels starting at x whose bit is set in `writeMask` with those in `bits`.
+// Only touches the bytes that actually contain written pixels.
+static inline void StoreBits32(Byte* row, int x, UInt32 bits, UInt32 writeMask)
+{
+	Byte* p = row + (x >> 3);
+	const int shift = 8 - (x & 7);
+	const uint64_t m = uint64_t(writeMask) << shift;
+	const uint64_t b = uint64_t(bits) << shift;
+
+	for (int i = 0; i < 5; i++)
+	{
+		const Byte mb = Byte(m >> (32 - 8 * i));
+		if (mb)
+			p[i] = Byte((p[i] & ~mb) | (Byte(b >> (32 - 8 * i)) & mb));
+	}
+}
+
+// Mask of the first n pixels of a 32-pixel chunk (1 <= n <= 32)
+static inline UInt32 LeadingBits(int n)
+{
+	return n >= 32 ? 0xFFFFFFFF : ~(0xFFFFFFFFu >> n);
+}
+
+// Number of clear bits above the most significant set bit (32 for 0)
+static inline int CountLeadingZeros(UInt32 bits)
+{
+	if (bits == 0)
+		return 32;
+#if _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, bits);
+	return 31 - (int) index;
+#else
+	return __builtin_clz(bits);
+#endif
+}
+
+// Pixels in the run of set bits starting at the leftmost pixel
+static inline int CountLeadingOnes(UInt32 bits)
+{
+	return CountLeadingZeros(~bits);
+}
+
+void Pomme::Graphics::Blit::CopyBitRow(Byte* dstRow, int dstX, const Byte* srcRow, int srcX, int count)
+{
+	for (int x = 0; x < count; x += 32)
+	{
+		UInt32 keep = LeadingBits(count - x);
+		StoreBits32(dstRow, dstX + x, LoadBits32(srcRow, srcX + x), keep);
+	}
+}
+
+// Boolean transfer modes on 32 1-bit pixels (set = black)
+template<int mode>
+static inline UInt32 BooleanBits(UInt32 d, UInt32 s)
+{
+	switch (mode)
+	{
+		case srcCopy:		return s;
+		case srcOr:			return d | s;
+		case srcXor:		return d ^ s;
+		case srcBic:		return d & ~s;
+		case notSrcCopy:	return ~s;
+		case notSrcOr:		return d | ~s;
+		case notSrcXor:		return d ^ ~s;
+		case notSrcBic:		return d & s;
+	}
+}
+
+template<int mode>
+static void CombineBitRow(Byte* dstRow, int dstX, const Byte* srcRow, int srcX, int count)
+{
+	for (int x = 0; x < count; x += 32)
+	{
+		const UInt32 keep = LeadingBits(count - x);
+		const UInt32 s = LoadBits32(srcRow, srcX + x);
+
+		// Chunks where the source leaves the destination alone cost one test
+		if ((mode == srcOr || mode == srcXor || mode == srcBic) && !(s & keep))
+			continue;
+		if ((mode == notSrcOr || mode == notSrcXor || mode == notSrcBic) && !(~s & keep))
+			continue;
+
+		StoreBits32(dstRow, dstX + x, BooleanBits<mode>(LoadBits32(dstRow, dstX + x), s), keep);
+	}
+}
+
+void Pomme::Graphics::Blit::BooleanBitRow(Byte* dstRow, int dstX, const Byte* srcRow, int srcX, int count, int mode)
+{
+	switch (mode)
+	{
+		case srcCopy:		CopyBitRow(dstRow, dstX, srcRow, srcX, count);						break;
+		case srcOr:			CombineBitRow<srcOr>(dstRow, dstX, srcRow, srcX, count);			break;
+		case srcXor:		CombineBitRow<srcXor>(dstRow, dstX, srcRow, srcX, count);			break;
+		case srcBic:		CombineBitRow<srcBic>(dstRow, dstX, srcRow, srcX, count);			break;
+		case notSrcCopy:	CombineBitRow<notSrcCopy>(dstRow, dstX, srcRow, srcX, count);		break;
+		case notSrcOr:		CombineBitRow<notSrcOr>(dstRow, dstX, srcRow, srcX, count);		break;
+		case notSrcXor:		CombineBitRow<notSrcXor>(dstRow, dstX, srcRow, srcX, count);		break;
+		case notSrcBic:		CombineBitRow<notSrcBic>(dstRow, dstX, srcRow, srcX, count);		break;
+		default:			throw std::invalid_argument("BooleanBitRow: not a boolean transfer mode");
+	}
+}
+
+void Pomme::Graphics::Blit::CopyBitRowMasked(Byte* dstRow, int dstX, const Byte* srcRow, int srcX, const Byte* maskRow, int maskX, int count)
+{
+	for (int x = 0; x < count; x += 32)
+	{
+		UInt32 m = LoadBits32(maskRow, maskX + x) & LeadingBits(count - x);
+		if (m)
+			StoreBits32(dstRow, dstX + x, LoadBits32(srcRow, srcX + x), m);
+	}
+}
+
+void Pomme::Graphics::Blit::CopyRowWithBitMask(UInt32* dst, const UInt32* src, const Byte* maskRow, int maskX, int count)
+{
+	for (int x = 0; x < count; x += 32)
+	{
+		UInt32 m = LoadBits32(maskRow, maskX + x) & LeadingBits(count - x);
+
+		if (m == 0)
+			continue;
+
+		if (m == 0xFFFFFFFF)
+		{
+			memcpy(dst + x, src + x, 32 * sizeof(UInt32));
+			continue;
+		}
+
+		// Copy each run of set bits in one go
+		while (m)
+		{
+			int start = CountLeadingZeros(m);
+			int len = CountLeadingOnes(UInt32(m << start));
+			memcpy(dst + x + start, src + x + start, len * sizeof(UInt32));
+			m &= (len + start >= 32) ? 0 : (0xFFFFFFFFu >> (start + len));
+		}
+	}
+}
+
+void Pomme::Graphics::Blit::CopyPackedRowWithBitMask(Byte* dst, const Byte* src, int pixelBytes, const Byte* maskRow, int maskX, int count)
+{
+	for (int x = 0; x < count; x += 32)
+	{
+		UInt32 m = LoadBits32(maskRow, maskX + x) & LeadingBits(count - x);
+
+		while (m)
+		{
+			int start = CountLeadingZeros(m);
+			int len = CountLeadingOnes(UInt32(m << start));
+			memcpy(dst + (x + start) * pixelBytes, src + (x + start) * pixelBytes, len * pixelBytes);
+			m &= (len + start >= 32) ? 0 : (0xFFFFFFFFu >> (start + len));
+		}
+	}
+}
+
+void Pomme::Graphics::Blit::ExpandBitRow(UInt32* dst, const Byte* srcRow, int srcX, int count, UInt32 black, UInt32 white)
+{
+	for (int x = 0; x < count; x += 32)
+	{
+		UInt32 bits = LoadBits32(srcRow, srcX + x);
+		int n = std::min(32, count - x);
+		for (int i = 0; i < n; i++)
+			dst[x + i] = (bits & (0x80000000u >> i)) ? black : white;
+	}
+}
+
+void Pomme::Graphics::Blit::ThresholdRow(Byte* dstRow, int dstX, const UInt32* src, int count)
+{
+	for (int x = 0; x < count; x += 32)
+	{
+		int n = std::min(32, count - x);
+		UInt32 bits = 0;
+		for (int i = 0; i < n; i++)
+		{
+			if (~src[x + i] & kRGBHighBits)
+				bits |= 0x80000000u >> i;
+		}
+		StoreBits32(dstRow, dstX + x, bits, LeadingBits(n));
+	}
+}
+
+//-----------------------------------------------------------------------------
+// 8-bit rows
+
+// clut8 in raw big-endian layout
+static const UInt32* GetClut8Raw()
+{
+	static const auto table = []()
+	{
+		std::array<UInt32, 256> t;
+		for (int i = 0; i < 256; i++)
+			t[i] = PackU32BE(&Pomme::Graphics::clut8[i]);
+		return t;
+	}();
+	return table.data();
+}
+
+// Maps every 15-bit RGB color to its nearest clut8 entry.
+// Built on first use (~8M distance tests, done once).
+static const Byte* GetInverseClut8()
+{
+	static const auto table = []()
+	{
+		auto t = std::make_unique<Byte[]>(1 << 15);
+		for (int rgb = 0; rgb < (1 << 15); rgb++)
+		{
+			int r = (rgb >> 10) & 0x1F;
+			int g = (rgb >> 5) & 0x1F;
+			int b = rgb & 0x1F;
+			r = (r << 3) | (r >> 2);
+			g = (g << 3) | (g >> 2);
+			b = (b << 3) | (b >> 2);
+
+			int best = 0;
+			int bestDist = INT32_MAX;
+			for (int i = 0; i < 256; i++)
+			{
+				UInt32 c = Pomme::Graphics::clut8[i];
+				int dr = int((c >> 16) & 0xFF) - r;
+				int dg = int((c >> 8) & 0xFF) - g;
+				int db = int(c & 0xFF) - b;
+				int dist = dr * dr + dg * dg + db * db;
+				if (dist < bestDist)
+				{
+					best = i;
+					bestDist = dist;
+				}
+			}
+			t[rgb] = Byte(best);
+		}
+		return t;
+	}();
+	return table.get();
+}
+
+void Pomme::Graphics::Blit::Index8ToARGBRow(UInt32* dst, const Byte* src, int count)
+{
+	const UInt32* clut = GetClut8Raw();
+	for (int x = 0; x < count; x++)
+		dst[x] = clut[src[x]];
+}
+
+void Pomme::Graphics::Blit::ARGBToIndex8Row(Byte* dst, const UInt32* src, int count)
+{
+	const Byte* inverse = GetInverseClut8();
+	const Byte* p = (const Byte*) src;
+	for (int x = 0; x < count; x++, p += 4)
+		dst[x] = inverse[((p[1] >> 3) << 10) | ((p[2] >> 3) << 5) | (p[3] >> 3)];
+}
+
+//-----------------------------------------------------------------------------
+// Dispatch
+
+static const Kernels kScalarKernels =
+{
+	"scalar",
+	CopyTransparentRow_Scalar,
+	CopyMaskedRow_Scalar,
+	ARGBToRGB555Row_Scalar,
+	RGB555ToARGBRow_Scalar,
+	ARGBToRGB565Row_Scalar,
+	RGB565ToARGBRow_Scalar,
+	{
+		BooleanRow_Scalar<srcCopy>,
+		BooleanRow_Scalar<srcOr>,
+		BooleanRow_Scalar<srcXor>,
+		BooleanRow_Scalar<srcBic>,
+		BooleanRow_Scalar<notSrcCopy>,
+		BooleanRow_Scalar<notSrcOr>,
+		BooleanRow_Scalar<notSrcXor>,
+		BooleanRow_Scalar<notSrcBic>,
+	},
+	{
+		ArithmeticRow_Scalar<blend>,
+		ArithmeticRow_Scalar<addPin>,
+		ArithmeticRow_Scalar<addOver>,
+		ArithmeticRow_Scalar<subPin>,
+		nullptr,	// transparent
+		ArithmeticRow_Scalar<adMax>,
+		ArithmeticRow_Scalar<subOver>,
+		ArithmeticRow_Scalar<adMin>,
+	},
+	AlphaCompositeRow_Scalar,
+	GatherRow_Scalar,
+	ReplicateRow_Scalar,
+	LerpRow_Scalar,
+	LerpGatherRow_Scalar,
+	FillRow_Scalar,
+	ARGBToBGRARow_Scalar,
+	ARGBToRGBARow_Scalar,
+};
+
+#if POMME_BLIT_X86
+static const Kernels kSSE2Kernels =
+{
+	"sse2",
+	CopyTransparentRow_SSE2,
+	CopyMaskedRow_SSE2,
+	ARGBToRGB555Row_SSE2,
+	RGB555ToARGBRow_SSE2,
+	ARGBToRGB565Row_SSE2,
+	RGB565ToARGBRow_SSE2,
+	{
+		BooleanRow_SSE2<srcCopy>,
+		BooleanRow_SSE2<srcOr>,
+		BooleanRow_SSE2<srcXor>,
+		BooleanRow_SSE2<srcBic>,
+		BooleanRow_SSE2<notSrcCopy>,
+		BooleanRow_SSE2<notSrcOr>,
+		BooleanRow_SSE2<notSrcXor>,
+		BooleanRow_SSE2<notSrcBic>,
+	},
+	{
+		ArithmeticRow_SSE2<blend>,
+		ArithmeticRow_SSE2<addPin>,
+		ArithmeticRow_SSE2<addOver>,
+		ArithmeticRow_SSE2<subPin>,
+		nullptr,	// transparent
+		ArithmeticRow_SSE2<adMax>,
+		ArithmeticRow_SSE2<subOver>,
+		ArithmeticRow_SSE2<adMin>,
+	},
+	AlphaCompositeRow_SSE2,
+	GatherRow_Scalar,
+	ReplicateRow_SSE2,
+	LerpRow_SSE2,
+	LerpGatherRow_SSE2,
+	FillRow_SSE2,
+	ARGBToBGRARow_SSE2,
+	ARGBToRGBARow_SSE2,
+};
+
+static const Kernels kAVX2Kernels =
+{
+	"avx2",
+	CopyTransparentRow_AVX2,
+	CopyMaskedRow_AVX2,
+	ARGBToRGB555Row_SSE2,
+	RGB555ToARGBRow_SSE2,
+	ARGBToRGB565Row_SSE2,
+	RGB565ToARGBRow_SSE2,
+	{
+		BooleanRow_AVX2<srcCopy>,
+		BooleanRow_AVX2<srcOr>,
+		BooleanRow_AVX2<srcXor>,
+		BooleanRow_AVX2<srcBic>,
+		BooleanRow_AVX2<notSrcCopy>,
+		BooleanRow_AVX2<notSrcOr>,
+		BooleanRow_AVX2<notSrcXor>,
+		BooleanRow_AVX2<notSrcBic>,
+	},
+	{
+		ArithmeticRow_AVX2<blend>,
+		ArithmeticRow_AVX2<addPin>,
+		ArithmeticRow_AVX2<addOver>,
+		ArithmeticRow_AVX2<subPin>,
+		nullptr,	// transparent
+		ArithmeticRow_AVX2<adMax>,
+		ArithmeticRow_AVX2<subOver>,
+		ArithmeticRow_AVX2<adMin>,
+	},
+	AlphaCompositeRow_AVX2,
+	GatherRow_AVX2,
+	ReplicateRow_SSE2,
+	LerpRow_AVX2,
+	LerpGatherRow_SSE2,
+	FillRow_AVX2,
+	SwizzleRow_AVX2<3, 2, 1, 0>,
+	SwizzleRow_AVX2<1, 2, 3, 0>,
+};
+#endif
+
+#if POMME_BLIT_NEON
+static const Kernels kNEONKernels =
+{
+	"neon",
+	CopyTransparentRow_NEON,
+	CopyMaskedRow_NEON,
+	ARGBToRGB555Row_NEON,
+	RGB555ToARGBRow_NEON,
+	ARGBToRGB565Row_NEON,
+	RGB565ToARGBRow_NEON,
+	{
+		BooleanRow_NEON<srcCopy>,
+		BooleanRow_NEON<srcOr>,
+		BooleanRow_NEON<srcXor>,
+		BooleanRow_NEON<srcBic>,
+		BooleanRow_NEON<notSrcCopy>,
+		BooleanRow_NEON<notSrcOr>,
+		BooleanRow_NEON<notSrcXor>,
+		BooleanRow_NEON<notSrcBic>,
+	},
+	{
+		ArithmeticRow_NEON<blend>,
+		ArithmeticRow_NEON<addPin>,
+		ArithmeticRow_NEON<addOver>,
+		ArithmeticRow_NEON<subPin>,
+		nullptr,	// transparent
+		ArithmeticRow_NEON<adMax>,
+		ArithmeticRow_NEON<subOver>,
+		ArithmeticRow_NEON<adMin>,
+	},
+	AlphaCompositeRow_NEON,
+	GatherRow_Scalar,
+	ReplicateRow_Scalar,
+	LerpRow_NEON,
+	LerpGatherRow_Scalar,
+	FillRow_NEON,
+	ARGBToBGRARow_NEON,
+	ARGBToRGBARow_NEON,
+};
+#endif
+
+static const Kernels& SelectKernels()
+{
+	// Set POMME_BLIT=scalar in the environment to compare against the plain C++ kernels
+	const char* override = getenv("POMME_BLIT");
+	if (override && 0 == strcmp(override, "scalar"))
+		return kScalarKernels;
+
+#if POMME_BLIT_X86
+	if (HasAVX2())
+		return kAVX2Kernels;
+	return kSSE2Kernels;
+#elif POMME_BLIT_NEON
+	return kNEONKernels;
+#else
+	return kScalarKernels;
+#endif
+}
+
+const Kernels& Pomme::Graphics::Blit::GetKernels()
+{
+	static const Kernels& kernels = SelectKernels();
+	return kernels;
+}
+
+const Kernels& Pomme::Graphics::Blit::GetScalarKernels()
+{
+	return kScalarKernels;
+}
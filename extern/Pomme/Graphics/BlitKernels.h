@@ -0,0 +1,135 @@
+#pragma once
+
+#include "PommeTypes.h"
+
+// Row kernels for the CopyBits/CopyMask inner loops.
+// Pixels are 32-bit ARGB, stored big-endian (as in ARGBPixmap).
+// Each kernel has a scalar version and SIMD versions; the best one for the
+// host CPU is picked once, at first use.
+
+namespace Pomme::Graphics::Blit
+{
+	// Copies the source pixels that aren't equal to `transparentColor`
+	// (given in the same raw big-endian layout as the pixels).
+	typedef void (*CopyTransparentRowFunc)(UInt32* dst, const UInt32* src, int count, UInt32 transparentColor);
+
+	// Copies the source pixels whose mask pixel is dark,
+	// i.e. has a red, green or blue component below 128.
+	typedef void (*CopyMaskedRowFunc)(UInt32* dst, const UInt32* src, const UInt32* mask, int count);
+
+	// Converts 32-bit ARGB to big-endian 16-bit pixels (xRGB1555 or RGB565).
+	// Color components are truncated.
+	typedef void (*PackRowFunc)(Byte* dst, const UInt32* src, int count);
+
+	// Converts big-endian 16-bit pixels to 32-bit ARGB. Components are widened
+	// by replicating their top bits, so that white stays white. Alpha is set to 255.
+	typedef void (*UnpackRowFunc)(UInt32* dst, const Byte* src, int count);
+
+	// Combines a source row into a destination row with one of the boolean
+	// transfer modes (srcCopy...notSrcBic). QuickDraw defines these on 1-bit
+	// pixels, where a set bit is black. Direct pixels have black = 0, so their RGB
+	// bits are combined inverted: srcOr darkens (AND), srcBic lightens (OR), srcXor
+	// inverts the destination where the source is dark, and so on.
+	// The destination's alpha is kept, except in srcCopy.
+	typedef void (*BooleanRowFunc)(UInt32* dst, const UInt32* src, int count);
+
+	constexpr int kNumBooleanModes = 8;
+
+	// Combines the RGB components of a source row into a destination row with
+	// one of QuickDraw's arithmetic transfer modes (blend...adMin). `opColor` is
+	// a raw pixel: the pin for addPin/subPin, or the per-channel source weight
+	// (0-255) for blend. The destination's alpha is kept.
+	typedef void (*ArithmeticRowFunc)(UInt32* dst, const UInt32* src, int count, UInt32 opColor);
+
+	constexpr int kNumArithmeticModes = 8;
+
+	// Composites a source row over a destination row using the source's
+	// (non-premultiplied) alpha.
+	typedef void (*AlphaCompositeRowFunc)(UInt32* dst, const UInt32* src, int count);
+
+	// Scaling. Blits work out the source positions once, with 16.16 fixed-point
+	// steppers, and pass them to these kernels row after row.
+
+	// dst[i] = src[index[i]] (nearest neighbor)
+	typedef void (*GatherRowFunc)(UInt32* dst, const UInt32* src, const int* index, int count);
+
+	// Repeats each of the `srcCount` source pixels `factor` times (integer upscaling).
+	// Writes exactly srcCount * factor pixels, for any factor >= 0.
+	typedef void (*ReplicateRowFunc)(UInt32* dst, const UInt32* src, int srcCount, int factor);
+
+	// Blends two rows, channel by channel: (a * (256 - weight) + b * weight + 128) >> 8,
+	// with 0 <= weight < 256.
+	typedef void (*LerpRowFunc)(UInt32* dst, const UInt32* a, const UInt32* b, int count, int weight);
+
+	// dst[i] = lerp(src[index[i]], src[index[i] + 1], weight[i]), rounded like LerpRowFunc.
+	typedef void (*LerpGatherRowFunc)(UInt32* dst, const UInt32* src, const int* index, const UInt16* weight, int count);
+
+	// Sets `count` pixels to `color` (a 32-bit memset).
+	typedef void (*FillRowFunc)(UInt32* dst, int count, UInt32 color);
+
+	// Reorders the bytes of ARGB pixels for presenting, e.g. to B, G, R, A in
+	// memory. `dst` may be the same as `src`.
+	typedef void (*SwizzleRowFunc)(UInt32* dst, const UInt32* src, int count);
+
+	struct Kernels
+	{
+		const char* name;
+		CopyTransparentRowFunc copyTransparentRow;
+		CopyMaskedRowFunc copyMaskedRow;
+		PackRowFunc argbToRGB555Row;
+		UnpackRowFunc rgb555ToARGBRow;
+		PackRowFunc argbToRGB565Row;
+		UnpackRowFunc rgb565ToARGBRow;
+		BooleanRowFunc booleanRows[kNumBooleanModes];	// indexed by transfer mode
+		ArithmeticRowFunc arithmeticRows[kNumArithmeticModes];	// indexed by transfer mode - blend; null for transparent
+		AlphaCompositeRowFunc alphaCompositeRow;
+		GatherRowFunc gatherRow;
+		ReplicateRowFunc replicateRow;
+		LerpRowFunc lerpRow;
+		LerpGatherRowFunc lerpGatherRow;
+		FillRowFunc fillRow;
+		SwizzleRowFunc argbToBGRARow;
+		SwizzleRowFunc argbToRGBARow;
+	};
+
+	// Returns the kernels for the best instruction set supported by this CPU.
+	const Kernels& GetKernels();
+
+	// Returns the plain C++ kernels (for reference/debugging).
+	const Kernels& GetScalarKernels();
+
+	// 1-bit rows (see PackedPixmap): a row is addressed by its base pointer plus
+	// a pixel offset, since rects needn't start on a byte boundary.
+	// These work on 32 mask bits at a time, so fully clear or fully set runs
+	// cost one test each.
+
+	// 1-bit -> 1-bit copy.
+	void CopyBitRow(Byte* dstRow, int dstX, const Byte* srcRow, int srcX, int count);
+
+	// 1-bit -> 1-bit with a boolean transfer mode (srcCopy...notSrcBic).
+	void BooleanBitRow(Byte* dstRow, int dstX, const Byte* srcRow, int srcX, int count, int mode);
+
+	// 1-bit -> 1-bit copy where the 1-bit mask is set.
+	void CopyBitRowMasked(Byte* dstRow, int dstX, const Byte* srcRow, int srcX, const Byte* maskRow, int maskX, int count);
+
+	// 32-bit -> 32-bit copy where the 1-bit mask is set.
+	void CopyRowWithBitMask(UInt32* dst, const UInt32* src, const Byte* maskRow, int maskX, int count);
+
+	// Same as CopyRowWithBitMask for 8- or 16-bit pixels (pixelBytes = 1 or 2).
+	void CopyPackedRowWithBitMask(Byte* dst, const Byte* src, int pixelBytes, const Byte* maskRow, int maskX, int count);
+
+	// 1-bit -> 32-bit: set bits become `black`, clear bits become `white`
+	// (both in raw big-endian layout).
+	void ExpandBitRow(UInt32* dst, const Byte* srcRow, int srcX, int count, UInt32 black, UInt32 white);
+
+	// 32-bit -> 1-bit: dark pixels (red, green or blue below 128) become set bits.
+	void ThresholdRow(Byte* dstRow, int dstX, const UInt32* src, int count);
+
+	// 8-bit rows, indexed into the standard 256-color palette (clut8).
+
+	// 8-bit -> 32-bit ARGB.
+	void Index8ToARGBRow(UInt32* dst, const Byte* src, int count);
+
+	// 32-bit ARGB -> nearest color in clut8 (looked up at 15-bit precision).
+	void ARGBToIndex8Row(Byte* dst, const UInt32* src, int count);
+}
@@ -0,0 +1,136 @@
+#include "Graphics/DamageRects.h"
+#include <algorithm>
+#include <cstdint>
+
+using namespace Pomme::Graphics;
+
+//-----------------------------------------------------------------------------
+// Rect helpers
+
+static inline int64_t Area(const Rect& r)
+{
+	return int64_t(r.right - r.left) * (r.bottom - r.top);
+}
+
+static inline Rect Union(const Rect& a, const Rect& b)
+{
+	return Rect
+	{
+		std::min(a.top, b.top),
+		std::min(a.left, b.left),
+		std::max(a.bottom, b.bottom),
+		std::max(a.right, b.right),
+	};
+}
+
+static inline bool Contains(const Rect& outer, const Rect& inner)
+{
+	return outer.left <= inner.left && outer.top <= inner.top
+		&& outer.right >= inner.right && outer.bottom >= inner.bottom;
+}
+
+// Pixels covered by the union of a and b but by neither a nor b
+static int64_t MergeWaste(const Rect& a, const Rect& b)
+{
+	const int64_t overlapW = std::min(a.right, b.right) - std::max(a.left, b.left);
+	const int64_t overlapH = std::min(a.bottom, b.bottom) - std::max(a.top, b.top);
+	const int64_t overlap = (overlapW > 0 && overlapH > 0) ? overlapW * overlapH : 0;
+	return Area(Union(a, b)) - (Area(a) + Area(b) - overlap);
+}
+
+// Merges the two rects whose union wastes the fewest pixels. Returns the new count.
+static int MergeCheapestPair(Rect* rects, int count)
+{
+	int bestI = 0;
+	int bestJ = 1;
+	int64_t bestWaste = INT64_MAX;
+
+	for (int i = 0; i < count; i++)
+	{
+		for (int j = i + 1; j < count; j++)
+		{
+			int64_t waste = MergeWaste(rects[i], rects[j]);
+			if (waste < bestWaste)
+			{
+				bestWaste = waste;
+				bestI = i;
+				bestJ = j;
+			}
+		}
+	}
+
+	rects[bestI] = Union(rects[bestI], rects[bestJ]);
+	rects[bestJ] = rects[count - 1];
+	return count - 1;
+}
+
+//-----------------------------------------------------------------------------
+// DamageRects
+
+DamageRects::DamageRects()
+	: rects{}
+	, count(0)
+{
+}
+
+void DamageRects::Clear()
+{
+	count = 0;
+}
+
+void DamageRects::Add(const Rect& newRect)
+{
+	if (newRect.left >= newRect.right || newRect.top >= newRect.bottom)
+		return;
+
+	Rect r = newRect;
+
+	// Fold r into existing rects for as long as that's cheap. A merged rect may
+	// have grown over other rects, so keep going until nothing changes.
+	for (bool merged = true; merged; )
+	{
+		merged = false;
+		for (int i = 0; i < count; i++)
+		{
+			if (Contains(rects[i], r))
+				return;
+
+			if (Contains(r, rects[i]) || MergeWaste(rects[i], r) <= kRectOverhead)
+			{
+				r = Union(rects[i], r);
+				rects[i] = rects[--count];
+				merged = true;
+				break;
+			}
+		}
+	}
+
+	if (count == kMaxRects)
+		count = MergeCheapestPair(rects, count);
+
+	rects[count++] = r;
+}
+
+Rect DamageRects::GetBounds() const
+{
+	Rect bounds = rects[0];
+	for (int i = 1; i < count; i++)
+		bounds = Union(bounds, rects[i]);
+	return bounds;
+}
+
+int DamageRects::CopyTo(Rect* out, int maxRects) const
+{
+	if (maxRects <= 0 || count == 0)
+		return 0;
+
+	Rect merged[kMaxRects];
+	std::copy(rects, rects + count, merged);
+
+	int n = count;
+	while (n > maxRects)
+		n = MergeCheapestPair(merged, n);
+
+	std::copy(merged, merged + n, out);
+	return n;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "PommeTypes.h"
+
+namespace Pomme::Graphics
+{
+	// Damaged area of a port, kept as a few rects instead of one bounding box,
+	// so that two small changes in opposite corners don't damage the whole port.
+	//
+	// Rects are merged when that costs little: each rect is assumed to cost as
+	// much as kRectOverhead pixels on top of its area (per-rect setup in the
+	// presenter), and two rects are merged whenever their union wastes fewer
+	// pixels than that. Once kMaxRects is reached, the cheapest pair is merged.
+	class DamageRects
+	{
+	public:
+		static constexpr int kMaxRects = 8;
+		static constexpr int kRectOverhead = 32 * 32;
+
+		DamageRects();
+
+		void Add(const Rect& r);
+
+		void Clear();
+
+		bool IsEmpty() const
+		{ return count == 0; }
+
+		int Count() const
+		{ return count; }
+
+		const Rect* begin() const
+		{ return rects; }
+
+		const Rect* end() const
+		{ return rects + count; }
+
+		// Bounding box of all the rects. Only valid if !IsEmpty().
+		Rect GetBounds() const;
+
+		// Copies the rects to `out`, merging them down to at most `maxRects` rects
+		// if needed. Returns the number of rects written.
+		int CopyTo(Rect* out, int maxRects) const;
+
+	private:
+		Rect rects[kMaxRects];
+		int count;
+	};
+}
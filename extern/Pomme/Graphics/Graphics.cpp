@@ -2,12 +2,23 @@
 #include "PommeFiles.h"
 #include "PommeGraphics.h"
 #include "PommeMemory.h"
+#include "Graphics/BackgroundJob.h"
+#include "Graphics/BandWorkers.h"
+#include "Graphics/BlitKernels.h"
+#include "Graphics/DamageRects.h"
+#include "Graphics/SpanRegion.h"
 #include "SysFont.h"
 #include "Utilities/memstream.h"
 
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <numeric>
+#include <string>
+#include <tuple>
 #include <cstring>
+#include <climits>
 #include <cmath>
 
 using namespace Pomme;
@@ -25,43 +36,194 @@ static bool IntersectRects(const Rect* r1, Rect* r2)
 // ---------------------------------------------------------------------------- -
 // Types
 
+// Converts a native ARGB color to the raw big-endian layout of pixmaps
+static inline UInt32 ToRawARGB(UInt32 nativeARGB)
+{
+	return PackU32BE(&nativeARGB);
+}
+
 struct GrafPortImpl
 {
+	static inline UInt64 nextSerial = 1;
+
 	GrafPort port;
-	ARGBPixmap pixels;
-	bool dirty;
-	Rect dirtyRect;
+	UInt64 serial;				// unique for the lifetime of the process, unlike `this`
+	UInt32 generation;			// bumped whenever the pixels may have changed
+	short depth;
+	ARGBPixmap pixels;			// depth 32
+	PackedPixmap packed;		// depths 1, 8, 16
+	DamageRects damage;			// in port coordinates
+	SpanRegion clipRgn;			// as set by SetClip, in port coordinates
+	SpanRegion drawableRgn;		// clipRgn clipped to portRect: where drawing may land
 	PixMap macpm;
 	PixMap* macpmPtr;
 
-	GrafPortImpl(const Rect boundsRect)
+	GrafPortImpl(const Rect boundsRect, short depth = 32, bool rgb565 = false)
 		: port({boundsRect, this})
-		, pixels(boundsRect.right - boundsRect.left, boundsRect.bottom - boundsRect.top)
-		, dirty(false)
+		, serial(nextSerial++)
+		, generation(0)
+		, depth(depth)
+		, pixels(depth == 32 ? ARGBPixmap(Width(boundsRect), Height(boundsRect)) : ARGBPixmap())
+		, packed(depth == 32 ? PackedPixmap() : PackedPixmap(depth, Width(boundsRect), Height(boundsRect), rgb565))
+		, clipRgn(Rect{-32768, -32768, 32767, 32767})		// QuickDraw's default: wide open
+		, drawableRgn(boundsRect)
 	{
 		macpm = {};
 		macpm.bounds = boundsRect;
-		macpm.pixelSize = 32;
-		macpm.rowBytes = (pixels.width * macpm.pixelSize / 8) | (1 << 15);		// bit 15 = 1: structure is PixMap, not BitMap
-		macpm._impl = (Ptr) &pixels;
+		macpm.pixelSize = depth;
+		macpm.rowBytes = GetRowBytes() | (1 << 15);		// bit 15 = 1: structure is PixMap, not BitMap
+		macpm._impl = (Ptr) this;
 		macpmPtr = &macpm;
 	}
 
-	void DamageRegion(const Rect& r)
+	bool IsPacked() const
+	{
+		return depth != 32;
+	}
+
+	int GetRowBytes() const
+	{
+		return IsPacked() ? packed.rowBytes : pixels.width * 4;
+	}
+
+	Byte* GetBaseAddr()
+	{
+		return IsPacked() ? packed.data.data() : pixels.data.data();
+	}
+
+	size_t GetStorageSize() const
+	{
+		return IsPacked() ? packed.data.size() : pixels.data.size();
+	}
+
+	bool HasSameFormat(const GrafPortImpl& other) const
+	{
+		return depth == other.depth && packed.rgb565 == other.packed.rgb565;
+	}
+
+	// Converts raw ARGB pixels to this port's 8- or 16-bit format.
+	void PackARGB(Byte* dst, const UInt32* src, int count) const
 	{
-		if (!dirty)
+		switch (depth)
 		{
-			dirtyRect = r;
+			case 16:
+				(packed.rgb565 ? Blit::GetKernels().argbToRGB565Row : Blit::GetKernels().argbToRGB555Row)(dst, src, count);
+				break;
+			case 8:
+				Blit::ARGBToIndex8Row(dst, src, count);
+				break;
+			default:
+				throw std::logic_error("PackARGB: bad depth");
 		}
-		else
+	}
+
+	// Returns `count` pixels starting at (x, y) as raw ARGB.
+	// 32-bit ports return a pointer straight into the pixmap; other depths are
+	// converted into `scratch`. 1-bit pixels become `black` or `white`.
+	UInt32* ReadARGB(int x, int y, int count, UInt32* scratch,
+		UInt32 black = ToRawARGB(0xFF'00'00'00), UInt32 white = 0xFF'FF'FF'FF)
+	{
+		switch (depth)
+		{
+			case 32:
+				return pixels.GetPtr(x, y);
+			case 16:
+				(packed.rgb565 ? Blit::GetKernels().rgb565ToARGBRow : Blit::GetKernels().rgb555ToARGBRow)(scratch, packed.GetPtr(x, y), count);
+				return scratch;
+			case 8:
+				Blit::Index8ToARGBRow(scratch, packed.GetPtr(x, y), count);
+				return scratch;
+			case 1:
+				Blit::ExpandBitRow(scratch, packed.GetRow(y), x, count, black, white);
+				return scratch;
+			default:
+				throw std::logic_error("ReadARGB: bad depth");
+		}
+	}
+
+	// Stores `count` raw ARGB pixels at (x, y), converting them to the port's depth.
+	// `src` may be the pointer returned by ReadARGB.
+	void WriteARGB(int x, int y, int count, const UInt32* src)
+	{
+		switch (depth)
+		{
+			case 32:
+			{
+				UInt32* dst = pixels.GetPtr(x, y);
+				if (dst != src)
+					memmove(dst, src, count * sizeof(UInt32));
+				break;
+			}
+			case 16:
+			case 8:
+				PackARGB(packed.GetPtr(x, y), src, count);
+				break;
+			case 1:
+				Blit::ThresholdRow(packed.GetRow(y), x, src, count);
+				break;
+			default:
+				throw std::logic_error("WriteARGB: bad depth");
+		}
+	}
+
+	// Fills a rect, in pixmap coordinates, with a raw ARGB color.
+	void Fill(int left, int top, int right, int bottom, UInt32 color)
+	{
+		const int w = right - left;
+
+		switch (depth)
+		{
+			case 32:
+			{
+				const auto fillRow = Blit::GetKernels().fillRow;
+				for (int y = top; y < bottom; y++)
+					fillRow(pixels.GetPtr(left, y), w, color);
+				break;
+			}
+
+			case 16:
+			{
+				Byte px[2];
+				PackARGB(px, &color, 1);
+				for (int y = top; y < bottom; y++)
+				{
+					Byte* dst = packed.GetPtr(left, y);
+					for (int x = 0; x < w; x++)
+					{
+						dst[2 * x + 0] = px[0];
+						dst[2 * x + 1] = px[1];
+					}
+				}
+				break;
+			}
+
+			case 8:
+			{
+				Byte index;
+				PackARGB(&index, &color, 1);
+				for (int y = top; y < bottom; y++)
+					memset(packed.GetPtr(left, y), index, w);
+				break;
+			}
+
+			case 1:
+			{
+				Byte bits[8] = {};
+				Blit::ThresholdRow(bits, 0, &color, 1);
+				packed.FillBits(left, top, right, bottom, bits[0] != 0);
+				break;
+			}
+		}
+	}
+
+	void DamageRegion(const Rect& r)
+	{
+		Rect clipped = r;
+		if (IntersectRects(&port.portRect, &clipped))
 		{
-			// Already dirty, expand existing dirty rect
-			dirtyRect.top    = std::min(dirtyRect.top,    r.top);
-			dirtyRect.left   = std::min(dirtyRect.left,   r.left);
-			dirtyRect.bottom = std::max(dirtyRect.bottom, r.bottom);
-			dirtyRect.right  = std::max(dirtyRect.right,  r.right);
+			damage.Add(clipped);
+			generation++;
 		}
-		dirty = true;
 	}
 
 	void DamageRegion(SInt16 x, SInt16 y, SInt16 w, SInt16 h)
@@ -70,6 +232,12 @@ struct GrafPortImpl
 		DamageRegion(r);
 	}
 
+	void SetClipRegion(const SpanRegion& rgn)
+	{
+		clipRgn = rgn;
+		drawableRgn = SpanRegion::Intersect(rgn, SpanRegion(port.portRect));
+	}
+
 	~GrafPortImpl()
 	{
 		macpm._impl = nullptr;
@@ -86,6 +254,10 @@ static GrafPortImpl* curPort = nullptr;
 static UInt32 penFG = 0xFF'FF'00'FF;
 static UInt32 penBG = 0xFF'00'00'FF;
 
+// OpColor for the arithmetic transfer modes, as native ARGB
+static UInt32 opColor = 0xFF'00'00'00;
+static bool opColorSet = false;
+
 static int penX = 0;
 static int penY = 0;
 
@@ -253,671 +425,2528 @@ Boolean EmptyRect(const Rect* r)
 }
 
 // ---------------------------------------------------------------------------- -
-// GWorld
+// Regions
 
-static inline GrafPortImpl& GetImpl(GWorldPtr offscreenGWorld)
+struct RegionImpl
 {
-	return *(GrafPortImpl*) offscreenGWorld->_impl;
-}
+	Region rgn;
+	RgnPtr rgnPtr;
+	SpanRegion spans;
+
+	RegionImpl()
+	{
+		rgn = {};
+		rgn.rgnSize = 10;
+		rgn._impl = this;
+		rgnPtr = &rgn;
+	}
+
+	// Refreshes the public fields after the spans have changed
+	void Sync()
+	{
+		rgn.rgnBBox = spans.GetBounds();
+		rgn.rgnSize = (SInt16) (spans.IsEmpty() || spans.IsRect()
+			? 10
+			: std::min(10 + 4 * spans.BandCount() + 4 * spans.SpanCount(), 0x7FFF));
+	}
+};
 
-static inline ARGBPixmap& GetImpl(PixMapPtr pixMap)
+static inline SpanRegion& GetSpans(RgnHandle rgn)
 {
-	return *(ARGBPixmap*) pixMap->_impl;
+	return ((RegionImpl*) (**rgn)._impl)->spans;
 }
 
-OSErr NewGWorld(GWorldPtr* offscreenGWorld, short pixelDepth, const Rect* boundsRect, void* junk1, void* junk2, long junk3)
+static void SetSpans(RgnHandle rgn, SpanRegion spans)
 {
-	(void) pixelDepth;
-	(void) junk1;
-	(void) junk2;
-	(void) junk3;
-
-	GrafPortImpl* impl = new GrafPortImpl(*boundsRect);
-	*offscreenGWorld = &impl->port;
-	return noErr;
+	auto& impl = *(RegionImpl*) (**rgn)._impl;
+	impl.spans = std::move(spans);
+	impl.Sync();
 }
 
-void DisposeGWorld(GWorldPtr offscreenGWorld)
+RgnHandle NewRgn(void)
 {
-	delete &GetImpl(offscreenGWorld);
+	return &(new RegionImpl)->rgnPtr;
 }
 
-void GetGWorld(CGrafPtr* port, GDHandle* gdh)
+void DisposeRgn(RgnHandle rgn)
 {
-	*port = &curPort->port;
-	*gdh = nil;
+	delete (RegionImpl*) (**rgn)._impl;
 }
 
-void SetGWorld(CGrafPtr port, GDHandle gdh)
+void CopyRgn(RgnHandle srcRgn, RgnHandle dstRgn)
 {
-	(void) gdh;
-	SetPort(port);
+	SetSpans(dstRgn, GetSpans(srcRgn));
 }
 
-PixMapHandle GetGWorldPixMap(GWorldPtr offscreenGWorld)
+void SetEmptyRgn(RgnHandle rgn)
 {
-	return &GetImpl(offscreenGWorld).macpmPtr;
+	SetSpans(rgn, SpanRegion());
 }
 
-Ptr GetPixBaseAddr(PixMapHandle pm)
+void SetRectRgn(RgnHandle rgn, short left, short top, short right, short bottom)
 {
-	return (Ptr) GetImpl(*pm).data.data();
+	Rect r;
+	SetRect(&r, left, top, right, bottom);
+	SetSpans(rgn, SpanRegion(r));
 }
 
-Boolean GetPixel(short h, short v)
+void RectRgn(RgnHandle rgn, const Rect* r)
 {
-	// GetPixel returns true if the pixel at (h,v) in the current port is black.
-	// For color ports, we check if the pixel is "dark" (not the background color).
-	if (!curPort)
-		return false;
-
-	auto offx = curPort->port.portRect.left;
-	auto offy = curPort->port.portRect.top;
-
-	int x = h - offx;
-	int y = v - offy;
-
-	// Bounds check
-	if (x < 0 || x >= curPort->pixels.width || y < 0 || y >= curPort->pixels.height)
-		return false;
-
-	UInt32* pixel = curPort->pixels.GetPtr(x, y);
-	UInt32 pixelValue = *pixel;
-
-	// In the original QuickDraw, GetPixel returns true if the pixel is black.
-	// For our ARGB implementation, check if it's not the background color.
-	// A simple approach: if not white (0xFFFFFFFF in big-endian ARGB), return true.
-	// More accurately, compare against penBG.
-	UInt32 bgColor = penBG;
-#if !(__BIG_ENDIAN__)
-	ByteswapInts(sizeof(bgColor), 1, &bgColor);
-#endif
-
-	return pixelValue != bgColor;
+	SetSpans(rgn, SpanRegion(*r));
 }
 
-// ---------------------------------------------------------------------------- -
-// Port
-
-void SetPort(GrafPtr port)
+void OffsetRgn(RgnHandle rgn, short dh, short dv)
 {
-	curPort = &GetImpl(port);
+	SpanRegion spans = GetSpans(rgn);
+	spans.Offset(dh, dv);
+	SetSpans(rgn, std::move(spans));
 }
 
-void GetPort(GrafPtr* outPort)
+void SectRgn(RgnHandle srcRgnA, RgnHandle srcRgnB, RgnHandle dstRgn)
 {
-	*outPort = &curPort->port;
+	SetSpans(dstRgn, SpanRegion::Intersect(GetSpans(srcRgnA), GetSpans(srcRgnB)));
 }
 
-Boolean IsPortDamaged(void)
+void UnionRgn(RgnHandle srcRgnA, RgnHandle srcRgnB, RgnHandle dstRgn)
 {
-	return curPort->dirty;
+	SetSpans(dstRgn, SpanRegion::Union(GetSpans(srcRgnA), GetSpans(srcRgnB)));
 }
 
-void GetPortDamageRegion(Rect* r)
+void DiffRgn(RgnHandle srcRgnA, RgnHandle srcRgnB, RgnHandle dstRgn)
 {
-	*r = curPort->dirtyRect;
+	SetSpans(dstRgn, SpanRegion::Difference(GetSpans(srcRgnA), GetSpans(srcRgnB)));
 }
 
-void ClearPortDamage(void)
+void XorRgn(RgnHandle srcRgnA, RgnHandle srcRgnB, RgnHandle dstRgn)
 {
-	curPort->dirty = false;
+	SetSpans(dstRgn, SpanRegion::Xor(GetSpans(srcRgnA), GetSpans(srcRgnB)));
 }
 
-void DamagePortRegion(const Rect* r)
+Boolean EmptyRgn(RgnHandle rgn)
 {
-	curPort->DamageRegion(*r);
+	return GetSpans(rgn).IsEmpty();
 }
 
-CGrafPtr GetWindowPort(WindowPtr window)
+Boolean EqualRgn(RgnHandle rgnA, RgnHandle rgnB)
 {
-	return window;
+	return GetSpans(rgnA) == GetSpans(rgnB);
 }
 
-PixMap* GetPortBitMapForCopyBits(CGrafPtr window)
+Boolean PtInRgn(Point pt, RgnHandle rgn)
 {
-	// Returns a pointer that can be used with CopyBits.
-	// Internally it's a PixMap but we return BitMap* for API compatibility.
-	return (PixMap*) GetImpl(window).macpmPtr;
+	return GetSpans(rgn).Contains(pt.h, pt.v);
 }
 
-Rect* GetPortBounds(CGrafPtr port, Rect* rect)
+Boolean RectInRgn(const Rect* r, RgnHandle rgn)
 {
-	*rect = port->portRect;
-	return rect;
+	bool overlaps = false;
+	GetSpans(rgn).ForEachRect(*r, [&](const Rect&) { overlaps = true; });
+	return overlaps;
 }
 
-void DumpPortTGA(const char* outPath)
+Rect* GetRegionBounds(RgnHandle rgn, Rect* bounds)
 {
-	curPort->pixels.WriteTGA(outPath);
+	*bounds = GetSpans(rgn).GetBounds();
+	return bounds;
 }
 
 // ---------------------------------------------------------------------------- -
-// Pen state manipulation
+// Compiled sprites
+
+// A source/mask pair preprocessed for CopyMask to ports of a given format.
+// For every row, it holds the runs of pixels where the mask is black, and the
+// source pixels of those runs, already in the destination's format, packed back
+// to back. Drawing a row then takes one memcpy per run, and the mask isn't
+// looked at again.
+//
+// A pair is only compiled the second time it's drawn unchanged, so that masks
+// that are drawn once and then modified don't pay for compiling.
+struct CompiledSprite
+{
+	struct Run
+	{
+		SInt16 left;		// [left, right) in source pixmap coordinates
+		SInt16 right;
+		UInt32 firstByte;	// offset of the run's first pixel in `pixels`
+	};
+
+	UInt32 srcGeneration;
+	UInt32 maskGeneration;
+	bool compiled;
+	int width;
+	int height;
+	int bytesPerPixel;
+	std::vector<UInt32> rowRuns;	// the runs of row y are runs[rowRuns[y]] to runs[rowRuns[y + 1] - 1]
+	std::vector<Run> runs;
+	std::vector<Byte> pixels;
+
+	// Converts the source pixels the same way as CopyMask does with a 1-bit mask
+	void Compile(GrafPortImpl& src, GrafPortImpl& mask, const GrafPortImpl& dst)
+	{
+		width  = std::min(Width(src.port.portRect),  Width(mask.port.portRect));
+		height = std::min(Height(src.port.portRect), Height(mask.port.portRect));
+		bytesPerPixel = dst.depth >> 3;
 
-void MoveTo(short h, short v)
-{
-	penX = h;
-	penY = v;
-}
+		rowRuns.clear();
+		runs.clear();
+		pixels.clear();
+		rowRuns.reserve(height + 1);
 
-void ForeColor(long color)
-{
-	penFG = GetEightColorPaletteValue(color);
-}
+		std::vector<UInt32> scratch(2 * width);
+		std::vector<Byte> packedScratch(width * bytesPerPixel);
+		std::vector<bool> black(width);
 
-void BackColor(long color)
-{
-	penBG = GetEightColorPaletteValue(color);
-}
+		for (int y = 0; y < height; y++)
+		{
+			rowRuns.push_back((UInt32) runs.size());
 
-void GetForeColor(RGBColor* rgb)
-{
-	rgb->red = (penFG >> 16 & 0xFF) << 8;
-	rgb->green = (penFG >> 8 & 0xFF) << 8;
-	rgb->blue = (penFG & 0xFF) << 8;
-}
+			// A set bit in 1-bit masks, or a pixel with any RGB component below 128 in deeper ones
+			if (mask.depth == 1)
+			{
+				for (int x = 0; x < width; x++)
+					black[x] = mask.packed.GetBit(x, y);
+			}
+			else
+			{
+				const Byte* m = (const Byte*) mask.ReadARGB(0, y, width, scratch.data() + width);
+				for (int x = 0; x < width; x++, m += 4)
+					black[x] = !(m[1] & m[2] & m[3] & 0x80);
+			}
 
-void RGBBackColor(const RGBColor* color)
-{
-	penBG
-		= 0xFF'00'00'00
-		| ((color->red >> 8) << 16)
-		| ((color->green >> 8) << 8)
-		| (color->blue >> 8)
-		;
-}
+			const Byte* s = nullptr;
+			for (int x = 0; x < width; )
+			{
+				if (!black[x])
+				{
+					x++;
+					continue;
+				}
 
-void RGBForeColor(const RGBColor* color)
-{
-	penFG
-		= 0xFF'00'00'00
-		| ((color->red >> 8) << 16)
-		| ((color->green >> 8) << 8)
-		| (color->blue >> 8)
-		;
-}
+				int end = x;
+				while (end < width && black[end])
+					end++;
 
-void RGBBackColor2(const UInt32 color)
-{
-	penBG = 0xFF000000 | (color & 0x00FFFFFF);
-}
+				if (!s)
+				{
+					if (dst.depth == 32 || !src.HasSameFormat(dst))
+					{
+						s = (const Byte*) src.ReadARGB(0, y, width, scratch.data());
+						if (dst.depth != 32)
+						{
+							dst.PackARGB(packedScratch.data(), (const UInt32*) s, width);
+							s = packedScratch.data();
+						}
+					}
+					else
+					{
+						s = src.packed.GetRow(y);
+					}
+				}
 
-void RGBForeColor2(const UInt32 color)
-{
-	penFG = 0xFF000000 | (color & 0x00FFFFFF);
-}
+				runs.push_back({(SInt16) x, (SInt16) end, (UInt32) pixels.size()});
+				pixels.insert(pixels.end(), s + x * bytesPerPixel, s + end * bytesPerPixel);
+				x = end;
+			}
+		}
 
-void PenNormal(void)
+		rowRuns.push_back((UInt32) runs.size());
+		compiled = true;
+	}
+};
+
+static constexpr size_t kMaxCompiledSprites = 256;
+
+// Keyed by source serial, mask serial, and destination format
+static std::map<std::tuple<UInt64, UInt64, int>, CompiledSprite> compiledSprites;
+
+// Returns the compiled version of a source/mask pair for drawing to `dst`, or
+// nullptr if it's not worth compiling (yet). 1-bit sources aren't compiled,
+// since their colors depend on the pen colors at the time of drawing, and
+// neither are 1-bit destinations.
+static const CompiledSprite* GetCompiledSprite(GrafPortImpl& src, GrafPortImpl& mask, const GrafPortImpl& dst)
 {
-	TODOMINOR();
+	if (src.depth == 1 || dst.depth == 1)
+		return nullptr;
+
+	const auto key = std::make_tuple(src.serial, mask.serial, dst.depth | (dst.packed.rgb565 << 8));
+	auto it = compiledSprites.find(key);
+
+	if (it == compiledSprites.end()
+		|| it->second.srcGeneration != src.generation
+		|| it->second.maskGeneration != mask.generation)
+	{
+		// First time we see the pair in this state: remember it, but draw it the slow way
+		if (compiledSprites.size() >= kMaxCompiledSprites)
+			compiledSprites.clear();
+
+		CompiledSprite& sprite = compiledSprites[key];
+		sprite = {};
+		sprite.srcGeneration = src.generation;
+		sprite.maskGeneration = mask.generation;
+		return nullptr;
+	}
+
+	CompiledSprite& sprite = it->second;
+	if (!sprite.compiled)
+		sprite.Compile(src, mask, dst);
+	return &sprite;
 }
 
-void PenSize(short width, short height)
+// Drops the compiled sprites that use a port that's going away
+static void ForgetCompiledSprites(const GrafPortImpl& port)
 {
-	(void) width;
-	(void) height;
-	TODOMINOR();
+	for (auto it = compiledSprites.begin(); it != compiledSprites.end(); )
+	{
+		if (std::get<0>(it->first) == port.serial || std::get<1>(it->first) == port.serial)
+			it = compiledSprites.erase(it);
+		else
+			++it;
+	}
 }
 
 // ---------------------------------------------------------------------------- -
-// Paint
+// Static layers
 
-static void _FillRect(const int left, const int top, const int right, const int bottom, UInt32 fillColor)
+// A GWorld holding the result of a sequence of draws, which are only redone
+// when the layer is invalidated or when one of the GWorlds they read from
+// changes. While a layer is being redrawn, the ports that CopyBits and
+// CopyMask read into it are recorded; their generations are noted when the
+// layer is finished, and compared whenever the layer is about to be reused.
+struct StaticLayer
 {
-	if (!curPort)
+	struct Source
 	{
-		throw std::runtime_error("_FillRect: no port set");
-	}
+		const GrafPortImpl* port;
+		UInt32 generation;
+	};
+
+	GWorldPtr gworld;
+	bool valid;
+	std::vector<Source> sources;
+	CGrafPtr savedPort;
+	GDHandle savedDevice;
+};
 
-	Rect dstRect;
-	dstRect.left   = left;
-	dstRect.top    = top;
-	dstRect.right  = right;
-	dstRect.bottom = bottom;
-	Rect clippedDstRect = dstRect;
-	if (!IntersectRects(&curPort->port.portRect, &clippedDstRect))
-	{
-		return;
-	}
-	curPort->DamageRegion(clippedDstRect);
+static std::vector<StaticLayer*> staticLayers;
 
-	fillColor = PackU32BE(&fillColor);		// convert to big-endian
+// The layer between BeginStaticLayer and EndStaticLayer, if any
+static StaticLayer* recordingLayer = nullptr;
+
+// Records `src` as a source of the layer being redrawn, if `dst` is that layer
+static void NoteLayerSource(const GrafPortImpl& dst, const GrafPortImpl& src)
+{
+	if (!recordingLayer || &dst != (const GrafPortImpl*) recordingLayer->gworld->_impl || &src == &dst)
+		return;
 
-	UInt32* dst = curPort->pixels.GetPtr(clippedDstRect.left, clippedDstRect.top);
+	auto& sources = recordingLayer->sources;
+	if (std::none_of(sources.begin(), sources.end(), [&](const auto& s) { return s.port == &src; }))
+		sources.push_back({&src, 0});
+}
 
-	for (int y = clippedDstRect.top; y < clippedDstRect.bottom; y++)
+// Invalidates the layers that read from a port that's going away
+static void ForgetLayerSources(const GrafPortImpl& port)
+{
+	for (StaticLayer* layer : staticLayers)
 	{
-		for (int x = 0; x < clippedDstRect.right - clippedDstRect.left; x++)
+		auto& sources = layer->sources;
+		auto gone = std::remove_if(sources.begin(), sources.end(), [&](const auto& s) { return s.port == &port; });
+		if (gone != sources.end())
 		{
-			dst[x] = fillColor;
+			sources.erase(gone, sources.end());
+			layer->valid = false;
 		}
-		dst += curPort->pixels.width;
 	}
 }
 
-void PaintRect(const struct Rect* r)
+// ---------------------------------------------------------------------------- -
+// Presenters
+
+// Converts ports into two caller-owned buffers in turn: the front buffer holds
+// the latest finished frame, while the back buffer is converted into on a
+// background thread. Each buffer keeps track of the areas where it's behind the
+// port, so that only those are converted.
+struct Presenter
 {
-	_FillRect(r->left, r->top, r->right, r->bottom, penFG);
-}
+	struct Buffer
+	{
+		Byte* pixels;
+		DamageRects stale;		// in pixmap coordinates
+	};
+
+	int width;
+	int height;
+	long rowBytes;
+	Blit::SwizzleRowFunc swizzleRow;
+	Buffer buffers[2];
+	int front;					// index of the buffer that GetPresentedFrame returns
+	bool hasFrame;				// false until the first conversion is done
+	GrafPortImpl* port;			// being converted, or last converted
+	UInt64 portSerial;			// of the port last presented, 0 if none
+	bool converting;
+	BackgroundJob job;
+};
 
-void EraseRect(const struct Rect* r)
+static std::vector<Presenter*> presenters;
+
+// Waits for the presenter's conversion, if any, and makes its result the front buffer
+static void FinishPresent(Presenter& presenter)
 {
-	_FillRect(r->left, r->top, r->right, r->bottom, penBG);
+	if (!presenter.converting)
+		return;
+
+	presenter.job.Wait();
+	presenter.front ^= 1;
+	presenter.hasFrame = true;
+	presenter.converting = false;
 }
 
-void LineTo(short x1, short y1)
+// Must be called before anything writes to the pixels of `port`, as they may be
+// being converted on another thread
+static void FinishPresentsFrom(const GrafPortImpl& port)
 {
-	UInt32 color = PackU32BE(&penFG);
+	for (Presenter* presenter : presenters)
+	{
+		if (presenter->converting && presenter->port == &port)
+			FinishPresent(*presenter);
+	}
+}
 
-	auto offx = curPort->port.portRect.left;
+// ---------------------------------------------------------------------------- -
+// Banded frames
+
+// A draw recorded between BeginBandedFrame and EndBandedFrame. Everything it
+// depends on besides the pixels is captured when it's recorded, so that it can
+// be replayed later, one band of rows at a time.
+struct BandedOp
+{
+	enum Kind { kFill, kCopyBits, kCopyMask };
+
+	Kind kind;
+	Rect dstRect;				// in port coordinates, not clipped yet
+	UInt32 color;				// kFill: raw fill color
+	short mode;					// kCopyBits: transfer mode
+	GrafPortImpl* src;			// kCopyBits, kCopyMask
+	GrafPortImpl* mask;			// kCopyMask
+	int srcLeft;				// top-left of the source rect, in source pixmap coordinates
+	int srcTop;
+	int maskLeft;				// top-left of the mask rect, in mask pixmap coordinates
+	int maskTop;
+	UInt32 black;				// kCopyMask: colors that 1-bit sources expand to
+	UInt32 white;
+	const CompiledSprite* compiled;	// kCopyMask: looked up just before replaying
+};
+
+// The port of the frame between BeginBandedFrame and EndBandedFrame, if its
+// draws are being recorded. Draws are only recorded with several threads.
+static GrafPortImpl* bandedPort = nullptr;
+static bool bandedFrameOpen = false;
+
+// Draws recorded since the frame began or was last replayed, and the ports they read from
+static std::vector<BandedOp> bandedOps;
+static std::vector<const GrafPortImpl*> bandedSources;
+
+static void ReplayBandedOps();
+
+static void RecordBandedOp(const BandedOp& op)
+{
+	for (const GrafPortImpl* port : {op.src, op.mask})
+	{
+		if (port && std::find(bandedSources.begin(), bandedSources.end(), port) == bandedSources.end())
+			bandedSources.push_back(port);
+	}
+
+	bandedOps.push_back(op);
+}
+
+// Must be called before anything reads the pixels of `port` without being recorded
+static void SettleForRead(const GrafPortImpl& port)
+{
+	if (&port == bandedPort && !bandedOps.empty())
+		ReplayBandedOps();
+}
+
+// Must be called before anything writes to the pixels of `port` without being
+// recorded: the recorded draws must land first, and read their sources as they are
+static void SettleForWrite(const GrafPortImpl& port)
+{
+	FinishPresentsFrom(port);
+
+	if (bandedOps.empty())
+		return;
+
+	if (&port == bandedPort
+		|| std::find(bandedSources.begin(), bandedSources.end(), &port) != bandedSources.end())
+	{
+		ReplayBandedOps();
+	}
+}
+
+// ---------------------------------------------------------------------------- -
+// GWorld
+
+static inline GrafPortImpl& GetImpl(GWorldPtr offscreenGWorld)
+{
+	return *(GrafPortImpl*) offscreenGWorld->_impl;
+}
+
+static inline GrafPortImpl& GetImpl(PixMapPtr pixMap)
+{
+	return *(GrafPortImpl*) pixMap->_impl;
+}
+
+OSErr NewGWorld(GWorldPtr* offscreenGWorld, short pixelDepth, const Rect* boundsRect, void* junk1, void* junk2, long junk3)
+{
+	(void) junk1;
+	(void) junk2;
+
+	short depth = 32;
+	if (pixelDepth == 1 || pixelDepth == 8 || pixelDepth == 16)
+		depth = pixelDepth;
+
+	GrafPortImpl* impl = new GrafPortImpl(*boundsRect, depth, junk3 & pommeRGB565GWorld);
+	Pomme::Memory::AccountGWorldPixels(impl->GetStorageSize());
+	*offscreenGWorld = &impl->port;
+	return noErr;
+}
+
+void DisposeGWorld(GWorldPtr offscreenGWorld)
+{
+	GrafPortImpl& impl = GetImpl(offscreenGWorld);
+	SettleForWrite(impl);
+	if (&impl == bandedPort)
+		bandedPort = nullptr;		// the rest of the frame is drawn right away
+
+	Pomme::Memory::AccountGWorldPixels(-(ptrdiff_t) impl.GetStorageSize());
+	ForgetCompiledSprites(impl);
+	ForgetLayerSources(impl);
+	delete &impl;
+}
+
+void GetGWorld(CGrafPtr* port, GDHandle* gdh)
+{
+	*port = &curPort->port;
+	*gdh = nil;
+}
+
+void SetGWorld(CGrafPtr port, GDHandle gdh)
+{
+	(void) gdh;
+	SetPort(port);
+}
+
+PixMapHandle GetGWorldPixMap(GWorldPtr offscreenGWorld)
+{
+	return &GetImpl(offscreenGWorld).macpmPtr;
+}
+
+Ptr GetPixBaseAddr(PixMapHandle pm)
+{
+	// The caller may write to the pixels behind our back
+	auto& impl = GetImpl(*pm);
+	SettleForWrite(impl);
+	impl.generation++;
+	return (Ptr) impl.GetBaseAddr();
+}
+
+const char* GetPixBaseAddrForReading(PixMapHandle pm)
+{
+	// Recorded draws into the port must land first, but nothing goes stale
+	auto& impl = GetImpl(*pm);
+	SettleForRead(impl);
+	return (const char*) impl.GetBaseAddr();
+}
+
+Boolean GetPixel(short h, short v)
+{
+	// GetPixel returns true if the pixel at (h,v) in the current port is black.
+	// For color ports, we check if the pixel is "dark" (not the background color).
+	if (!curPort)
+		return false;
+
+	SettleForRead(*curPort);
+
+	auto offx = curPort->port.portRect.left;
 	auto offy = curPort->port.portRect.top;
 
-	int x0 = penX;
-	int y0 = penY;
-	int dx = std::abs(x1 - x0);
-	int sx = x0 < x1 ? 1 : -1;
-	int dy = -std::abs(y1 - y0);
-	int sy = y0 < y1 ? 1 : -1;
-	int err = dx + dy;
-	curPort->DamageRegion(penX, penY, dx, dy);
-	while (1)
+	int x = h - offx;
+	int y = v - offy;
+
+	// Bounds check
+	if (x < 0 || x >= Width(curPort->port.portRect) || y < 0 || y >= Height(curPort->port.portRect))
+		return false;
+
+	if (curPort->depth == 1)
+		return curPort->packed.GetBit(x, y);
+
+	UInt32 scratch;
+	UInt32 pixelValue = *curPort->ReadARGB(x, y, 1, &scratch);
+
+	// In the original QuickDraw, GetPixel returns true if the pixel is black.
+	// For our ARGB implementation, check if it's not the background color.
+	// A simple approach: if not white (0xFFFFFFFF in big-endian ARGB), return true.
+	// More accurately, compare against penBG.
+	UInt32 bgColor = penBG;
+#if !(__BIG_ENDIAN__)
+	ByteswapInts(sizeof(bgColor), 1, &bgColor);
+#endif
+
+	return pixelValue != bgColor;
+}
+
+// ---------------------------------------------------------------------------- -
+// Static layers
+
+OSErr NewStaticLayer(StaticLayerPtr* layer, short pixelDepth, const Rect* boundsRect, long flags)
+{
+	GWorldPtr gworld;
+	OSErr err = NewGWorld(&gworld, pixelDepth, boundsRect, nullptr, nullptr, flags);
+	if (err != noErr)
+		return err;
+
+	*layer = new StaticLayer{gworld, false, {}, nullptr, nullptr};
+	staticLayers.push_back(*layer);
+	return noErr;
+}
+
+void DisposeStaticLayer(StaticLayerPtr layer)
+{
+	if (recordingLayer == layer)
+	{
+		SetGWorld(layer->savedPort, layer->savedDevice);
+		recordingLayer = nullptr;
+	}
+
+	staticLayers.erase(std::remove(staticLayers.begin(), staticLayers.end(), layer), staticLayers.end());
+	DisposeGWorld(layer->gworld);
+	delete layer;
+}
+
+GWorldPtr GetStaticLayerGWorld(StaticLayerPtr layer)
+{
+	return layer->gworld;
+}
+
+void InvalidateStaticLayer(StaticLayerPtr layer)
+{
+	layer->valid = false;
+}
+
+Boolean BeginStaticLayer(StaticLayerPtr layer)
+{
+	if (recordingLayer)
+	{
+		throw std::logic_error("BeginStaticLayer: already redrawing a layer");
+	}
+
+	if (layer->valid
+		&& std::all_of(layer->sources.begin(), layer->sources.end(),
+			[](const auto& s) { return s.port->generation == s.generation; }))
+	{
+		return false;
+	}
+
+	layer->valid = false;
+	layer->sources.clear();
+	GetGWorld(&layer->savedPort, &layer->savedDevice);
+	SetGWorld(layer->gworld, nullptr);
+	recordingLayer = layer;
+	return true;
+}
+
+void EndStaticLayer(StaticLayerPtr layer)
+{
+	if (recordingLayer != layer)
+	{
+		throw std::logic_error("EndStaticLayer: layer isn't being redrawn");
+	}
+
+	// Sources may have been drawn into before being read, so note where they're at now
+	for (auto& source : layer->sources)
+		source.generation = source.port->generation;
+
+	layer->valid = true;
+	recordingLayer = nullptr;
+	SetGWorld(layer->savedPort, layer->savedDevice);
+}
+
+void DrawStaticLayer(StaticLayerPtr layer, const Rect* dstRect)
+{
+	PixMapHandle src = GetGWorldPixMap(layer->gworld);
+	PixMapHandle dst = &curPort->macpmPtr;
+	CopyBits(*src, *dst, &layer->gworld->portRect, dstRect, srcCopy, nullptr);
+}
+
+// ---------------------------------------------------------------------------- -
+// Port
+
+void SetPort(GrafPtr port)
+{
+	curPort = &GetImpl(port);
+}
+
+void GetPort(GrafPtr* outPort)
+{
+	*outPort = &curPort->port;
+}
+
+Boolean IsPortDamaged(void)
+{
+	return !curPort->damage.IsEmpty();
+}
+
+void GetPortDamageRegion(Rect* r)
+{
+	*r = curPort->damage.GetBounds();
+}
+
+short GetPortDamageRects(Rect* rects, short maxRects)
+{
+	return (short) curPort->damage.CopyTo(rects, maxRects);
+}
+
+void ClearPortDamage(void)
+{
+	curPort->damage.Clear();
+}
+
+void DamagePortRegion(const Rect* r)
+{
+	curPort->DamageRegion(*r);
+}
+
+void GetClip(RgnHandle rgn)
+{
+	SetSpans(rgn, curPort->clipRgn);
+}
+
+void SetClip(RgnHandle rgn)
+{
+	// Recorded draws are replayed with the clip region they were recorded with
+	SettleForRead(*curPort);
+	curPort->SetClipRegion(GetSpans(rgn));
+}
+
+void ClipRect(const Rect* r)
+{
+	SettleForRead(*curPort);
+	curPort->SetClipRegion(SpanRegion(*r));
+}
+
+CGrafPtr GetWindowPort(WindowPtr window)
+{
+	return window;
+}
+
+PixMap* GetPortBitMapForCopyBits(CGrafPtr window)
+{
+	// Returns a pointer that can be used with CopyBits.
+	// Internally it's a PixMap but we return BitMap* for API compatibility.
+	return (PixMap*) GetImpl(window).macpmPtr;
+}
+
+Rect* GetPortBounds(CGrafPtr port, Rect* rect)
+{
+	*rect = port->portRect;
+	return rect;
+}
+
+void DumpPortTGA(const char* outPath)
+{
+	SettleForRead(*curPort);
+
+	if (!curPort->IsPacked())
+	{
+		curPort->pixels.WriteTGA(outPath);
+		return;
+	}
+
+	// Packed ports convert straight into the rows of the temporary pixmap
+	ARGBPixmap converted(curPort->packed.width, curPort->packed.height);
+	for (int y = 0; y < converted.height; y++)
+		curPort->ReadARGB(0, y, converted.width, converted.GetPtr(0, y));
+	converted.WriteTGA(outPath);
+}
+
+// ---------------------------------------------------------------------------- -
+// Pen state manipulation
+
+void MoveTo(short h, short v)
+{
+	penX = h;
+	penY = v;
+}
+
+void ForeColor(long color)
+{
+	penFG = GetEightColorPaletteValue(color);
+}
+
+void BackColor(long color)
+{
+	penBG = GetEightColorPaletteValue(color);
+}
+
+void GetForeColor(RGBColor* rgb)
+{
+	rgb->red = (penFG >> 16 & 0xFF) << 8;
+	rgb->green = (penFG >> 8 & 0xFF) << 8;
+	rgb->blue = (penFG & 0xFF) << 8;
+}
+
+void RGBBackColor(const RGBColor* color)
+{
+	penBG
+		= 0xFF'00'00'00
+		| ((color->red >> 8) << 16)
+		| ((color->green >> 8) << 8)
+		| (color->blue >> 8)
+		;
+}
+
+void RGBForeColor(const RGBColor* color)
+{
+	penFG
+		= 0xFF'00'00'00
+		| ((color->red >> 8) << 16)
+		| ((color->green >> 8) << 8)
+		| (color->blue >> 8)
+		;
+}
+
+void RGBBackColor2(const UInt32 color)
+{
+	penBG = 0xFF000000 | (color & 0x00FFFFFF);
+}
+
+void RGBForeColor2(const UInt32 color)
+{
+	penFG = 0xFF000000 | (color & 0x00FFFFFF);
+}
+
+void OpColor(const RGBColor* color)
+{
+	opColor
+		= 0xFF'00'00'00
+		| ((color->red >> 8) << 16)
+		| ((color->green >> 8) << 8)
+		| (color->blue >> 8)
+		;
+	opColorSet = true;
+}
+
+void PenNormal(void)
+{
+	TODOMINOR();
+}
+
+void PenSize(short width, short height)
+{
+	(void) width;
+	(void) height;
+	TODOMINOR();
+}
+
+// ---------------------------------------------------------------------------- -
+// Scaling
+
+// Source positions along one axis of a scaled blit, worked out once per blit
+// with a 16.16 fixed-point stepper. Samples are taken at pixel centers.
+struct ScaleAxis
+{
+	std::vector<int> index;			// Nearest: source pixel. Bilinear: source pixel before the sample.
+	std::vector<UInt16> weight;		// Bilinear only: weight (0-255) of the pixel after `index`
+
+	ScaleAxis(int srcSize, int dstSize, bool bilinear)
+		: index(dstSize)
+		, weight(bilinear ? dstSize : 0)
+	{
+		const int64_t step = ((int64_t) srcSize << 16) / dstSize;
+
+		if (!bilinear)
+		{
+			int64_t pos = step / 2;
+			for (int i = 0; i < dstSize; i++, pos += step)
+				index[i] = std::min(int(pos >> 16), srcSize - 1);
+		}
+		else
+		{
+			// Shift by half a pixel, so that samples fall between source pixel centers
+			int64_t pos = step / 2 - 0x8000;
+			for (int i = 0; i < dstSize; i++, pos += step)
+			{
+				int p = int(std::max<int64_t>(pos, 0) >> 16);
+				int w = pos < 0 ? 0 : int((pos >> 8) & 0xFF);
+				if (p >= srcSize - 1)
+				{
+					p = srcSize - 1;
+					w = 0;
+				}
+				index[i] = p;
+				weight[i] = UInt16(w);
+			}
+		}
+	}
+};
+
+// Resamples source rows to the size of a destination rect, one destination row at a time.
+// A resampled row is reused as long as consecutive destination rows map to the same
+// source position, so vertical upscaling costs one horizontal pass per source row.
+class RowResampler
+{
+	int srcWidth;
+	int dstWidth;
+	bool bilinear;
+	int factor;				// Nearest-neighbor integer upscale factor (2x, 3x...), or 0
+	ScaleAxis xAxis;
+	ScaleAxis yAxis;
+	std::vector<UInt32> buffers;
+	int lastIndex;
+	int lastWeight;
+	const UInt32* lastRow;
+
+public:
+	RowResampler(int srcWidth, int srcHeight, int dstWidth, int dstHeight, bool bilinear)
+		: srcWidth(srcWidth)
+		, dstWidth(dstWidth)
+		, bilinear(bilinear)
+		, factor((!bilinear && dstWidth > srcWidth && dstWidth % srcWidth == 0) ? dstWidth / srcWidth : 0)
+		, xAxis(srcWidth, dstWidth, bilinear)
+		, yAxis(srcHeight, dstHeight, bilinear)
+		, buffers(3 * srcWidth + 1 + dstWidth)
+		, lastIndex(-1)
+		, lastWeight(-1)
+		, lastRow(nullptr)
+	{
+	}
+
+	// readRow(y, scratch) must return source row y (srcWidth raw ARGB pixels),
+	// either from the source itself or written into `scratch`.
+	// The returned row stays valid until the next call.
+	template<typename ReadRow>
+	const UInt32* GetRow(int dstY, ReadRow&& readRow)
+	{
+		const int sy = yAxis.index[dstY];
+		const int wy = bilinear ? yAxis.weight[dstY] : 0;
+
+		if (sy == lastIndex && wy == lastWeight)
+			return lastRow;
+
+		const auto& kernels = Blit::GetKernels();
+		UInt32* scratchA = buffers.data();
+		UInt32* scratchB = scratchA + srcWidth;
+		UInt32* blended = scratchB + srcWidth;		// srcWidth + 1 pixels
+		UInt32* row = blended + srcWidth + 1;
+
+		const UInt32* s = readRow(sy, scratchA);
+
+		if (bilinear)
+		{
+			if (wy == 0)
+				memcpy(blended, s, srcWidth * sizeof(UInt32));
+			else
+				kernels.lerpRow(blended, s, readRow(sy + 1, scratchB), srcWidth, wy);
+
+			// Repeat the last pixel so that every sample has a right neighbor
+			blended[srcWidth] = blended[srcWidth - 1];
+			kernels.lerpGatherRow(row, blended, xAxis.index.data(), xAxis.weight.data(), dstWidth);
+			lastRow = row;
+		}
+		else if (dstWidth == srcWidth)
+		{
+			lastRow = s;
+		}
+		else if (factor)
+		{
+			kernels.replicateRow(row, s, srcWidth, factor);
+			lastRow = row;
+		}
+		else
+		{
+			kernels.gatherRow(row, s, xAxis.index.data(), dstWidth);
+			lastRow = row;
+		}
+
+		lastIndex = sy;
+		lastWeight = wy;
+		return lastRow;
+	}
+};
+
+// ---------------------------------------------------------------------------- -
+// Paint
+
+// Damages the parts of r that lie in the clip region
+static void DamageClipped(GrafPortImpl& port, const SpanRegion& clip, const Rect& r)
+{
+	clip.ForEachRect(r, [&](const Rect& part) { port.DamageRegion(part); });
+}
+
+static void _FillRect(const int left, const int top, const int right, const int bottom, UInt32 fillColor)
+{
+	if (!curPort)
+	{
+		throw std::runtime_error("_FillRect: no port set");
+	}
+
+	Rect dstRect;
+	dstRect.left   = left;
+	dstRect.top    = top;
+	dstRect.right  = right;
+	dstRect.bottom = bottom;
+
+	const auto offx = curPort->port.portRect.left;
+	const auto offy = curPort->port.portRect.top;
+	const UInt32 color = ToRawARGB(fillColor);
+
+	if (curPort == bandedPort)
+	{
+		BandedOp op = {};
+		op.kind = BandedOp::kFill;
+		op.dstRect = dstRect;
+		op.color = color;
+		RecordBandedOp(op);
+		DamageClipped(*curPort, curPort->drawableRgn, dstRect);
+		return;
+	}
+
+	SettleForWrite(*curPort);
+
+	curPort->drawableRgn.ForEachRect(dstRect, [&](const Rect& clippedDstRect)
+	{
+		curPort->DamageRegion(clippedDstRect);
+		curPort->Fill(
+			clippedDstRect.left   - offx,
+			clippedDstRect.top    - offy,
+			clippedDstRect.right  - offx,
+			clippedDstRect.bottom - offy,
+			color);
+	});
+}
+
+// Paints the horizontal spans of a shape into the current port, clipped to
+// its drawable region. The area actually drawn is damaged once, in Finish().
+class SpanPainter
+{
+public:
+	explicit SpanPainter(UInt32 fillColor)
+		: port(*curPort)
+		, color(ToRawARGB(fillColor))
+		, offx(port.port.portRect.left)
+		, offy(port.port.portRect.top)
+		, bounds(port.drawableRgn.GetBounds())
+		, drawn{SHRT_MAX, SHRT_MAX, SHRT_MIN, SHRT_MIN}
+	{
+		SettleForWrite(port);
+	}
+
+	// Bounds of the drawable region; nothing outside them can be painted.
+	const Rect& GetBounds() const
+	{ return bounds; }
+
+	// Paints row y from x = left (inclusive) to x = right (exclusive).
+	void FillSpan(int y, int left, int right)
+	{
+		if (y < bounds.top || y >= bounds.bottom)
+			return;
+
+		Rect span;
+		span.top    = y;
+		span.bottom = y + 1;
+		span.left   = std::max(left, (int) bounds.left);
+		span.right  = std::min(right, (int) bounds.right);
+
+		port.drawableRgn.ForEachRect(span, [&](const Rect& r)
+		{
+			port.Fill(r.left - offx, r.top - offy, r.right - offx, r.bottom - offy, color);
+			drawn.left   = std::min(drawn.left, r.left);
+			drawn.top    = std::min(drawn.top, r.top);
+			drawn.right  = std::max(drawn.right, r.right);
+			drawn.bottom = std::max(drawn.bottom, r.bottom);
+		});
+	}
+
+	void Finish()
+	{
+		if (drawn.left < drawn.right)
+			port.DamageRegion(drawn);
+	}
+
+private:
+	GrafPortImpl& port;
+	const UInt32 color;
+	const int offx;
+	const int offy;
+	const Rect bounds;
+	Rect drawn;
+};
+
+void PaintRect(const struct Rect* r)
+{
+	_FillRect(r->left, r->top, r->right, r->bottom, penFG);
+}
+
+void EraseRect(const struct Rect* r)
+{
+	_FillRect(r->left, r->top, r->right, r->bottom, penBG);
+}
+
+void LineTo(short x1, short y1)
+{
+	int x0 = penX;
+	int y0 = penY;
+	penX = x1;
+	penY = y1;
+
+	SpanPainter painter(penFG);
+	const Rect& bounds = painter.GetBounds();
+
+	// Reject lines that miss the drawable region entirely
+	if (std::max(x0, (int) x1) < bounds.left || std::min(x0, (int) x1) >= bounds.right
+		|| std::max(y0, (int) y1) < bounds.top || std::min(y0, (int) y1) >= bounds.bottom)
+	{
+		return;
+	}
+
+	// Horizontal and vertical lines are a single rect
+	if (x0 == x1 || y0 == y1)
+	{
+		const int left = std::min(x0, (int) x1);
+		const int right = std::max(x0, (int) x1) + 1;
+		const int top = std::max(std::min(y0, (int) y1), (int) bounds.top);
+		const int bottom = std::min(std::max(y0, (int) y1) + 1, (int) bounds.bottom);
+		for (int y = top; y < bottom; y++)
+			painter.FillSpan(y, left, right);
+		painter.Finish();
+		return;
+	}
+
+	// Bresenham, emitting one horizontal run per row
+	const int dx = std::abs(x1 - x0);
+	const int sx = x0 < x1 ? 1 : -1;
+	const int dy = -std::abs(y1 - y0);
+	const int sy = y0 < y1 ? 1 : -1;
+	int err = dx + dy;
+
+	// Once the line leaves the drawable bounds in its direction of travel, it can't come back
+	auto isPastBounds = [&](int x, int y)
+	{
+		return (sy > 0 ? y >= bounds.bottom : y < bounds.top)
+			|| (sx > 0 ? x >= bounds.right : x < bounds.left);
+	};
+
+	int runX = x0;
+	while (true)
+	{
+		if (x0 == x1 && y0 == y1)
+		{
+			painter.FillSpan(y0, std::min(runX, x0), std::max(runX, x0) + 1);
+			break;
+		}
+
+		const int e2 = 2 * err;
+		const int prevX = x0;
+		if (e2 >= dy)
+		{
+			err += dy;
+			x0 += sx;
+		}
+		if (e2 <= dx)
+		{
+			err += dx;
+			painter.FillSpan(y0, std::min(runX, prevX), std::max(runX, prevX) + 1);
+			y0 += sy;
+			runX = x0;
+
+			if (isPastBounds(runX, y0))
+				break;
+		}
+	}
+
+	painter.Finish();
+}
+
+void FrameRect(const Rect* r)
+{
+	if (r->left >= r->right || r->top >= r->bottom)
+		return;
+
+	_FillRect(r->left,      r->top,        r->right, r->top + 1,  penFG);
+	_FillRect(r->left,      r->bottom - 1, r->right, r->bottom,   penFG);
+	_FillRect(r->left,      r->top + 1,    r->left + 1,  r->bottom - 1, penFG);
+	_FillRect(r->right - 1, r->top + 1,    r->right,     r->bottom - 1, penFG);
+}
+
+void FrameArc(const Rect* r, short startAngle, short arcAngle)
+{
+	(void) r;
+	(void) startAngle;
+	(void) arcAngle;
+
+	TODOMINOR();
+}
+
+void Pomme::Graphics::DrawARGBPixmap(int left, int top, ARGBPixmap& pixmap)
+{
+	if (!curPort)
+	{
+		throw std::runtime_error("DrawARGBPixmap: no port set");
+	}
+
+	SettleForWrite(*curPort);
+
+	Rect dstRect;
+	dstRect.left   = left;
+	dstRect.top    = top;
+	dstRect.right  = left + pixmap.width;
+	dstRect.bottom = top  + pixmap.height;
+	curPort->drawableRgn.ForEachRect(dstRect, [&](const Rect& clippedDstRect)
+	{
+		curPort->DamageRegion(clippedDstRect);
+
+		UInt32* src = pixmap.GetPtr(clippedDstRect.left - dstRect.left, clippedDstRect.top - dstRect.top);
+
+		for (int y = clippedDstRect.top; y < clippedDstRect.bottom; y++)
+		{
+			curPort->WriteARGB(clippedDstRect.left, y, Width(clippedDstRect), src);
+			src += pixmap.width;
+		}
+	});
+}
+
+void DrawPicture(PicHandle myPicture, const Rect* dstRect)
+{
+	auto& pic = **myPicture;
+
+	// The picture handle may have been moved by heap compaction since
+	// GetPicture, so refresh the pointer to the pixels tacked onto it.
+	pic.__pomme_pixelsARGB32 = (Ptr) *myPicture + sizeof(Picture);
+
+	UInt32* srcPixels = (UInt32*) pic.__pomme_pixelsARGB32;
+
+	int dstWidth = Width(*dstRect);
+	int dstHeight = Height(*dstRect);
+	int srcWidth = Width(pic.picFrame);
+	int srcHeight = Height(pic.picFrame);
+
+	if (srcWidth <= 0 || srcHeight <= 0 || dstWidth <= 0 || dstHeight <= 0)
+		return;
+
+	SettleForWrite(*curPort);
+	const SpanRegion& clip = curPort->drawableRgn;
+
+	if (srcWidth != dstWidth || srcHeight != dstHeight)
+	{
+		// Pictures are usually artwork drawn at another resolution (e.g. @2x), so smooth them
+		RowResampler resampler(srcWidth, srcHeight, dstWidth, dstHeight, true);
+		clip.ForEachRect(*dstRect, [&](const Rect& part)
+		{
+			const int x = part.left - dstRect->left;
+			for (int y = part.top - dstRect->top; y < part.bottom - dstRect->top; y++)
+			{
+				const UInt32* row = resampler.GetRow(y, [&](int sy, UInt32*) -> const UInt32*
+				{
+					return srcPixels + sy * srcWidth;
+				});
+				curPort->WriteARGB(part.left, dstRect->top + y, Width(part), row + x);
+			}
+		});
+	}
+	else
+	{
+		clip.ForEachRect(*dstRect, [&](const Rect& part)
+		{
+			const int x = part.left - dstRect->left;
+			for (int y = part.top - dstRect->top; y < part.bottom - dstRect->top; y++)
+			{
+				curPort->WriteARGB(part.left, dstRect->top + y, Width(part), srcPixels + y * srcWidth + x);
+			}
+		});
+	}
+
+	DamageClipped(*curPort, clip, *dstRect);
+}
+
+// Per-thread scratch rows for converting blits
+static UInt32* GetScratchRows(int count)
+{
+	static thread_local std::vector<UInt32> scratch;
+	if ((int) scratch.size() < count)
+		scratch.resize(count);
+	return scratch.data();
+}
+
+// Copies a row between two packed pixmaps of the same format.
+static void CopyPackedRow(GrafPortImpl& src, int srcX, int srcY, GrafPortImpl& dst, int dstX, int dstY, int width)
+{
+	if (src.depth == 1)
+	{
+		Blit::CopyBitRow(dst.packed.GetRow(dstY), dstX, src.packed.GetRow(srcY), srcX, width);
+	}
+	else
+	{
+		memmove(dst.packed.GetPtr(dstX, dstY), src.packed.GetPtr(srcX, srcY), width * (src.depth >> 3));
+	}
+}
+
+// Returns the OpColor to use with an arithmetic transfer mode, as a raw pixel.
+// If OpColor was never called, each mode gets a default that makes it useful
+// on its own: addPin pins to white, subPin to black, and blend weighs 50%.
+static UInt32 GetRawOpColor(short mode)
+{
+	if (opColorSet)
+		return ToRawARGB(opColor);
+
+	switch (mode)
+	{
+		case addPin:	return ToRawARGB(0xFF'FF'FF'FF);
+		case subPin:	return ToRawARGB(0xFF'00'00'00);
+		case blend:		return ToRawARGB(0xFF'80'80'80);
+		default:		return 0;
+	}
+}
+
+// Combines a row of raw ARGB source pixels into a row of destination pixels with a transfer mode.
+static void CombineARGBRow(UInt32* d, const UInt32* s, int width, short mode)
+{
+	const auto& kernels = Blit::GetKernels();
+
+	switch (mode)
+	{
+		case srcCopy:
+			memmove(d, s, width * sizeof(UInt32));
+			break;
+
+		case srcCopy|transparent:
+			// Replaces the destination pixel with the source pixel
+			// if the source pixel is not equal to the background color.
+			kernels.copyTransparentRow(d, s, width, ToRawARGB(penBG));
+			break;
+
+		case srcOr:
+		case srcXor:
+		case srcBic:
+		case notSrcCopy:
+		case notSrcOr:
+		case notSrcXor:
+		case notSrcBic:
+			kernels.booleanRows[mode](d, s, width);
+			break;
+
+		case blend:
+		case addPin:
+		case addOver:
+		case subPin:
+		case subOver:
+		case adMax:
+		case adMin:
+			kernels.arithmeticRows[mode - blend](d, s, width, GetRawOpColor(mode));
+			break;
+
+		case pommeAlphaCopy:
+			// Composites the source over the destination according to the source's alpha channel
+			kernels.alphaCompositeRow(d, s, width);
+			break;
+
+		default:
+			TODOFATAL2("unsupported CopyBits mode " << mode);
+			break;
+	}
+}
+
+// Raw colors that 1-bit sources expand to. Like QuickDraw, colorize them with
+// the pen colors, except in the boolean modes, which work on the pixel values.
+static void GetBitColors(short mode, UInt32& black, UInt32& white)
+{
+	const bool booleanMode = mode >= srcOr && mode <= notSrcBic;
+	black = ToRawARGB(booleanMode ? 0xFF'00'00'00 : penFG);
+	white = ToRawARGB(booleanMode ? 0xFF'FF'FF'FF : penBG);
+}
+
+// CopyBits where the source and/or the destination isn't 32-bit.
+// Rows are converted through 32-bit ARGB, unless both sides have the same format
+// (for srcCopy) or are both 1-bit.
+static void CopyBitsConverted(
+	GrafPortImpl& src, int srcX, int srcY,
+	GrafPortImpl& dst, int dstX, int dstY,
+	int width, int height,
+	short mode)
+{
+	if (mode == srcCopy && src.HasSameFormat(dst))
+	{
+		for (int y = 0; y < height; y++)
+			CopyPackedRow(src, srcX, srcY + y, dst, dstX, dstY + y, width);
+		return;
+	}
+
+	if (mode >= srcCopy && mode <= notSrcBic && src.depth == 1 && dst.depth == 1)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			Blit::BooleanBitRow(
+				dst.packed.GetRow(dstY + y), dstX,
+				src.packed.GetRow(srcY + y), srcX,
+				width, mode);
+		}
+		return;
+	}
+
+	UInt32 black, white;
+	GetBitColors(mode, black, white);
+
+	UInt32* srcScratch = GetScratchRows(2 * width);
+	UInt32* dstScratch = srcScratch + width;
+
+	for (int y = 0; y < height; y++)
+	{
+		const UInt32* s = src.ReadARGB(srcX, srcY + y, width, srcScratch, black, white);
+
+		if (mode == srcCopy)
+		{
+			dst.WriteARGB(dstX, dstY + y, width, s);
+			continue;
+		}
+
+		UInt32* d = dst.ReadARGB(dstX, dstY + y, width, dstScratch);
+		CombineARGBRow(d, s, width, mode);
+		dst.WriteARGB(dstX, dstY + y, width, d);
+	}
+}
+
+// CopyBits between rects of different sizes. Rows go through 32-bit ARGB.
+// Only the parts of dstRect inside `clip` are drawn; rows and columns
+// that are clipped out aren't resampled.
+static void CopyBitsScaled(
+	GrafPortImpl& src, int srcX, int srcY, int srcWidth, int srcHeight,
+	GrafPortImpl& dst, int dstX, int dstY, const Rect& dstRect,
+	const SpanRegion& clip,
+	short mode, bool bilinear)
+{
+	UInt32 black, white;
+	GetBitColors(mode, black, white);
+
+	RowResampler resampler(srcWidth, srcHeight, Width(dstRect), Height(dstRect), bilinear);
+	UInt32* dstScratch = GetScratchRows(Width(dstRect));
+
+	clip.ForEachRect(dstRect, [&](const Rect& part)
+	{
+		const int x = part.left - dstRect.left;
+		const int width = Width(part);
+
+		for (int y = part.top - dstRect.top; y < part.bottom - dstRect.top; y++)
+		{
+			const UInt32* s = resampler.GetRow(y, [&](int sy, UInt32* scratch) -> const UInt32*
+			{
+				return src.ReadARGB(srcX, srcY + sy, srcWidth, scratch, black, white);
+			}) + x;
+
+			if (mode == srcCopy)
+			{
+				dst.WriteARGB(dstX + x, dstY + y, width, s);
+				continue;
+			}
+
+			UInt32* d = dst.ReadARGB(dstX + x, dstY + y, width, dstScratch);
+			CombineARGBRow(d, s, width, mode);
+			dst.WriteARGB(dstX + x, dstY + y, width, d);
+		}
+	});
+}
+
+// Unscaled CopyBits. (srcLeft, srcTop) is the top-left of the source rect, in
+// source pixmap coordinates. Only the part of dstRect within `area` is drawn,
+// clipped to `clip`; the destination isn't damaged.
+static void CopyBitsUnscaled(
+	GrafPortImpl& srcPort, int srcLeft, int srcTop,
+	GrafPortImpl& dstPort, const Rect& dstRect, const Rect& area,
+	const SpanRegion& clip, short mode)
+{
+	const auto& dstBounds = dstPort.port.portRect;
+	const int dstX = dstRect.left - dstBounds.left;
+	const int dstY = dstRect.top  - dstBounds.top;
+
+	// Each part is a rect of `area` that survives clipping; (x, y) is its offset in dstRect
+	clip.ForEachRect(area, [&](const Rect& part)
+	{
+		const int x = part.left - dstRect.left;
+		const int y = part.top  - dstRect.top;
+
+		if (srcPort.IsPacked() || dstPort.IsPacked())
+		{
+			CopyBitsConverted(
+				srcPort, srcLeft + x, srcTop + y,
+				dstPort, dstX + x, dstY + y,
+				Width(part), Height(part),
+				mode);
+		}
+		else
+		{
+			for (int row = y; row < y + Height(part); row++)
+			{
+				UInt32* dstPix = dstPort.pixels.GetPtr(dstX + x, dstY + row);
+				UInt32* srcPix = srcPort.pixels.GetPtr(srcLeft + x, srcTop + row);
+				CombineARGBRow(dstPix, srcPix, Width(part), mode);
+			}
+		}
+	});
+}
+
+// Whether a CopyBits can be recorded into a banded frame: its result mustn't
+// depend on the pen or op colors, which may have changed by the time it's replayed
+static bool IsColorFreeCopy(short mode, const GrafPortImpl& src, const GrafPortImpl& dst)
+{
+	if (mode >= srcOr && mode <= notSrcBic)
+		return true;
+
+	if (mode != srcCopy && mode != pommeAlphaCopy)
+		return false;
+
+	// 1-bit sources are colorized with the pen colors, unless they're copied as is
+	return src.depth != 1 || (mode == srcCopy && dst.depth == 1);
+}
+
+// Returns the region that a blit to `dst` is clipped to: the port's drawable
+// region, further clipped to maskRgn if there is one. `storage` holds the
+// intersection if one had to be computed.
+static const SpanRegion& GetBlitClip(const GrafPortImpl& dst, RgnHandle maskRgn, SpanRegion& storage)
+{
+	if (!maskRgn)
+		return dst.drawableRgn;
+
+	storage = SpanRegion::Intersect(dst.drawableRgn, GetSpans(maskRgn));
+	return storage;
+}
+
+void CopyBits(
+	const PixMap* srcBits,
+              PixMap* dstBits,
+	const Rect* srcRect,
+	const Rect* dstRect,
+	short mode,
+	RgnHandle maskRgn
+)
+{
+	// In classic QuickDraw, BitMap and PixMap had compatible layouts.
+	// We treat all bitmaps as pixmaps internally.
+	auto& srcPort = GetImpl((PixMapPtr) srcBits);
+	auto& dstPort = GetImpl((PixMapPtr) dstBits);
+	NoteLayerSource(dstPort, srcPort);
+
+	const auto& srcBounds = ((const PixMap*)srcBits)->bounds;
+	const auto& dstBounds = ((const PixMap*)dstBits)->bounds;
+
+	int srcRectWidth = Width(*srcRect);
+	int srcRectHeight = Height(*srcRect);
+	int dstRectWidth = Width(*dstRect);
+	int dstRectHeight = Height(*dstRect);
+
+	const bool bilinear = mode & pommeBilinearScaling;
+	mode &= ~pommeBilinearScaling;
+
+	if (srcRectWidth <= 0 || srcRectHeight <= 0 || dstRectWidth <= 0 || dstRectHeight <= 0)
+		return;
+
+	SpanRegion clipStorage;
+	const SpanRegion& clip = GetBlitClip(dstPort, maskRgn, clipStorage);
+
+	const int srcX = srcRect->left - srcBounds.left;
+	const int srcY = srcRect->top  - srcBounds.top;
+	const int dstX = dstRect->left - dstBounds.left;
+	const int dstY = dstRect->top  - dstBounds.top;
+	const bool scaled = srcRectWidth != dstRectWidth || srcRectHeight != dstRectHeight;
+
+	if (&dstPort == bandedPort && &srcPort != &dstPort && !maskRgn && !scaled
+		&& IsColorFreeCopy(mode, srcPort, dstPort))
+	{
+		BandedOp op = {};
+		op.kind = BandedOp::kCopyBits;
+		op.dstRect = *dstRect;
+		op.mode = mode;
+		op.src = &srcPort;
+		op.srcLeft = srcX;
+		op.srcTop = srcY;
+		RecordBandedOp(op);
+		DamageClipped(dstPort, clip, *dstRect);
+		return;
+	}
+
+	SettleForRead(srcPort);
+	SettleForWrite(dstPort);
+
+	if (scaled)
+	{
+		CopyBitsScaled(
+			srcPort, srcX, srcY, srcRectWidth, srcRectHeight,
+			dstPort, dstX, dstY, *dstRect,
+			clip, mode, bilinear);
+		DamageClipped(dstPort, clip, *dstRect);
+		return;
+	}
+
+	CopyBitsUnscaled(srcPort, srcX, srcY, dstPort, *dstRect, *dstRect, clip, mode);
+	DamageClipped(dstPort, clip, *dstRect);
+}
+
+// CopyMask to a dstRect of a different size. The source and the mask are
+// scaled with nearest-neighbor sampling, so that the mask's edges stay crisp.
+// Only the parts of dstRect inside `clip` are drawn.
+static void CopyMaskScaled(
+	GrafPortImpl& src, int srcX, int srcY,
+	GrafPortImpl& mask, int maskX, int maskY,
+	int srcWidth, int srcHeight,
+	GrafPortImpl& dst, int dstX, int dstY, const Rect& dstRect,
+	const SpanRegion& clip)
+{
+	const int dstWidth = Width(dstRect);
+	const int dstHeight = Height(dstRect);
+
+	// Like QuickDraw, colorize 1-bit sources with the pen colors
+	const UInt32 black = ToRawARGB(penFG);
+	const UInt32 white = ToRawARGB(penBG);
+
+	RowResampler srcResampler(srcWidth, srcHeight, dstWidth, dstHeight, false);
+	RowResampler maskResampler(srcWidth, srcHeight, dstWidth, dstHeight, false);
+	UInt32* dstScratch = GetScratchRows(dstWidth);
+	auto copyMaskedRow = Blit::GetKernels().copyMaskedRow;
+
+	clip.ForEachRect(dstRect, [&](const Rect& part)
+	{
+		const int x = part.left - dstRect.left;
+		const int width = Width(part);
+
+		for (int y = part.top - dstRect.top; y < part.bottom - dstRect.top; y++)
+		{
+			const UInt32* s = srcResampler.GetRow(y, [&](int sy, UInt32* scratch) -> const UInt32*
+			{
+				return src.ReadARGB(srcX, srcY + sy, srcWidth, scratch, black, white);
+			}) + x;
+
+			const UInt32* m = maskResampler.GetRow(y, [&](int sy, UInt32* scratch) -> const UInt32*
+			{
+				return mask.ReadARGB(maskX, maskY + sy, srcWidth, scratch);
+			}) + x;
+
+			UInt32* d = dst.ReadARGB(dstX + x, dstY + y, width, dstScratch);
+			copyMaskedRow(d, s, m, width);
+			dst.WriteARGB(dstX + x, dstY + y, width, d);
+		}
+	});
+}
+
+// Unscaled CopyMask from a compiled sprite. (srcX, srcY) is the top-left
+// of the source rect, in source pixmap coordinates. Only the part of dstRect
+// within `area` is drawn, clipped to `clip`; the destination isn't damaged.
+static void CopyCompiledSprite(
+	const CompiledSprite& sprite, int srcX, int srcY,
+	GrafPortImpl& dst, const Rect& dstRect, const Rect& area,
+	const SpanRegion& clip)
+{
+	const auto& dstBounds = dst.port.portRect;
+	const int bpp = sprite.bytesPerPixel;
+
+	clip.ForEachRect(area, [&](const Rect& part)
+	{
+		// Span of source columns that this part covers
+		const int left  = srcX + part.left  - dstRect.left;
+		const int right = srcX + part.right - dstRect.left;
+		const int dx = dstRect.left - dstBounds.left - srcX;
+
+		for (int y = part.top; y < part.bottom; y++)
+		{
+			const int sy = srcY + y - dstRect.top;
+			if (sy < 0 || sy >= sprite.height)
+				continue;
+
+			Byte* dstRow = dst.IsPacked() ? dst.packed.GetRow(y - dstBounds.top) : (Byte*) dst.pixels.GetPtr(0, y - dstBounds.top);
+			const auto* run    = sprite.runs.data() + sprite.rowRuns[sy];
+			const auto* runEnd = sprite.runs.data() + sprite.rowRuns[sy + 1];
+
+			for (; run != runEnd && run->left < right; run++)
+			{
+				if (run->right <= left)
+					continue;
+
+				const int a = std::max<int>(run->left, left);
+				const int b = std::min<int>(run->right, right);
+				const Byte* p = sprite.pixels.data() + run->firstByte + (a - run->left) * bpp;
+
+				memcpy(dstRow + (a + dx) * bpp, p, (b - a) * bpp);
+			}
+		}
+	});
+}
+
+// Unscaled CopyMask. (srcLeft, srcTop) and (maskLeft, maskTop) are the top-left
+// corners of the source and mask rects, in pixmap coordinates. 1-bit sources
+// expand to `black` and `white`. Only the part of dstRect within `area` is drawn,
+// clipped to `clip`; the destination isn't damaged.
+static void CopyMaskUnscaled(
+	GrafPortImpl& srcPort, int srcLeft, int srcTop,
+	GrafPortImpl& maskPort, int maskLeft, int maskTop,
+	GrafPortImpl& dstPort, const Rect& dstRect, const Rect& area,
+	const SpanRegion& clip, UInt32 black, UInt32 white)
+{
+	const auto& dstBounds = dstPort.port.portRect;
+	const int rowWidth = Width(dstRect);
+
+	UInt32* srcScratch = GetScratchRows(4 * rowWidth);
+	UInt32* dstScratch = srcScratch + rowWidth;
+	UInt32* maskScratch = dstScratch + rowWidth;
+	Byte* packedScratch = (Byte*) (maskScratch + rowWidth);
+
+	// Each part is a rect of `area` that survives clipping
+	clip.ForEachRect(area, [&](const Rect& part)
+	{
+		const int partX = part.left - dstRect.left;
+		const int partY = part.top  - dstRect.top;
+		const int srcX  = srcLeft  + partX;
+		const int srcY  = srcTop   + partY;
+		const int maskX = maskLeft + partX;
+		const int maskY = maskTop  + partY;
+		const int dstX  = part.left - dstBounds.left;
+		const int dstY  = part.top  - dstBounds.top;
+		const int width = Width(part);
+
+		for (int y = 0; y < Height(part); y++)
+		{
+			if (maskPort.depth == 1)
+			{
+				// Native 1-bit mask: set bits copy. The mask is tested 32 pixels at a time.
+				const Byte* maskRow = maskPort.packed.GetRow(maskY + y);
+
+				if (dstPort.depth == 1 && srcPort.depth == 1)
+				{
+					Blit::CopyBitRowMasked(
+						dstPort.packed.GetRow(dstY + y), dstX,
+						srcPort.packed.GetRow(srcY + y), srcX,
+						maskRow, maskX,
+						width);
+				}
+				else if (dstPort.depth == 32 && srcPort.depth == 32)
+				{
+					Blit::CopyRowWithBitMask(
+						dstPort.pixels.GetPtr(dstX, dstY + y),
+						srcPort.pixels.GetPtr(srcX, srcY + y),
+						maskRow, maskX,
+						width);
+				}
+				else if (dstPort.depth == 8 || dstPort.depth == 16)
+				{
+					// Bring the source to the destination's format, then copy whole pixels
+					const Byte* s;
+					if (srcPort.HasSameFormat(dstPort))
+					{
+						s = srcPort.packed.GetPtr(srcX, srcY + y);
+					}
+					else
+					{
+						dstPort.PackARGB(packedScratch, srcPort.ReadARGB(srcX, srcY + y, width, srcScratch, black, white), width);
+						s = packedScratch;
+					}
+
+					Blit::CopyPackedRowWithBitMask(
+						dstPort.packed.GetPtr(dstX, dstY + y), s, dstPort.depth >> 3,
+						maskRow, maskX,
+						width);
+				}
+				else
+				{
+					const UInt32* s = srcPort.ReadARGB(srcX, srcY + y, width, srcScratch, black, white);
+					UInt32* d = dstPort.ReadARGB(dstX, dstY + y, width, dstScratch);
+					Blit::CopyRowWithBitMask(d, s, maskRow, maskX, width);
+					dstPort.WriteARGB(dstX, dstY + y, width, d);
+				}
+			}
+			else
+			{
+				// Classic Mac masks were 1-bit: black = copy, white = leave the destination alone.
+				// With deeper masks, a pixel counts as black if any of its RGB components is below 128.
+				const UInt32* s = srcPort.ReadARGB(srcX, srcY + y, width, srcScratch, black, white);
+				const UInt32* m = maskPort.ReadARGB(maskX, maskY + y, width, maskScratch);
+				UInt32* d = dstPort.ReadARGB(dstX, dstY + y, width, dstScratch);
+				Blit::GetKernels().copyMaskedRow(d, s, m, width);
+				dstPort.WriteARGB(dstX, dstY + y, width, d);
+			}
+		}
+	});
+}
+
+// Sprites whose mask lines up with the source can be drawn from their compiled runs
+static const CompiledSprite* GetCompiledSpriteFor(
+	GrafPortImpl& srcPort, const Rect* srcRect,
+	GrafPortImpl& maskPort, const Rect* maskRect,
+	const GrafPortImpl& dstPort)
+{
+	const auto& srcBounds = srcPort.port.portRect;
+	const auto& maskBounds = maskPort.port.portRect;
+
+	if (srcRect->left - srcBounds.left != maskRect->left - maskBounds.left
+		|| srcRect->top - srcBounds.top != maskRect->top - maskBounds.top)
+	{
+		return nullptr;
+	}
+
+	return GetCompiledSprite(srcPort, maskPort, dstPort);
+}
+
+void CopyMask(
+	const PixMap* srcBits,
+	const PixMap* maskBits,
+              PixMap* dstBits,
+	const Rect* srcRect,
+	const Rect* maskRect,
+	const Rect* dstRect
+)
+{
+	/*
+	 * CopyMask copies the source image to the destination, using the mask
+	 * to determine which pixels to copy. Where the mask is black (non-zero),
+	 * the source pixel is copied; where it's white (zero), the destination
+	 * pixel is left unchanged.
+	 *
+	 * Per Inside Macintosh: Imaging with QuickDraw, the mask acts as a
+	 * stencil through which the source is copied.
+	 */
+
+	// In classic QuickDraw, BitMap and PixMap had compatible layouts.
+	// We treat all bitmaps as pixmaps internally.
+	auto& srcPort = GetImpl((PixMapPtr) srcBits);
+	auto& maskPort = GetImpl((PixMapPtr) maskBits);
+	auto& dstPort = GetImpl((PixMapPtr) dstBits);
+	NoteLayerSource(dstPort, srcPort);
+	NoteLayerSource(dstPort, maskPort);
+
+	const auto& srcBounds = ((const PixMap*)srcBits)->bounds;
+	const auto& maskBounds = ((const PixMap*)maskBits)->bounds;
+	const auto& dstBounds = ((const PixMap*)dstBits)->bounds;
+
+	int srcRectWidth = Width(*srcRect);
+	int srcRectHeight = Height(*srcRect);
+	int maskRectWidth = Width(*maskRect);
+	int maskRectHeight = Height(*maskRect);
+	int dstRectWidth = Width(*dstRect);
+	int dstRectHeight = Height(*dstRect);
+
+	// The mask is sampled at the same positions as the source
+	if (srcRectWidth != maskRectWidth || srcRectHeight != maskRectHeight)
+	{
+		TODOFATAL2("CopyMask: source and mask rects must have the same dimensions");
+	}
+
+	if (srcRectWidth <= 0 || srcRectHeight <= 0 || dstRectWidth <= 0 || dstRectHeight <= 0)
+		return;
+
+	const SpanRegion& clip = dstPort.drawableRgn;
+	const bool scaled = srcRectWidth != dstRectWidth || srcRectHeight != dstRectHeight;
+
+	// Like QuickDraw, colorize 1-bit sources with the pen colors
+	const UInt32 black = ToRawARGB(penFG);
+	const UInt32 white = ToRawARGB(penBG);
+
+	if (&dstPort == bandedPort && &srcPort != &dstPort && &maskPort != &dstPort && !scaled)
+	{
+		BandedOp op = {};
+		op.kind = BandedOp::kCopyMask;
+		op.dstRect = *dstRect;
+		op.src = &srcPort;
+		op.mask = &maskPort;
+		op.srcLeft  = srcRect->left  - srcBounds.left;
+		op.srcTop   = srcRect->top   - srcBounds.top;
+		op.maskLeft = maskRect->left - maskBounds.left;
+		op.maskTop  = maskRect->top  - maskBounds.top;
+		op.black = black;
+		op.white = white;
+		RecordBandedOp(op);
+		DamageClipped(dstPort, clip, *dstRect);
+		return;
+	}
+
+	SettleForRead(srcPort);
+	SettleForRead(maskPort);
+	SettleForWrite(dstPort);
+
+	if (scaled)
+	{
+		CopyMaskScaled(
+			srcPort, srcRect->left - srcBounds.left, srcRect->top - srcBounds.top,
+			maskPort, maskRect->left - maskBounds.left, maskRect->top - maskBounds.top,
+			srcRectWidth, srcRectHeight,
+			dstPort, dstRect->left - dstBounds.left, dstRect->top - dstBounds.top, *dstRect,
+			clip);
+		DamageClipped(dstPort, clip, *dstRect);
+		return;
+	}
+
+	if (const CompiledSprite* sprite = GetCompiledSpriteFor(srcPort, srcRect, maskPort, maskRect, dstPort))
+	{
+		CopyCompiledSprite(*sprite, srcRect->left - srcBounds.left, srcRect->top - srcBounds.top, dstPort, *dstRect, *dstRect, clip);
+	}
+	else
+	{
+		CopyMaskUnscaled(
+			srcPort, srcRect->left - srcBounds.left, srcRect->top - srcBounds.top,
+			maskPort, maskRect->left - maskBounds.left, maskRect->top - maskBounds.top,
+			dstPort, *dstRect, *dstRect,
+			clip, black, white);
+	}
+
+	DamageClipped(dstPort, clip, *dstRect);
+}
+
+// ---------------------------------------------------------------------------- -
+// Banded frames
+
+// Below this many rows per band, threads aren't worth waking up
+static constexpr int kMinRowsPerBand = 32;
+
+// Bands handed out per thread, so that threads that are done early can take
+// over bands that would otherwise be waited for
+static constexpr int kBandsPerThread = 4;
+
+// Looks up the compiled sprites that kCopyMask ops can be drawn from. The cache
+// mustn't be cleared while the ops hold pointers into it: make room now, and
+// stop looking sprites up once it's full.
+static void LookUpCompiledSprites(std::vector<BandedOp>& ops, const GrafPortImpl& dst)
+{
+	if (compiledSprites.size() >= kMaxCompiledSprites)
+		compiledSprites.clear();
+
+	for (BandedOp& op : ops)
+	{
+		if (op.kind == BandedOp::kCopyMask
+			&& compiledSprites.size() < kMaxCompiledSprites
+			&& op.srcLeft == op.maskLeft && op.srcTop == op.maskTop)
+		{
+			op.compiled = GetCompiledSprite(*op.src, *op.mask, dst);
+		}
+	}
+}
+
+// Draws every op's part within `area`, in order, clipped to the port's drawable
+// region. Doesn't damage the port, so it may run on any thread as long as the
+// areas drawn concurrently don't share rows.
+static void DrawBandedOps(const std::vector<BandedOp>& ops, GrafPortImpl& port, const Rect& area)
+{
+	const SpanRegion& clip = port.drawableRgn;
+	const int offx = port.port.portRect.left;
+	const int offy = port.port.portRect.top;
+
+	for (const BandedOp& op : ops)
+	{
+		Rect part;
+		if (!SectRect(&op.dstRect, &area, &part))
+			continue;
+
+		switch (op.kind)
+		{
+			case BandedOp::kFill:
+				clip.ForEachRect(part, [&](const Rect& r)
+				{
+					port.Fill(r.left - offx, r.top - offy, r.right - offx, r.bottom - offy, op.color);
+				});
+				break;
+
+			case BandedOp::kCopyBits:
+				CopyBitsUnscaled(*op.src, op.srcLeft, op.srcTop, port, op.dstRect, part, clip, op.mode);
+				break;
+
+			case BandedOp::kCopyMask:
+				if (op.compiled)
+				{
+					CopyCompiledSprite(*op.compiled, op.srcLeft, op.srcTop, port, op.dstRect, part, clip);
+				}
+				else
+				{
+					CopyMaskUnscaled(
+						*op.src, op.srcLeft, op.srcTop,
+						*op.mask, op.maskLeft, op.maskTop,
+						port, op.dstRect, part,
+						clip, op.black, op.white);
+				}
+				break;
+		}
+	}
+}
+
+// Draws the ops over `bandCount` bands of rows of the port's drawable region,
+// on several threads. None of the ops may read from the port.
+static void DrawBandedOpsInBands(const std::vector<BandedOp>& ops, GrafPortImpl& port, int bandCount)
+{
+	const Rect drawBounds = port.drawableRgn.GetBounds();
+	const int height = Height(drawBounds);
+
+	if (bandCount <= 1)
+	{
+		DrawBandedOps(ops, port, drawBounds);
+		return;
+	}
+
+	RunBands(bandCount, [&](int band)
+	{
+		Rect area = drawBounds;
+		area.top    = drawBounds.top + height * band / bandCount;
+		area.bottom = drawBounds.top + height * (band + 1) / bandCount;
+		DrawBandedOps(ops, port, area);
+	});
+}
+
+// Draws the ops recorded so far, and starts over with an empty recording
+static void ReplayBandedOps()
+{
+	GrafPortImpl& port = *bandedPort;
+	FinishPresentsFrom(port);
+	LookUpCompiledSprites(bandedOps, port);
+
+	// Replaying ops one band at a time gives the same pixels as drawing them one
+	// after the other: each op only writes to the rows it covers, and no op
+	// reads from the port, which is only written to by the recorded ops
+	const int rows = Height(port.drawableRgn.GetBounds());
+	const int bandCount = std::min(GetBandThreadCount() * kBandsPerThread, rows / kMinRowsPerBand);
+	DrawBandedOpsInBands(bandedOps, port, bandCount);
+
+	bandedOps.clear();
+	bandedSources.clear();
+}
+
+void BeginBandedFrame(CGrafPtr port)
+{
+	if (bandedFrameOpen)
+	{
+		throw std::logic_error("BeginBandedFrame: a banded frame is already open");
+	}
+
+	bandedFrameOpen = true;
+
+	// With a single thread, there's nothing to gain from recording
+	bandedPort = GetBandThreadCount() > 1 ? &GetImpl(port) : nullptr;
+}
+
+void EndBandedFrame(void)
+{
+	if (!bandedFrameOpen)
+	{
+		throw std::logic_error("EndBandedFrame: no banded frame is open");
+	}
+
+	if (!bandedOps.empty())
+		ReplayBandedOps();
+
+	bandedFrameOpen = false;
+	bandedPort = nullptr;
+}
+
+// ---------------------------------------------------------------------------- -
+// Sprite batches
+
+// Below this many sprites per band, threads aren't worth waking up
+static constexpr int kMinSpritesPerBand = 16;
+
+void DrawSpriteBatch(const SpriteBatchItem* items, long count)
+{
+	if (!curPort || count <= 0)
+		return;
+
+	GrafPortImpl& dstPort = *curPort;
+	const Rect drawBounds = dstPort.drawableRgn.GetBounds();
+
+	// Like QuickDraw, colorize 1-bit sources with the pen colors
+	const UInt32 black = ToRawARGB(penFG);
+	const UInt32 white = ToRawARGB(penBG);
+
+	std::vector<long> order(count);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](long a, long b) { return items[a].layer < items[b].layer; });
+
+	std::vector<BandedOp> sprites;
+	sprites.reserve(count);
+	bool readsFromDst = false;
+
+	for (long i : order)
+	{
+		const SpriteBatchItem& item = items[i];
+		GrafPortImpl& src = GetImpl(item.src);
+		GrafPortImpl& mask = GetImpl(item.mask);
+		NoteLayerSource(dstPort, src);
+		NoteLayerSource(dstPort, mask);
+
+		// Keep the part of srcRect that lies in both pixmaps, and move the destination along
+		Rect srcRect;
+		if (!SectRect(&item.srcRect, &src.port.portRect, &srcRect)
+			|| !SectRect(&srcRect, &mask.port.portRect, &srcRect))
+		{
+			continue;
+		}
+
+		BandedOp sprite = {};
+		sprite.kind = BandedOp::kCopyMask;
+		sprite.src = &src;
+		sprite.mask = &mask;
+		sprite.srcLeft  = srcRect.left - src.port.portRect.left;
+		sprite.srcTop   = srcRect.top  - src.port.portRect.top;
+		sprite.maskLeft = srcRect.left - mask.port.portRect.left;
+		sprite.maskTop  = srcRect.top  - mask.port.portRect.top;
+		sprite.dstRect.left   = item.dstPoint.h + srcRect.left - item.srcRect.left;
+		sprite.dstRect.top    = item.dstPoint.v + srcRect.top  - item.srcRect.top;
+		sprite.dstRect.right  = sprite.dstRect.left + Width(srcRect);
+		sprite.dstRect.bottom = sprite.dstRect.top  + Height(srcRect);
+		sprite.black = black;
+		sprite.white = white;
+
+		Rect visible;
+		if (!SectRect(&sprite.dstRect, &drawBounds, &visible))
+			continue;
+
+		readsFromDst |= &src == &dstPort || &mask == &dstPort;
+		sprites.push_back(sprite);
+	}
+
+	if (&dstPort == bandedPort && !readsFromDst)
+	{
+		for (const BandedOp& sprite : sprites)
+		{
+			RecordBandedOp(sprite);
+			DamageClipped(dstPort, dstPort.drawableRgn, sprite.dstRect);
+		}
+		return;
+	}
+
+	for (const BandedOp& sprite : sprites)
+	{
+		SettleForRead(*sprite.src);
+		SettleForRead(*sprite.mask);
+	}
+	SettleForWrite(dstPort);
+
+	LookUpCompiledSprites(sprites, dstPort);
+
+	// Bands don't share any destination rows, so they can be drawn concurrently,
+	// unless a sprite reads from the port being drawn to
+	const int bandCount = readsFromDst ? 1 : std::min({
+		GetBandThreadCount(),
+		(int) sprites.size() / kMinSpritesPerBand,
+		Height(drawBounds) / kMinRowsPerBand});
+
+	DrawBandedOpsInBands(sprites, dstPort, bandCount);
+
+	// Damage is tracked per port, so it's only touched from this thread
+	for (const BandedOp& sprite : sprites)
+		DamageClipped(dstPort, dstPort.drawableRgn, sprite.dstRect);
+}
+
+// ---------------------------------------------------------------------------- -
+// Presenters
+
+OSErr NewPresenter(PresenterPtr* presenter, short width, short height, long format, void* buffer1, void* buffer2, long rowBytes)
+{
+	Blit::SwizzleRowFunc swizzleRow;
+	switch (format)
+	{
+		case pommePresentBGRA:	swizzleRow = Blit::GetKernels().argbToBGRARow;	break;
+		case pommePresentRGBA:	swizzleRow = Blit::GetKernels().argbToRGBARow;	break;
+		default:				return paramErr;
+	}
+
+	// Rows are converted as arrays of UInt32
+	if (width <= 0 || height <= 0
+		|| rowBytes < 4L * width || rowBytes % 4 != 0
+		|| !buffer1 || !buffer2 || buffer1 == buffer2
+		|| (uintptr_t) buffer1 % 4 != 0 || (uintptr_t) buffer2 % 4 != 0)
+	{
+		return paramErr;
+	}
+
+	*presenter = new Presenter{
+		width, height, rowBytes, swizzleRow,
+		{{(Byte*) buffer1, {}}, {(Byte*) buffer2, {}}},
+		1, false, nullptr, 0, false, {}};
+	presenters.push_back(*presenter);
+	return noErr;
+}
+
+void DisposePresenter(PresenterPtr presenter)
+{
+	FinishPresent(*presenter);
+	presenters.erase(std::remove(presenters.begin(), presenters.end(), presenter), presenters.end());
+	delete presenter;
+}
+
+void PresentPort(PresenterPtr presenter, CGrafPtr port)
+{
+	Presenter& p = *presenter;
+	GrafPortImpl& impl = GetImpl(port);
+
+	FinishPresent(p);
+	SettleForRead(impl);
+
+	// The part of the port that fits in the buffers, in pixmap coordinates
+	const Rect all = {
+		0,
+		0,
+		(SInt16) std::min(p.height, Height(impl.port.portRect)),
+		(SInt16) std::min(p.width, Width(impl.port.portRect))};
+
+	if (impl.serial != p.portSerial)
 	{
-		curPort->pixels.Plot(x0 - offx, y0 - offy, color);
-		if (x0 == x1 && y0 == y1) break;
-		int e2 = 2 * err;
-		if (e2 >= dy)
+		// Another port, or the first one: neither buffer holds any of it yet
+		for (auto& buffer : p.buffers)
 		{
-			err += dy;
-			x0 += sx;
+			buffer.stale.Clear();
+			if (!EmptyRect(&all))
+				buffer.stale.Add(all);
 		}
-		if (e2 <= dx)
+		p.portSerial = impl.serial;
+	}
+	else
+	{
+		for (Rect r : impl.damage)
 		{
-			err += dx;
-			y0 += sy;
+			OffsetRect(&r, -impl.port.portRect.left, -impl.port.portRect.top);
+			if (!IntersectRects(&all, &r))
+				continue;
+			for (auto& buffer : p.buffers)
+				buffer.stale.Add(r);
 		}
 	}
-	penX = x0;
-	penY = y0;
-}
 
-void FrameRect(const Rect* r)
-{
-	UInt32 color = PackU32BE(&penFG);
+	impl.damage.Clear();
+	p.port = &impl;
 
-	auto& pm = curPort->pixels;
-	auto offx = curPort->port.portRect.left;
-	auto offy = curPort->port.portRect.top;
+	Presenter::Buffer& back = p.buffers[p.front ^ 1];
+	if (back.stale.IsEmpty())
+	{
+		// The back buffer is as up to date as the front one
+		p.front ^= 1;
+		p.hasFrame = true;
+		return;
+	}
 
-	for (int x = r->left; x < r->right; x++) pm.Plot(x            - offx, r->top        - offy, color);
-	for (int x = r->left; x < r->right; x++) pm.Plot(x            - offx, r->bottom - 1 - offy, color);
-	for (int y = r->top; y < r->bottom; y++) pm.Plot(r->left      - offx, y             - offy, color);
-	for (int y = r->top; y < r->bottom; y++) pm.Plot(r->right - 1 - offx, y             - offy, color);
+	Rect rects[DamageRects::kMaxRects];
+	const int rectCount = back.stale.CopyTo(rects, DamageRects::kMaxRects);
+	back.stale.Clear();
 
-	curPort->DamageRegion(*r);
+	// Until FinishPresent, the port's pixels must only be read (see FinishPresentsFrom)
+	p.converting = true;
+	p.job.Start([&impl, pixels = back.pixels, rowBytes = p.rowBytes, swizzleRow = p.swizzleRow, rects, rectCount]()
+	{
+		for (int i = 0; i < rectCount; i++)
+		{
+			const Rect& r = rects[i];
+			const int w = Width(r);
+			for (int y = r.top; y < r.bottom; y++)
+			{
+				// Other depths are expanded to ARGB in the row itself, then swizzled in place
+				UInt32* row = (UInt32*) (pixels + y * rowBytes) + r.left;
+				swizzleRow(row, impl.ReadARGB(r.left, y, w, row), w);
+			}
+		}
+	});
 }
 
-void FrameArc(const Rect* r, short startAngle, short arcAngle)
+void* GetPresentedFrame(PresenterPtr presenter, Boolean waitForLatest)
 {
-	(void) r;
-	(void) startAngle;
-	(void) arcAngle;
+	Presenter& p = *presenter;
 
-	TODOMINOR();
+	if (p.converting && (waitForLatest || p.job.IsDone()))
+		FinishPresent(p);
+
+	return p.hasFrame ? p.buffers[p.front].pixels : nullptr;
 }
 
-void Pomme::Graphics::DrawARGBPixmap(int left, int top, ARGBPixmap& pixmap)
+// ---------------------------------------------------------------------------- -
+// Oval drawing
+
+// Computes how far each row of an oval inscribed in r is inset from r's left
+// and right edges. A pixel belongs to the oval if its center lies within the
+// ellipse; rows with no such pixel get an inset of Width(r), i.e. an empty span.
+//
+// Everything is done in integers, in units of half a pixel from the center:
+// with u and k the horizontal and vertical distances from the center to a pixel
+// center, the pixel is inside if u^2 h^2 + k^2 w^2 <= w^2 h^2.
+static std::vector<int> _GetOvalInsets(const Rect* r)
 {
-	if (!curPort)
-	{
-		throw std::runtime_error("DrawARGBPixmap: no port set");
-	}
+	const int w = Width(*r);
+	const int h = Height(*r);
 
-	Rect dstRect;
-	dstRect.left   = left;
-	dstRect.top    = top;
-	dstRect.right  = left + pixmap.width;
-	dstRect.bottom = top  + pixmap.height;
-	Rect clippedDstRect = dstRect;
-	if (!IntersectRects(&curPort->port.portRect, &clippedDstRect))
-	{
-		return;  // wholly outside bounds
-	}
-	curPort->DamageRegion(clippedDstRect);
+	std::vector<int> insets(h, w);
 
-	UInt32* src = pixmap.GetPtr(clippedDstRect.left - dstRect.left, clippedDstRect.top - dstRect.top);
-	UInt32* dst = curPort->pixels.GetPtr(clippedDstRect.left, clippedDstRect.top);
+	const UInt64 w2 = (UInt64) w * w;
+	const UInt64 h2 = (UInt64) h * h;
 
-	for (int y = clippedDstRect.top; y < clippedDstRect.bottom; y++)
+	// The widest half-span shrinks as k grows, so umax only ever steps down
+	int umax = w - 1;
+	for (int k = (h - 1) % 2; k <= h - 1; k += 2)
 	{
-		memcpy(dst, src, Width(clippedDstRect) * sizeof(UInt32));
-		dst += curPort->pixels.width;
-		src += pixmap.width;
+		const UInt64 limit = w2 * (h2 - (UInt64) k * k);
+		while (umax >= 0 && (UInt64) umax * umax * h2 > limit)
+			umax -= 2;
+
+		if (umax < 0)
+			break;
+
+		const int inset = (w - 1 - umax) / 2;
+		insets[(h - 1 - k) / 2] = inset;
+		insets[(h - 1 + k) / 2] = inset;
 	}
+
+	return insets;
 }
 
-void DrawPicture(PicHandle myPicture, const Rect* dstRect)
+void FrameOval(const Rect* r)
 {
-	auto& pic = **myPicture;
+	if (!curPort) return;
 
-	UInt32* srcPixels = (UInt32*) pic.__pomme_pixelsARGB32;
+	const int w = Width(*r);
+	const int h = Height(*r);
+	if (w <= 0 || h <= 0)
+		return;
 
-	int dstWidth = Width(*dstRect);
-	int dstHeight = Height(*dstRect);
-	int srcWidth = Width(pic.picFrame);
-	int srcHeight = Height(pic.picFrame);
+	const auto insets = _GetOvalInsets(r);
+	auto insetAt = [&](int j) { return (j < 0 || j >= h) ? w : insets[j]; };
 
-	if (srcWidth != dstWidth || srcHeight != dstHeight)
-		TODOFATAL2("we only support dstRect with the same width/height as the source picture");
+	SpanPainter painter(penFG);
 
-	for (int y = 0; y < dstHeight; y++)
+	for (int j = 0; j < h; j++)
 	{
-		memcpy(
-			curPort->pixels.GetPtr(dstRect->left, dstRect->top + y),
-			srcPixels + y * srcWidth,
-			4 * dstWidth);
+		const int inset = insets[j];
+		if (inset >= w)
+			continue;
+
+		// A pixel is on the outline unless all 4 of its neighbors are in the oval
+		const int innerInset = std::max({inset + 1, insetAt(j - 1), insetAt(j + 1)});
+		const int y = r->top + j;
+
+		if (2 * innerInset >= w)
+		{
+			painter.FillSpan(y, r->left + inset, r->right - inset);
+		}
+		else
+		{
+			painter.FillSpan(y, r->left + inset, r->left + innerInset);
+			painter.FillSpan(y, r->right - innerInset, r->right - inset);
+		}
 	}
 
-	curPort->DamageRegion(*dstRect);
+	painter.Finish();
 }
 
-void CopyBits(
-	const PixMap* srcBits,
-              PixMap* dstBits,
-	const Rect* srcRect,
-	const Rect* dstRect,
-	short mode,
-	void* maskRgn
-)
+void PaintOval(const Rect* r)
 {
-	(void) maskRgn;
+	if (!curPort) return;
 
-	// In classic QuickDraw, BitMap and PixMap had compatible layouts.
-	// We treat all bitmaps as pixmaps internally.
-	auto& srcPM = GetImpl((PixMapPtr) srcBits);
-	auto& dstPM = GetImpl((PixMapPtr) dstBits);
+	if (r->left >= r->right || r->top >= r->bottom)
+		return;
 
-	const auto& srcBounds = ((const PixMap*)srcBits)->bounds;
-	const auto& dstBounds = ((const PixMap*)dstBits)->bounds;
+	const auto insets = _GetOvalInsets(r);
 
-	int srcRectWidth = Width(*srcRect);
-	int srcRectHeight = Height(*srcRect);
-	int dstRectWidth = Width(*dstRect);
-	int dstRectHeight = Height(*dstRect);
+	SpanPainter painter(penFG);
 
-	if (srcRectWidth != dstRectWidth || srcRectHeight != dstRectHeight)
-		TODOFATAL2("can only copy between rects of same dimensions");
+	for (int j = 0; j < (int) insets.size(); j++)
+		painter.FillSpan(r->top + j, r->left + insets[j], r->right - insets[j]);
 
-	switch (mode)
-	{
-		case srcCopy:
-			for (int y = 0; y < srcRectHeight; y++)
-			{
-				memcpy(
-						dstPM.GetPtr(dstRect->left - dstBounds.left, dstRect->top - dstBounds.top + y),
-						srcPM.GetPtr(srcRect->left - srcBounds.left, srcRect->top - srcBounds.top + y),
-						4 * srcRectWidth
-				);
-			}
-			break;
+	painter.Finish();
+}
 
-		case srcCopy|transparent:
-		{
-			// Replaces the destination pixel with the source pixel
-			// if the source pixel is not equal to the background color.
+void FillOval(const Rect* r, const Pattern* pat)
+{
+	// For now, just paint with foreground color (ignoring pattern)
+	// A full implementation would apply the pattern
+	(void) pat;
+	PaintOval(r);
+}
 
-			UInt32 transparentColor = penBG;
-#if !(__BIG_ENDIAN__)
-			ByteswapInts(sizeof(transparentColor), 1, &transparentColor);  // need to byteswap because ARGBPixmap.GetPtr returns a pointer to raw (big-endian) ARGB ints
-#endif
+// ---------------------------------------------------------------------------- -
+// Text rendering
+
+// Runs of set bits in a row of a glyph, in pixels from the left edge of the
+// glyph's bit rows (i.e. from the pen position minus SysFont::leftMargin).
+struct GlyphSpan
+{
+	SInt8 row;
+	SInt8 left;
+	SInt8 right;
+};
+
+// A glyph span placed in a string, in pixels from the pen position and rows
+// from the top of the text (the pen position minus SysFont::ascend).
+struct TextSpan
+{
+	SInt16 row;
+	SInt16 left;
+	SInt16 right;
+};
+
+// Returns a glyph's bit rows cut into spans, top to bottom and left to right.
+// All glyphs are expanded once, on first use; they don't depend on colors,
+// which are only applied when the spans are filled.
+static const std::vector<GlyphSpan>& GetGlyphSpans(const SysFont::Glyph& glyph)
+{
+	static const auto table = []()
+	{
+		std::vector<std::vector<GlyphSpan>> t(std::size(SysFont::glyphs));
 
-			for (int y = 0; y < srcRectHeight; y++)
+		for (size_t i = 0; i < t.size(); i++)
+		{
+			for (int row = 0; row < SysFont::rows; row++)
 			{
-				UInt32* dstPix = dstPM.GetPtr(dstRect->left - dstBounds.left, dstRect->top - dstBounds.top + y);
-				UInt32* srcPix = srcPM.GetPtr(srcRect->left - srcBounds.left, srcRect->top - srcBounds.top + y);
-				for (int x = 0; x < srcRectWidth; x++)
+				const unsigned bits = SysFont::glyphs[i].bits[row];
+				for (int x = 0; x < SysFont::widthBits; )
 				{
-					if (*srcPix != transparentColor)
+					if (!(bits & (1u << x)))
 					{
-						*dstPix = *srcPix;
+						x++;
+						continue;
 					}
-					dstPix++;
-					srcPix++;
+
+					int end = x;
+					while (end < SysFont::widthBits && (bits & (1u << end)))
+						end++;
+
+					t[i].push_back({(SInt8) row, (SInt8) x, (SInt8) end});
+					x = end;
 				}
 			}
-			break;
 		}
 
-		default:
-			TODOFATAL2("unsupported CopyBits mode " << mode);
-			break;
-	}
+		return t;
+	}();
 
-	curPort->DamageRegion(*dstRect);
+	return table[&glyph - SysFont::glyphs];
 }
 
-void CopyMask(
-	const PixMap* srcBits,
-	const PixMap* maskBits,
-              PixMap* dstBits,
-	const Rect* srcRect,
-	const Rect* maskRect,
-	const Rect* dstRect
-)
+// Lays out the glyph spans of a whole string into `spans`, and returns the
+// width of the string (as TextWidthC).
+static int _LayOutString(const char* cstr, std::vector<TextSpan>& spans)
 {
-	/*
-	 * CopyMask copies the source image to the destination, using the mask
-	 * to determine which pixels to copy. Where the mask is black (non-zero),
-	 * the source pixel is copied; where it's white (zero), the destination
-	 * pixel is left unchanged.
-	 *
-	 * Per Inside Macintosh: Imaging with QuickDraw, the mask acts as a
-	 * stencil through which the source is copied.
-	 */
-
-	// In classic QuickDraw, BitMap and PixMap had compatible layouts.
-	// We treat all bitmaps as pixmaps internally.
-	auto& srcPM = GetImpl((PixMapPtr) srcBits);
-	auto& maskPM = GetImpl((PixMapPtr) maskBits);
-	auto& dstPM = GetImpl((PixMapPtr) dstBits);
+	spans.clear();
 
-	const auto& srcBounds = ((const PixMap*)srcBits)->bounds;
-	const auto& maskBounds = ((const PixMap*)maskBits)->bounds;
-	const auto& dstBounds = ((const PixMap*)dstBits)->bounds;
+	int x = 0;
+	for (const char* c = cstr; *c; c++)
+	{
+		if (c != cstr)
+			x += SysFont::charSpacing;
 
-	int srcRectWidth = Width(*srcRect);
-	int srcRectHeight = Height(*srcRect);
-	int maskRectWidth = Width(*maskRect);
-	int maskRectHeight = Height(*maskRect);
-	int dstRectWidth = Width(*dstRect);
-	int dstRectHeight = Height(*dstRect);
+		const auto& glyph = SysFont::GetGlyph(*c);
+		const int glyphLeft = x - SysFont::leftMargin;
 
-	// All three rectangles should have the same dimensions for simple copy
-	if (srcRectWidth != dstRectWidth || srcRectHeight != dstRectHeight ||
-	    srcRectWidth != maskRectWidth || srcRectHeight != maskRectHeight)
-	{
-		TODOFATAL2("CopyMask: can only copy between rects of same dimensions");
-	}
-
-	for (int y = 0; y < srcRectHeight; y++)
-	{
-		UInt32* srcPix = srcPM.GetPtr(srcRect->left - srcBounds.left, srcRect->top - srcBounds.top + y);
-		UInt32* maskPix = maskPM.GetPtr(maskRect->left - maskBounds.left, maskRect->top - maskBounds.top + y);
-		UInt32* dstPix = dstPM.GetPtr(dstRect->left - dstBounds.left, dstRect->top - dstBounds.top + y);
-
-		for (int x = 0; x < srcRectWidth; x++)
-		{
-			// In a 32-bit ARGB mask, we check if mask pixel is non-white.
-			// Classic Mac masks were 1-bit: black = copy, white = don't copy.
-			// For 32-bit ARGB, treat any non-white (non-0xFFFFFFFF) as "copy".
-			// Actually, for masks, typically black (0xFF000000) means copy.
-			// Let's check the alpha or the whole value.
-			
-			// Simple approach: if mask pixel has any non-white component, copy.
-			// A proper mask should be black (0xFF000000 big-endian) where we copy.
-			UInt32 m = *maskPix;
-			
-			// If mask is not fully white (0xFFFFFFFF in big-endian ARGB), copy the source
-			// Or check if it's black: mask pixels that are dark should trigger copy
-			// In classic QuickDraw, black in mask = copy. Let's check RGB components.
-			// Extract RGB (ignoring alpha) and see if it's dark
-			UInt8 r = (m >> 16) & 0xFF;
-			UInt8 g = (m >> 8) & 0xFF;
-			UInt8 b = m & 0xFF;
-			
-			// If any RGB channel is dark (less than 128), consider it "copy"
-			// Or more simply: if not white, copy
-			if (r < 128 || g < 128 || b < 128)
-			{
-				*dstPix = *srcPix;
-			}
+		for (const GlyphSpan& span : GetGlyphSpans(glyph))
+			spans.push_back({span.row, (SInt16) (glyphLeft + span.left), (SInt16) (glyphLeft + span.right)});
 
-			srcPix++;
-			maskPix++;
-			dstPix++;
-		}
+		x += glyph.width;
 	}
 
-	curPort->DamageRegion(*dstRect);
+	return *cstr ? x : -SysFont::charSpacing;
 }
 
-// ---------------------------------------------------------------------------- -
-// Oval drawing
+// A string rendered over its background rect, in the destination's format,
+// so that drawing it again is one memcpy per row.
+struct CachedString
+{
+	int width;
+	int bytesPerPixel;
+	std::vector<Byte> pixels;			// SysFont::rows rows of width * bytesPerPixel bytes
+	std::vector<TextSpan> overhang;		// glyph spans sticking out of the background rect
+};
+
+static constexpr size_t kMaxCachedStrings = 64;
+
+static bool stringCacheEnabled = false;
+
+// Keyed by text, foreground color, background color, and destination format
+static std::map<std::tuple<std::string, UInt32, UInt32, int>, CachedString> cachedStrings;
 
-static void _PlotOvalPoints(ARGBPixmap& pm, int cx, int cy, int x, int y, UInt32 color, int offx, int offy)
+void SetStringCacheEnabled(Boolean enabled)
 {
-	// Plot 4 symmetric points of the oval
-	pm.Plot(cx + x - offx, cy + y - offy, color);
-	pm.Plot(cx - x - offx, cy + y - offy, color);
-	pm.Plot(cx + x - offx, cy - y - offy, color);
-	pm.Plot(cx - x - offx, cy - y - offy, color);
+	stringCacheEnabled = enabled;
+	if (!enabled)
+		cachedStrings.clear();
 }
 
-static void _DrawOvalOutline(ARGBPixmap& pm, const Rect* r, UInt32 color, int offx, int offy)
+// Returns the cached rendering of a string in the current colors, rendering
+// it first if needed, or nullptr if the string can't be cached.
+static const CachedString* GetCachedString(const char* cstr, const GrafPortImpl& dst)
 {
-	/*
-	 * Midpoint ellipse algorithm to draw oval outline.
-	 * The oval is inscribed in the bounding rectangle r.
-	 */
-	int left = r->left;
-	int top = r->top;
-	int right = r->right;
-	int bottom = r->bottom;
+	// 1-bit ports threshold the colors, so they keep the uncached path
+	if (dst.depth == 1)
+		return nullptr;
 
-	// Center of the oval
-	int cx = (left + right) / 2;
-	int cy = (top + bottom) / 2;
+	auto key = std::make_tuple(std::string(cstr), penFG, penBG, dst.depth | (dst.packed.rgb565 << 8));
+	auto it = cachedStrings.find(key);
+	if (it != cachedStrings.end())
+		return &it->second;
 
-	// Semi-axes
-	int a = (right - left) / 2;  // horizontal radius
-	int b = (bottom - top) / 2;  // vertical radius
+	std::vector<TextSpan> spans;
+	const int width = _LayOutString(cstr, spans);
+	if (width <= 0)
+		return nullptr;
 
-	if (a <= 0 || b <= 0) return;
+	if (cachedStrings.size() >= kMaxCachedStrings)
+		cachedStrings.clear();
 
-	int a2 = a * a;
-	int b2 = b * b;
-	int fa2 = 4 * a2;
-	int fb2 = 4 * b2;
+	CachedString& entry = cachedStrings[std::move(key)];
+	entry.width = width;
+	entry.bytesPerPixel = dst.depth >> 3;
+	entry.pixels.resize(SysFont::rows * width * entry.bytesPerPixel);
 
-	int x, y, sigma;
+	// Render in raw ARGB, then convert each row the same way Fill converts colors
+	const UInt32 fg = ToRawARGB(penFG);
+	const UInt32 bg = ToRawARGB(penBG);
+	std::vector<UInt32> argb(SysFont::rows * width, bg);
 
-	// First region: where slope > -1
-	for (x = 0, y = b, sigma = 2 * b2 + a2 * (1 - 2 * b); b2 * x <= a2 * y; x++)
+	for (const TextSpan& span : spans)
 	{
-		_PlotOvalPoints(pm, cx, cy, x, y, color, offx, offy);
-		if (sigma >= 0)
-		{
-			sigma += fa2 * (1 - y);
-			y--;
-		}
-		sigma += b2 * ((4 * x) + 6);
-	}
+		if (span.left < 0 || span.right > width)
+			entry.overhang.push_back(span);
 
-	// Second region: where slope <= -1
-	for (x = a, y = 0, sigma = 2 * a2 + b2 * (1 - 2 * a); a2 * y <= b2 * x; y++)
-	{
-		_PlotOvalPoints(pm, cx, cy, x, y, color, offx, offy);
-		if (sigma >= 0)
-		{
-			sigma += fb2 * (1 - x);
-			x--;
-		}
-		sigma += a2 * ((4 * y) + 6);
+		UInt32* row = argb.data() + span.row * width;
+		for (int x = std::max<int>(span.left, 0); x < std::min<int>(span.right, width); x++)
+			row[x] = fg;
 	}
-}
-
-static void _FillOval(ARGBPixmap& pm, const Rect* r, UInt32 color, int offx, int offy)
-{
-	/*
-	 * Fill an oval inscribed in the bounding rectangle r.
-	 * Uses scanline approach with midpoint ellipse algorithm.
-	 */
-	int left = r->left;
-	int top = r->top;
-	int right = r->right;
-	int bottom = r->bottom;
-
-	int cx = (left + right) / 2;
-	int cy = (top + bottom) / 2;
-
-	int a = (right - left) / 2;
-	int b = (bottom - top) / 2;
-
-	if (a <= 0 || b <= 0) return;
 
-	// For each row from cy-b to cy+b, calculate the x extent and fill
-	for (int y = -b; y <= b; y++)
-	{
-		// Ellipse equation: (x/a)^2 + (y/b)^2 = 1
-		// Solving for x: x = a * sqrt(1 - (y/b)^2)
-		double yRatio = (double)y / (double)b;
-		double xExtent = a * std::sqrt(1.0 - yRatio * yRatio);
-		int x1 = cx - (int)xExtent;
-		int x2 = cx + (int)xExtent;
+	if (dst.depth == 32)
+		memcpy(entry.pixels.data(), argb.data(), entry.pixels.size());
+	else
+		dst.PackARGB(entry.pixels.data(), argb.data(), (int) argb.size());
 
-		// Fill horizontal line from x1 to x2 at row cy+y
-		for (int x = x1; x <= x2; x++)
-		{
-			pm.Plot(x - offx, cy + y - offy, color);
-		}
-	}
+	return &entry;
 }
 
-void FrameOval(const Rect* r)
+// Draws a cached string at the pen position, clipped to the current port.
+static void _DrawCachedString(const CachedString& entry)
 {
-	if (!curPort) return;
-
-	UInt32 color = PackU32BE(&penFG);
-	auto offx = curPort->port.portRect.left;
-	auto offy = curPort->port.portRect.top;
+	auto& port = *curPort;
+	const auto& bounds = port.port.portRect;
+	const int bpp = entry.bytesPerPixel;
+	SettleForWrite(port);
 
-	_DrawOvalOutline(curPort->pixels, r, color, offx, offy);
-	curPort->DamageRegion(*r);
-}
+	Rect dstRect;
+	dstRect.left   = penX;
+	dstRect.top    = penY - SysFont::ascend;
+	dstRect.right  = penX + entry.width;
+	dstRect.bottom = dstRect.top + SysFont::rows;
 
-void PaintOval(const Rect* r)
-{
-	if (!curPort) return;
+	port.drawableRgn.ForEachRect(dstRect, [&](const Rect& part)
+	{
+		for (int y = part.top; y < part.bottom; y++)
+		{
+			Byte* dstRow = port.IsPacked() ? port.packed.GetRow(y - bounds.top) : (Byte*) port.pixels.GetPtr(0, y - bounds.top);
+			const Byte* srcRow = entry.pixels.data() + (y - dstRect.top) * entry.width * bpp;
 
-	UInt32 color = PackU32BE(&penFG);
-	auto offx = curPort->port.portRect.left;
-	auto offy = curPort->port.portRect.top;
+			memcpy(dstRow + (part.left - bounds.left) * bpp,
+				srcRow + (part.left - dstRect.left) * bpp,
+				Width(part) * bpp);
+		}
 
-	_FillOval(curPort->pixels, r, color, offx, offy);
-	curPort->DamageRegion(*r);
-}
+		port.DamageRegion(part);
+	});
 
-void FillOval(const Rect* r, const Pattern* pat)
-{
-	// For now, just paint with foreground color (ignoring pattern)
-	// A full implementation would apply the pattern
-	(void) pat;
-	PaintOval(r);
+	if (!entry.overhang.empty())
+	{
+		SpanPainter painter(penFG);
+		for (const TextSpan& span : entry.overhang)
+			painter.FillSpan(dstRect.top + span.row, penX + span.left, penX + span.right);
+		painter.Finish();
+	}
 }
 
-// ---------------------------------------------------------------------------- -
-// Text rendering
-
 short TextWidthC(const char* cstr)
 {
 	if (!cstr) return 0;
@@ -935,69 +2964,50 @@ void DrawStringC(const char* cstr)
 {
 	if (!cstr) return;
 
+	if (stringCacheEnabled)
+	{
+		if (const CachedString* entry = GetCachedString(cstr, *curPort))
+		{
+			_DrawCachedString(*entry);
+			penX += entry->width;
+			return;
+		}
+	}
+
+	// Lay out the whole string first, so that the glyphs go out as one batch of spans
+	static std::vector<TextSpan> spans;
+	const int width = _LayOutString(cstr, spans);
+
 	_FillRect(
 		penX,
 		penY - SysFont::ascend,
-		penX + TextWidthC(cstr),
+		penX + width,
 		penY + SysFont::descend,
 		penBG
 	);
 
-	penX -= SysFont::charSpacing;
-	for (; *cstr; cstr++)
-	{
-		penX += SysFont::charSpacing;
-		DrawChar(*cstr);
-	}
+	SpanPainter painter(penFG);
+	const int top = penY - SysFont::ascend;
+	for (const TextSpan& span : spans)
+		painter.FillSpan(top + span.row, penX + span.left, penX + span.right);
+	painter.Finish();
+
+	penX += width;
 }
 
 void DrawChar(char c)
 {
-	UInt32 fg = PackU32BE(&penFG);
-
 	auto& glyph = SysFont::GetGlyph(c);
 
-	// Theoretical coordinates of top-left corner of glyph (may be outside port bounds!)
-	Rect dstRect;
-	dstRect.left   = penX - SysFont::leftMargin;
-	dstRect.top    = penY - SysFont::ascend;
-	dstRect.right  = dstRect.left + SysFont::widthBits;
-	dstRect.bottom = dstRect.top  + SysFont::rows;
+	// Top-left corner of the glyph's bit rows (may be outside port bounds!)
+	const int left = penX - SysFont::leftMargin;
+	const int top  = penY - SysFont::ascend;
+
+	SpanPainter painter(penFG);
+	for (const GlyphSpan& span : GetGlyphSpans(glyph))
+		painter.FillSpan(top + span.row, left + span.left, left + span.right);
+	painter.Finish();
 
 	// Advance pen position
 	penX += glyph.width;
-
-	Rect clippedDstRect = dstRect;
-	if (!IntersectRects(&curPort->port.portRect, &clippedDstRect))
-	{
-		return;  // wholly outside bounds
-	}
-	curPort->DamageRegion(clippedDstRect);
-
-	// Glyph boundaries
-	int minCol = clippedDstRect.left - dstRect.left;
-	int minRow = clippedDstRect.top  - dstRect.top;
-
-	auto* dst2 = curPort->pixels.GetPtr(clippedDstRect.left, clippedDstRect.top);
-
-	for (int glyphY = minRow; glyphY < minRow + Height(clippedDstRect); glyphY++)
-	{
-		auto rowBits = glyph.bits[glyphY];
-
-		rowBits >>= minCol;
-
-		auto* dstRow = dst2;
-
-		for (int glyphX = minCol; glyphX < minCol + Width(clippedDstRect); glyphX++)
-		{
-			if (rowBits & 1)
-			{
-				*dstRow = fg;
-			}
-			rowBits >>= 1;
-			dstRow++;
-		}
-
-		dst2 += curPort->pixels.width;
-	}
 }
@@ -0,0 +1,293 @@
+#include "Graphics/SpanRegion.h"
+#include <climits>
+
+using namespace Pomme::Graphics;
+
+static inline SInt16 ClampCoord(int v)
+{
+	return (SInt16) std::clamp(v, SHRT_MIN, SHRT_MAX);
+}
+
+//-----------------------------------------------------------------------------
+// Construction
+
+SpanRegion::SpanRegion(const Rect& r)
+{
+	SetRect(r);
+}
+
+void SpanRegion::SetEmpty()
+{
+	bands.clear();
+	spans.clear();
+}
+
+void SpanRegion::SetRect(const Rect& r)
+{
+	SetEmpty();
+
+	if (r.left >= r.right || r.top >= r.bottom)
+		return;
+
+	bands.push_back({r.top, r.bottom, 0, 1});
+	spans.push_back({r.left, r.right});
+}
+
+// Appends a band below the existing ones, or stretches the last band down
+// if it ends at `top` and has the same spans.
+void SpanRegion::AppendBand(int top, int bottom, const std::vector<Span>& bandSpans)
+{
+	if (bandSpans.empty() || top >= bottom)
+		return;
+
+	if (!bands.empty())
+	{
+		Band& last = bands.back();
+		if (last.bottom == top
+			&& last.spanCount == bandSpans.size()
+			&& std::equal(bandSpans.begin(), bandSpans.end(), spans.begin() + last.firstSpan,
+				[](const Span& a, const Span& b) { return a.left == b.left && a.right == b.right; }))
+		{
+			last.bottom = (SInt16) bottom;
+			return;
+		}
+	}
+
+	bands.push_back({(SInt16) top, (SInt16) bottom, (UInt32) spans.size(), (UInt32) bandSpans.size()});
+	spans.insert(spans.end(), bandSpans.begin(), bandSpans.end());
+}
+
+//-----------------------------------------------------------------------------
+// Queries
+
+Rect SpanRegion::GetBounds() const
+{
+	if (IsEmpty())
+		return Rect{0, 0, 0, 0};
+
+	Rect bounds;
+	bounds.top    = bands.front().top;
+	bounds.bottom = bands.back().bottom;
+	bounds.left   = SHRT_MAX;
+	bounds.right  = SHRT_MIN;
+
+	for (const Band& band : bands)
+	{
+		bounds.left  = std::min(bounds.left, spans[band.firstSpan].left);
+		bounds.right = std::max(bounds.right, spans[band.firstSpan + band.spanCount - 1].right);
+	}
+
+	return bounds;
+}
+
+bool SpanRegion::Contains(int x, int y) const
+{
+	auto band = std::partition_point(bands.begin(), bands.end(),
+		[&](const Band& b) { return b.bottom <= y; });
+
+	if (band == bands.end() || band->top > y)
+		return false;
+
+	const Span* first = spans.data() + band->firstSpan;
+	const Span* last = first + band->spanCount;
+	const Span* span = std::partition_point(first, last,
+		[&](const Span& s) { return s.right <= x; });
+
+	return span != last && span->left <= x;
+}
+
+bool SpanRegion::operator==(const SpanRegion& other) const
+{
+	// The representation is canonical, so equal regions have equal bands and spans
+	return bands.size() == other.bands.size()
+		&& spans.size() == other.spans.size()
+		&& std::equal(bands.begin(), bands.end(), other.bands.begin(),
+			[](const Band& a, const Band& b) { return a.top == b.top && a.bottom == b.bottom && a.spanCount == b.spanCount; })
+		&& std::equal(spans.begin(), spans.end(), other.spans.begin(),
+			[](const Span& a, const Span& b) { return a.left == b.left && a.right == b.right; });
+}
+
+//-----------------------------------------------------------------------------
+// Transformations
+
+void SpanRegion::Offset(int dx, int dy)
+{
+	// Coordinates are pinned to the 16-bit range; rebuild the region in case
+	// pinning collapses or joins anything
+	SpanRegion moved;
+	std::vector<Span> bandSpans;
+
+	for (const Band& band : bands)
+	{
+		bandSpans.clear();
+		for (UInt32 i = 0; i < band.spanCount; i++)
+		{
+			const Span& s = spans[band.firstSpan + i];
+			Span m = {ClampCoord(s.left + dx), ClampCoord(s.right + dx)};
+			if (m.left < m.right)
+				bandSpans.push_back(m);
+		}
+		moved.AppendBand(ClampCoord(band.top + dy), ClampCoord(band.bottom + dy), bandSpans);
+	}
+
+	*this = std::move(moved);
+}
+
+//-----------------------------------------------------------------------------
+// Boolean operations
+
+static inline bool Keep(bool inA, bool inB, SpanRegion::Op op)
+{
+	switch (op)
+	{
+		case SpanRegion::Op::Union:			return inA || inB;
+		case SpanRegion::Op::Intersect:		return inA && inB;
+		case SpanRegion::Op::Difference:	return inA && !inB;
+		default:							return inA != inB;
+	}
+}
+
+// Combines two sorted span lists by sweeping over their edges left to right.
+// The output spans are sorted and never touch, since the output can only
+// switch on or off once at any given x.
+static void CombineSpans(
+	const SpanRegion::Span* a, int countA,
+	const SpanRegion::Span* b, int countB,
+	SpanRegion::Op op,
+	std::vector<SpanRegion::Span>& out)
+{
+	out.clear();
+
+	// Edge k of a span list is the left edge of span k/2 if k is even, its right edge otherwise
+	auto edge = [](const SpanRegion::Span* s, int k) -> int
+	{
+		return (k & 1) ? s[k >> 1].right : s[k >> 1].left;
+	};
+
+	const int edgesA = 2 * countA;
+	const int edgesB = 2 * countB;
+	int ka = 0;
+	int kb = 0;
+	bool inA = false;
+	bool inB = false;
+	bool inOut = false;
+	int start = 0;
+
+	while (ka < edgesA || kb < edgesB)
+	{
+		const int x = std::min(
+			ka < edgesA ? edge(a, ka) : INT_MAX,
+			kb < edgesB ? edge(b, kb) : INT_MAX);
+
+		for (; ka < edgesA && edge(a, ka) == x; ka++)
+			inA = !inA;
+		for (; kb < edgesB && edge(b, kb) == x; kb++)
+			inB = !inB;
+
+		const bool keep = Keep(inA, inB, op);
+		if (keep != inOut)
+		{
+			if (keep)
+				start = x;
+			else
+				out.push_back({(SInt16) start, (SInt16) x});
+			inOut = keep;
+		}
+	}
+}
+
+SpanRegion SpanRegion::Combine(const SpanRegion& a, const SpanRegion& b, Op op)
+{
+	SpanRegion result;
+	std::vector<Span> bandSpans;
+
+	size_t ia = 0;
+	size_t ib = 0;
+
+	int y = INT_MAX;
+	if (!a.bands.empty()) y = std::min(y, (int) a.bands.front().top);
+	if (!b.bands.empty()) y = std::min(y, (int) b.bands.front().top);
+
+	// Walk down both band lists at once. Each step covers rows [y, nextY),
+	// over which neither region changes.
+	while (true)
+	{
+		while (ia < a.bands.size() && a.bands[ia].bottom <= y) ia++;
+		while (ib < b.bands.size() && b.bands[ib].bottom <= y) ib++;
+
+		if (ia == a.bands.size() && ib == b.bands.size())
+			break;
+
+		int nextY = INT_MAX;
+		const Span* spansA = nullptr;
+		const Span* spansB = nullptr;
+		int countA = 0;
+		int countB = 0;
+
+		if (ia < a.bands.size())
+		{
+			const Band& band = a.bands[ia];
+			if (band.top > y)
+			{
+				nextY = std::min(nextY, (int) band.top);
+			}
+			else
+			{
+				nextY = std::min(nextY, (int) band.bottom);
+				spansA = a.spans.data() + band.firstSpan;
+				countA = band.spanCount;
+			}
+		}
+
+		if (ib < b.bands.size())
+		{
+			const Band& band = b.bands[ib];
+			if (band.top > y)
+			{
+				nextY = std::min(nextY, (int) band.top);
+			}
+			else
+			{
+				nextY = std::min(nextY, (int) band.bottom);
+				spansB = b.spans.data() + band.firstSpan;
+				countB = band.spanCount;
+			}
+		}
+
+		if (countA || countB)
+		{
+			CombineSpans(spansA, countA, spansB, countB, op, bandSpans);
+			result.AppendBand(y, nextY, bandSpans);
+		}
+
+		y = nextY;
+	}
+
+	return result;
+}
+
+SpanRegion SpanRegion::Union(const SpanRegion& a, const SpanRegion& b)
+{
+	if (a.IsEmpty()) return b;
+	if (b.IsEmpty()) return a;
+	return Combine(a, b, Op::Union);
+}
+
+SpanRegion SpanRegion::Intersect(const SpanRegion& a, const SpanRegion& b)
+{
+	if (a.IsEmpty() || b.IsEmpty()) return SpanRegion();
+	return Combine(a, b, Op::Intersect);
+}
+
+SpanRegion SpanRegion::Difference(const SpanRegion& a, const SpanRegion& b)
+{
+	if (a.IsEmpty() || b.IsEmpty()) return a;
+	return Combine(a, b, Op::Difference);
+}
+
+SpanRegion SpanRegion::Xor(const SpanRegion& a, const SpanRegion& b)
+{
+	if (a.IsEmpty()) return b;
+	if (b.IsEmpty()) return a;
+	return Combine(a, b, Op::Xor);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "PommeTypes.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace Pomme::Graphics
+{
+	// Region stored as sorted scanline spans, backing RgnHandle and port clipping.
+	//
+	// The region is cut into horizontal bands of rows that have the same spans.
+	// Bands are sorted top to bottom and don't overlap. Within a band, spans are
+	// sorted left to right and neither overlap nor touch. Vertically adjacent
+	// bands with identical spans are coalesced, so a rect is always one band with
+	// one span, and equal regions always have the same representation.
+	class SpanRegion
+	{
+	public:
+		struct Span
+		{
+			SInt16 left;
+			SInt16 right;
+		};
+
+		struct Band
+		{
+			SInt16 top;
+			SInt16 bottom;
+			UInt32 firstSpan;
+			UInt32 spanCount;
+		};
+
+		enum class Op { Union, Intersect, Difference, Xor };
+
+		SpanRegion() = default;
+
+		explicit SpanRegion(const Rect& r);
+
+		void SetEmpty();
+
+		void SetRect(const Rect& r);
+
+		bool IsEmpty() const
+		{ return bands.empty(); }
+
+		bool IsRect() const
+		{ return bands.size() == 1 && spans.size() == 1; }
+
+		int SpanCount() const
+		{ return (int) spans.size(); }
+
+		int BandCount() const
+		{ return (int) bands.size(); }
+
+		// Bounding box of the region, or an all-zero rect if the region is empty.
+		Rect GetBounds() const;
+
+		bool Contains(int x, int y) const;
+
+		void Offset(int dx, int dy);
+
+		bool operator==(const SpanRegion& other) const;
+
+		static SpanRegion Union(const SpanRegion& a, const SpanRegion& b);
+
+		static SpanRegion Intersect(const SpanRegion& a, const SpanRegion& b);
+
+		static SpanRegion Difference(const SpanRegion& a, const SpanRegion& b);
+
+		static SpanRegion Xor(const SpanRegion& a, const SpanRegion& b);
+
+		// Cuts the part of `clip` that lies in the region into rects, and calls
+		// fn(const Rect&) on each of them, top to bottom and left to right.
+		// The rects don't overlap; each is a span of a band, clipped to `clip`.
+		template<typename F>
+		void ForEachRect(const Rect& clip, F&& fn) const
+		{
+			if (clip.left >= clip.right || clip.top >= clip.bottom)
+				return;
+
+			auto band = std::partition_point(bands.begin(), bands.end(),
+				[&](const Band& b) { return b.bottom <= clip.top; });
+
+			for (; band != bands.end() && band->top < clip.bottom; ++band)
+			{
+				Rect r;
+				r.top    = std::max(band->top, clip.top);
+				r.bottom = std::min(band->bottom, clip.bottom);
+
+				const Span* span = spans.data() + band->firstSpan;
+				const Span* spanEnd = span + band->spanCount;
+				for (; span != spanEnd && span->left < clip.right; span++)
+				{
+					if (span->right <= clip.left)
+						continue;
+
+					r.left  = std::max(span->left, clip.left);
+					r.right = std::min(span->right, clip.right);
+					fn(r);
+				}
+			}
+		}
+
+	private:
+		static SpanRegion Combine(const SpanRegion& a, const SpanRegion& b, Op op);
+
+		void AppendBand(int top, int bottom, const std::vector<Span>& bandSpans);
+
+		std::vector<Band> bands;
+		std::vector<Span> spans;
+	};
+}
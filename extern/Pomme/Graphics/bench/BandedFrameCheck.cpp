@@ -0,0 +1,346 @@
+// Check: a frame drawn between BeginBandedFrame and EndBandedFrame must come out
+// byte-identical to the same frame drawn immediately. Draws the same random
+// scripts (CopyBits in every mode, CopyMask, sprite batches, shapes, text, and
+// mid-frame reads and writes that force a flush) both ways, at depths 1, 8, 16
+// and 32, then compares every port's pixels and the frame's damage rects.
+//
+// Rerun it after touching CopyMaskUnscaled, the compiled-sprite runs, or
+// anything else a recorded frame replays.
+//
+// Not part of the game build. Build and run by hand, from extern/Pomme:
+//
+//     g++ -std=c++17 -O2 -Wno-multichar -I. Graphics/bench/BandedFrameCheck.cpp Graphics/bench/GraphicsStubs.cpp Graphics/Graphics.cpp Graphics/ARGBPixmap.cpp Graphics/BlitKernels.cpp Graphics/BandWorkers.cpp Graphics/BackgroundJob.cpp Graphics/SystemPalettes.cpp Graphics/PICT.cpp Graphics/Color.cpp Graphics/DamageRects.cpp Graphics/SpanRegion.cpp Memory/Memory.cpp PommeDebug.cpp Utilities/structpack.cpp Utilities/memstream.cpp Utilities/bigendianstreams.cpp Utilities/IEEEExtended.cpp -o BandedFrameCheck -lpthread
+//     ./BandedFrameCheck
+//
+// Bands are spread over 4 threads unless POMME_BAND_THREADS says otherwise.
+// Add -fsanitize=thread (or address) to check the band workers as well.
+
+#include "Pomme.h"
+#include "PommeGraphics.h"
+#include "Graphics/BandWorkers.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+static constexpr int kNumSprites = 8;
+static constexpr int kFramesPerDepth = 12;
+
+static Rect gFrameRect = {0, 0, 300, 400};
+static long gPixelSum = 0;		// keeps the GetPixel calls from being optimized out
+
+struct World
+{
+	GWorldPtr frame;
+	GWorldPtr other;
+	std::vector<GWorldPtr> srcs;
+	std::vector<GWorldPtr> masks;
+	std::vector<char> reads;		// bytes read from the frame mid-frame
+};
+
+static void RandomColors(std::mt19937& rng)
+{
+	RGBColor fore = {(UInt16) rng(), (UInt16) rng(), (UInt16) rng()};
+	RGBColor back = {(UInt16) rng(), (UInt16) rng(), (UInt16) rng()};
+	RGBForeColor(&fore);
+	RGBBackColor(&back);
+}
+
+static Rect RandomRect(std::mt19937& rng, int maxSize = 80)
+{
+	// May stick out of the frame on any side
+	Rect r;
+	r.left = (int) (rng() % 440) - 20;
+	r.top = (int) (rng() % 340) - 20;
+	r.right = r.left + rng() % maxSize;
+	r.bottom = r.top + rng() % maxSize;
+	return r;
+}
+
+static void PaintNoise(std::mt19937& rng, GWorldPtr gworld, const Rect& bounds)
+{
+	SetGWorld(gworld, nullptr);
+	for (int i = 0; i < 40; i++)
+	{
+		RGBColor c = {(UInt16) rng(), (UInt16) rng(), (UInt16) rng()};
+		RGBForeColor(&c);
+		Rect r;
+		r.top = rng() % bounds.bottom;
+		r.left = rng() % bounds.right;
+		r.bottom = r.top + 1 + rng() % 12;
+		r.right = r.left + 1 + rng() % 12;
+		PaintOval(&r);
+	}
+}
+
+// Two worlds made with the same seed start out identical
+static World MakeWorld(int depth, unsigned seed)
+{
+	static const int kSrcDepths[] = {32, 16, 8, 1};
+	static const int kMaskDepths[] = {1, 32, 8};
+	static const RGBColor kWhite = {0xFFFF, 0xFFFF, 0xFFFF};
+
+	std::mt19937 rng(seed);
+	World world;
+	NewGWorld(&world.frame, depth, &gFrameRect, nullptr, nullptr, 0);
+	NewGWorld(&world.other, depth, &gFrameRect, nullptr, nullptr, 0);
+
+	for (int i = 0; i < kNumSprites; i++)
+	{
+		Rect r = {0, 0, (SInt16) (8 + rng() % 50), (SInt16) (8 + rng() % 50)};
+		GWorldPtr src;
+		GWorldPtr mask;
+		NewGWorld(&src, kSrcDepths[i % 4], &r, nullptr, nullptr, 0);
+		NewGWorld(&mask, kMaskDepths[i % 3], &r, nullptr, nullptr, 0);
+
+		PaintNoise(rng, src, r);
+		SetGWorld(mask, nullptr);
+		RGBForeColor(&kWhite);
+		PaintRect(&r);
+		PaintNoise(rng, mask, r);
+
+		world.srcs.push_back(src);
+		world.masks.push_back(mask);
+	}
+
+	SetGWorld(world.frame, nullptr);
+	ClearPortDamage();
+	return world;
+}
+
+// Draws one frame's worth of random operations into the world.
+// With `mixed`, also throws in everything that must flush a recorded frame:
+// drawing into the sources, reading the frame back, clipping, text...
+static void DrawFrame(World& world, unsigned seed, bool banded, bool mixed)
+{
+	static const short kCopyModes[] =
+	{
+		srcCopy, srcOr, srcXor, notSrcBic, blend, addPin,
+		srcCopy | transparent, pommeAlphaCopy, srcCopy, srcCopy,
+	};
+
+	std::mt19937 rng(seed);
+
+	if (banded)
+		BeginBandedFrame(world.frame);
+
+	SetGWorld(world.frame, nullptr);
+	ClipRect(&gFrameRect);
+	RandomColors(rng);
+	PaintRect(&gFrameRect);
+
+	const int numOps = 150 + rng() % 150;
+	for (int i = 0; i < numOps; i++)
+	{
+		const int k = rng() % kNumSprites;
+		const int op = rng() % 100;
+		PixMapHandle framePM = GetGWorldPixMap(world.frame);
+
+		if (op < 20)
+		{
+			RandomColors(rng);
+			Rect r = RandomRect(rng);
+			if (rng() % 2)
+				PaintRect(&r);
+			else if (rng() % 2)
+				EraseRect(&r);
+			else
+				FrameRect(&r);
+		}
+		else if (op < 40)
+		{
+			Rect srcRect = world.srcs[k]->portRect;
+			Rect dstRect = srcRect;
+			OffsetRect(&dstRect, (int) (rng() % 440) - 20, (int) (rng() % 340) - 20);
+			if (rng() % 6 == 0)
+				dstRect.right += rng() % 20;		// scaled
+			short mode = kCopyModes[rng() % 10];
+			RgnHandle maskRgn = nullptr;
+			if (rng() % 8 == 0)
+			{
+				maskRgn = NewRgn();
+				SetRectRgn(maskRgn, 50, 50, 250, 200);
+			}
+			RandomColors(rng);
+			CopyBits(*GetGWorldPixMap(world.srcs[k]), *framePM, &srcRect, &dstRect, mode, maskRgn);
+			if (maskRgn)
+				DisposeRgn(maskRgn);
+		}
+		else if (op < 60)
+		{
+			Rect srcRect = world.srcs[k]->portRect;
+			Rect dstRect = srcRect;
+			OffsetRect(&dstRect, (int) (rng() % 440) - 20, (int) (rng() % 340) - 20);
+			if (rng() % 8 == 0)
+				dstRect.bottom += 7;		// scaled
+			RandomColors(rng);
+			CopyMask(*GetGWorldPixMap(world.srcs[k]), *GetGWorldPixMap(world.masks[k]), *framePM, &srcRect, &srcRect, &dstRect);
+		}
+		else if (op < 68)
+		{
+			std::vector<SpriteBatchItem> items(20 + rng() % 60);
+			for (SpriteBatchItem& item : items)
+			{
+				int j = rng() % kNumSprites;
+				item.src = world.srcs[j];
+				item.mask = world.masks[j];
+				item.srcRect = world.srcs[j]->portRect;
+				item.dstPoint.v = (int) (rng() % 340) - 20;
+				item.dstPoint.h = (int) (rng() % 440) - 20;
+				item.layer = rng() % 3;
+			}
+			RandomColors(rng);
+			DrawSpriteBatch(items.data(), (long) items.size());
+		}
+		else if (!mixed)
+		{
+			continue;
+		}
+		else if (op < 72)
+		{
+			PaintNoise(rng, world.srcs[k], world.srcs[k]->portRect);
+			SetGWorld(world.frame, nullptr);
+		}
+		else if (op < 75)
+		{
+			// Poke a mask's pixels directly, behind QuickDraw's back
+			Byte* pixels = (Byte*) GetPixBaseAddr(GetGWorldPixMap(world.masks[k]));
+			pixels[rng() % 8] ^= 0xFF;
+		}
+		else if (op < 78)
+		{
+			// Copy part of the frame into another port, and into itself
+			Rect srcRect = RandomRect(rng, 120);
+			SectRect(&srcRect, &gFrameRect, &srcRect);
+			srcRect.right = std::min<SInt16>(srcRect.right, 390);
+			srcRect.bottom = std::min<SInt16>(srcRect.bottom, 290);
+			if (srcRect.right <= srcRect.left || srcRect.bottom <= srcRect.top)
+				continue;
+			Rect dstRect = srcRect;
+			OffsetRect(&dstRect, 5, 3);
+			CopyBits(*framePM, *GetGWorldPixMap(world.other), &srcRect, &dstRect, srcCopy, nullptr);
+			if (rng() % 2)
+				CopyBits(*framePM, *framePM, &srcRect, &dstRect, srcCopy, nullptr);
+			SetGWorld(world.frame, nullptr);
+		}
+		else if (op < 82)
+		{
+			RandomColors(rng);
+			Rect r = RandomRect(rng);
+			MoveTo(r.left, r.top);
+			LineTo(r.right, r.bottom);
+			PaintOval(&r);
+			MoveTo(r.left, r.bottom);
+			DrawStringC("Banded 123");
+		}
+		else if (op < 85)
+		{
+			Rect r = RandomRect(rng, 300);
+			ClipRect(rng() % 2 ? &r : &gFrameRect);
+		}
+		else if (op < 87)
+		{
+			gPixelSum += GetPixel(rng() % 400, rng() % 300);
+		}
+		else if (op < 88)
+		{
+			// Must see every draw recorded so far
+			const int rowBytes = (*framePM)->rowBytes & 0x3FFF;
+			world.reads.push_back(GetPixBaseAddrForReading(framePM)[(rng() % 300) * rowBytes + rng() % rowBytes]);
+		}
+		else if (op < 90)
+		{
+			// Sprite drawn into another port, reading from the frame
+			SpriteBatchItem item = {world.frame, world.masks[k], world.masks[k]->portRect, {10, 10}, 0};
+			SetGWorld(world.other, nullptr);
+			DrawSpriteBatch(&item, 1);
+			SetGWorld(world.frame, nullptr);
+		}
+	}
+
+	if (banded)
+		EndBandedFrame();
+}
+
+static void DisposeWorld(World& world)
+{
+	DisposeGWorld(world.frame);
+	DisposeGWorld(world.other);
+	for (int i = 0; i < kNumSprites; i++)
+	{
+		DisposeGWorld(world.srcs[i]);
+		DisposeGWorld(world.masks[i]);
+	}
+}
+
+static bool SamePixels(GWorldPtr a, GWorldPtr b)
+{
+	PixMapHandle pmA = GetGWorldPixMap(a);
+	PixMapHandle pmB = GetGWorldPixMap(b);
+	int rowBytes = (*pmA)->rowBytes & 0x3FFF;
+	int height = a->portRect.bottom - a->portRect.top;
+	return 0 == memcmp(GetPixBaseAddr(pmA), GetPixBaseAddr(pmB), rowBytes * height);
+}
+
+static bool SameWorlds(const World& a, const World& b)
+{
+	if (!SamePixels(a.frame, b.frame) || !SamePixels(a.other, b.other) || a.reads != b.reads)
+		return false;
+
+	for (int i = 0; i < kNumSprites; i++)
+	{
+		if (!SamePixels(a.srcs[i], b.srcs[i]) || !SamePixels(a.masks[i], b.masks[i]))
+			return false;
+	}
+
+	Rect damageA[64];
+	Rect damageB[64];
+	SetGWorld(a.frame, nullptr);
+	short numA = GetPortDamageRects(damageA, 64);
+	ClearPortDamage();
+	SetGWorld(b.frame, nullptr);
+	short numB = GetPortDamageRects(damageB, 64);
+	ClearPortDamage();
+	return numA == numB && 0 == memcmp(damageA, damageB, numA * sizeof(Rect));
+}
+
+int main()
+{
+	setenv("POMME_BAND_THREADS", "4", 0);
+	Pomme::Graphics::Init();
+	printf("%d band threads\n", Pomme::Graphics::GetBandThreadCount());
+
+	int runs = 0;
+	int failures = 0;
+
+	for (bool mixed : {false, true})
+	{
+		for (int depth : {1, 8, 16, 32})
+		{
+			World immediate = MakeWorld(depth, 7);
+			World recorded = MakeWorld(depth, 7);
+
+			for (int frame = 0; frame < kFramesPerDepth; frame++)
+			{
+				DrawFrame(immediate, 100 + frame, false, mixed);
+				DrawFrame(recorded, 100 + frame, true, mixed);
+
+				runs++;
+				if (!SameWorlds(immediate, recorded))
+				{
+					failures++;
+					printf("MISMATCH: depth %d, frame %d%s\n", depth, frame, mixed ? ", mixed ops" : "");
+				}
+			}
+
+			DisposeWorld(immediate);
+			DisposeWorld(recorded);
+		}
+	}
+
+	printf("%d/%d frames identical (%ld)\n", runs - failures, runs, gPixelSum);
+	return failures != 0;
+}
@@ -0,0 +1,204 @@
+// Benchmark: pixels per nanosecond of every blit row kernel, with the scalar
+// kernels and with the ones GetKernels() picks for this CPU. Before timing,
+// checks that both give the same pixels on random rows of random lengths.
+//
+// Not part of the game build. Build and run by hand, from extern/Pomme:
+//
+//     g++ -std=c++17 -O2 -DNDEBUG -Wno-multichar -I. Graphics/bench/BlitKernelsBench.cpp Graphics/BlitKernels.cpp Graphics/SystemPalettes.cpp -o BlitKernelsBench
+//     ./BlitKernelsBench
+//
+// Rows are 640 pixels wide, like the game's frame, and the working set fits in L2.
+
+#include "Graphics/BlitKernels.h"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+using namespace Pomme::Graphics::Blit;
+
+static constexpr int kWidth = 640;
+static constexpr int kRows = 64;
+static constexpr int kCheckTrials = 500;
+static constexpr double kMinSeconds = 0.05;
+
+static constexpr UInt32 kTransparentColor = 0xFFFFFFFF;		// white, as sprites use
+
+// Rows of source pixels, masks, destination pixels, and their 16-bit versions
+struct Rows
+{
+	std::vector<UInt32> src, mask, dst;
+	std::vector<Byte> src16, dst16;
+	std::vector<int> gatherIndex;
+	std::vector<UInt16> lerpWeights;
+
+	Rows()
+		: src(kWidth * kRows)
+		, mask(kWidth * kRows)
+		, dst(kWidth * kRows)
+		, src16(kWidth * kRows * 2)
+		, dst16(kWidth * kRows * 2)
+		, gatherIndex(kWidth)
+		, lerpWeights(kWidth)
+	{
+		// Sprite-like rows: runs of opaque pixels separated by runs of the
+		// transparent color, with a mask that's dark exactly over the opaque runs
+		UInt32 rng = 0x9E3779B9;
+		bool opaque = false;
+		int runLeft = 0;
+		for (size_t i = 0; i < src.size(); i++)
+		{
+			rng = rng * 1664525 + 1013904223;
+			if (runLeft-- <= 0)
+			{
+				opaque = !opaque;
+				runLeft = 4 + (rng >> 27);
+			}
+			// Alpha is the first byte in memory: the low byte on little-endian hosts
+			src[i] = opaque ? (rng | 0xFF) : kTransparentColor;
+			// Dark (every component below 128) exactly where the source is drawn
+			mask[i] = opaque ? ((rng & 0x7F7F7F00) | 0xFF) : (rng | 0x808080FF);
+			dst[i] = rng ^ 0x5A5A5A5A;
+		}
+
+		for (size_t i = 0; i < src16.size(); i++)
+			src16[i] = (Byte) (i * 37);
+
+		// Downscale by 2/3, the most common scaled blit
+		for (int x = 0; x < kWidth; x++)
+		{
+			gatherIndex[x] = x * 2 / 3;
+			lerpWeights[x] = (UInt16) ((x * 2 * 256 / 3) & 0xFF);
+		}
+	}
+
+	bool operator==(const Rows& other) const
+	{
+		return dst == other.dst && dst16 == other.dst16;
+	}
+};
+
+struct Bench
+{
+	const char* name;
+	std::function<void(const Kernels&, Rows&, int row, int count)> run;
+};
+
+static std::vector<Bench> MakeBenches()
+{
+	std::vector<Bench> benches;
+
+	auto at = [](std::vector<UInt32>& v, int row) { return v.data() + row * kWidth; };
+	auto at16 = [](std::vector<Byte>& v, int row) { return v.data() + row * kWidth * 2; };
+
+	benches.push_back({"copyTransparentRow", [=](const Kernels& k, Rows& r, int y, int n) { k.copyTransparentRow(at(r.dst, y), at(r.src, y), n, kTransparentColor); }});
+	benches.push_back({"copyMaskedRow", [=](const Kernels& k, Rows& r, int y, int n) { k.copyMaskedRow(at(r.dst, y), at(r.src, y), at(r.mask, y), n); }});
+	benches.push_back({"argbToRGB555Row", [=](const Kernels& k, Rows& r, int y, int n) { k.argbToRGB555Row(at16(r.dst16, y), at(r.src, y), n); }});
+	benches.push_back({"rgb555ToARGBRow", [=](const Kernels& k, Rows& r, int y, int n) { k.rgb555ToARGBRow(at(r.dst, y), at16(r.src16, y), n); }});
+	benches.push_back({"argbToRGB565Row", [=](const Kernels& k, Rows& r, int y, int n) { k.argbToRGB565Row(at16(r.dst16, y), at(r.src, y), n); }});
+	benches.push_back({"rgb565ToARGBRow", [=](const Kernels& k, Rows& r, int y, int n) { k.rgb565ToARGBRow(at(r.dst, y), at16(r.src16, y), n); }});
+
+	static const char* const kBooleanNames[kNumBooleanModes] =
+		{"srcCopy", "srcOr", "srcXor", "srcBic", "notSrcCopy", "notSrcOr", "notSrcXor", "notSrcBic"};
+	for (int mode = 0; mode < kNumBooleanModes; mode++)
+	{
+		benches.push_back({kBooleanNames[mode], [=](const Kernels& k, Rows& r, int y, int n) { k.booleanRows[mode](at(r.dst, y), at(r.src, y), n); }});
+	}
+
+	static const char* const kArithmeticNames[kNumArithmeticModes] =
+		{"blend", "addPin", "addOver", "subPin", "transparent", "addMax", "subOver", "adMin"};
+	for (int mode = 0; mode < kNumArithmeticModes; mode++)
+	{
+		if (!GetScalarKernels().arithmeticRows[mode])
+			continue;
+		benches.push_back({kArithmeticNames[mode], [=](const Kernels& k, Rows& r, int y, int n) { k.arithmeticRows[mode](at(r.dst, y), at(r.src, y), n, 0x80808080); }});
+	}
+
+	benches.push_back({"alphaCompositeRow", [=](const Kernels& k, Rows& r, int y, int n) { k.alphaCompositeRow(at(r.dst, y), at(r.src, y), n); }});
+	benches.push_back({"gatherRow", [=](const Kernels& k, Rows& r, int y, int n) { k.gatherRow(at(r.dst, y), at(r.src, y), r.gatherIndex.data(), n); }});
+	benches.push_back({"replicateRow x1", [=](const Kernels& k, Rows& r, int y, int n) { k.replicateRow(at(r.dst, y), at(r.src, y), n, 1); }});
+	benches.push_back({"replicateRow x2", [=](const Kernels& k, Rows& r, int y, int n) { k.replicateRow(at(r.dst, y), at(r.src, y), (n + 1) / 2, 2); }});
+	benches.push_back({"replicateRow x3", [=](const Kernels& k, Rows& r, int y, int n) { k.replicateRow(at(r.dst, y), at(r.src, y), n / 3, 3); }});
+	benches.push_back({"lerpRow", [=](const Kernels& k, Rows& r, int y, int n) { k.lerpRow(at(r.dst, y), at(r.src, y), at(r.mask, y), n, 96); }});
+	benches.push_back({"lerpGatherRow", [=](const Kernels& k, Rows& r, int y, int n) { k.lerpGatherRow(at(r.dst, y), at(r.src, y), r.gatherIndex.data(), r.lerpWeights.data(), n); }});
+	benches.push_back({"fillRow", [=](const Kernels& k, Rows& r, int y, int n) { k.fillRow(at(r.dst, y), n, 0x336699FF); }});
+	benches.push_back({"argbToBGRARow", [=](const Kernels& k, Rows& r, int y, int n) { k.argbToBGRARow(at(r.dst, y), at(r.src, y), n); }});
+	benches.push_back({"argbToRGBARow", [=](const Kernels& k, Rows& r, int y, int n) { k.argbToRGBARow(at(r.dst, y), at(r.src, y), n); }});
+
+	return benches;
+}
+
+// Runs the kernel on random rows and lengths with both kernel sets, and
+// compares all the output after each call, so that a SIMD kernel that writes
+// past `count` is caught too. Returns false on the first difference.
+static bool Check(const Bench& bench, const Kernels& scalar, const Kernels& best, const Rows& rows)
+{
+	Rows scalarRows = rows;
+	Rows bestRows = rows;
+
+	UInt32 rng = 0x2545F491;
+	for (int trial = 0; trial < kCheckTrials; trial++)
+	{
+		rng = rng * 1664525 + 1013904223;
+		const int y = (rng >> 8) % kRows;
+		rng = rng * 1664525 + 1013904223;
+		const int count = 1 + (rng >> 8) % kWidth;
+
+		bench.run(scalar, scalarRows, y, count);
+		bench.run(best, bestRows, y, count);
+		if (!(scalarRows == bestRows))
+		{
+			printf("MISMATCH: %s (%s vs %s), row %d, %d pixels\n", bench.name, scalar.name, best.name, y, count);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Runs the kernel over all the rows until kMinSeconds have passed. Returns pixels/ns.
+static double Time(const Bench& bench, const Kernels& kernels, Rows& rows)
+{
+	using Clock = std::chrono::steady_clock;
+
+	long pixels = 0;
+	const auto start = Clock::now();
+	auto now = start;
+	do
+	{
+		for (int y = 0; y < kRows; y++)
+			bench.run(kernels, rows, y, kWidth);
+		pixels += long(kWidth) * kRows;
+		now = Clock::now();
+	} while (std::chrono::duration<double>(now - start).count() < kMinSeconds);
+
+	return pixels / std::chrono::duration<double, std::nano>(now - start).count();
+}
+
+int main()
+{
+	const Kernels& scalar = GetScalarKernels();
+	const Kernels& best = GetKernels();
+	const std::vector<Bench> benches = MakeBenches();
+
+	Rows rows;
+
+	bool identical = true;
+	for (const Bench& bench : benches)
+		identical = Check(bench, scalar, best, rows) && identical;
+	if (!identical)
+		return 1;
+	printf("%s kernels match %s kernels\n\n", best.name, scalar.name);
+
+	printf("%-20s%12s%12s%10s   (pixels/ns)\n", "kernel", scalar.name, best.name, "speedup");
+
+	for (const Bench& bench : benches)
+	{
+		const double scalarRate = Time(bench, scalar, rows);
+		const double bestRate = Time(bench, best, rows);
+		printf("%-20s%12.2f%12.2f%9.1fx\n", bench.name, scalarRate, bestRate, bestRate / scalarRate);
+	}
+
+	return 0;
+}
@@ -0,0 +1,215 @@
+// Check: CopyMask through a compiled sprite must write the same bytes as the
+// uncompiled path. Then times both, for a 48x48 sprite into a 16-bit port, and
+// the compiled path again with GetPixBaseAddrForReading on the mask before each
+// draw: reading the mask mustn't forget the compiled pair.
+//
+// A pair is compiled the second time it's drawn unchanged, and GetPixBaseAddr
+// on the mask counts as a change. So after GetPixBaseAddr, the first CopyMask
+// of the pair takes the uncompiled path and the second one the compiled runs;
+// drawing the first into one port and the second into an identical port lets
+// us compare the two.
+//
+// Not part of the game build. Build and run by hand, from extern/Pomme:
+//
+//     g++ -std=c++17 -O2 -Wno-multichar -I. Graphics/bench/CompiledSpriteCheck.cpp Graphics/bench/GraphicsStubs.cpp Graphics/Graphics.cpp Graphics/ARGBPixmap.cpp Graphics/BlitKernels.cpp Graphics/BandWorkers.cpp Graphics/BackgroundJob.cpp Graphics/SystemPalettes.cpp Graphics/PICT.cpp Graphics/Color.cpp Graphics/DamageRects.cpp Graphics/SpanRegion.cpp Memory/Memory.cpp PommeDebug.cpp Utilities/structpack.cpp Utilities/memstream.cpp Utilities/bigendianstreams.cpp Utilities/IEEEExtended.cpp -o CompiledSpriteCheck -lpthread
+//     ./CompiledSpriteCheck
+
+#include "Pomme.h"
+#include "PommeGraphics.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+static constexpr int kRoundsPerCombination = 6;
+static constexpr int kDrawsPerRound = 4;
+static constexpr int kTimedDraws = 200'000;
+
+static std::mt19937 gRng(7);
+
+static void PaintNoise(GWorldPtr gworld)
+{
+	const Rect& bounds = gworld->portRect;
+	SetGWorld(gworld, nullptr);
+	for (int i = 0; i < 60; i++)
+	{
+		RGBColor c = {(UInt16) gRng(), (UInt16) gRng(), (UInt16) gRng()};
+		RGBForeColor(&c);
+		Rect r;
+		r.top = gRng() % bounds.bottom;
+		r.left = gRng() % bounds.right;
+		r.bottom = r.top + 1 + gRng() % 8;
+		r.right = r.left + 1 + gRng() % 8;
+		PaintRect(&r);
+	}
+}
+
+static int GetRowBytes(GWorldPtr gworld)
+{
+	return (*GetGWorldPixMap(gworld))->rowBytes & 0x3FFF;
+}
+
+static int GetHeight(GWorldPtr gworld)
+{
+	return gworld->portRect.bottom - gworld->portRect.top;
+}
+
+static bool SamePixels(GWorldPtr a, GWorldPtr b)
+{
+	return 0 == memcmp(GetPixBaseAddr(GetGWorldPixMap(a)), GetPixBaseAddr(GetGWorldPixMap(b)), GetRowBytes(a) * GetHeight(a));
+}
+
+static Rect RandomRect(int maxTop, int maxLeft, int maxHeight, int maxWidth)
+{
+	Rect r;
+	r.top = gRng() % maxTop;
+	r.left = gRng() % maxLeft;
+	r.bottom = r.top + 1 + gRng() % maxHeight;
+	r.right = r.left + 1 + gRng() % maxWidth;
+	return r;
+}
+
+// Random sources, masks and clip rects, for one combination of depths.
+// Returns the number of rounds where the two paths disagreed.
+static int CheckDepths(int srcDepth, int maskDepth, int dstDepth, long dstFlags)
+{
+	Rect srcBounds = {0, 0, 24, 40};
+	Rect dstBounds = {0, 0, 50, 60};
+	GWorldPtr src;
+	GWorldPtr mask;
+	GWorldPtr uncompiled;
+	GWorldPtr compiled;
+	NewGWorld(&src, srcDepth, &srcBounds, nullptr, nullptr, 0);
+	NewGWorld(&mask, maskDepth, &srcBounds, nullptr, nullptr, 0);
+	NewGWorld(&uncompiled, dstDepth, &dstBounds, nullptr, nullptr, dstFlags);
+	NewGWorld(&compiled, dstDepth, &dstBounds, nullptr, nullptr, dstFlags);
+
+	int failures = 0;
+	for (int round = 0; round < kRoundsPerCombination; round++)
+	{
+		PaintNoise(src);
+		PaintNoise(mask);
+		PaintNoise(uncompiled);
+		memcpy(GetPixBaseAddr(GetGWorldPixMap(compiled)), GetPixBaseAddr(GetGWorldPixMap(uncompiled)), GetRowBytes(uncompiled) * GetHeight(uncompiled));
+
+		Rect clip = RandomRect(20, 20, 20, 30);
+		clip.bottom += 30;
+		clip.right += 30;
+
+		for (int i = 0; i < kDrawsPerRound; i++)
+		{
+			// Partial source rects, and destinations that stick out of the port
+			Rect srcRect = RandomRect(10, 20, 14, 20);
+			Rect dstRect = srcRect;
+			const int dstLeft = (int) (gRng() % 70) - 10;
+			const int dstTop = (int) (gRng() % 60) - 10;
+			OffsetRect(&dstRect, dstLeft - srcRect.left, dstTop - srcRect.top);
+
+			GetPixBaseAddr(GetGWorldPixMap(mask));		// forget the compiled pair
+
+			SetGWorld(uncompiled, nullptr);
+			ClipRect(&clip);
+			CopyMask(*GetGWorldPixMap(src), *GetGWorldPixMap(mask), *GetGWorldPixMap(uncompiled), &srcRect, &srcRect, &dstRect);
+
+			SetGWorld(compiled, nullptr);
+			ClipRect(&clip);
+			CopyMask(*GetGWorldPixMap(src), *GetGWorldPixMap(mask), *GetGWorldPixMap(compiled), &srcRect, &srcRect, &dstRect);
+		}
+
+		if (!SamePixels(uncompiled, compiled))
+		{
+			printf("MISMATCH: source %d-bit, mask %d-bit, destination %d-bit%s, round %d\n",
+				srcDepth, maskDepth, dstDepth, dstFlags ? " (565)" : "", round);
+			failures++;
+		}
+	}
+
+	DisposeGWorld(src);
+	DisposeGWorld(mask);
+	DisposeGWorld(uncompiled);
+	DisposeGWorld(compiled);
+	return failures;
+}
+
+enum class MaskAccess { kNone, kRead, kWrite };
+
+// A 48x48 32-bit sprite with a 1-bit mask, drawn all over a 16-bit port,
+// accessing the mask's pixels before each draw. Returns ns per draw.
+static double TimeSprite(MaskAccess access)
+{
+	Rect spriteBounds = {0, 0, 48, 48};
+	Rect dstBounds = {0, 0, 480, 640};
+	GWorldPtr src;
+	GWorldPtr mask;
+	GWorldPtr dst;
+	NewGWorld(&src, 32, &spriteBounds, nullptr, nullptr, 0);
+	NewGWorld(&mask, 1, &spriteBounds, nullptr, nullptr, 0);
+	NewGWorld(&dst, 16, &dstBounds, nullptr, nullptr, 0);
+
+	PaintNoise(src);
+
+	// A diamond-ish mask, with a few runs per row
+	static const RGBColor kBlack = {0, 0, 0};
+	SetGWorld(mask, nullptr);
+	RGBForeColor(&kBlack);
+	for (int i = 0; i < 6; i++)
+	{
+		Rect r = {(SInt16) (i * 8), (SInt16) (24 - i * 4), (SInt16) (i * 8 + 8), (SInt16) (24 + i * 4)};
+		PaintRect(&r);
+	}
+
+	SetGWorld(dst, nullptr);
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < kTimedDraws; i++)
+	{
+		if (access == MaskAccess::kWrite)
+			GetPixBaseAddr(GetGWorldPixMap(mask));
+		else if (access == MaskAccess::kRead)
+			GetPixBaseAddrForReading(GetGWorldPixMap(mask));
+		Rect dstRect = spriteBounds;
+		OffsetRect(&dstRect, i % 580, i % 400);
+		CopyMask(*GetGWorldPixMap(src), *GetGWorldPixMap(mask), *GetGWorldPixMap(dst), &spriteBounds, &spriteBounds, &dstRect);
+	}
+	const auto end = std::chrono::steady_clock::now();
+
+	DisposeGWorld(src);
+	DisposeGWorld(mask);
+	DisposeGWorld(dst);
+	return std::chrono::duration<double, std::nano>(end - start).count() / kTimedDraws;
+}
+
+int main()
+{
+	Pomme::Graphics::Init();
+
+	int runs = 0;
+	int failures = 0;
+	for (int srcDepth : {32, 16, 8})
+	{
+		for (int maskDepth : {1, 32, 8})
+		{
+			for (int dstDepth : {32, 16, 8})
+			{
+				failures += CheckDepths(srcDepth, maskDepth, dstDepth, 0);
+				runs += kRoundsPerCombination;
+				if (dstDepth == 16)
+				{
+					failures += CheckDepths(srcDepth, maskDepth, dstDepth, pommeRGB565GWorld);
+					runs += kRoundsPerCombination;
+				}
+			}
+		}
+	}
+
+	printf("%d/%d rounds identical\n", runs - failures, runs);
+	if (failures != 0)
+		return 1;
+
+	const double uncompiledNs = TimeSprite(MaskAccess::kWrite);
+	const double compiledNs = TimeSprite(MaskAccess::kNone);
+	const double readNs = TimeSprite(MaskAccess::kRead);
+	printf("48x48 sprite into a 16-bit port: %.1f ns uncompiled, %.1f ns compiled, %.1f ns compiled with the mask read before each draw\n",
+		uncompiledNs, compiledNs, readNs);
+	return 0;
+}
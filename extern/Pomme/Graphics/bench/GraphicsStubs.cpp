@@ -0,0 +1,24 @@
+// Link stubs for the standalone checks in this directory. Graphics.cpp calls
+// into the file and resource managers (to load fonts and pictures), which the
+// checks never need; these stand in for Files.cpp and Resources.cpp and their
+// dependencies.
+
+#include "Pomme.h"
+#include "PommeFiles.h"
+
+#include <stdexcept>
+
+OSErr FSClose(short)
+{ return noErr; }
+
+OSErr FSpOpenDF(const FSSpec*, char, short*)
+{ return fnfErr; }
+
+Handle GetResource(ResType, short)
+{ return nullptr; }
+
+void ReleaseResource(Handle)
+{}
+
+std::iostream& Pomme::Files::GetStream(short)
+{ throw std::runtime_error("no files in the graphics checks"); }
@@ -0,0 +1,355 @@
+// Check: a presenter's buffers must match a per-pixel conversion of the port
+// it presents, at depths 1, 8, 16 and 32, in BGRA and RGBA, with buffers the
+// size of the port, smaller than it, and larger than it. Frames mix immediate
+// and banded drawing, direct writes damaged by hand, and switching between two
+// ports. Also checks that NewPresenter rejects bad arguments.
+//
+// Not part of the game build. Build and run by hand, from extern/Pomme:
+//
+//     g++ -std=c++17 -O2 -Wno-multichar -I. Graphics/bench/PresenterCheck.cpp Graphics/bench/GraphicsStubs.cpp Graphics/Graphics.cpp Graphics/ARGBPixmap.cpp Graphics/BlitKernels.cpp Graphics/BandWorkers.cpp Graphics/BackgroundJob.cpp Graphics/SystemPalettes.cpp Graphics/PICT.cpp Graphics/Color.cpp Graphics/DamageRects.cpp Graphics/SpanRegion.cpp Memory/Memory.cpp PommeDebug.cpp Utilities/structpack.cpp Utilities/memstream.cpp Utilities/bigendianstreams.cpp Utilities/IEEEExtended.cpp -o PresenterCheck -lpthread
+//     ./PresenterCheck
+//
+// Run it with POMME_BLIT=scalar as well, and with -fsanitize=thread to check
+// the background conversion.
+
+#include "Pomme.h"
+#include "PommeGraphics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+static constexpr int kNumSprites = 4;
+static constexpr int kFramesPerRun = 18;
+static constexpr Byte kUntouched = 0xCD;
+
+static Rect gPortRect = {0, 0, 300, 400};
+
+struct World
+{
+	GWorldPtr ports[2];
+	std::vector<GWorldPtr> srcs;
+	std::vector<GWorldPtr> masks;
+};
+
+static void RandomColors(std::mt19937& rng)
+{
+	RGBColor fore = {(UInt16) rng(), (UInt16) rng(), (UInt16) rng()};
+	RGBColor back = {(UInt16) rng(), (UInt16) rng(), (UInt16) rng()};
+	RGBForeColor(&fore);
+	RGBBackColor(&back);
+}
+
+static Rect RandomRect(std::mt19937& rng)
+{
+	// May stick out of the port on any side
+	Rect r;
+	r.left = (int) (rng() % 440) - 20;
+	r.top = (int) (rng() % 340) - 20;
+	r.right = r.left + rng() % 80;
+	r.bottom = r.top + rng() % 80;
+	return r;
+}
+
+static void PaintNoise(std::mt19937& rng, GWorldPtr gworld)
+{
+	const Rect& bounds = gworld->portRect;
+	SetGWorld(gworld, nullptr);
+	for (int i = 0; i < 40; i++)
+	{
+		RGBColor c = {(UInt16) rng(), (UInt16) rng(), (UInt16) rng()};
+		RGBForeColor(&c);
+		Rect r;
+		r.top = rng() % bounds.bottom;
+		r.left = rng() % bounds.right;
+		r.bottom = r.top + 1 + rng() % 12;
+		r.right = r.left + 1 + rng() % 12;
+		PaintOval(&r);
+	}
+}
+
+static World MakeWorld(std::mt19937& rng, int depth)
+{
+	static const int kSrcDepths[] = {32, 16, 8, 1};
+	static const RGBColor kWhite = {0xFFFF, 0xFFFF, 0xFFFF};
+
+	World world;
+	NewGWorld(&world.ports[0], depth, &gPortRect, nullptr, nullptr, 0);
+	NewGWorld(&world.ports[1], depth, &gPortRect, nullptr, nullptr, 0);
+
+	for (int i = 0; i < kNumSprites; i++)
+	{
+		Rect r = {0, 0, (SInt16) (8 + rng() % 50), (SInt16) (8 + rng() % 50)};
+		GWorldPtr src;
+		GWorldPtr mask;
+		NewGWorld(&src, kSrcDepths[i], &r, nullptr, nullptr, 0);
+		NewGWorld(&mask, 1, &r, nullptr, nullptr, 0);
+		PaintNoise(rng, src);
+		SetGWorld(mask, nullptr);
+		RGBForeColor(&kWhite);
+		PaintRect(&r);
+		PaintNoise(rng, mask);
+		world.srcs.push_back(src);
+		world.masks.push_back(mask);
+	}
+	return world;
+}
+
+static void DisposeWorld(World& world)
+{
+	DisposeGWorld(world.ports[0]);
+	DisposeGWorld(world.ports[1]);
+	for (int i = 0; i < kNumSprites; i++)
+	{
+		DisposeGWorld(world.srcs[i]);
+		DisposeGWorld(world.masks[i]);
+	}
+}
+
+// A frame's worth of random drawing into the port, immediate or banded
+static void DrawFrame(std::mt19937& rng, World& world, GWorldPtr port, bool banded)
+{
+	if (banded)
+		BeginBandedFrame(port);
+
+	SetGWorld(port, nullptr);
+	const int numOps = 20 + rng() % 40;
+	for (int i = 0; i < numOps; i++)
+	{
+		const int k = rng() % kNumSprites;
+		RandomColors(rng);
+		switch (rng() % 4)
+		{
+			case 0:
+			{
+				Rect r = RandomRect(rng);
+				PaintRect(&r);
+				break;
+			}
+			case 1:
+			{
+				Rect srcRect = world.srcs[k]->portRect;
+				Rect dstRect = srcRect;
+				OffsetRect(&dstRect, (int) (rng() % 440) - 20, (int) (rng() % 340) - 20);
+				CopyMask(*GetGWorldPixMap(world.srcs[k]), *GetGWorldPixMap(world.masks[k]), *GetGWorldPixMap(port), &srcRect, &srcRect, &dstRect);
+				break;
+			}
+			case 2:
+			{
+				std::vector<SpriteBatchItem> items(20 + rng() % 40);
+				for (SpriteBatchItem& item : items)
+				{
+					const int j = rng() % kNumSprites;
+					item.src = world.srcs[j];
+					item.mask = world.masks[j];
+					item.srcRect = world.srcs[j]->portRect;
+					item.dstPoint.v = (int) (rng() % 340) - 20;
+					item.dstPoint.h = (int) (rng() % 440) - 20;
+					item.layer = rng() % 3;
+				}
+				DrawSpriteBatch(items.data(), (long) items.size());
+				break;
+			}
+			case 3:
+			{
+				MoveTo((int) (rng() % 440) - 20, (int) (rng() % 340) - 20);
+				DrawStringC("Presented 123");
+				break;
+			}
+		}
+	}
+
+	if (banded)
+		EndBandedFrame();
+}
+
+// Writes to a band of rows behind QuickDraw's back, and damages it by hand
+static void WriteDirectly(std::mt19937& rng, GWorldPtr port)
+{
+	SetGWorld(port, nullptr);
+	PixMapHandle pixMap = GetGWorldPixMap(port);
+	Byte* pixels = (Byte*) GetPixBaseAddr(pixMap);
+	const int rowBytes = (*pixMap)->rowBytes & 0x3FFF;
+	const int top = rng() % (gPortRect.bottom - 20);
+	for (int y = top; y < top + 20; y++)
+	{
+		for (int i = 0; i < rowBytes; i++)
+			pixels[y * rowBytes + i] ^= (Byte) rng();
+	}
+	Rect damage = {(SInt16) top, 0, (SInt16) (top + 20), gPortRect.right};
+	DamagePortRegion(&damage);
+}
+
+// Compares the latest presented frame against the port converted to 32 bits
+// and swizzled one pixel at a time. Parts of the buffer the port doesn't cover
+// must be left alone.
+static bool MatchesPort(PresenterPtr presenter, GWorldPtr port, GWorldPtr argb, int width, int height, long format, long rowBytes)
+{
+	const Byte* presented = (const Byte*) GetPresentedFrame(presenter, true);
+	if (!presented)
+	{
+		printf("MISMATCH: no presented frame\n");
+		return false;
+	}
+
+	SetGWorld(argb, nullptr);
+	ForeColor(blackColor);
+	BackColor(whiteColor);
+	CopyBits(*GetGWorldPixMap(port), *GetGWorldPixMap(argb), &gPortRect, &gPortRect, srcCopy, nullptr);
+	const Byte* argbPixels = (const Byte*) GetPixBaseAddr(GetGWorldPixMap(argb));
+	const int argbRowBytes = (*GetGWorldPixMap(argb))->rowBytes & 0x3FFF;
+
+	const int coveredWidth = std::min(width, (int) gPortRect.right);
+	const int coveredHeight = std::min(height, (int) gPortRect.bottom);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < rowBytes / 4; x++)
+		{
+			const Byte* got = presented + y * rowBytes + x * 4;
+			Byte expected[4];
+			if (x >= coveredWidth || y >= coveredHeight)
+			{
+				memset(expected, kUntouched, 4);
+			}
+			else
+			{
+				const Byte* s = argbPixels + y * argbRowBytes + x * 4;
+				if (format == pommePresentBGRA)
+				{
+					expected[0] = s[3];
+					expected[1] = s[2];
+					expected[2] = s[1];
+					expected[3] = s[0];
+				}
+				else
+				{
+					expected[0] = s[1];
+					expected[1] = s[2];
+					expected[2] = s[3];
+					expected[3] = s[0];
+				}
+			}
+
+			if (0 != memcmp(got, expected, 4))
+			{
+				printf("MISMATCH at %d,%d: %02X%02X%02X%02X, expected %02X%02X%02X%02X\n", x, y,
+					got[0], got[1], got[2], got[3], expected[0], expected[1], expected[2], expected[3]);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Presents 18 frames into buffers of the given size. Returns the number of
+// checked frames that didn't match, and adds the number checked to `checks`.
+static int CheckPresenter(int depth, long format, int width, int height, int& checks)
+{
+	std::mt19937 rng(depth * 7 + format);
+	World world = MakeWorld(rng, depth);
+	GWorldPtr argb;
+	NewGWorld(&argb, 32, &gPortRect, nullptr, nullptr, 0);
+
+	// Odd widths get padding at the end of each row
+	const long rowBytes = width * 4 + 8 * (width & 1);
+	std::vector<Byte> buffer1(rowBytes * height, kUntouched);
+	std::vector<Byte> buffer2(rowBytes * height, kUntouched);
+
+	PresenterPtr presenter;
+	if (noErr != NewPresenter(&presenter, width, height, format, buffer1.data(), buffer2.data(), rowBytes))
+	{
+		printf("NewPresenter failed: %dx%d\n", width, height);
+		return 1;
+	}
+
+	int failures = 0;
+	if (GetPresentedFrame(presenter, false))
+	{
+		printf("GetPresentedFrame returned a frame before anything was presented\n");
+		failures++;
+	}
+
+	for (int frame = 0; frame < kFramesPerRun; frame++)
+	{
+		// A few frames from one port, then a few from the other
+		GWorldPtr port = world.ports[(frame / 6) % 2];
+
+		// A frame of drawing, then a frame with only a direct write, then an
+		// empty frame that's checked. The empty frame's buffer must catch up
+		// with both earlier frames, and only damage says where the write was.
+		switch (frame % 3)
+		{
+			case 0:
+				DrawFrame(rng, world, port, frame % 2 == 1);
+				break;
+			case 1:
+				WriteDirectly(rng, port);
+				break;
+		}
+
+		PresentPort(presenter, port);
+
+		// Display the previous frame while this one converts
+		if (frame % 2 == 1)
+			GetPresentedFrame(presenter, false);
+
+		if (frame % 3 == 2)
+		{
+			checks++;
+			if (!MatchesPort(presenter, port, argb, width, height, format, rowBytes))
+			{
+				printf("  %d-bit, %s, %dx%d, frame %d\n", depth, format == pommePresentBGRA ? "BGRA" : "RGBA", width, height, frame);
+				failures++;
+			}
+		}
+	}
+
+	DisposePresenter(presenter);
+	DisposeGWorld(argb);
+	DisposeWorld(world);
+	return failures;
+}
+
+static bool RejectsBadArguments()
+{
+	PresenterPtr presenter;
+	Byte buffer[64];
+	return paramErr == NewPresenter(&presenter, 4, 2, 7, buffer, buffer + 32, 16)						// unknown format
+		&& paramErr == NewPresenter(&presenter, 4, 2, pommePresentBGRA, buffer, buffer + 32, 14)		// rows too short
+		&& paramErr == NewPresenter(&presenter, 4, 2, pommePresentBGRA, buffer, buffer, 16)			// same buffer twice
+		&& paramErr == NewPresenter(&presenter, 0, 2, pommePresentBGRA, buffer, buffer + 32, 16);		// empty
+}
+
+int main()
+{
+	Pomme::Graphics::Init();
+
+	static const struct { int width, height; } kSizes[] =
+	{
+		{400, 300},		// same as the port
+		{333, 251},		// cropped
+		{421, 317},		// larger than the port
+	};
+
+	int checks = 0;
+	int failures = 0;
+	for (int depth : {32, 16, 8, 1})
+	{
+		for (long format : {pommePresentBGRA, pommePresentRGBA})
+		{
+			for (const auto& size : kSizes)
+				failures += CheckPresenter(depth, format, size.width, size.height, checks);
+		}
+	}
+
+	if (!RejectsBadArguments())
+	{
+		printf("NewPresenter accepted bad arguments\n");
+		failures++;
+	}
+
+	printf("%d/%d presented frames match their port\n", checks - std::min(failures, checks), checks);
+	return failures != 0;
+}
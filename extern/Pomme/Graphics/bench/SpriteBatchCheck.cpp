@@ -0,0 +1,254 @@
+// Check: DrawSpriteBatch must write the same bytes and report the same damage
+// rects as the equivalent sequence of CopyMask calls, at 1, 8, 16 and 32 bits,
+// with a mix of source and mask depths, partial and out-of-bounds source rects,
+// and a clip region with a hole in it. Then times a 300-sprite batch against
+// 300 CopyMask calls into a 16-bit port.
+//
+// Batches of 16 sprites or more are split into bands when the machine has
+// several cores. Run with POMME_BAND_THREADS=4 to cover the banded path on
+// any machine.
+//
+// Not part of the game build. Build and run by hand, from extern/Pomme:
+//
+//     g++ -std=c++17 -O2 -Wno-multichar -I. Graphics/bench/SpriteBatchCheck.cpp Graphics/bench/GraphicsStubs.cpp Graphics/Graphics.cpp Graphics/ARGBPixmap.cpp Graphics/BlitKernels.cpp Graphics/BandWorkers.cpp Graphics/BackgroundJob.cpp Graphics/SystemPalettes.cpp Graphics/PICT.cpp Graphics/Color.cpp Graphics/DamageRects.cpp Graphics/SpanRegion.cpp Memory/Memory.cpp PommeDebug.cpp Utilities/structpack.cpp Utilities/memstream.cpp Utilities/bigendianstreams.cpp Utilities/IEEEExtended.cpp -o SpriteBatchCheck -lpthread
+//     ./SpriteBatchCheck
+
+#include "Pomme.h"
+#include "PommeGraphics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+static constexpr int kSpriteKinds = 8;
+static constexpr int kBatchesPerDepth = 60;
+static constexpr int kMaxDamageRects = 64;
+static constexpr int kTimedFrames = 200;
+
+static Rect gPortBounds = {0, 0, 300, 400};
+
+static std::mt19937 gRng(11);
+
+static void PaintNoise(GWorldPtr gworld)
+{
+	const Rect& bounds = gworld->portRect;
+	SetGWorld(gworld, nullptr);
+	for (int i = 0; i < 40; i++)
+	{
+		RGBColor c = {(UInt16) gRng(), (UInt16) gRng(), (UInt16) gRng()};
+		RGBForeColor(&c);
+		Rect r;
+		r.top = gRng() % bounds.bottom;
+		r.left = gRng() % bounds.right;
+		r.bottom = r.top + 1 + gRng() % 12;
+		r.right = r.left + 1 + gRng() % 12;
+		PaintOval(&r);
+	}
+}
+
+static std::vector<SpriteBatchItem> RandomBatch(const std::vector<GWorldPtr>& srcs, const std::vector<GWorldPtr>& masks, int count)
+{
+	std::vector<SpriteBatchItem> items(count);
+	for (SpriteBatchItem& item : items)
+	{
+		const int kind = gRng() % kSpriteKinds;
+		item.src = srcs[kind];
+		item.mask = masks[kind];
+		item.srcRect = srcs[kind]->portRect;
+		if (gRng() % 4 == 0)
+		{
+			// Partial, and sometimes sticking out of the source
+			item.srcRect.left += gRng() % 5;
+			item.srcRect.top += gRng() % 5;
+			item.srcRect.right += (int) (gRng() % 9) - 4;
+		}
+		item.dstPoint.v = (int) (gRng() % 340) - 20;
+		item.dstPoint.h = (int) (gRng() % 440) - 20;
+		item.layer = gRng() % 4;
+	}
+	return items;
+}
+
+// What DrawSpriteBatch is meant to do, one CopyMask at a time
+static void DrawWithCopyMask(const std::vector<SpriteBatchItem>& items, GWorldPtr dst)
+{
+	std::vector<int> order(items.size());
+	for (size_t i = 0; i < items.size(); i++)
+		order[i] = (int) i;
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return items[a].layer < items[b].layer; });
+
+	for (int i : order)
+	{
+		const SpriteBatchItem& item = items[i];
+		Rect srcRect;
+		SectRect(&item.srcRect, &item.src->portRect, &srcRect);
+		SectRect(&srcRect, &item.mask->portRect, &srcRect);
+		if (EmptyRect(&srcRect))
+			continue;
+
+		Rect dstRect = srcRect;
+		OffsetRect(&dstRect, item.dstPoint.h - item.srcRect.left, item.dstPoint.v - item.srcRect.top);
+		CopyMask(*GetGWorldPixMap(item.src), *GetGWorldPixMap(item.mask), *GetGWorldPixMap(dst), &srcRect, &srcRect, &dstRect);
+	}
+}
+
+static bool CheckDepth(int dstDepth)
+{
+	static const int kSrcDepths[] = {32, 16, 8, 1};
+	static const int kMaskDepths[] = {1, 32, 8};
+	static const RGBColor kWhite = {0xFFFF, 0xFFFF, 0xFFFF};
+	static const RGBColor kFill = {0x4000, 0x8000, 0xC000};
+	static const RGBColor kRed = {0xFFFF, 0, 0};
+	static const RGBColor kGreen = {0, 0xFFFF, 0};
+
+	GWorldPtr batched;
+	GWorldPtr sequential;
+	NewGWorld(&batched, dstDepth, &gPortBounds, nullptr, nullptr, 0);
+	NewGWorld(&sequential, dstDepth, &gPortBounds, nullptr, nullptr, 0);
+
+	std::vector<GWorldPtr> srcs;
+	std::vector<GWorldPtr> masks;
+	for (int i = 0; i < kSpriteKinds; i++)
+	{
+		Rect bounds = {0, 0, (SInt16) (8 + gRng() % 50), (SInt16) (8 + gRng() % 50)};
+		GWorldPtr src;
+		GWorldPtr mask;
+		NewGWorld(&src, kSrcDepths[i % 4], &bounds, nullptr, nullptr, 0);
+		NewGWorld(&mask, kMaskDepths[i % 3], &bounds, nullptr, nullptr, 0);
+		PaintNoise(src);
+		SetGWorld(mask, nullptr);
+		RGBForeColor(&kWhite);
+		PaintRect(&bounds);
+		PaintNoise(mask);
+		srcs.push_back(src);
+		masks.push_back(mask);
+	}
+
+	bool ok = true;
+	for (int batch = 0; batch < kBatchesPerDepth && ok; batch++)
+	{
+		// Every third batch is too small to be banded
+		const int count = batch % 3 == 0 ? 5 : 50 + gRng() % 400;
+		const std::vector<SpriteBatchItem> items = RandomBatch(srcs, masks, count);
+
+		Rect clipRect;
+		clipRect.top = gRng() % 30;
+		clipRect.left = gRng() % 30;
+		clipRect.bottom = gPortBounds.bottom - gRng() % 30;
+		clipRect.right = gPortBounds.right - gRng() % 30;
+		RgnHandle clip = NewRgn();
+		RgnHandle hole = NewRgn();
+		RectRgn(clip, &clipRect);
+		SetRectRgn(hole, 100, 100, 150, 220);
+		DiffRgn(clip, hole, clip);
+
+		Rect damage[2][kMaxDamageRects];
+		short damageCount[2];
+		for (GWorldPtr gworld : {batched, sequential})
+		{
+			SetGWorld(gworld, nullptr);
+			ClipRect(&gPortBounds);
+			RGBForeColor(&kFill);
+			PaintRect(&gPortBounds);
+			SetClip(clip);
+			RGBForeColor(&kRed);		// 1-bit sources are colorized
+			RGBBackColor(&kGreen);
+			ClearPortDamage();
+
+			if (gworld == batched)
+				DrawSpriteBatch(items.data(), count);
+			else
+				DrawWithCopyMask(items, gworld);
+
+			const int i = gworld == batched ? 0 : 1;
+			damageCount[i] = GetPortDamageRects(damage[i], kMaxDamageRects);
+		}
+
+		const int rowBytes = (*GetGWorldPixMap(batched))->rowBytes & 0x3FFF;
+		if (0 != memcmp(GetPixBaseAddr(GetGWorldPixMap(batched)), GetPixBaseAddr(GetGWorldPixMap(sequential)), rowBytes * gPortBounds.bottom))
+		{
+			printf("MISMATCH: %d-bit, batch %d, %d sprites\n", dstDepth, batch, count);
+			ok = false;
+		}
+		else if (damageCount[0] != damageCount[1] || 0 != memcmp(damage[0], damage[1], damageCount[0] * sizeof(Rect)))
+		{
+			printf("DAMAGE MISMATCH: %d-bit, batch %d: %d rects, expected %d\n", dstDepth, batch, damageCount[0], damageCount[1]);
+			ok = false;
+		}
+
+		DisposeRgn(clip);
+		DisposeRgn(hole);
+	}
+
+	for (int i = 0; i < kSpriteKinds; i++)
+	{
+		DisposeGWorld(srcs[i]);
+		DisposeGWorld(masks[i]);
+	}
+	DisposeGWorld(batched);
+	DisposeGWorld(sequential);
+	return ok;
+}
+
+// 300 40x48 sprites into a 16-bit port, as a batch or with CopyMask.
+// Returns us per frame.
+static double TimeFrame(bool batched)
+{
+	Rect portBounds = {0, 0, 420, 620};
+	Rect spriteBounds = {0, 0, 40, 48};
+	GWorldPtr dst;
+	GWorldPtr src;
+	GWorldPtr mask;
+	NewGWorld(&dst, 16, &portBounds, nullptr, nullptr, 0);
+	NewGWorld(&src, 16, &spriteBounds, nullptr, nullptr, 0);
+	NewGWorld(&mask, 1, &spriteBounds, nullptr, nullptr, 0);
+	PaintNoise(src);
+	PaintNoise(mask);
+
+	std::vector<SpriteBatchItem> items(300);
+	for (SpriteBatchItem& item : items)
+	{
+		item.src = src;
+		item.mask = mask;
+		item.srcRect = spriteBounds;
+		item.dstPoint.v = gRng() % 400;
+		item.dstPoint.h = gRng() % 600;
+		item.layer = gRng() % 6;
+	}
+
+	SetGWorld(dst, nullptr);
+	const auto start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < kTimedFrames; frame++)
+	{
+		if (batched)
+			DrawSpriteBatch(items.data(), (long) items.size());
+		else
+			DrawWithCopyMask(items, dst);
+	}
+	const auto end = std::chrono::steady_clock::now();
+
+	DisposeGWorld(dst);
+	DisposeGWorld(src);
+	DisposeGWorld(mask);
+	return std::chrono::duration<double, std::micro>(end - start).count() / kTimedFrames;
+}
+
+int main()
+{
+	Pomme::Graphics::Init();
+
+	for (int depth : {16, 32, 8, 1})
+	{
+		if (!CheckDepth(depth))
+			return 1;
+	}
+	printf("Batches identical to CopyMask at 1, 8, 16 and 32 bits, with the same damage rects\n");
+
+	const double copyMaskUs = TimeFrame(false);
+	const double batchUs = TimeFrame(true);
+	printf("300 40x48 sprites into a 16-bit port: %.1f us with CopyMask, %.1f us batched\n", copyMaskUs, batchUs);
+	return 0;
+}
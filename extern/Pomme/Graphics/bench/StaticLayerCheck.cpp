@@ -0,0 +1,160 @@
+// Check: a static layer is redrawn exactly when one of its sources changes
+// (drawing, GetPixBaseAddr, disposal) or it's invalidated, and never because
+// of drawing into the port it's composited onto or reading a source's pixels
+// with GetPixBaseAddrForReading. Also checks that the composited layer looks
+// the same as drawing its sources directly.
+//
+// Not part of the game build. Build and run by hand, from extern/Pomme:
+//
+//     g++ -std=c++17 -O2 -Wno-multichar -I. Graphics/bench/StaticLayerCheck.cpp Graphics/bench/GraphicsStubs.cpp Graphics/Graphics.cpp Graphics/ARGBPixmap.cpp Graphics/BlitKernels.cpp Graphics/BandWorkers.cpp Graphics/BackgroundJob.cpp Graphics/SystemPalettes.cpp Graphics/PICT.cpp Graphics/Color.cpp Graphics/DamageRects.cpp Graphics/SpanRegion.cpp Memory/Memory.cpp PommeDebug.cpp Utilities/structpack.cpp Utilities/memstream.cpp Utilities/bigendianstreams.cpp Utilities/IEEEExtended.cpp -o StaticLayerCheck -lpthread
+//     ./StaticLayerCheck
+
+#include "Pomme.h"
+#include "PommeGraphics.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+static Rect gBounds = {0, 0, 20, 30};
+static Rect gSpriteBounds = {0, 0, 4, 4};
+static Rect gSpriteDst = {5, 5, 9, 9};
+
+static GWorldPtr gBackground;
+static GWorldPtr gSprite;
+static GWorldPtr gMask;
+
+static int gRedraws = 0;
+static int gFailures = 0;
+
+static void DrawSources(GWorldPtr dst)
+{
+	CopyBits(*GetGWorldPixMap(gBackground), *GetGWorldPixMap(dst), &gBounds, &gBounds, srcCopy, nullptr);
+	CopyMask(*GetGWorldPixMap(gSprite), *GetGWorldPixMap(gMask), *GetGWorldPixMap(dst), &gSpriteBounds, &gSpriteBounds, &gSpriteDst);
+}
+
+// One game frame: bring the layer up to date if needed, then composite it
+static void DrawFrame(StaticLayerPtr layer, GWorldPtr dst)
+{
+	if (BeginStaticLayer(layer))
+	{
+		gRedraws++;
+		DrawSources(GetStaticLayerGWorld(layer));
+		EndStaticLayer(layer);
+	}
+	SetGWorld(dst, nullptr);
+	DrawStaticLayer(layer, &gBounds);
+}
+
+static void Expect(const char* what, int expectedRedraws)
+{
+	if (gRedraws != expectedRedraws)
+	{
+		printf("FAIL: %s: %d redraws, expected %d\n", what, gRedraws, expectedRedraws);
+		gFailures++;
+	}
+}
+
+static bool SamePixels(GWorldPtr a, GWorldPtr b)
+{
+	const int rowBytes = (*GetGWorldPixMap(a))->rowBytes & 0x3FFF;
+	return 0 == memcmp(GetPixBaseAddr(GetGWorldPixMap(a)), GetPixBaseAddr(GetGWorldPixMap(b)), rowBytes * (gBounds.bottom - gBounds.top));
+}
+
+int main()
+{
+	Pomme::Graphics::Init();
+
+	static const RGBColor kRed = {0xFFFF, 0, 0};
+	static const RGBColor kBlack = {0, 0, 0};
+
+	NewGWorld(&gBackground, 32, &gBounds, nullptr, nullptr, 0);
+	NewGWorld(&gSprite, 32, &gSpriteBounds, nullptr, nullptr, 0);
+	NewGWorld(&gMask, 1, &gSpriteBounds, nullptr, nullptr, 0);
+
+	GWorldPtr dst;
+	GWorldPtr direct;
+	NewGWorld(&dst, 16, &gBounds, nullptr, nullptr, 0);
+	NewGWorld(&direct, 16, &gBounds, nullptr, nullptr, 0);
+
+	StaticLayerPtr layer;
+	NewStaticLayer(&layer, 16, &gBounds, 0);
+
+	SetGWorld(gBackground, nullptr);
+	RGBForeColor(&kRed);
+	PaintRect(&gBounds);
+	SetGWorld(gMask, nullptr);
+	RGBForeColor(&kBlack);
+	PaintRect(&gSpriteBounds);
+
+	for (int i = 0; i < 5; i++)
+		DrawFrame(layer, dst);
+	Expect("5 unchanged frames", 1);
+
+	DrawSources(direct);
+	if (!SamePixels(dst, direct))
+	{
+		printf("FAIL: the composited layer differs from drawing its sources directly\n");
+		gFailures++;
+	}
+
+	SetGWorld(gSprite, nullptr);
+	RGBForeColor(&kRed);
+	PaintRect(&gSpriteBounds);
+	DrawFrame(layer, dst);
+	DrawFrame(layer, dst);
+	Expect("painting a source", 2);
+
+	GetPixBaseAddr(GetGWorldPixMap(gMask));
+	DrawFrame(layer, dst);
+	DrawFrame(layer, dst);
+	Expect("GetPixBaseAddr on a source", 3);
+
+	GetPixBaseAddrForReading(GetGWorldPixMap(gMask));
+	DrawFrame(layer, dst);
+	Expect("GetPixBaseAddrForReading on a source", 3);
+
+	InvalidateStaticLayer(layer);
+	DrawFrame(layer, dst);
+	Expect("InvalidateStaticLayer", 4);
+
+	SetGWorld(dst, nullptr);
+	PaintRect(&gBounds);
+	DrawFrame(layer, dst);
+	Expect("painting the destination", 4);
+
+	// Nesting is a logic error
+	InvalidateStaticLayer(layer);
+	BeginStaticLayer(layer);
+	try
+	{
+		BeginStaticLayer(layer);
+		printf("FAIL: nested BeginStaticLayer didn't throw\n");
+		gFailures++;
+	}
+	catch (const std::logic_error&)
+	{
+	}
+	EndStaticLayer(layer);
+
+	// That left the layer with no sources: draw them again, then dispose of one
+	InvalidateStaticLayer(layer);
+	DrawFrame(layer, dst);
+	Expect("redrawing after an empty layer", 5);
+	DisposeGWorld(gSprite);
+	NewGWorld(&gSprite, 32, &gSpriteBounds, nullptr, nullptr, 0);
+	DrawFrame(layer, dst);
+	Expect("disposing of a source", 6);
+
+	DisposeStaticLayer(layer);
+	DisposeGWorld(gBackground);
+	DisposeGWorld(gSprite);
+	DisposeGWorld(gMask);
+	DisposeGWorld(dst);
+	DisposeGWorld(direct);
+
+	if (gFailures != 0)
+		return 1;
+	printf("Static layers redrawn exactly when needed\n");
+	return 0;
+}
@@ -0,0 +1,223 @@
+// Check: DrawStringC must draw the same pixels with and without the string
+// cache, at 8, 16 and 32 bits, over random strings, colors, pen positions and
+// clip rects. At 32 bits, the output is also compared to a per-pixel rendering
+// of the font bits. Then times DrawStringC with and without the cache.
+//
+// Not part of the game build. Build and run by hand, from extern/Pomme:
+//
+//     g++ -std=c++17 -O2 -Wno-multichar -I. Graphics/bench/TextCheck.cpp Graphics/bench/GraphicsStubs.cpp Graphics/Graphics.cpp Graphics/ARGBPixmap.cpp Graphics/BlitKernels.cpp Graphics/BandWorkers.cpp Graphics/BackgroundJob.cpp Graphics/SystemPalettes.cpp Graphics/PICT.cpp Graphics/Color.cpp Graphics/DamageRects.cpp Graphics/SpanRegion.cpp Memory/Memory.cpp PommeDebug.cpp Utilities/structpack.cpp Utilities/memstream.cpp Utilities/bigendianstreams.cpp Utilities/IEEEExtended.cpp -o TextCheck -lpthread
+//     ./TextCheck
+
+#include "Pomme.h"
+#include "PommeGraphics.h"
+#include "Graphics/SysFont.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Pomme;
+
+static constexpr int kWidth = 80;
+static constexpr int kHeight = 40;
+static constexpr int kTrialsPerDepth = 3000;
+static constexpr int kTimedDraws = 100'000;
+
+static const RGBColor kGray = {0x8000, 0x8000, 0x8000};
+
+enum Expected { kUntouched, kBackground, kForeground };
+
+static void MarkGlyph(std::vector<Expected>& expected, char c, int left, int top)
+{
+	const SysFont::Glyph& glyph = SysFont::GetGlyph(c);
+	for (int row = 0; row < SysFont::rows; row++)
+	{
+		for (int bit = 0; bit < SysFont::widthBits; bit++)
+		{
+			const int x = left + bit;
+			const int y = top + row;
+			if (((glyph.bits[row] >> bit) & 1) && x >= 0 && y >= 0 && x < kWidth && y < kHeight)
+				expected[y * kWidth + x] = kForeground;
+		}
+	}
+}
+
+// What DrawStringC(s) at (penX, penY) followed by DrawChar(extraChar) should
+// leave in each pixel, ignoring the clip rect
+static std::vector<Expected> RenderReference(const std::string& s, char extraChar, int penX, int penY)
+{
+	std::vector<Expected> expected(kWidth * kHeight, kUntouched);
+
+	const int top = penY - SysFont::ascend;
+	const int width = TextWidthC(s.c_str());
+	for (int y = std::max(top, 0); y < std::min(penY + SysFont::descend, kHeight); y++)
+	{
+		for (int x = std::max(penX, 0); x < std::min(penX + width, kWidth); x++)
+			expected[y * kWidth + x] = kBackground;
+	}
+
+	int left = penX - SysFont::leftMargin;
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		if (i != 0)
+			left += SysFont::charSpacing;
+		MarkGlyph(expected, s[i], left, top);
+		left += SysFont::GetGlyph(s[i]).width;
+	}
+
+	// DrawChar draws no background
+	MarkGlyph(expected, extraChar, penX + width - SysFont::leftMargin, top);
+	return expected;
+}
+
+// Compares a 32-bit port against the reference, telling the gray fill, the
+// background color and the foreground color apart
+static bool MatchesReference(GWorldPtr gworld, const std::vector<Expected>& expected, const Rect& clip, const RGBColor& fg, const RGBColor& bg)
+{
+	// Colors that can't be told apart from the gray fill make the check meaningless
+	if ((fg.red >> 8) == 0x80 || (bg.red >> 8) == 0x80)
+		return true;
+
+	const Byte* pixels = (const Byte*) GetPixBaseAddr(GetGWorldPixMap(gworld));
+	for (int y = 0; y < kHeight; y++)
+	{
+		for (int x = 0; x < kWidth; x++)
+		{
+			const Byte* argb = pixels + (y * kWidth + x) * 4;
+			Expected got;
+			if (argb[1] == 0x80 && argb[2] == 0x80)
+				got = kUntouched;
+			else if (argb[1] == (fg.red >> 8) && argb[2] == (fg.green >> 8) && argb[3] == (fg.blue >> 8))
+				got = kForeground;
+			else
+				got = kBackground;
+
+			const bool inClip = x >= clip.left && x < clip.right && y >= clip.top && y < clip.bottom;
+			const Expected want = inClip ? expected[y * kWidth + x] : kUntouched;
+
+			// A background the same red as the foreground reads as foreground
+			if (got != want && !(want == kBackground && (bg.red >> 8) == (fg.red >> 8)))
+			{
+				printf("MISMATCH against the font bits at %d,%d: got %d, expected %d\n", x, y, got, want);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool CheckDepth(int depth, std::mt19937& rng)
+{
+	Rect bounds = {0, 0, kHeight, kWidth};
+	GWorldPtr uncached;
+	GWorldPtr cached;
+	NewGWorld(&uncached, depth, &bounds, nullptr, nullptr, 0);
+	NewGWorld(&cached, depth, &bounds, nullptr, nullptr, 0);
+
+	bool ok = true;
+	for (int trial = 0; trial < kTrialsPerDepth && ok; trial++)
+	{
+		std::string s;
+		const int length = rng() % 8;
+		for (int i = 0; i < length; i++)
+			s += (char) (30 + rng() % 100);		// includes a few codepoints the font doesn't have
+		if (trial % 5 == 0)
+			s = "j" + s;		// a glyph that hangs below the background rect
+
+		const int penX = (int) (rng() % (kWidth + 40)) - 30;
+		const int penY = (int) (rng() % (kHeight + 20)) - 5;
+
+		RGBColor fg = {(UInt16) rng(), (UInt16) rng(), (UInt16) rng()};
+		RGBColor bg = {(UInt16) rng(), (UInt16) rng(), (UInt16) rng()};
+		if (trial % 3 != 0)
+		{
+			// Mostly the same colors, so that the cache gets hits
+			fg = {0xFFFF, 0, 0};
+			bg = {0, 0, 0xFFFF};
+		}
+
+		Rect clip;
+		clip.top = rng() % 10;
+		clip.left = rng() % 10;
+		clip.bottom = kHeight - rng() % 10;
+		clip.right = kWidth - rng() % 10;
+
+		for (GWorldPtr gworld : {uncached, cached})
+		{
+			const bool useCache = gworld == cached;
+			SetGWorld(gworld, nullptr);
+			ClipRect(&bounds);
+			RGBForeColor(&kGray);
+			PaintRect(&bounds);
+			ClipRect(&clip);
+			RGBForeColor(&fg);
+			RGBBackColor(&bg);
+			SetStringCacheEnabled(useCache);
+			for (int i = 0; i < (useCache ? 2 : 1); i++)		// the second draw comes from the cache
+			{
+				MoveTo(penX, penY);
+				DrawStringC(s.c_str());
+			}
+			DrawChar('X');
+		}
+
+		if (0 != memcmp(GetPixBaseAddr(GetGWorldPixMap(uncached)), GetPixBaseAddr(GetGWorldPixMap(cached)), kWidth * kHeight * depth / 8))
+		{
+			printf("MISMATCH between cached and uncached: %d-bit, trial %d, \"%s\"\n", depth, trial, s.c_str());
+			ok = false;
+		}
+		else if (depth == 32)
+		{
+			ok = MatchesReference(uncached, RenderReference(s, 'X', penX, penY), clip, fg, bg);
+		}
+	}
+
+	SetStringCacheEnabled(false);
+	DisposeGWorld(uncached);
+	DisposeGWorld(cached);
+	return ok;
+}
+
+// A 15-character string into a 16-bit port. Returns ns per DrawStringC.
+static double TimeDrawString(bool useCache)
+{
+	Rect bounds = {0, 0, 480, 640};
+	GWorldPtr gworld;
+	NewGWorld(&gworld, 16, &bounds, nullptr, nullptr, 0);
+	SetGWorld(gworld, nullptr);
+	SetStringCacheEnabled(useCache);
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < kTimedDraws; i++)
+	{
+		MoveTo(20 + i % 400, 20 + i % 440);
+		DrawStringC("Score: 00123456");
+	}
+	const auto end = std::chrono::steady_clock::now();
+
+	SetStringCacheEnabled(false);
+	DisposeGWorld(gworld);
+	return std::chrono::duration<double, std::nano>(end - start).count() / kTimedDraws;
+}
+
+int main()
+{
+	Pomme::Graphics::Init();
+
+	std::mt19937 rng(3);
+	for (int depth : {32, 16, 8})
+	{
+		if (!CheckDepth(depth, rng))
+			return 1;
+	}
+	printf("Cached and uncached text identical at 8, 16 and 32 bits, and matching the font bits\n");
+
+	const double uncachedNs = TimeDrawString(false);
+	const double cachedNs = TimeDrawString(true);
+	printf("15 characters into a 16-bit port: %.1f ns uncached, %.1f ns cached\n", uncachedNs, cachedNs);
+	return 0;
+}
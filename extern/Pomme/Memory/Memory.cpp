@@ -1,99 +1,1461 @@
 #include <iostream>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdio>
+#include <atomic>
+#include <mutex>
+#include <new>
 
 #include "Pomme.h"
 #include "PommeMemory.h"
+#include "PommeFiles.h"
+
+#if _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+#endif
 
 using namespace Pomme;
 using namespace Pomme::Memory;
 
-#define LOG POMME_GENLOG(POMME_DEBUG_MEMORY, "MEMO")
+#define LOG POMME_GENLOG(POMME_DEBUG_MEMORY, "MEMO")
+
+#if POMME_PTR_TRACKING
+static uint32_t gCurrentPtrBatch = 0;
+static uint32_t gCurrentNumPtrsInBatch = 0;
+static BlockDescriptor* gLiveBlocks = nullptr;		// head of the current batch's live list
+
+	// Must be expanded directly in the public allocation function,
+	// so that the return address is that of the caller.
+	#if _MSC_VER
+		#include <intrin.h>
+		#define TAG_ALLOC_SITE(block) ((block)->allocSite = _ReturnAddress())
+	#else
+		#define TAG_ALLOC_SITE(block) ((block)->allocSite = __builtin_return_address(0))
+	#endif
+#else
+	#define TAG_ALLOC_SITE(block) ((void) (block))
+#endif
+
+static_assert(sizeof(BlockDescriptor) <= kBlockDescriptorPadding);
+static_assert(kBlockDescriptorPadding % 16 == 0);
+
+// Guards the relocatable zone, master pointers, purgeable/resource handle
+// bookkeeping and pointer tracking. Ptr allocations don't need it.
+// Recursive because e.g. allocating may purge, which frees.
+static std::recursive_mutex gHeapMutex;
+using HeapLock = std::lock_guard<std::recursive_mutex>;
+
+static thread_local OSErr gMemError = noErr;
+static std::atomic<size_t> gHeapBudget = 0;
+
+static void PurgeToBudget(size_t liveBytes, size_t bytesNeeded);
+
+//-----------------------------------------------------------------------------
+// Size-class allocator
+//
+// Small blocks (descriptor + payload) are rounded up to a size class and carved
+// out of 64 KB slabs. Freed blocks go back onto their class's free list and get
+// reused by the next allocation of the same class, so the frame loop's churn of
+// small Ptrs never reaches the global allocator.
+//
+// Very large blocks are mapped straight from the OS. Fresh pages come back
+// zeroed, so NewPtrClear/NewHandleClear don't need to memset them.
+//
+// Everything in between goes through operator new as before.
+//
+// The allocation path is a pure function of the block's total size
+// (descriptor + capacity), so Free can find its way back without extra state.
+
+static constexpr size_t kSlabSize = 64 * 1024;
+static constexpr size_t kSizeClassGranularity = 16;
+static constexpr size_t kMaxSlabBlockSize = 16 * 1024;
+static constexpr size_t kMappedBlockThreshold = 256 * 1024;
+static constexpr size_t kPageSize = 4096;
+
+// 16-byte steps up to 128, then four classes per power of two.
+static constexpr uint16_t kSizeClasses[] =
+{
+	   32,    48,    64,    80,    96,   112,   128,
+	  160,   192,   224,   256,   320,   384,   448,   512,
+	  640,   768,   896,  1024,  1280,  1536,  1792,  2048,
+	 2560,  3072,  3584,  4096,  5120,  6144,  7168,  8192,
+	10240, 12288, 14336, 16384,
+};
+
+static constexpr int kNumSizeClasses = sizeof(kSizeClasses) / sizeof(kSizeClasses[0]);
+static_assert(kSizeClasses[kNumSizeClasses - 1] == kMaxSlabBlockSize);
+
+struct FreeCell
+{
+	FreeCell* next;
+};
+
+struct SizeClass
+{
+	FreeCell* freeList = nullptr;
+	size_t numSlabs = 0;
+};
+
+// Shared free lists, guarded by gSizeClassMutex
+static SizeClass gSizeClasses[kNumSizeClasses];
+static std::mutex gSizeClassMutex;
+
+// Each thread allocates from and frees to its own free lists, so that the
+// common path takes no lock. Threads trade cells with the shared lists in
+// batches (see GetTransferBatchSize).
+struct ThreadSizeClassCache
+{
+	FreeCell* freeList[kNumSizeClasses] = {};
+	uint32_t numFree[kNumSizeClasses] = {};
+
+	~ThreadSizeClassCache();
+};
+
+static thread_local ThreadSizeClassCache tSizeClassCache;
+
+// Maps (blockSize / kSizeClassGranularity) to a size class index in O(1).
+static const auto gSizeClassLookup = []()
+{
+	std::array<uint8_t, kMaxSlabBlockSize / kSizeClassGranularity + 1> lut{};
+	int sc = 0;
+	for (size_t i = 0; i < lut.size(); i++)
+	{
+		while (kSizeClasses[sc] < i * kSizeClassGranularity)
+			sc++;
+		lut[i] = (uint8_t) sc;
+	}
+	return lut;
+}();
+
+static inline int GetSizeClass(size_t blockSize)
+{
+	return gSizeClassLookup[(blockSize + kSizeClassGranularity - 1) / kSizeClassGranularity];
+}
+
+// Half a slab's worth of cells
+static inline uint32_t GetTransferBatchSize(int sc)
+{
+	return (uint32_t) std::max<size_t>(2, kSlabSize / 2 / kSizeClasses[sc]);
+}
+
+// Must be called with gSizeClassMutex held.
+static void RefillSizeClass(int sc)
+{
+	const size_t cellSize = kSizeClasses[sc];
+
+	char* slab = (char*) std::malloc(kSlabSize);
+	if (!slab)
+		throw std::bad_alloc();
+
+	// Thread the new cells onto the free list, lowest address first
+	FreeCell* head = gSizeClasses[sc].freeList;
+	for (size_t offset = kSlabSize - kSlabSize % cellSize; offset > 0; offset -= cellSize)
+	{
+		FreeCell* cell = (FreeCell*) (slab + offset - cellSize);
+		cell->next = head;
+		head = cell;
+	}
+
+	gSizeClasses[sc].freeList = head;
+	gSizeClasses[sc].numSlabs++;
+}
+
+// Moves a batch of cells from the shared free list to this thread's.
+static void FetchCells(ThreadSizeClassCache& cache, int sc)
+{
+	std::lock_guard<std::mutex> lock(gSizeClassMutex);
+
+	const uint32_t batchSize = GetTransferBatchSize(sc);
+	SizeClass& shared = gSizeClasses[sc];
+
+	for (uint32_t i = 0; i < batchSize; i++)
+	{
+		if (!shared.freeList)
+			RefillSizeClass(sc);
+
+		FreeCell* cell = shared.freeList;
+		shared.freeList = cell->next;
+		cell->next = cache.freeList[sc];
+		cache.freeList[sc] = cell;
+	}
+
+	cache.numFree[sc] += batchSize;
+}
+
+// Moves `count` cells from this thread's free list back to the shared one.
+static void ReturnCells(ThreadSizeClassCache& cache, int sc, uint32_t count)
+{
+	if (count == 0)
+		return;
+
+	// Find the tail of the run to return
+	FreeCell* head = cache.freeList[sc];
+	FreeCell* tail = head;
+	for (uint32_t i = 1; i < count; i++)
+		tail = tail->next;
+
+	cache.freeList[sc] = tail->next;
+	cache.numFree[sc] -= count;
+
+	std::lock_guard<std::mutex> lock(gSizeClassMutex);
+	tail->next = gSizeClasses[sc].freeList;
+	gSizeClasses[sc].freeList = head;
+}
+
+ThreadSizeClassCache::~ThreadSizeClassCache()
+{
+	for (int sc = 0; sc < kNumSizeClasses; sc++)
+		ReturnCells(*this, sc, numFree[sc]);
+}
+
+static void* MapPages(size_t numBytes)
+{
+#if _WIN32
+	void* p = VirtualAlloc(nullptr, numBytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	void* p = mmap(nullptr, numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		p = nullptr;
+#endif
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+static void UnmapPages(void* p, size_t numBytes)
+{
+#if _WIN32
+	(void) numBytes;
+	VirtualFree(p, 0, MEM_RELEASE);
+#else
+	munmap(p, numBytes);
+#endif
+}
+
+// Allocates at least `blockSize` bytes and returns the actual size in `blockSize`.
+// Returns true if the block's memory is known to be zero-filled already.
+static bool AllocateBlockMemory(size_t& blockSize, char** outBuf)
+{
+	if (blockSize <= kMaxSlabBlockSize)
+	{
+		int sc = GetSizeClass(blockSize);
+		ThreadSizeClassCache& cache = tSizeClassCache;
+		if (!cache.freeList[sc])
+			FetchCells(cache, sc);
+
+		FreeCell* cell = cache.freeList[sc];
+		cache.freeList[sc] = cell->next;
+		cache.numFree[sc]--;
+		*outBuf = (char*) cell;
+		blockSize = kSizeClasses[sc];
+		return false;
+	}
+	else if (blockSize >= kMappedBlockThreshold)
+	{
+		blockSize = (blockSize + kPageSize - 1) & ~(kPageSize - 1);
+		*outBuf = (char*) MapPages(blockSize);
+		return true;
+	}
+	else
+	{
+		*outBuf = new char[blockSize];
+		return false;
+	}
+}
+
+static void FreeBlockMemory(char* buf, size_t blockSize)
+{
+	if (blockSize <= kMaxSlabBlockSize)
+	{
+		int sc = GetSizeClass(blockSize);
+		ThreadSizeClassCache& cache = tSizeClassCache;
+		FreeCell* cell = (FreeCell*) buf;
+		cell->next = cache.freeList[sc];
+		cache.freeList[sc] = cell;
+
+		// Don't let a thread that frees what others allocate hoard cells
+		if (++cache.numFree[sc] > 2 * GetTransferBatchSize(sc))
+			ReturnCells(cache, sc, GetTransferBatchSize(sc));
+	}
+	else if (blockSize >= kMappedBlockThreshold)
+	{
+		UnmapPages(buf, blockSize);
+	}
+	else
+	{
+		delete[] buf;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Frame arena
+//
+// Between Pomme_BeginFrameArena and Pomme_EndFrameArena, small Ptrs allocated
+// by the calling thread are bump-allocated out of 64 KB chunks. DisposePtr on
+// such a block doesn't do any free-list work; it just decrements its chunk's
+// count of live blocks. Once a chunk is full or the frame ends, the chunk is
+// retired, and it gets recycled in one shot when its last block is disposed.
+//
+// So blocks that outlive the frame (e.g. an effect that animates for a few
+// frames) stay valid; they just keep their chunk from being recycled.
+//
+// Chunks are aligned to their size, so a block finds its chunk by masking its
+// address.
+
+static constexpr size_t kFrameArenaChunkSize = 64 * 1024;
+static constexpr size_t kMaxFrameArenaBlockSize = 4 * 1024;
+static constexpr int kMaxSpareFrameArenaChunks = 8;
+
+struct FrameArenaChunk
+{
+	// Live blocks, plus one while the chunk is some thread's current chunk.
+	// Whoever drops this to 0 recycles the chunk.
+	std::atomic<uint32_t> refCount;
+	char* top;
+	FrameArenaChunk* nextSpare;
+};
+
+static constexpr size_t kFrameArenaChunkHeaderSize = 64;
+static_assert(sizeof(FrameArenaChunk) <= kFrameArenaChunkHeaderSize);
+
+struct ThreadFrameArena
+{
+	int depth = 0;							// Begin/End nesting
+	FrameArenaChunk* current = nullptr;
+
+	~ThreadFrameArena();
+};
+
+static thread_local ThreadFrameArena tFrameArena;
+
+static std::mutex gSpareChunksMutex;
+static FrameArenaChunk* gSpareChunks = nullptr;
+static int gNumSpareChunks = 0;
+
+static inline char* GetChunkEnd(FrameArenaChunk* chunk)
+{
+	return (char*) chunk + kFrameArenaChunkSize;
+}
+
+static void* AllocateAlignedChunk()
+{
+#if _WIN32
+	void* p = _aligned_malloc(kFrameArenaChunkSize, kFrameArenaChunkSize);
+#else
+	void* p = nullptr;
+	if (0 != posix_memalign(&p, kFrameArenaChunkSize, kFrameArenaChunkSize))
+		p = nullptr;
+#endif
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+static void FreeAlignedChunk(void* p)
+{
+#if _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+static FrameArenaChunk* AcquireChunk()
+{
+	FrameArenaChunk* chunk = nullptr;
+
+	{
+		std::lock_guard<std::mutex> lock(gSpareChunksMutex);
+		if (gSpareChunks)
+		{
+			chunk = gSpareChunks;
+			gSpareChunks = chunk->nextSpare;
+			gNumSpareChunks--;
+		}
+	}
+
+	if (!chunk)
+		chunk = (FrameArenaChunk*) AllocateAlignedChunk();
+
+	new (&chunk->refCount) std::atomic<uint32_t>(1);		// the owner's reference
+	chunk->top = (char*) chunk + kFrameArenaChunkHeaderSize;
+	chunk->nextSpare = nullptr;
+	return chunk;
+}
+
+static void RecycleChunk(FrameArenaChunk* chunk)
+{
+	std::lock_guard<std::mutex> lock(gSpareChunksMutex);
+
+	if (gNumSpareChunks >= kMaxSpareFrameArenaChunks)
+	{
+		FreeAlignedChunk(chunk);
+		return;
+	}
+
+	chunk->nextSpare = gSpareChunks;
+	gSpareChunks = chunk;
+	gNumSpareChunks++;
+}
+
+static void ReleaseChunkRef(FrameArenaChunk* chunk)
+{
+	if (1 == chunk->refCount.fetch_sub(1, std::memory_order_acq_rel))
+		RecycleChunk(chunk);
+}
+
+// Stops allocating from the thread's current chunk.
+static void RetireCurrentChunk(ThreadFrameArena& arena)
+{
+	if (arena.current)
+	{
+		ReleaseChunkRef(arena.current);
+		arena.current = nullptr;
+	}
+}
+
+ThreadFrameArena::~ThreadFrameArena()
+{
+	RetireCurrentChunk(*this);
+}
+
+// Returns nullptr if the block should go through the regular allocator.
+static char* FrameArenaAllocate(size_t blockSize)
+{
+	ThreadFrameArena& arena = tFrameArena;
+
+	if (arena.depth == 0 || blockSize > kMaxFrameArenaBlockSize)
+		return nullptr;
+
+	blockSize = (blockSize + 15) & ~15;
+
+	if (arena.current && arena.current->top + blockSize > GetChunkEnd(arena.current))
+		RetireCurrentChunk(arena);
+
+	if (!arena.current)
+		arena.current = AcquireChunk();
+
+	FrameArenaChunk* chunk = arena.current;
+	char* p = chunk->top;
+	chunk->top += blockSize;
+	chunk->refCount.fetch_add(1, std::memory_order_relaxed);
+	return p;
+}
+
+static void FrameArenaFree(char* buf)
+{
+	auto* chunk = (FrameArenaChunk*) ((uintptr_t) buf & ~(uintptr_t) (kFrameArenaChunkSize - 1));
+	ReleaseChunkRef(chunk);
+}
+
+//-----------------------------------------------------------------------------
+// Relocatable zone
+//
+// Handle blocks below kMappedBlockThreshold live in arenas: mapped regions in
+// which blocks are laid out back to back. Disposing of a block leaves a hole.
+// Since the application only reaches these blocks through their master
+// pointers, unlocked blocks can be slid down over the holes (rewriting their
+// master pointers), and arenas emptied this way are given back to the OS.
+//
+// Compaction only ever happens in CompactMem/MaxMem, or when a new handle
+// can't otherwise fit, i.e. in calls that were allowed to move memory on the
+// Mac. Locked blocks stay put.
+
+static constexpr size_t kArenaSize = 1024 * 1024;
+
+struct Arena
+{
+	char* base;
+	size_t size;
+	size_t top;				// blocks occupy [base, base+top)
+	size_t liveBytes;		// bytes occupied by live blocks, descriptors included
+	size_t numLive;
+};
+
+// Sorted by base address
+static std::vector<Arena> gArenas;
+
+static inline size_t GetZoneBlockSize(const BlockDescriptor* block)
+{
+	return kBlockDescriptorPadding + block->capacity;
+}
+
+static Arena& GetArena(const BlockDescriptor* block)
+{
+	auto it = std::upper_bound(gArenas.begin(), gArenas.end(), (const char*) block,
+		[](const char* p, const Arena& arena) { return p < arena.base; });
+
+	if (it == gArenas.begin())
+		throw std::runtime_error("block isn't in the relocatable zone");
+
+	--it;
+	if ((const char*) block >= it->base + it->size)
+		throw std::runtime_error("block isn't in the relocatable zone");
+
+	return *it;
+}
+
+static Arena& NewArena(size_t minSize)
+{
+	Arena arena = {};
+	arena.size = std::max(kArenaSize, (minSize + kPageSize - 1) & ~(kPageSize - 1));
+	arena.base = (char*) MapPages(arena.size);
+
+	auto it = std::upper_bound(gArenas.begin(), gArenas.end(), arena.base,
+		[](const char* p, const Arena& a) { return p < a.base; });
+	return *gArenas.insert(it, arena);
+}
+
+static void ReleaseArena(Arena& arena)
+{
+	UnmapPages(arena.base, arena.size);
+	gArenas.erase(gArenas.begin() + (&arena - gArenas.data()));
+}
+
+// Turns a gap in an arena into a dead block, so the arena can still be walked.
+static void MarkFreeSpace(char* p, size_t numBytes)
+{
+	BlockDescriptor* hole = (BlockDescriptor*) p;
+	hole->magic = 'DEAD';
+	hole->size = 0;
+	hole->capacity = (uint32_t) (numBytes - kBlockDescriptorPadding);
+	hole->flags = kBlockInZone;
+	hole->masterPtr = nullptr;
+	hole->rezMeta = nullptr;
+}
+
+static void MoveZoneBlock(BlockDescriptor* block, char* dst)
+{
+	memmove(dst, block, GetZoneBlockSize(block));
+	BlockDescriptor* moved = (BlockDescriptor*) dst;
+	*moved->masterPtr = moved->GetData();
+
+#if POMME_PTR_TRACKING
+	if (moved->ptrBatch == gCurrentPtrBatch)
+	{
+		if (moved->prevLive)
+			moved->prevLive->nextLive = moved;
+		else
+			gLiveBlocks = moved;
+		if (moved->nextLive)
+			moved->nextLive->prevLive = moved;
+	}
+#endif
+}
+
+// Slides the arena's unlocked blocks down over the holes.
+// Returns the size of the largest contiguous free run left in the arena.
+static size_t SlideArena(Arena& arena)
+{
+	size_t largestFree = 0;
+	size_t dst = 0;
+	size_t src = 0;
+
+	while (src < arena.top)
+	{
+		BlockDescriptor* block = (BlockDescriptor*) (arena.base + src);
+		size_t blockSize = GetZoneBlockSize(block);
+
+		if (block->magic == 'LIVE')
+		{
+			if (block->flags & kBlockLocked)
+			{
+				// Can't move this one; leave the gap before it as a hole
+				if (dst < src)
+				{
+					MarkFreeSpace(arena.base + dst, src - dst);
+					largestFree = std::max(largestFree, src - dst - kBlockDescriptorPadding);
+				}
+				dst = src + blockSize;
+			}
+			else
+			{
+				if (dst != src)
+					MoveZoneBlock(block, arena.base + dst);
+				dst += blockSize;
+			}
+		}
+
+		src += blockSize;
+	}
+
+	arena.top = dst;
+
+	if (arena.size - arena.top > kBlockDescriptorPadding)
+		largestFree = std::max(largestFree, arena.size - arena.top - kBlockDescriptorPadding);
+
+	return largestFree;
+}
+
+// Moves as many unlocked blocks as possible out of the given arena,
+// into the free space at the end of lower arenas.
+static void EvacuateArena(size_t arenaIndex)
+{
+	Arena& arena = gArenas[arenaIndex];
+
+	for (size_t src = 0; src < arena.top; )
+	{
+		BlockDescriptor* block = (BlockDescriptor*) (arena.base + src);
+		size_t blockSize = GetZoneBlockSize(block);
+
+		if (block->magic == 'LIVE' && !(block->flags & kBlockLocked))
+		{
+			for (size_t i = 0; i < arenaIndex; i++)
+			{
+				Arena& dstArena = gArenas[i];
+				if (dstArena.size - dstArena.top >= blockSize)
+				{
+					MoveZoneBlock(block, dstArena.base + dstArena.top);
+					dstArena.top += blockSize;
+					dstArena.liveBytes += blockSize;
+					dstArena.numLive++;
+
+					MarkFreeSpace(arena.base + src, blockSize);
+					arena.liveBytes -= blockSize;
+					arena.numLive--;
+					break;
+				}
+			}
+		}
+
+		src += blockSize;
+	}
+}
+
+// Defragments the zone. Returns the size of the largest contiguous free block.
+static size_t CompactZone()
+{
+	for (auto& arena : gArenas)
+		SlideArena(arena);
+
+	// Walk down from the highest arena, moving its blocks into lower arenas
+	for (size_t i = gArenas.size(); i-- > 1; )
+	{
+		EvacuateArena(i);
+		SlideArena(gArenas[i]);
+		if (gArenas[i].numLive == 0)
+			ReleaseArena(gArenas[i]);
+	}
+
+	size_t largestFree = 0;
+	for (auto& arena : gArenas)
+		largestFree = std::max(largestFree, SlideArena(arena));
+	return largestFree;
+}
+
+static size_t GetZoneFreeBytes()
+{
+	size_t freeBytes = 0;
+	for (auto& arena : gArenas)
+		freeBytes += arena.size - arena.liveBytes;
+	return freeBytes;
+}
+
+static char* ZoneAllocate(size_t blockSize)
+{
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (auto& arena : gArenas)
+		{
+			if (arena.size - arena.top >= blockSize)
+			{
+				char* p = arena.base + arena.top;
+				arena.top += blockSize;
+				arena.liveBytes += blockSize;
+				arena.numLive++;
+				return p;
+			}
+		}
+
+		// No room at the end of any arena. Before mapping a new arena, compact
+		// the zone if the holes would make room and are worth the trouble.
+		size_t holeBytes = 0;
+		size_t zoneBytes = 0;
+		for (auto& arena : gArenas)
+		{
+			holeBytes += arena.top - arena.liveBytes;
+			zoneBytes += arena.size;
+		}
+
+		if (pass > 0 || holeBytes < blockSize || holeBytes < zoneBytes / 4)
+			break;
+
+		CompactZone();
+	}
+
+	Arena& arena = NewArena(blockSize);
+	arena.top = blockSize;
+	arena.liveBytes = blockSize;
+	arena.numLive = 1;
+	return arena.base;
+}
+
+static void ZoneFree(BlockDescriptor* block)
+{
+	Arena& arena = GetArena(block);
+	size_t blockSize = GetZoneBlockSize(block);
+	size_t offset = (char*) block - arena.base;
+
+	arena.liveBytes -= blockSize;
+	arena.numLive--;
+
+	if (arena.numLive == 0)
+	{
+		arena.top = 0;
+		if (gArenas.size() > 1)
+			ReleaseArena(arena);
+	}
+	else if (offset + blockSize == arena.top)
+	{
+		arena.top = offset;
+	}
+}
+
+// Tries to grow a block in place, into the free space at the end of its arena
+// or into a hole right after it.
+static bool ZoneGrowInPlace(BlockDescriptor* block, size_t minCapacity, size_t wantedCapacity)
+{
+	Arena& arena = GetArena(block);
+	size_t blockEnd = (char*) block - arena.base + GetZoneBlockSize(block);
+
+	if (blockEnd == arena.top)
+	{
+		size_t available = arena.size - (blockEnd - block->capacity);
+		if (available < minCapacity)
+			return false;
+
+		size_t newCapacity = std::min(available, wantedCapacity);
+		arena.top += newCapacity - block->capacity;
+		arena.liveBytes += newCapacity - block->capacity;
+		block->capacity = (uint32_t) newCapacity;
+		return true;
+	}
+
+	BlockDescriptor* next = (BlockDescriptor*) (arena.base + blockEnd);
+	if (next->magic != 'LIVE')
+	{
+		size_t nextSize = GetZoneBlockSize(next);
+		if (block->capacity + nextSize < minCapacity)
+			return false;
+
+		arena.liveBytes += nextSize;
+		block->capacity += (uint32_t) nextSize;
+		return true;
+	}
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Master pointers
+//
+// A Handle points to a master pointer, which in turn points to the block's data.
+// Master pointers never move, so a block can be relocated by rewriting its
+// master pointer. They're allocated in batches, and unused ones are kept on a
+// free list threaded through the master pointers themselves.
+
+static constexpr int kMasterPointersPerBatch = 1024;
+
+static Ptr* gFreeMasterPointers = nullptr;
+
+static Ptr* AllocateMasterPointer()
+{
+	if (!gFreeMasterPointers)
+	{
+		Ptr* batch = (Ptr*) std::malloc(kMasterPointersPerBatch * sizeof(Ptr));
+		if (!batch)
+			throw std::bad_alloc();
+
+		for (int i = 0; i < kMasterPointersPerBatch - 1; i++)
+			batch[i] = (Ptr) &batch[i + 1];
+		batch[kMasterPointersPerBatch - 1] = nullptr;
+
+		gFreeMasterPointers = batch;
+	}
+
+	Ptr* masterPtr = gFreeMasterPointers;
+	gFreeMasterPointers = (Ptr*) *masterPtr;
+	*masterPtr = nullptr;
+	return masterPtr;
+}
+
+static void FreeMasterPointer(Ptr* masterPtr)
+{
+	*masterPtr = (Ptr) gFreeMasterPointers;
+	gFreeMasterPointers = masterPtr;
+}
+
+static Handle NewHandleFromBlock(BlockDescriptor* block)
+{
+	Ptr* masterPtr = AllocateMasterPointer();
+	*masterPtr = block->GetData();
+	block->masterPtr = masterPtr;
+	return masterPtr;
+}
+
+
+//-----------------------------------------------------------------------------
+// Heap statistics
+//
+// Every change to a live block's size or resource type goes through
+// AccountLiveBlock, which keeps the totals behind Pomme_GetHeapReport.
+//
+// Each thread keeps its own counters, which only it writes to, so that
+// allocating never contends on shared cache lines or takes a lock. Readers
+// merge the counters of all threads (MergeHeapStats). A block freed by
+// another thread than the one that allocated it makes the counters of either
+// thread lopsided, but the sums are still right.
+
+static constexpr int kNumHistogramBuckets = kPommeHeapHistogramBuckets;
+
+// Every thread merges the stats after allocating this many bytes,
+// to sample the peak heap size and enforce the heap budget.
+static constexpr size_t kStatsSyncInterval = 256 * 1024;
+
+struct HeapTotals
+{
+	ptrdiff_t liveBytes;
+	ptrdiff_t liveBlocks;
+	long allocs;
+	long frees;
+	size_t bytesAllocated;
+	size_t bytesFreed;
+	long allocSizeHistogram[kNumHistogramBuckets];
+	long liveSizeHistogram[kNumHistogramBuckets];
+};
+
+struct ThreadHeapStats
+{
+	// Written by the owning thread only, read by anyone merging the stats
+	std::atomic<ptrdiff_t> liveBytes;
+	std::atomic<ptrdiff_t> liveBlocks;
+	std::atomic<long> allocs;
+	std::atomic<long> frees;
+	std::atomic<size_t> bytesAllocated;
+	std::atomic<size_t> bytesFreed;
+	std::atomic<long> allocSizeHistogram[kNumHistogramBuckets];
+	std::atomic<long> liveSizeHistogram[kNumHistogramBuckets];
+
+	// Owning thread only
+	size_t bytesSinceSync = 0;
+
+	// Registry of live threads' stats, guarded by gStatsMutex
+	ThreadHeapStats* prev;
+	ThreadHeapStats* next;
+
+	ThreadHeapStats();
+	~ThreadHeapStats();
+};
+
+static std::mutex gStatsMutex;
+static ThreadHeapStats* gThreadStats = nullptr;		// guarded by gStatsMutex
+static HeapTotals gExitedThreadStats = {};			// guarded by gStatsMutex
+static size_t gPeakHeapSize = 0;					// guarded by gStatsMutex
+
+static thread_local ThreadHeapStats tHeapStats;
+
+static std::atomic<ptrdiff_t> gGWorldPixelBytes = 0;
+static std::atomic<ptrdiff_t> gPeakGWorldPixelBytes = 0;
+
+// Guarded by gHeapMutex
+static std::unordered_map<ResType, size_t> gLiveBytesByResType;
+
+// Live handles that hold a resource (i.e. whose block has rezMeta set).
+// Guarded by gHeapMutex.
+static std::unordered_set<Handle> gResourceHandles;
+
+// Guarded by gStatsMutex
+static long gFrameNumber = 0;
+static HeapTotals gFrameStartTotals = {};
+static HeapTotals gLastFrameTotals = {};
+
+// Only the owning thread may call this
+template<typename T>
+static inline void Bump(std::atomic<T>& counter, T delta)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+template<typename T>
+static inline T Read(const std::atomic<T>& counter)
+{
+	return counter.load(std::memory_order_relaxed);
+}
+
+// Adds up the counters of a thread. Call with gStatsMutex held.
+static void AddThreadStats(HeapTotals& totals, const ThreadHeapStats& stats)
+{
+	totals.liveBytes += Read(stats.liveBytes);
+	totals.liveBlocks += Read(stats.liveBlocks);
+	totals.allocs += Read(stats.allocs);
+	totals.frees += Read(stats.frees);
+	totals.bytesAllocated += Read(stats.bytesAllocated);
+	totals.bytesFreed += Read(stats.bytesFreed);
+	for (int i = 0; i < kNumHistogramBuckets; i++)
+	{
+		totals.allocSizeHistogram[i] += Read(stats.allocSizeHistogram[i]);
+		totals.liveSizeHistogram[i] += Read(stats.liveSizeHistogram[i]);
+	}
+}
+
+ThreadHeapStats::ThreadHeapStats()
+	: liveBytes(0)
+	, liveBlocks(0)
+	, allocs(0)
+	, frees(0)
+	, bytesAllocated(0)
+	, bytesFreed(0)
+	, allocSizeHistogram{}
+	, liveSizeHistogram{}
+	, prev(nullptr)
+{
+	std::lock_guard<std::mutex> lock(gStatsMutex);
+	next = gThreadStats;
+	if (next)
+		next->prev = this;
+	gThreadStats = this;
+}
+
+ThreadHeapStats::~ThreadHeapStats()
+{
+	std::lock_guard<std::mutex> lock(gStatsMutex);
+
+	// Keep the thread's contribution around
+	AddThreadStats(gExitedThreadStats, *this);
+
+	if (prev)
+		prev->next = next;
+	else
+		gThreadStats = next;
+	if (next)
+		next->prev = prev;
+}
+
+// Call with gStatsMutex held.
+static HeapTotals MergeHeapStatsLocked()
+{
+	HeapTotals totals = gExitedThreadStats;
+	for (const ThreadHeapStats* stats = gThreadStats; stats; stats = stats->next)
+		AddThreadStats(totals, *stats);
+
+	gPeakHeapSize = std::max(gPeakHeapSize, (size_t) std::max<ptrdiff_t>(0, totals.liveBytes));
+	return totals;
+}
+
+static HeapTotals MergeHeapStats()
+{
+	std::lock_guard<std::mutex> lock(gStatsMutex);
+	return MergeHeapStatsLocked();
+}
+
+// Bucket 0 holds empty blocks; bucket i holds sizes in [2^(i-1), 2^i).
+static int GetHistogramBucket(uint32_t size)
+{
+	int bucket = 0;
+	while (size != 0 && bucket < kNumHistogramBuckets - 1)
+	{
+		size >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+static void AccountLiveBlock(const BlockDescriptor* block, int sign)
+{
+	const ptrdiff_t bytes = kBlockDescriptorPadding + block->size;
+
+	ThreadHeapStats& stats = tHeapStats;
+	Bump<ptrdiff_t>(stats.liveBytes, sign * bytes);
+	Bump<long>(stats.liveSizeHistogram[GetHistogramBucket(block->size)], sign);
+
+	// Only handles hold resources, and handles are only touched with gHeapMutex held
+	if (block->rezMeta)
+		gLiveBytesByResType[block->rezMeta->type] += sign * bytes;
+}
+
+// Called every kStatsSyncInterval bytes allocated by a thread.
+static void SyncHeapStats(size_t bytesNeeded)
+{
+	tHeapStats.bytesSinceSync = 0;
+
+	HeapTotals totals = MergeHeapStats();
+
+	const size_t budget = gHeapBudget.load(std::memory_order_relaxed);
+	if (budget != 0 && totals.liveBytes + bytesNeeded > budget)
+		PurgeToBudget(totals.liveBytes, bytesNeeded);
+}
+
+//-----------------------------------------------------------------------------
+// Implementation-specific stuff
+
+enum BlockPlacement
+{
+	kFixedBlock,			// stays put
+	kRelocatableBlock,		// may live in the relocatable zone
+	kPtrBlock,				// stays put; may come from the frame arena
+};
+
+static BlockDescriptor* AllocateBlock(uint32_t size, bool clear, uint32_t minCapacity, BlockPlacement placement)
+{
+	size_t blockSize = kBlockDescriptorPadding + std::max(size, minCapacity);
+
+	ThreadHeapStats& stats = tHeapStats;
+	stats.bytesSinceSync += blockSize;
+	if (stats.bytesSinceSync >= kStatsSyncInterval)
+		SyncHeapStats(blockSize);
+
+	char* buf = nullptr;
+	bool preZeroed = false;
+	uint8_t flags = 0;
+
+	if (placement == kRelocatableBlock && blockSize < kMappedBlockThreshold)
+	{
+		HeapLock lock(gHeapMutex);
+		blockSize = (blockSize + 15) & ~15;
+		buf = ZoneAllocate(blockSize);
+		flags = kBlockInZone;
+	}
+	else if (placement == kPtrBlock && nullptr != (buf = FrameArenaAllocate(blockSize)))
+	{
+		blockSize = (blockSize + 15) & ~15;
+		flags = kBlockInFrameArena;
+	}
+	else
+	{
+		preZeroed = AllocateBlockMemory(blockSize, &buf);
+	}
+
+	BlockDescriptor* block = (BlockDescriptor*) buf;
+
+	block->magic = 'LIVE';
+	block->size = size;
+	block->capacity = (uint32_t) (blockSize - kBlockDescriptorPadding);
+	block->flags = flags;
+	block->masterPtr = nullptr;
+	block->rezMeta = nullptr;
+
+	if (clear && !preZeroed)
+		memset(block->GetData(), 0, size);
+
+	AccountLiveBlock(block, +1);
+	Bump<ptrdiff_t>(stats.liveBlocks, 1);
+	Bump<long>(stats.allocs, 1);
+	Bump<long>(stats.allocSizeHistogram[GetHistogramBucket(size)], 1);
+	Bump<size_t>(stats.bytesAllocated, kBlockDescriptorPadding + size);
+
+#if POMME_PTR_TRACKING
+	HeapLock lock(gHeapMutex);
+	block->ptrBatch = gCurrentPtrBatch;
+	block->ptrNumInBatch = gCurrentNumPtrsInBatch++;
+	block->allocSite = nullptr;
+	block->prevLive = nullptr;
+	block->nextLive = gLiveBlocks;
+	if (gLiveBlocks)
+		gLiveBlocks->prevLive = block;
+	gLiveBlocks = block;
+#endif
+
+	return block;
+}
+
+BlockDescriptor* BlockDescriptor::Allocate(uint32_t size, bool clear, uint32_t minCapacity)
+{
+	return AllocateBlock(size, clear, minCapacity, kPtrBlock);
+}
+
+BlockDescriptor* BlockDescriptor::AllocateRelocatable(uint32_t size, bool clear, uint32_t minCapacity)
+{
+	return AllocateBlock(size, clear, minCapacity, kRelocatableBlock);
+}
+
+void BlockDescriptor::Free(BlockDescriptor* block)
+{
+	if (!block)
+		return;
+
+	const size_t blockSize = kBlockDescriptorPadding + block->capacity;
+
+	block->SetResourceMetadata(nullptr);
+
+	ThreadHeapStats& stats = tHeapStats;
+	AccountLiveBlock(block, -1);
+	Bump<ptrdiff_t>(stats.liveBlocks, -1);
+	Bump<long>(stats.frees, 1);
+	Bump<size_t>(stats.bytesFreed, kBlockDescriptorPadding + block->size);
+
+	block->magic = 'DEAD';
+	block->size = 0;
+	block->masterPtr = nullptr;
+#if POMME_PTR_TRACKING
+	{
+		HeapLock lock(gHeapMutex);
+		if (block->ptrBatch == gCurrentPtrBatch)
+		{
+			if (block->prevLive)
+				block->prevLive->nextLive = block->nextLive;
+			else
+				gLiveBlocks = block->nextLive;
+			if (block->nextLive)
+				block->nextLive->prevLive = block->prevLive;
+		}
+	}
+#endif
+
+	if (block->flags & kBlockInZone)
+	{
+		// Keep the capacity so that the arena can still be walked
+		HeapLock lock(gHeapMutex);
+		ZoneFree(block);
+	}
+	else if (block->flags & kBlockInFrameArena)
+	{
+		FrameArenaFree((char*) block);
+	}
+	else
+	{
+		block->capacity = 0;
+		FreeBlockMemory((char*) block, blockSize);
+	}
+}
+
+static BlockDescriptor* MoveToNewBlock(BlockDescriptor* block, uint32_t newSize, uint32_t newCapacity, BlockPlacement placement)
+{
+	// Allocating a relocatable block may compact the zone, so pin the old block meanwhile
+	const uint8_t oldFlags = block->flags;
+	block->flags |= kBlockLocked;
+
+	BlockDescriptor* newBlock = AllocateBlock(newSize, false, newCapacity, placement);
+	memcpy(newBlock->GetData(), block->GetData(), std::min(block->size, newSize));
+
+	newBlock->flags |= oldFlags & kBlockStateMask;
+	newBlock->masterPtr = block->masterPtr;
+#if POMME_PTR_TRACKING
+	newBlock->allocSite = block->allocSite;
+#endif
+	if (newBlock->masterPtr)
+		*newBlock->masterPtr = newBlock->GetData();
+
+	const auto* rezMeta = block->rezMeta;
+	block->SetResourceMetadata(nullptr);
+	newBlock->SetResourceMetadata(rezMeta);
+
+	BlockDescriptor::Free(block);
+	return newBlock;
+}
+
+BlockDescriptor* BlockDescriptor::Resize(BlockDescriptor* block, uint32_t newSize)
+{
+	// Out of room: aim for 50% slack on top of the requested size,
+	// so that growing a handle piecemeal costs amortized O(1) per byte.
+	uint64_t wantedCapacity = std::max<uint64_t>(newSize, block->capacity + block->capacity / 2);
+	wantedCapacity = std::min<uint64_t>(wantedCapacity, 0x7FFFFFFF);
+
+	if (newSize > block->capacity
+		&& (block->flags & kBlockInZone)
+		&& ZoneGrowInPlace(block, newSize, (wantedCapacity + 15) & ~15))
+	{
+		// The block has grown into adjacent free space; fall through
+	}
+
+	if (newSize <= block->capacity)
+	{
+		AccountLiveBlock(block, -1);
+		block->size = newSize;
+		AccountLiveBlock(block, +1);
+		return block;
+	}
+
+	if (block->flags & kBlockLocked)
+		return nullptr;
+
+	return MoveToNewBlock(block, newSize, (uint32_t) wantedCapacity, block->masterPtr ? kRelocatableBlock : kPtrBlock);
+}
+
+BlockDescriptor* BlockDescriptor::MoveOutOfZone(BlockDescriptor* block)
+{
+	if (!(block->flags & kBlockInZone))
+		return block;
+
+	return MoveToNewBlock(block, block->size, block->size, kFixedBlock);
+}
+
+void BlockDescriptor::CheckIsLive() const
+{
+	if (magic == 'DEAD')
+		throw std::runtime_error("ptr/handle double free?");
+
+	if (magic != 'LIVE')
+		throw std::runtime_error("corrupted ptr/handle");
+}
+
+void BlockDescriptor::SetResourceMetadata(const Pomme::Files::ResourceMetadata* meta)
+{
+	if (meta == rezMeta)
+		return;
+
+	HeapLock lock(gHeapMutex);
+
+	if (meta)
+		flags |= kBlockResource;
+	else
+		flags &= ~kBlockResource;
+
+	AccountLiveBlock(this, -1);
+	rezMeta = meta;
+	AccountLiveBlock(this, +1);
+
+	if (masterPtr)
+	{
+		if (meta)
+			gResourceHandles.insert(masterPtr);
+		else
+			gResourceHandles.erase(masterPtr);
+	}
+}
+
+BlockDescriptor* BlockDescriptor::HandleToBlock(Handle h)
+{
+	if (!h || !*h)
+		return nullptr;
+	BlockDescriptor* bd = (BlockDescriptor*) (*h - kBlockDescriptorPadding);
+	bd->CheckIsLive();
+	if (bd->masterPtr != h)
+		throw std::runtime_error("not a handle, or corrupted master pointer");
+	return bd;
+}
+
+BlockDescriptor* BlockDescriptor::PtrToBlock(Ptr p)
+{
+	if (!p)
+		return nullptr;
+	BlockDescriptor* bd = (BlockDescriptor*) (p - kBlockDescriptorPadding);
+	bd->CheckIsLive();
+	if (bd->masterPtr)
+		throw std::runtime_error("expected a ptr, got a handle's data");
+	return bd;
+}
+
+//-----------------------------------------------------------------------------
+// Memory: purgeable handles
+//
+// Purgeable handles are kept in least-recently-used order. Purging a handle
+// frees its block but keeps its master pointer, so the handle stays valid and
+// just becomes empty (*h == nullptr). If the handle held a resource, we
+// remember which one, so that LoadResource can read it back in.
+
+static std::list<Handle> gPurgeableLRU;		// least recently used first
+static std::unordered_map<Handle, std::list<Handle>::iterator> gPurgeableLRUIndex;
+static std::unordered_map<Handle, const Pomme::Files::ResourceMetadata*> gPurgedResources;
+
+void Pomme::Memory::TouchHandle(Handle h)
+{
+	HeapLock lock(gHeapMutex);
+
+	auto it = gPurgeableLRUIndex.find(h);
+	if (it != gPurgeableLRUIndex.end())
+	{
+		gPurgeableLRU.splice(gPurgeableLRU.end(), gPurgeableLRU, it->second);
+	}
+	else
+	{
+		gPurgeableLRU.push_back(h);
+		gPurgeableLRUIndex[h] = std::prev(gPurgeableLRU.end());
+	}
+}
+
+static void ForgetPurgeable(Handle h)
+{
+	auto it = gPurgeableLRUIndex.find(h);
+	if (it != gPurgeableLRUIndex.end())
+	{
+		gPurgeableLRU.erase(it->second);
+		gPurgeableLRUIndex.erase(it);
+	}
+}
+
+const Pomme::Files::ResourceMetadata* Pomme::Memory::GetPurgedResource(Handle h)
+{
+	HeapLock lock(gHeapMutex);
 
-#if POMME_PTR_TRACKING
-#include <set>
-static uint32_t gCurrentPtrBatch = 0;
-static uint32_t gCurrentNumPtrsInBatch = 0;
-static std::set<uint32_t> gLivePtrNums;
-#endif
+	auto it = gPurgedResources.find(h);
+	return it == gPurgedResources.end() ? nullptr : it->second;
+}
 
-static constexpr int kBlockDescriptorPadding = 32;
-static_assert(sizeof(BlockDescriptor) <= kBlockDescriptorPadding);
+void Pomme::Memory::ForgetResourceFork(short forkRefNum)
+{
+	HeapLock lock(gHeapMutex);
 
-static size_t gTotalHeapSize = 0;
-static size_t gNumBlocksAllocated = 0;
+	for (auto it = gPurgedResources.begin(); it != gPurgedResources.end(); )
+	{
+		if (it->second->forkRefNum == forkRefNum)
+			it = gPurgedResources.erase(it);
+		else
+			++it;
+	}
 
-//-----------------------------------------------------------------------------
-// Implementation-specific stuff
+	// The fork's metadata is about to go away, so detach any handles still
+	// pointing to it. Copy the set since SetResourceMetadata modifies it.
+	std::vector<Handle> resourceHandles(gResourceHandles.begin(), gResourceHandles.end());
+	for (Handle h : resourceHandles)
+	{
+		BlockDescriptor* block = BlockDescriptor::HandleToBlock(h);
+		if (block->rezMeta->forkRefNum == forkRefNum)
+			block->SetResourceMetadata(nullptr);
+	}
+}
 
-BlockDescriptor* BlockDescriptor::Allocate(uint32_t size)
+// Empties the handle. Returns the number of bytes freed.
+static size_t PurgeHandle(Handle h)
 {
-	char* buf = new char[kBlockDescriptorPadding + size];
+	BlockDescriptor* block = BlockDescriptor::HandleToBlock(h);
+	if (!block)
+		return 0;
 
-	BlockDescriptor* block = (BlockDescriptor*) buf;
+	size_t freed = kBlockDescriptorPadding + block->size;
 
-	block->magic = 'LIVE';
-	block->size = size;
-	block->ptrToData = buf + kBlockDescriptorPadding;
-	block->rezMeta = nullptr;
+	ForgetPurgeable(h);
+	if (block->rezMeta)
+		gPurgedResources[h] = block->rezMeta;
 
-	gTotalHeapSize += kBlockDescriptorPadding + size;
-	gNumBlocksAllocated++;
+	BlockDescriptor::Free(block);
+	*h = nullptr;
+	return freed;
+}
 
-#if POMME_PTR_TRACKING
-	block->ptrBatch = gCurrentPtrBatch;
-	block->ptrNumInBatch = gCurrentNumPtrsInBatch++;
-	gLivePtrNums.insert(block->ptrNumInBatch);
-#endif
+// Purges unlocked purgeable handles, least recently used first.
+static size_t PurgeLRU(size_t bytesNeeded, bool resourcesOnly)
+{
+	size_t freed = 0;
 
-	return block;
+	for (auto it = gPurgeableLRU.begin(); it != gPurgeableLRU.end() && freed < bytesNeeded; )
+	{
+		Handle h = *it;
+		++it;	// PurgeHandle unlinks h
+
+		BlockDescriptor* block = BlockDescriptor::HandleToBlock(h);
+		if (block->flags & kBlockLocked)
+			continue;
+		if (resourcesOnly && !block->rezMeta)
+			continue;
+
+		freed += PurgeHandle(h);
+	}
+
+	return freed;
 }
 
-void BlockDescriptor::Free(BlockDescriptor* block)
+static void PurgeToBudget(size_t liveBytes, size_t bytesNeeded)
 {
-	if (!block)
+	const size_t budget = gHeapBudget.load(std::memory_order_relaxed);
+	if (liveBytes + bytesNeeded <= budget)
 		return;
 
-	gTotalHeapSize -= kBlockDescriptorPadding + block->size;
-	gNumBlocksAllocated--;
+	HeapLock lock(gHeapMutex);
 
-	block->magic = 'DEAD';
-	block->size = 0;
-	block->ptrToData = nullptr;
-	block->rezMeta = nullptr;
-#if POMME_PTR_TRACKING
-	if (block->ptrBatch == gCurrentPtrBatch)
-		gLivePtrNums.erase(block->ptrNumInBatch);
-#endif
+	size_t excess = liveBytes + bytesNeeded - budget;
+	LOG << "Over budget by " << excess << " bytes, purging resources\n";
+	PurgeLRU(excess, true);
+}
+
+void HPurge(Handle h)
+{
+	HeapLock lock(gHeapMutex);
 
-	char* buf = (char*) block;
-	delete[] buf;
+	BlockDescriptor* block = BlockDescriptor::HandleToBlock(h);
+	if (block)
+	{
+		block->flags |= kBlockPurgeable;
+		TouchHandle(h);
+	}
+	gMemError = block ? noErr : nilHandleErr;
 }
 
-void BlockDescriptor::CheckIsLive() const
+void HNoPurge(Handle h)
 {
-	if (magic == 'DEAD')
-		throw std::runtime_error("ptr/handle double free?");
+	HeapLock lock(gHeapMutex);
 
-	if (magic != 'LIVE')
-		throw std::runtime_error("corrupted ptr/handle");
+	BlockDescriptor* block = BlockDescriptor::HandleToBlock(h);
+	if (block)
+		block->flags &= ~kBlockPurgeable;
+	ForgetPurgeable(h);
+	gMemError = block ? noErr : nilHandleErr;
 }
 
-BlockDescriptor* BlockDescriptor::HandleToBlock(Handle h)
+void EmptyHandle(Handle h)
 {
-	if (!h || !*h)
-		return nullptr;
-	BlockDescriptor* bd = (BlockDescriptor*) (*h - kBlockDescriptorPadding);
-	bd->CheckIsLive();
-	return bd;
+	HeapLock lock(gHeapMutex);
+
+	BlockDescriptor* block = BlockDescriptor::HandleToBlock(h);
+	if (block && (block->flags & kBlockLocked))
+	{
+		gMemError = memPurErr;
+		return;
+	}
+
+	PurgeHandle(h);
+	gMemError = h ? noErr : nilHandleErr;
 }
 
-BlockDescriptor* BlockDescriptor::PtrToBlock(Ptr p)
+void ReallocateHandle(Handle h, Size byteCount)
 {
-	if (!p)
-		return nullptr;
-	BlockDescriptor* bd = (BlockDescriptor*) (p - kBlockDescriptorPadding);
-	bd->CheckIsLive();
-	return bd;
+	HeapLock lock(gHeapMutex);
+
+	if (!h)
+	{
+		gMemError = nilHandleErr;
+		return;
+	}
+
+	if (byteCount < 0)
+		throw std::invalid_argument("trying to alloc negative size handle");
+	if (byteCount > 0x7FFFFFFF)
+		throw std::invalid_argument("trying to alloc massive handle");
+
+	BlockDescriptor* oldBlock = BlockDescriptor::HandleToBlock(h);
+	if (oldBlock && (oldBlock->flags & kBlockLocked))
+	{
+		gMemError = memLockedErr;
+		return;
+	}
+
+	ForgetPurgeable(h);
+	gPurgedResources.erase(h);
+	BlockDescriptor::Free(oldBlock);
+	*h = nullptr;
+
+	BlockDescriptor* block = BlockDescriptor::AllocateRelocatable((UInt32) byteCount);
+	TAG_ALLOC_SITE(block);
+	block->masterPtr = h;
+	*h = block->GetData();
+	gMemError = noErr;
+}
+
+void PurgeMem(Size cbNeeded)
+{
+	HeapLock lock(gHeapMutex);
+
+	PurgeLRU(cbNeeded, false);
+}
+
+void PurgeMemSys(Size cbNeeded)
+{
+	PurgeMem(cbNeeded);
+}
+
+void Pomme_SetHeapBudget(Size maxBytes)
+{
+	gHeapBudget = (size_t) std::max<Size>(maxBytes, 0);
+	if (gHeapBudget != 0)
+		PurgeToBudget(MergeHeapStats().liveBytes, 0);
 }
 
 //-----------------------------------------------------------------------------
@@ -101,54 +1463,97 @@ BlockDescriptor* BlockDescriptor::PtrToBlock(Ptr p)
 
 Handle NewHandle(Size size)
 {
+	HeapLock lock(gHeapMutex);
+
 	if (size < 0)
 		throw std::invalid_argument("trying to alloc negative size handle");
 	if (size > 0x7FFFFFFF)
 		throw std::invalid_argument("trying to alloc massive handle");
 
-	BlockDescriptor* block = BlockDescriptor::Allocate((UInt32) size);
-	return &block->ptrToData;
+	BlockDescriptor* block = BlockDescriptor::AllocateRelocatable((UInt32) size);
+	TAG_ALLOC_SITE(block);
+	return NewHandleFromBlock(block);
 }
 
 Handle NewHandleClear(Size s)
 {
-	Handle h = NewHandle(s);
-	memset(*h, 0, s);
-	return h;
+	HeapLock lock(gHeapMutex);
+
+	if (s < 0)
+		throw std::invalid_argument("trying to alloc negative size handle");
+	if (s > 0x7FFFFFFF)
+		throw std::invalid_argument("trying to alloc massive handle");
+
+	BlockDescriptor* block = BlockDescriptor::AllocateRelocatable((UInt32) s, true);
+	TAG_ALLOC_SITE(block);
+	return NewHandleFromBlock(block);
 }
 
 Handle NewHandleSys(Size s)
 {
-	return NewHandle(s);
+	Handle h = NewHandle(s);
+	TAG_ALLOC_SITE(BlockDescriptor::HandleToBlock(h));
+	return h;
 }
 
 Handle NewHandleSysClear(Size s)
 {
-	return NewHandleClear(s);
+	Handle h = NewHandleClear(s);
+	TAG_ALLOC_SITE(BlockDescriptor::HandleToBlock(h));
+	return h;
 }
 
 Handle TempNewHandle(Size s, OSErr* err)
 {
 	Handle h = NewHandle(s);
+	TAG_ALLOC_SITE(BlockDescriptor::HandleToBlock(h));
 	*err = noErr;
 	return h;
 }
 
 Size GetHandleSize(Handle h)
 {
-	return BlockDescriptor::HandleToBlock(h)->size;
+	// An empty (purged) handle has size 0
+	const BlockDescriptor* block = BlockDescriptor::HandleToBlock(h);
+	return block ? block->size : 0;
 }
 
 void SetHandleSize(Handle handle, Size byteCount)
 {
-	(void) handle;
-	(void) byteCount;
-	TODOFATAL();
+	HeapLock lock(gHeapMutex);
+
+	if (byteCount < 0)
+		throw std::invalid_argument("trying to set negative handle size");
+	if (byteCount > 0x7FFFFFFF)
+		throw std::invalid_argument("trying to set massive handle size");
+
+	if (!handle)
+		throw std::invalid_argument("SetHandleSize: nil handle");
+
+	// A purged handle has an empty master pointer; like the Memory Manager,
+	// report it instead of resizing
+	BlockDescriptor* block = BlockDescriptor::HandleToBlock(handle);
+	if (!block)
+	{
+		gMemError = nilHandleErr;
+		return;
+	}
+
+	gMemError = BlockDescriptor::Resize(block, (UInt32) byteCount) ? noErr : memFullErr;
 }
 
 void DisposeHandle(Handle h)
 {
+	if (!h)
+		return;
+
+	HeapLock lock(gHeapMutex);
+
+	ForgetPurgeable(h);
+	gPurgedResources.erase(h);
+
 	BlockDescriptor::Free(BlockDescriptor::HandleToBlock(h));
+	FreeMasterPointer(h);
 }
 
 OSErr PtrToHand(const void* srcPtr, Handle* dstHndl, Size size)
@@ -171,6 +1576,130 @@ OSErr PtrToHand(const void* srcPtr, Handle* dstHndl, Size size)
 	return noErr;
 }
 
+//-----------------------------------------------------------------------------
+// Memory: relocatable blocks
+
+OSErr MemError(void)
+{
+	return gMemError;
+}
+
+void HLock(Handle h)
+{
+	HeapLock lock(gHeapMutex);
+
+	BlockDescriptor* block = BlockDescriptor::HandleToBlock(h);
+	if (block)
+	{
+		block->flags |= kBlockLocked;
+		if (block->flags & kBlockPurgeable)
+			TouchHandle(h);
+	}
+	gMemError = block ? noErr : nilHandleErr;
+}
+
+void HUnlock(Handle h)
+{
+	HeapLock lock(gHeapMutex);
+
+	BlockDescriptor* block = BlockDescriptor::HandleToBlock(h);
+	if (block)
+		block->flags &= ~kBlockLocked;
+	gMemError = block ? noErr : nilHandleErr;
+}
+
+void MoveHHi(Handle h)
+{
+	HeapLock lock(gHeapMutex);
+
+	BlockDescriptor* block = BlockDescriptor::HandleToBlock(h);
+	if (!block)
+	{
+		gMemError = nilHandleErr;
+		return;
+	}
+
+	if (block->flags & kBlockLocked)
+	{
+		gMemError = memLockedErr;
+		return;
+	}
+
+	// There is no "top of the heap" here. The point of MoveHHi is to keep a
+	// block that will stay locked for a while from getting in the way of
+	// compaction, so take it out of the relocatable zone altogether.
+	BlockDescriptor::MoveOutOfZone(block);
+	gMemError = noErr;
+}
+
+void HLockHi(Handle h)
+{
+	MoveHHi(h);
+	HLock(h);
+}
+
+SInt8 HGetState(Handle h)
+{
+	BlockDescriptor* block = BlockDescriptor::HandleToBlock(h);
+	gMemError = block ? noErr : nilHandleErr;
+	return block ? (SInt8) (block->flags & kBlockStateMask) : 0;
+}
+
+void HSetState(Handle h, SInt8 flags)
+{
+	HeapLock lock(gHeapMutex);
+
+	BlockDescriptor* block = BlockDescriptor::HandleToBlock(h);
+	if (block)
+	{
+		block->flags = (block->flags & ~kBlockStateMask) | (flags & kBlockStateMask);
+		if (block->flags & kBlockPurgeable)
+			TouchHandle(h);
+		else
+			ForgetPurgeable(h);
+	}
+	gMemError = block ? noErr : nilHandleErr;
+}
+
+Size CompactMem(Size cbNeeded)
+{
+	HeapLock lock(gHeapMutex);
+
+	(void) cbNeeded;
+	return (Size) CompactZone();
+}
+
+Size CompactMemSys(Size cbNeeded)
+{
+	return CompactMem(cbNeeded);
+}
+
+Size MaxMem(Size* grow)
+{
+	HeapLock lock(gHeapMutex);
+
+	PurgeMem(maxSize);
+	size_t largestFree = CompactZone();
+
+	if (grow)
+	{
+		// The zone grows by mapping new arenas, so it can grow as much as a single block may be large
+		size_t zoneBytes = 0;
+		for (auto& arena : gArenas)
+			zoneBytes += arena.size;
+		*grow = (Size) (0x7FFFFFFF - std::min<size_t>(zoneBytes, 0x7FFFFFFF));
+	}
+
+	return (Size) largestFree;
+}
+
+long FreeMem(void)
+{
+	HeapLock lock(gHeapMutex);
+
+	return (long) GetZoneFreeBytes();
+}
+
 //-----------------------------------------------------------------------------
 // Memory: Ptr
 
@@ -182,19 +1711,27 @@ Ptr NewPtr(Size byteCount)
 		throw std::invalid_argument("trying to alloc massive ptr");
 
 	BlockDescriptor* bd = BlockDescriptor::Allocate((UInt32) byteCount);
-	return bd->ptrToData;
+	TAG_ALLOC_SITE(bd);
+	return bd->GetData();
 }
 
 Ptr NewPtrSys(Size byteCount)
 {
-	return NewPtr(byteCount);
+	Ptr p = NewPtr(byteCount);
+	TAG_ALLOC_SITE(BlockDescriptor::PtrToBlock(p));
+	return p;
 }
 
 Ptr NewPtrClear(Size byteCount)
 {
-	Ptr ptr = NewPtr(byteCount);
-	memset(ptr, 0, byteCount);
-	return ptr;
+	if (byteCount < 0)
+		throw std::invalid_argument("trying to NewPtr negative size");
+	if (byteCount > 0x7FFFFFFF)
+		throw std::invalid_argument("trying to alloc massive ptr");
+
+	BlockDescriptor* bd = BlockDescriptor::Allocate((UInt32) byteCount, true);
+	TAG_ALLOC_SITE(bd);
+	return bd->GetData();
 }
 
 Size GetPtrSize(Ptr p)
@@ -209,28 +1746,221 @@ void DisposePtr(Ptr p)
 }
 
 //-----------------------------------------------------------------------------
-// Memory: pointer tracking
+// Memory: frame arena
+
+void Pomme_BeginFrameArena()
+{
+	tFrameArena.depth++;
+}
+
+void Pomme_EndFrameArena()
+{
+	ThreadFrameArena& arena = tFrameArena;
+
+	if (arena.depth <= 0)
+		throw std::logic_error("Pomme_EndFrameArena without Pomme_BeginFrameArena");
+
+	if (--arena.depth > 0)
+		return;
+
+	FrameArenaChunk* chunk = arena.current;
+	if (chunk && 1 == chunk->refCount.load(std::memory_order_acquire))
+	{
+		// Everything allocated this frame is gone already: rewind and keep the chunk for the next frame
+		chunk->top = (char*) chunk + kFrameArenaChunkHeaderSize;
+	}
+	else
+	{
+		RetireCurrentChunk(arena);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Memory: heap statistics
 
 long Pomme_GetNumAllocs()
 {
-	return (long) gNumBlocksAllocated;
+	return (long) MergeHeapStats().liveBlocks;
 }
 
 Size Pomme_GetHeapSize()
 {
-	return (Size) gTotalHeapSize;
+	return (Size) MergeHeapStats().liveBytes;
+}
+
+void Pomme::Memory::AccountGWorldPixels(ptrdiff_t numBytes)
+{
+	ptrdiff_t total = gGWorldPixelBytes.fetch_add(numBytes) + numBytes;
+	ptrdiff_t peak = gPeakGWorldPixelBytes.load();
+	while (total > peak && !gPeakGWorldPixelBytes.compare_exchange_weak(peak, total))
+	{
+	}
+}
+
+void Pomme_HeapReportEndFrame()
+{
+	std::lock_guard<std::mutex> lock(gStatsMutex);
+
+	HeapTotals totals = MergeHeapStatsLocked();
+	gLastFrameTotals.allocs = totals.allocs - gFrameStartTotals.allocs;
+	gLastFrameTotals.frees = totals.frees - gFrameStartTotals.frees;
+	gLastFrameTotals.bytesAllocated = totals.bytesAllocated - gFrameStartTotals.bytesAllocated;
+	gLastFrameTotals.bytesFreed = totals.bytesFreed - gFrameStartTotals.bytesFreed;
+	gFrameStartTotals = totals;
+	gFrameNumber++;
+}
+
+void Pomme_GetHeapReport(PommeHeapReport* report)
+{
+	std::lock_guard<std::mutex> lock(gStatsMutex);
+
+	const HeapTotals totals = MergeHeapStatsLocked();
+
+	*report = {};
+
+	report->liveBytes				= (Size) totals.liveBytes;
+	report->peakLiveBytes			= (Size) gPeakHeapSize;
+	report->liveBlocks				= (long) totals.liveBlocks;
+	report->gworldPixelBytes		= (Size) gGWorldPixelBytes.load();
+	report->peakGWorldPixelBytes	= (Size) gPeakGWorldPixelBytes.load();
+	report->totalAllocs				= totals.allocs;
+	report->totalFrees				= totals.frees;
+	report->frameNumber				= gFrameNumber;
+	report->allocsLastFrame			= gLastFrameTotals.allocs;
+	report->freesLastFrame			= gLastFrameTotals.frees;
+	report->bytesAllocatedLastFrame	= (Size) gLastFrameTotals.bytesAllocated;
+	report->bytesFreedLastFrame		= (Size) gLastFrameTotals.bytesFreed;
+
+	std::copy(std::begin(totals.allocSizeHistogram), std::end(totals.allocSizeHistogram), report->allocSizeHistogram);
+	std::copy(std::begin(totals.liveSizeHistogram), std::end(totals.liveSizeHistogram), report->liveSizeHistogram);
+}
+
+Size Pomme_GetLiveBytesForResType(ResType type)
+{
+	HeapLock lock(gHeapMutex);
+
+	auto it = gLiveBytesByResType.find(type);
+	return it == gLiveBytesByResType.end() ? 0 : (Size) it->second;
+}
+
+static void WriteJSONHistogram(FILE* out, const char* name, const long* histogram)
+{
+	fprintf(out, "\t\"%s\": {", name);
+	bool first = true;
+	for (int i = 0; i < kNumHistogramBuckets; i++)
+	{
+		if (histogram[i] == 0)
+			continue;
+		// Key each bucket by its smallest size
+		fprintf(out, "%s\"%lu\": %ld", first ? "" : ", ", i == 0 ? 0ul : 1ul << (i - 1), histogram[i]);
+		first = false;
+	}
+	fprintf(out, "},\n");
+}
+
+OSErr Pomme_DumpHeapReportJSON(const char* path)
+{
+	FILE* out = path ? fopen(path, "w") : stdout;
+	if (!out)
+		return ioErr;
+
+	PommeHeapReport r;
+	Pomme_GetHeapReport(&r);
+
+	fprintf(out, "{\n");
+	fprintf(out, "\t\"liveBytes\": %ld,\n", (long) r.liveBytes);
+	fprintf(out, "\t\"peakLiveBytes\": %ld,\n", (long) r.peakLiveBytes);
+	fprintf(out, "\t\"liveBlocks\": %ld,\n", r.liveBlocks);
+	fprintf(out, "\t\"gworldPixelBytes\": %ld,\n", (long) r.gworldPixelBytes);
+	fprintf(out, "\t\"peakGWorldPixelBytes\": %ld,\n", (long) r.peakGWorldPixelBytes);
+	fprintf(out, "\t\"totalAllocs\": %ld,\n", r.totalAllocs);
+	fprintf(out, "\t\"totalFrees\": %ld,\n", r.totalFrees);
+	fprintf(out, "\t\"frameNumber\": %ld,\n", r.frameNumber);
+	fprintf(out, "\t\"lastFrame\": {\"allocs\": %ld, \"frees\": %ld, \"bytesAllocated\": %ld, \"bytesFreed\": %ld},\n",
+			r.allocsLastFrame, r.freesLastFrame, (long) r.bytesAllocatedLastFrame, (long) r.bytesFreedLastFrame);
+	WriteJSONHistogram(out, "allocSizeHistogram", r.allocSizeHistogram);
+	WriteJSONHistogram(out, "liveSizeHistogram", r.liveSizeHistogram);
+
+	std::vector<std::pair<ResType, size_t>> byType;
+	{
+		HeapLock lock(gHeapMutex);
+		byType.assign(gLiveBytesByResType.begin(), gLiveBytesByResType.end());
+	}
+	std::sort(byType.begin(), byType.end());
+
+	fprintf(out, "\t\"liveBytesByResType\": {");
+	bool first = true;
+	for (const auto& [type, bytes] : byType)
+	{
+		if (bytes == 0)
+			continue;
+		std::string fourCC = FourCCString(type, '?');
+		std::replace(fourCC.begin(), fourCC.end(), '"', '?');
+		std::replace(fourCC.begin(), fourCC.end(), '\\', '?');
+		fprintf(out, "%s\"%s\": %lu", first ? "" : ", ", fourCC.c_str(), (unsigned long) bytes);
+		first = false;
+	}
+	fprintf(out, "}\n");
+	fprintf(out, "}\n");
+
+	if (path)
+		fclose(out);
+	else
+		fflush(out);
+
+	return noErr;
 }
 
+//-----------------------------------------------------------------------------
+// Memory: pointer tracking
+
 void Pomme_FlushPtrTracking(bool issueWarnings)
 {
 #if POMME_PTR_TRACKING
-	if (issueWarnings && !gLivePtrNums.empty())
+	HeapLock lock(gHeapMutex);
+
+	struct LeakSite
 	{
-		for (uint32_t ptrNum : gLivePtrNums)
-			printf("%s: ptr/handle %d:%d is still live!\n", __func__, gCurrentPtrBatch, ptrNum);
+		const void* site;
+		size_t numBlocks;
+		size_t numBytes;
+		uint32_t firstPtrNum;
+	};
+
+	std::unordered_map<const void*, LeakSite> leaks;
+
+	// Walk the batch's live list, detaching every block from it as we go
+	for (BlockDescriptor* block = gLiveBlocks; block; )
+	{
+		if (issueWarnings)
+		{
+			auto [it, isNew] = leaks.try_emplace(block->allocSite, LeakSite{block->allocSite, 0, 0, block->ptrNumInBatch});
+			it->second.numBlocks++;
+			it->second.numBytes += block->size;
+			it->second.firstPtrNum = std::min(it->second.firstPtrNum, block->ptrNumInBatch);
+		}
+
+		BlockDescriptor* next = block->nextLive;
+		block->prevLive = nullptr;
+		block->nextLive = nullptr;
+		block = next;
+	}
+
+	if (!leaks.empty())
+	{
+		std::vector<LeakSite> sites;
+		for (const auto& it : leaks)
+			sites.push_back(it.second);
+		std::sort(sites.begin(), sites.end(), [](const LeakSite& a, const LeakSite& b) { return a.numBytes > b.numBytes; });
+
+		for (const LeakSite& s : sites)
+		{
+			printf("%s: %zu ptr/handle(s), %zu bytes, allocated from %p are still live! (first: %d:%d)\n",
+				   __func__, s.numBlocks, s.numBytes, s.site, gCurrentPtrBatch, s.firstPtrNum);
+		}
 	}
 
-	gLivePtrNums.clear();
+	gLiveBlocks = nullptr;
 	gCurrentPtrBatch++;
 	gCurrentNumPtrsInBatch = 0;
 #else
@@ -0,0 +1,164 @@
+// Microbenchmark: NewPtr/DisposePtr churn through the size-class slabs and the
+// mapped-page path, against the plain `new char[]` path they replaced.
+//
+// Not part of the game build. Build and run by hand, from extern/Pomme:
+//
+//     g++ -std=c++17 -O2 -DNDEBUG -Wno-multichar -I. Memory/bench/MemoryBench.cpp Memory/Memory.cpp PommeDebug.cpp -o MemoryBench -lpthread
+//     ./MemoryBench
+
+#include "Pomme.h"
+#include "PommeMemory.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// What BlockDescriptor::Allocate and Free used to do: one `new char[]` per
+// block, with the descriptor in the first 32 bytes.
+
+static constexpr int kOldBlockDescriptorPadding = 32;
+
+struct OldBlockDescriptor
+{
+	UInt32 magic;
+	UInt32 size;
+	Ptr ptrToData;
+	void* rezMeta;
+};
+
+static Ptr OldNewPtr(Size size, bool clear)
+{
+	char* buf = new char[kOldBlockDescriptorPadding + size];
+	OldBlockDescriptor* block = (OldBlockDescriptor*) buf;
+	block->magic = 'LIVE';
+	block->size = (UInt32) size;
+	block->ptrToData = buf + kOldBlockDescriptorPadding;
+	block->rezMeta = nullptr;
+	if (clear)
+		memset(block->ptrToData, 0, size);
+	return block->ptrToData;
+}
+
+static void OldDisposePtr(Ptr p)
+{
+	char* buf = p - kOldBlockDescriptorPadding;
+	((OldBlockDescriptor*) buf)->magic = 'DEAD';
+	delete[] buf;
+}
+
+//-----------------------------------------------------------------------------
+
+struct Allocator
+{
+	const char* name;
+	Ptr (*newPtr)(Size size, bool clear);
+	void (*disposePtr)(Ptr p);
+};
+
+static const Allocator kAllocators[] =
+{
+	{"new char[]", OldNewPtr, OldDisposePtr},
+	{"Pomme", [](Size size, bool clear) { return clear ? NewPtrClear(size) : NewPtr(size); }, DisposePtr},
+};
+
+static uint32_t NextRandom(uint32_t& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+// Keeps `liveCount` blocks alive; every op frees a random one and allocates a
+// new one of a random size in [minSize, maxSize]. Returns ns per op (a free
+// and an allocation).
+static double TimeChurn(const Allocator& a, Size minSize, Size maxSize, int liveCount, int numOps)
+{
+	std::vector<Size> sizes(numOps);
+	std::vector<int> slots(numOps);
+	uint32_t rng = 0x12345678;
+	for (int i = 0; i < numOps; i++)
+	{
+		sizes[i] = minSize + (Size) (NextRandom(rng) % (uint32_t) (maxSize - minSize + 1));
+		slots[i] = (int) (NextRandom(rng) % (uint32_t) liveCount);
+	}
+
+	std::vector<Ptr> live(liveCount);
+	for (int i = 0; i < liveCount; i++)
+		live[i] = a.newPtr(minSize, false);
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < numOps; i++)
+	{
+		Ptr& p = live[slots[i]];
+		a.disposePtr(p);
+		p = a.newPtr(sizes[i], false);
+		p[0] = (char) i;
+	}
+	const auto end = std::chrono::steady_clock::now();
+
+	for (Ptr p : live)
+		a.disposePtr(p);
+
+	return std::chrono::duration<double, std::nano>(end - start).count() / numOps;
+}
+
+// Allocates a cleared block, touches its first page, and frees it. This is
+// where mapped pages pay off: the untouched pages are never zeroed.
+static double TimeLargeClear(const Allocator& a, Size size, int numOps)
+{
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < numOps; i++)
+	{
+		Ptr p = a.newPtr(size, true);
+		p[i % 4096] = (char) i;
+		a.disposePtr(p);
+	}
+	const auto end = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double, std::nano>(end - start).count() / numOps;
+}
+
+int main()
+{
+	struct { Size minSize, maxSize; } smallRanges[] =
+	{
+		{1, 16},
+		{17, 64},
+		{65, 256},
+		{257, 1024},
+		{1025, 4096},
+		{4097, 16384},
+	};
+
+	printf("Churn, 256 live blocks (ns per free + alloc)\n");
+	printf("%-14s", "sizes");
+	for (const Allocator& a : kAllocators)
+		printf("%14s", a.name);
+	printf("\n");
+
+	for (auto range : smallRanges)
+	{
+		char label[32];
+		snprintf(label, sizeof(label), "%ld-%ld", (long) range.minSize, (long) range.maxSize);
+		printf("%-14s", label);
+		for (const Allocator& a : kAllocators)
+			printf("%14.1f", TimeChurn(a, range.minSize, range.maxSize, 256, 2'000'000));
+		printf("\n");
+	}
+
+	printf("\nNewPtrClear, touch one page, DisposePtr (ns per block)\n");
+	for (Size size : {256 * 1024, 1024 * 1024, 4 * 1024 * 1024})
+	{
+		char label[32];
+		snprintf(label, sizeof(label), "%ld KB", (long) size / 1024);
+		printf("%-14s", label);
+		for (const Allocator& a : kAllocators)
+			printf("%14.1f", TimeLargeClear(a, size, 2000));
+		printf("\n");
+	}
+
+	return 0;
+}
@@ -156,6 +156,9 @@ void GetResInfo(Handle theResource, short* theID, ResType* theType, char* name25
 
 void ReleaseResource(Handle theResource);
 
+// Reads the resource's data back in if its handle was purged.
+void LoadResource(Handle theResource);
+
 void RemoveResource(Handle theResource);
 
 void AddResource(Handle theData, ResType theType, short theID, const char* name);
@@ -210,7 +213,12 @@ PicHandle GetPictureFromFile(const FSSpec* spec);
 
 void DisposeGWorld(GWorldPtr offscreenGWorld);
 
+// Pass in NewGWorld's flags to store a 16-bit GWorld as RGB565 instead of QuickDraw's xRGB1555.
+// Pomme extension (not part of the original Toolbox API).
+enum { pommeRGB565GWorld = 1L << 30 };
+
 // IM:QD:6-16
+// Depths 1, 8 (clut8) and 16 are stored natively; other depths are stored as 32-bit ARGB.
 QDErr NewGWorld(
 	GWorldPtr* offscreenGWorld,
 	short pixelDepth,
@@ -230,9 +238,122 @@ PixMapHandle GetGWorldPixMap(GWorldPtr offscreenGWorld);
 // IM:QD:6-38
 Ptr GetPixBaseAddr(PixMapHandle pm);
 
+// Same as GetPixBaseAddr, for callers that only read the pixels. Unlike
+// GetPixBaseAddr, it doesn't count as a change to the pixmap, so it keeps
+// compiled sprites and static layers built from it.
+// Pomme extension (not part of the original Toolbox API).
+const char* GetPixBaseAddrForReading(PixMapHandle pm);
+
 // Get pixel color at point
 Boolean GetPixel(short h, short v);
 
+// ----------------------------------------------------------------------------
+// QuickDraw 2D: Static layers
+// Pomme extension (not part of the original Toolbox API).
+//
+// A static layer caches the result of a sequence of draws (e.g. a background
+// and the scenery on it) in a GWorld, so that it costs a single CopyBits per
+// frame. The draws are only redone when the layer is invalidated, or when a
+// GWorld that CopyBits or CopyMask read into the layer has changed since.
+// Anything else the draws depend on (which GWorlds to draw, where, pen
+// colors...) must be handled by calling InvalidateStaticLayer.
+//
+//     if (BeginStaticLayer(layer))
+//     {
+//         ... draw into GetStaticLayerGWorld(layer) ...
+//         EndStaticLayer(layer);
+//     }
+//     DrawStaticLayer(layer, &dstRect);
+
+// Creates a layer backed by a GWorld with the given depth, bounds, and NewGWorld flags.
+OSErr NewStaticLayer(StaticLayerPtr* layer, short pixelDepth, const Rect* boundsRect, long flags);
+
+void DisposeStaticLayer(StaticLayerPtr layer);
+
+GWorldPtr GetStaticLayerGWorld(StaticLayerPtr layer);
+
+// Forces the layer to be redrawn the next time BeginStaticLayer is called.
+void InvalidateStaticLayer(StaticLayerPtr layer);
+
+// Returns false if the layer is up to date. Otherwise, makes the layer's GWorld
+// the current port and returns true; the caller must then redraw the whole
+// layer and call EndStaticLayer.
+Boolean BeginStaticLayer(StaticLayerPtr layer);
+
+// Marks the layer as up to date and restores the port that was current
+// before BeginStaticLayer.
+void EndStaticLayer(StaticLayerPtr layer);
+
+// Copies the layer to dstRect in the current port.
+void DrawStaticLayer(StaticLayerPtr layer, const Rect* dstRect);
+
+// ----------------------------------------------------------------------------
+// QuickDraw 2D: Banded frames
+// Pomme extension (not part of the original Toolbox API).
+//
+// Between BeginBandedFrame and EndBandedFrame, fills (PaintRect, EraseRect,
+// FrameRect), unscaled CopyMask and DrawSpriteBatch, and unscaled CopyBits in
+// modes that don't use the pen or op colors, are recorded instead of drawn when
+// they go to the frame's port. The recording is replayed over horizontal bands
+// of the port on several threads; the pixels come out the same as if every draw
+// had been done right away.
+//
+// Anything else that touches the frame's pixels, or the pixels of a GWorld that
+// a recorded draw reads from (other draws, GetPixBaseAddr, SetClip...), first
+// replays what was recorded so far, so the frame can contain any drawing. Draws
+// are only recorded if there are several threads to replay them on.
+
+// Starts recording the draws that go to `port`. Banded frames can't be nested.
+void BeginBandedFrame(CGrafPtr port);
+
+// Replays what's left of the recording, and goes back to drawing right away.
+void EndBandedFrame(void);
+
+// ----------------------------------------------------------------------------
+// QuickDraw 2D: Presenters
+// Pomme extension (not part of the original Toolbox API).
+//
+// A presenter converts a port's pixels to a format that the host can display
+// as is, into two buffers owned by the caller. Only the parts of the port that
+// were damaged since they were last converted into a buffer are converted
+// again, so code that writes straight to a port's pixels must damage what it
+// writes with DamagePortRegion.
+//
+// PresentPort converts into one buffer on a background thread while the other
+// one is shown, so the next frame can be simulated meanwhile; the conversion is
+// only waited for when the port is written to again, or when the frame is asked
+// for with waitForLatest.
+//
+//     PresentPort(presenter, port);		// at the end of each frame
+//     ...
+//     void* pixels = GetPresentedFrame(presenter, false);	// when displaying
+
+// Formats of the pixels in the presenter's buffers: 32 bits per pixel, with
+// the bytes in this order in memory.
+enum
+{
+	pommePresentBGRA = 0,
+	pommePresentRGBA = 1,
+};
+
+// Creates a presenter for ports of width x height pixels: larger ports are
+// cropped, and smaller ones leave the rest of the buffers as is. The buffers
+// must hold height rows of rowBytes bytes each, and stay valid until the
+// presenter is disposed of.
+OSErr NewPresenter(PresenterPtr* presenter, short width, short height, long format, void* buffer1, void* buffer2, long rowBytes);
+
+// Waits for the conversion in progress, if any, before disposing of the presenter.
+void DisposePresenter(PresenterPtr presenter);
+
+// Starts converting the port into the buffer that isn't shown, and clears the
+// port's damage. Presenting another port than last time converts it whole.
+void PresentPort(PresenterPtr presenter, CGrafPtr port);
+
+// Returns the buffer holding the latest frame that's done converting, or NULL
+// if none is yet. With waitForLatest, waits for the frame in progress first.
+// The buffer is valid until the next call to PresentPort.
+void* GetPresentedFrame(PresenterPtr presenter, Boolean waitForLatest);
+
 // ----------------------------------------------------------------------------
 // QuickDraw 2D: Port
 
@@ -268,10 +389,60 @@ void RGBBackColor2(UInt32 color);
 // Pomme extension (not part of the original Toolbox API).
 void RGBForeColor2(UInt32 color);
 
+// Sets the pin color of addPin/subPin and the per-channel weights of blend.
+// Until OpColor is called, addPin pins to white, subPin to black, and blend weighs 50%.
+void OpColor(const RGBColor* color);
+
 void PenNormal(void);
 
 void PenSize(short width, short height);
 
+// ----------------------------------------------------------------------------
+// QuickDraw 2D: Regions
+
+RgnHandle NewRgn(void);
+
+void DisposeRgn(RgnHandle rgn);
+
+void CopyRgn(RgnHandle srcRgn, RgnHandle dstRgn);
+
+void SetEmptyRgn(RgnHandle rgn);
+
+void SetRectRgn(RgnHandle rgn, short left, short top, short right, short bottom);
+
+void RectRgn(RgnHandle rgn, const Rect* r);
+
+void OffsetRgn(RgnHandle rgn, short dh, short dv);
+
+// The destination region may be one of the source regions.
+void SectRgn(RgnHandle srcRgnA, RgnHandle srcRgnB, RgnHandle dstRgn);
+
+void UnionRgn(RgnHandle srcRgnA, RgnHandle srcRgnB, RgnHandle dstRgn);
+
+void DiffRgn(RgnHandle srcRgnA, RgnHandle srcRgnB, RgnHandle dstRgn);
+
+void XorRgn(RgnHandle srcRgnA, RgnHandle srcRgnB, RgnHandle dstRgn);
+
+Boolean EmptyRgn(RgnHandle rgn);
+
+Boolean EqualRgn(RgnHandle rgnA, RgnHandle rgnB);
+
+Boolean PtInRgn(Point pt, RgnHandle rgn);
+
+Boolean RectInRgn(const Rect* r, RgnHandle rgn);
+
+Rect* GetRegionBounds(RgnHandle rgn, Rect* bounds);
+
+// Copies the current port's clip region into rgn.
+void GetClip(RgnHandle rgn);
+
+// Sets the current port's clip region to a copy of rgn.
+// Drawing to the port is clipped to it (in addition to the port rect).
+void SetClip(RgnHandle rgn);
+
+// Sets the current port's clip region to a rect.
+void ClipRect(const Rect* r);
+
 // ----------------------------------------------------------------------------
 // QuickDraw 2D: Paint
 
@@ -296,10 +467,19 @@ void DrawChar(char c);
 
 void DrawStringC(const char* cstr);
 
+// Enables caching of whole rendered strings, keyed by text and pen colors, so
+// that DrawStringC draws a string it has seen before as a single blit.
+// Disabled by default. Disabling it frees the cache.
+// Pomme extension (not part of the original Toolbox API).
+void SetStringCacheEnabled(Boolean enabled);
+
 // IM:QD:7-44
 void DrawPicture(PicHandle myPicture, const Rect* dstRect);
 
 // CopyBits - copies bits from source to destination bitmap/pixmap
+// Supports the boolean modes, the arithmetic modes (see OpColor), transparent and pommeAlphaCopy.
+// The rects may differ in size; the source is then scaled to fit (see pommeBilinearScaling).
+// Drawing is clipped to the destination port's clip region, and to maskRgn if it isn't nil.
 // Note: In classic QuickDraw, this took BitMap* but worked with PixMap* too
 // because PixMap's first fields matched BitMap's layout. For compatibility,
 // we accept BitMap* and internally treat them as PixMap*.
@@ -309,11 +489,13 @@ void CopyBits(
 	const Rect* srcRect,
 	const Rect* dstRect,
 	short mode,
-	void* maskRgn
+	RgnHandle maskRgn
 );
 
 // CopyMask - copy source to destination using mask (where mask is black, copy source)
 // Note: Same compatibility approach as CopyBits
+// The source and mask rects must have the same size. If dstRect's size differs,
+// the source and mask are scaled to fit, with nearest-neighbor sampling.
 void CopyMask(
 	const PixMap* srcBits,
 	const PixMap* maskBits,
@@ -323,6 +505,14 @@ void CopyMask(
 	const Rect* dstRect
 );
 
+// Draws many masked sprites into the current port, as with CopyMask (unscaled).
+// Sprites are drawn by increasing layer, and in array order within a layer.
+// Each sprite's srcRect is clipped to its source and mask, and to the port's
+// clip region. Large batches are split into horizontal bands of the port that
+// are drawn on several threads at once; the output is the same either way.
+// Pomme extension (not part of the original Toolbox API).
+void DrawSpriteBatch(const SpriteBatchItem* items, long count);
+
 // Draw oval outline inscribed in bounding rectangle
 void FrameOval(const Rect* r);
 
@@ -344,6 +534,12 @@ Boolean IsPortDamaged(void);
 // Pomme extension (not part of the original Toolbox API).
 void GetPortDamageRegion(Rect* r);
 
+// Stores the current port's damaged area into "rects", as at most "maxRects"
+// rects (fewer than kept internally means some get merged). Returns the number
+// of rects written, which is 0 if the port isn't damaged.
+// Pomme extension (not part of the original Toolbox API).
+short GetPortDamageRects(Rect* rects, short maxRects);
+
 // Sets current port as undamaged.
 // Pomme extension (not part of the original Toolbox API).
 void ClearPortDamage(void);
@@ -419,35 +615,6 @@ static inline void MaxApplZone(void) {}
 // No-op in Pomme.
 static inline void MoreMasters(void) {}
 
-// No-op in Pomme.
-static inline Size CompactMem(Size size) { return size; }
-
-// No-op in Pomme.
-// Compact system heap zone manually.
-static inline Size CompactMemSys(Size size) { return size; }
-
-// No-op in Pomme.
-static inline void PurgeMem(Size size) { (void) size; }
-
-// No-op in Pomme.
-static inline void PurgeMemSys(Size size) { (void) size; }
-
-// No-op in Pomme.
-// TODO: do something about `grow` and return a large integer to make it look like we have tons of memory.
-static inline Size MaxMem(Size* grow) { (void) grow; return 0; }
-
-// No-op in Pomme.
-static inline void HNoPurge(Handle handle) { (void) handle; }	// no-op
-
-// No-op in Pomme.
-static inline void HLock(Handle handle) { (void) handle; }	// no-op
-
-// No-op in Pomme.
-static inline void HLockHi(Handle handle) { (void) handle; }	// no-op
-
-// No-op in Pomme.
-static inline void HUnlock(Handle handle) { (void) handle; }	// no-op
-
 // No-op in Pomme.
 static inline void NoPurgePixels(PixMapHandle handle) { (void) handle; }	// no-op
 
@@ -490,6 +657,62 @@ void DisposeHandle(Handle);
 // Allocates a handle of the given size and copies the contents of srcPtr into it
 OSErr PtrToHand(const void* srcPtr, Handle* dstHndl, Size size);
 
+//-----------------------------------------------------------------------------
+// Memory: relocatable blocks
+
+#if POMME_DECLARE_MEMORY_FUNCS
+// Result code of the last Memory Manager call that reports errors this way
+// (SetHandleSize, HLock, MoveHHi, etc.)
+OSErr MemError(void);
+
+// Compacts the heap: unlocked handles are moved over free space.
+// Returns the size of the largest contiguous free block.
+Size CompactMem(Size cbNeeded);
+
+Size CompactMemSys(Size cbNeeded);
+
+// Compacts the heap and returns the size of the largest contiguous free block.
+// `grow` receives the amount by which the heap can still grow.
+Size MaxMem(Size* grow);
+
+// Returns the total amount of free space in the heap.
+long FreeMem(void);
+
+// Prevents a relocatable block from being moved by heap compaction.
+void HLock(Handle handle);
+
+// Moves the block out of the way of heap compaction, then locks it.
+void HLockHi(Handle handle);
+
+void HUnlock(Handle handle);
+
+// Moves the block to where it won't hinder heap compaction while it stays locked.
+// Fails with memLockedErr if the block is already locked.
+void MoveHHi(Handle handle);
+
+// Returns the handle's state flags (0x80: locked, 0x40: purgeable, 0x20: resource).
+SInt8 HGetState(Handle handle);
+
+void HSetState(Handle handle, SInt8 flags);
+
+// Marks a handle as purgeable: PurgeMem, MaxMem or the heap budget may empty it.
+void HPurge(Handle handle);
+
+void HNoPurge(Handle handle);
+
+// Frees the handle's data but keeps the handle itself valid (*handle becomes NULL).
+void EmptyHandle(Handle handle);
+
+// Allocates new data for a handle, typically one that was emptied.
+void ReallocateHandle(Handle handle, Size byteCount);
+
+// Empties unlocked purgeable handles, least recently used first,
+// until at least `cbNeeded` bytes have been freed.
+void PurgeMem(Size cbNeeded);
+
+void PurgeMemSys(Size cbNeeded);
+#endif /* POMME_DECLARE_MEMORY_FUNCS */
+
 //-----------------------------------------------------------------------------
 // Memory: Ptr
 
@@ -514,6 +737,67 @@ long Pomme_GetNumAllocs(void);
 // Returns lower bound of total heap allocated by application
 Size Pomme_GetHeapSize(void);
 
+// Pomme extension:
+// Snapshot of the heap statistics, see Pomme_GetHeapReport.
+// Histogram bucket 0 counts empty blocks; bucket i counts blocks whose size
+// is in [2^(i-1), 2^i).
+#define kPommeHeapHistogramBuckets 32
+
+typedef struct PommeHeapReport
+{
+	Size	liveBytes;					// Ptr and Handle blocks, including their descriptors
+	Size	peakLiveBytes;				// sampled every 256 KB allocated per thread, and on every report
+	long	liveBlocks;
+	Size	gworldPixelBytes;			// offscreen GWorld pixels (not counted in liveBytes)
+	Size	peakGWorldPixelBytes;
+	long	totalAllocs;
+	long	totalFrees;
+	long	frameNumber;				// number of calls to Pomme_HeapReportEndFrame
+	long	allocsLastFrame;
+	long	freesLastFrame;
+	Size	bytesAllocatedLastFrame;
+	Size	bytesFreedLastFrame;
+	long	allocSizeHistogram[kPommeHeapHistogramBuckets];	// every allocation so far, by requested size
+	long	liveSizeHistogram[kPommeHeapHistogramBuckets];	// live blocks, by current size
+} PommeHeapReport;
+
+// Pomme extension:
+// Fills in a snapshot of the heap statistics.
+// Safe to call from any thread; merges the counters kept by each thread.
+void Pomme_GetHeapReport(PommeHeapReport* report);
+
+// Pomme extension:
+// Returns how many heap bytes are held by live resources of the given type.
+Size Pomme_GetLiveBytesForResType(ResType type);
+
+// Pomme extension:
+// Call once per frame. Latches the per-frame allocation counters.
+void Pomme_HeapReportEndFrame(void);
+
+// Pomme extension:
+// Writes the heap report, including live bytes per resource type, as JSON.
+// Pass NULL to write to stdout.
+OSErr Pomme_DumpHeapReportJSON(const char* path);
+
+// Pomme extension:
+// When the heap grows past this many bytes, purgeable resource handles are
+// emptied (least recently used first) to make room. LoadResource reloads them.
+// Pass 0 to disable (the default).
+void Pomme_SetHeapBudget(Size maxBytes);
+
+//-----------------------------------------------------------------------------
+// Memory: frame arena
+
+// Pomme extension:
+// Until the matching Pomme_EndFrameArena, small Ptrs allocated by this thread
+// (NewPtr, NewPtrClear) are bump-allocated from a cheap, recyclable arena.
+// GetPtrSize and DisposePtr work on them as usual, and they stay valid after
+// the frame ends; memory is recycled once a chunk's last block is disposed.
+// Calls may be nested.
+void Pomme_BeginFrameArena(void);
+
+void Pomme_EndFrameArena(void);
+
 //-----------------------------------------------------------------------------
 // Memory: pointer tracking
 
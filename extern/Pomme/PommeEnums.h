@@ -209,6 +209,17 @@ enum EResTypes
     rAliasType = 'alis',
 };
 
+// Resource attributes
+enum EResAttributes
+{
+    resSysHeap      = 64,   // System or application heap?
+    resPurgeable    = 32,   // Purgeable resource?
+    resLocked       = 16,   // Load it in locked?
+    resProtected    = 8,    // Protected?
+    resPreload      = 4,    // Load in on OpenResFile?
+    resChanged      = 2,    // Resource changed?
+};
+
 //-----------------------------------------------------------------------------
 // Sound Manager enums
 
@@ -460,7 +471,11 @@ enum
 	subOver = 38,
 	adMin = 39,
 	ditherCopy = 64,
-	transparent = 36
+	transparent = 36,
+
+	// Pomme extensions (not part of the original Toolbox API)
+	pommeAlphaCopy = 0x0100,		// Composites the source over the destination according to the source's alpha channel
+	pommeBilinearScaling = 0x0200,	// Add to a CopyBits mode to scale with bilinear filtering instead of nearest neighbor
 };
 
 enum
@@ -41,6 +41,38 @@ namespace Pomme::Graphics
 		{ return (UInt32*) &data.data()[4 * (y * width + x)]; }
 	};
 
+	// Pixmap with fewer than 32 bits per pixel, laid out like a classic QuickDraw
+	// PixMap: rows are `rowBytes` apart, and pixels are packed from the most
+	// significant bit of each byte. Multi-byte pixels are big-endian.
+	//  - depth 1: a set bit is black.
+	//  - depth 8: index into clut8.
+	//  - depth 16: xRGB1555 as in QuickDraw, or RGB565 if `rgb565` is set.
+	struct PackedPixmap
+	{
+		int depth;
+		bool rgb565;
+		int width;
+		int height;
+		int rowBytes;
+		std::vector<Byte> data;
+
+		PackedPixmap();
+
+		PackedPixmap(int depth, int w, int h, bool rgb565 = false);
+
+		inline Byte* GetRow(int y)
+		{ return &data.data()[y * rowBytes]; }
+
+		// Only for depths >= 8
+		inline Byte* GetPtr(int x, int y)
+		{ return &data.data()[y * rowBytes + x * (depth >> 3)]; }
+
+		inline bool GetBit(int x, int y) const
+		{ return data[y * rowBytes + (x >> 3)] & (0x80 >> (x & 7)); }
+
+		void FillBits(int left, int top, int right, int bottom, bool black);
+	};
+
 	void Init();
 
 	void Shutdown();
@@ -11,26 +11,92 @@ namespace Pomme::Files
 
 namespace Pomme::Memory
 {
+#if POMME_PTR_TRACKING
+	static constexpr int kBlockDescriptorPadding = 64;
+#else
+	static constexpr int kBlockDescriptorPadding = 32;
+#endif
+
+	enum BlockFlags : uint8_t
+	{
+		// Handle state bits, as reported by HGetState
+		kBlockLocked		= 0x80,
+		kBlockPurgeable		= 0x40,
+		kBlockResource		= 0x20,
+		kBlockStateMask		= 0xE0,
+
+		// Internal: block lives in a relocatable arena (see CompactMem)
+		kBlockInZone		= 0x01,
+
+		// Internal: block was bump-allocated from a frame arena (see Pomme_BeginFrameArena)
+		kBlockInFrameArena	= 0x02,
+	};
+
 	struct BlockDescriptor
 	{
 		uint32_t magic;
-		uint32_t size;
+		uint32_t size;			// logical size, as reported by GetPtrSize/GetHandleSize
+		uint32_t capacity;		// bytes reserved for the data; size can grow up to this in place
+		uint8_t flags;			// see BlockFlags
+		Ptr* masterPtr;			// handles only: master pointer to this block's data (nullptr for Ptrs)
+		const Pomme::Files::ResourceMetadata* rezMeta;		// set through SetResourceMetadata
+#if POMME_PTR_TRACKING
+		BlockDescriptor* prevLive;		// intrusive list of the blocks allocated in the current batch
+		BlockDescriptor* nextLive;
+		const void* allocSite;			// return address of the NewPtr/NewHandle call
 		uint32_t ptrBatch;
 		uint32_t ptrNumInBatch;
-		Ptr ptrToData;
-		const Pomme::Files::ResourceMetadata* rezMeta;
+#endif
+
+		// Set `clear` to get zero-filled data (free for large blocks).
+		// The block reserves at least `minCapacity` bytes for its data.
+		static BlockDescriptor* Allocate(uint32_t size, bool clear = false, uint32_t minCapacity = 0);
 
-		static BlockDescriptor* Allocate(uint32_t size);
+		// Same as Allocate, but the block may be moved around by heap compaction
+		// while it's unlocked. Only use this for blocks that are reached through a handle.
+		static BlockDescriptor* AllocateRelocatable(uint32_t size, bool clear = false, uint32_t minCapacity = 0);
 
 		static void Free(BlockDescriptor* block);
 
+		// Changes the block's logical size. Grows in place into the block's spare
+		// capacity if possible; otherwise moves the data to a new block (updating
+		// the master pointer) and returns the new block.
+		// Returns nullptr if the block needs to move but is locked.
+		static BlockDescriptor* Resize(BlockDescriptor* block, uint32_t newSize);
+
+		// Moves a handle's data to a new block outside of the relocatable zone.
+		static BlockDescriptor* MoveOutOfZone(BlockDescriptor* block);
+
 		void CheckIsLive() const;
 
+		// Tags the block as holding the given resource (or nothing if nullptr),
+		// setting kBlockResource to match and keeping the per-type heap
+		// statistics up to date.
+		void SetResourceMetadata(const Pomme::Files::ResourceMetadata* meta);
+
+		inline Ptr GetData()
+		{ return (Ptr) this + kBlockDescriptorPadding; }
+
 		static BlockDescriptor* HandleToBlock(Handle h);
 
 		static BlockDescriptor* PtrToBlock(Ptr p);
 	};
 
+	// Marks a purgeable handle as most recently used.
+	void TouchHandle(Handle h);
+
+	// Returns the metadata of the resource that a purged handle used to hold,
+	// or nullptr if the handle isn't a purged resource.
+	const Pomme::Files::ResourceMetadata* GetPurgedResource(Handle h);
+
+	// Forgets about the resources of a fork that's being closed,
+	// so that they aren't reloaded from it.
+	void ForgetResourceFork(short forkRefNum);
+
+	// Tells the heap statistics that GWorld pixel storage has grown (or shrunk,
+	// if negative) by this many bytes.
+	void AccountGWorldPixels(ptrdiff_t numBytes);
+
 	class DisposeHandleGuard
 	{
 	public:
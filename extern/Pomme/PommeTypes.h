@@ -144,7 +144,7 @@ typedef struct PixMap
 	Rect bounds;
 	short pixelSize;
 	short rowBytes;
-	Ptr _impl;		// Points to ARGBPixmap
+	Ptr _impl;		// Points to GrafPortImpl
 } PixMap;
 typedef PixMap*							PixMapPtr;
 typedef PixMapPtr*						PixMapHandle;
@@ -159,6 +159,34 @@ typedef GrafPort                        CGrafPort;
 typedef GrafPtr							CGrafPtr;
 typedef CGrafPtr						GWorldPtr;
 
+// Pomme extension (not part of the original Toolbox API): see NewStaticLayer.
+typedef struct StaticLayer*				StaticLayerPtr;
+
+// Pomme extension (not part of the original Toolbox API): see NewPresenter.
+typedef struct Presenter*				PresenterPtr;
+
+// Pomme extension (not part of the original Toolbox API): see DrawSpriteBatch.
+typedef struct SpriteBatchItem
+{
+	GWorldPtr src;
+	GWorldPtr mask;
+	Rect srcRect;		// same rect in the source and in the mask
+	Point dstPoint;		// where srcRect's top-left corner goes in the current port
+	short layer;		// lower layers are drawn first
+} SpriteBatchItem;
+
+// Only rgnSize and rgnBBox match QuickDraw's layout; the region's shape is kept
+// internally as scanline spans. rgnSize is 10 for rectangular or empty regions,
+// like in QuickDraw, and larger otherwise.
+typedef struct Region
+{
+	SInt16 rgnSize;
+	Rect rgnBBox;
+	void* _impl;	// Points to RegionImpl
+} Region;
+typedef Region*							RgnPtr;
+typedef RgnPtr*							RgnHandle;
+
 //-----------------------------------------------------------------------------
 // QuickDraw 2D: Color Manager
 /* Pattern */
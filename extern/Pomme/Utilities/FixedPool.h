@@ -1,46 +1,296 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#if _MSC_VER
+	#include <intrin.h>
+#endif
+
 namespace Pomme {
 
+// Index of the lowest set bit. `bits` must not be 0.
+inline int PoolLowestSetBit(uint64_t bits)
+{
+#if _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, bits);
+	return (int) index;
+#else
+	return __builtin_ctzll(bits);
+#endif
+}
+
+// True if TId can tell apart MAX slots and the all-ones kNil marker
+template<typename TId, int MAX>
+constexpr bool PoolIdFits()
+{
+	return std::is_integral_v<TId> && MAX > 0
+		&& uintmax_t(MAX) <= uintmax_t(std::numeric_limits<TId>::max());
+}
+
+// One bit per slot, set while the slot holds a live object.
+// Iterating visits live slots only, skipping 64 free slots at a time.
+template<int MAX>
+class PoolLiveBitmap
+{
+	static constexpr int kNumWords = (MAX + 63) / 64;
+	uint64_t words[kNumWords] = {};
+
+public:
+	void Set(int i)
+	{ words[i >> 6] |= uint64_t(1) << (i & 63); }
+
+	void Clear(int i)
+	{ words[i >> 6] &= ~(uint64_t(1) << (i & 63)); }
+
+	bool Test(int i) const
+	{ return words[i >> 6] & (uint64_t(1) << (i & 63)); }
+
+	template<typename F>
+	void ForEach(F&& fn) const
+	{
+		for (int w = 0; w < kNumWords; w++)
+		{
+			for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1)
+				fn(w * 64 + PoolLowestSetBit(bits));
+		}
+	}
+};
+
+// Fixed-capacity object pool. Objects never move, so pointers to them stay valid.
+// Free slots are chained through their own storage: no allocations, no side vector.
+// Not thread-safe; see LockFreeFixedPool.
 template<typename TObj, typename TId, int MAX>
 class FixedPool
 {
-	// fixed size array so that pointers to the elements don't move around in memory
-	// (unlike how a vector might move around elements on resize)
-	TObj pool[MAX];
-	std::vector<TId> freeIDs;
+	static constexpr TId kNil = TId(-1);
+	static_assert(PoolIdFits<TId, MAX>(), "TId is too small for MAX slots: the last ones would alias kNil");
+
+	union Slot
+	{
+		TId nextFree;
+		alignas(TObj) unsigned char storage[sizeof(TObj)];
+	};
+
+	Slot pool[MAX];
+	PoolLiveBitmap<MAX> live;
+	TId freeHead;
 	int inUse, inUsePeak;
 
+	TObj* At(int i)
+	{ return std::launder(reinterpret_cast<TObj*>(pool[i].storage)); }
+
 public:
 	FixedPool()
 	{
 		inUse = 0;
 		inUsePeak = 0;
-		freeIDs.reserve(MAX);
-		for (int i = MAX - 1; i >= 0; i--)
-			freeIDs.push_back(i);
+		for (int i = 0; i < MAX - 1; i++)
+			pool[i].nextFree = TId(i + 1);
+		pool[MAX - 1].nextFree = kNil;
+		freeHead = 0;
+	}
+
+	~FixedPool()
+	{
+		live.ForEach([this](int i) { At(i)->~TObj(); });
 	}
 
-	TObj* Alloc()
+	FixedPool(const FixedPool&) = delete;
+	FixedPool& operator=(const FixedPool&) = delete;
+
+	template<typename... Args>
+	TObj* Alloc(Args&&... args)
 	{
-		if (freeIDs.empty())
+		if (freeHead == kNil)
 			throw std::length_error("pool exhausted");
-		TId id = freeIDs.back();
-		freeIDs.pop_back();
+		TId id = freeHead;
+		freeHead = pool[id].nextFree;
+		TObj* obj = new (pool[id].storage) TObj(std::forward<Args>(args)...);
+		live.Set(id);
 		inUse++;
 		if (inUse > inUsePeak)
 			inUsePeak = inUse;
-		return &pool[id];
+		return obj;
 	}
 
 	void Dispose(TObj* obj)
 	{
-		intptr_t id = obj - &pool[0];
+		TId id = GetID(obj);
+		if (!live.Test(id))
+			throw std::invalid_argument("obj isn't allocated");
+		obj->~TObj();
+		live.Clear(id);
+		pool[id].nextFree = freeHead;
+		freeHead = id;
+		inUse--;
+	}
+
+	TId GetID(const TObj* obj) const
+	{
+		intptr_t id = reinterpret_cast<const Slot*>(obj) - &pool[0];
 		if (id < 0 || id >= MAX)
 			throw std::invalid_argument("obj isn't stored in pool");
-		inUse--;
-		freeIDs.push_back((TId)id);
+		return (TId) id;
 	}
+
+	// Calls fn(TObj&) on every live object, in slot order.
+	// fn may dispose of the object it's given.
+	template<typename F>
+	void ForEachLive(F&& fn)
+	{
+		live.ForEach([&](int i) { fn(*At(i)); });
+	}
+
+	int GetNumInUse() const
+	{ return inUse; }
+
+	int GetPeakInUse() const
+	{ return inUsePeak; }
+};
+
+// Same as FixedPool, but Alloc and Dispose may be called concurrently from any
+// number of threads (e.g. the game thread and the audio callback) without locking.
+//
+// The free list is a Treiber stack. Its head packs a slot index with a tag
+// that's bumped on every pop, so that a pop can't be fooled by the head being
+// popped and pushed back in the meantime (ABA).
+template<typename TObj, typename TId, int MAX>
+class LockFreeFixedPool
+{
+	static_assert(MAX > 0 && uint64_t(MAX) < 0xFFFFFFFFull);
+	static_assert(PoolIdFits<TId, MAX>(), "TId is too small for MAX slots");
+
+	static constexpr uint32_t kNil = 0xFFFFFFFF;
+
+	struct Slot
+	{
+		// Kept apart from the object, so that a thread racing to pop a slot
+		// that has just been handed out reads a stale link, not garbage
+		std::atomic<uint32_t> nextFree;
+		alignas(TObj) unsigned char storage[sizeof(TObj)];
+	};
+
+	Slot pool[MAX];
+	std::atomic<uint64_t> freeHead;		// tag << 32 | index
+	std::atomic<uint64_t> liveWords[(MAX + 63) / 64];
+	std::atomic<int> inUse;
+
+	static uint64_t Pack(uint32_t tag, uint32_t index)
+	{ return (uint64_t(tag) << 32) | index; }
+
+	TObj* At(int i)
+	{ return std::launder(reinterpret_cast<TObj*>(pool[i].storage)); }
+
+	uint32_t Pop()
+	{
+		uint64_t head = freeHead.load(std::memory_order_acquire);
+		for (;;)
+		{
+			uint32_t index = uint32_t(head);
+			if (index == kNil)
+				return kNil;
+			uint32_t next = pool[index].nextFree.load(std::memory_order_relaxed);
+			uint64_t newHead = Pack(uint32_t(head >> 32) + 1, next);
+			if (freeHead.compare_exchange_weak(head, newHead, std::memory_order_acq_rel, std::memory_order_acquire))
+				return index;
+		}
+	}
+
+	void Push(uint32_t index)
+	{
+		uint64_t head = freeHead.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			pool[index].nextFree.store(uint32_t(head), std::memory_order_relaxed);
+			uint64_t newHead = Pack(uint32_t(head >> 32), index);
+			if (freeHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed))
+				return;
+		}
+	}
+
+public:
+	LockFreeFixedPool()
+		: freeHead(Pack(0, 0))
+		, inUse(0)
+	{
+		for (int i = 0; i < MAX; i++)
+			pool[i].nextFree.store(i + 1 < MAX ? uint32_t(i + 1) : kNil, std::memory_order_relaxed);
+		for (auto& w : liveWords)
+			w.store(0, std::memory_order_relaxed);
+	}
+
+	~LockFreeFixedPool()
+	{
+		ForEachLive([](TObj& obj) { obj.~TObj(); });
+	}
+
+	LockFreeFixedPool(const LockFreeFixedPool&) = delete;
+	LockFreeFixedPool& operator=(const LockFreeFixedPool&) = delete;
+
+	// Returns nullptr if the pool is exhausted (doesn't throw, so it's safe
+	// to call from an audio callback).
+	template<typename... Args>
+	TObj* TryAlloc(Args&&... args)
+	{
+		uint32_t id = Pop();
+		if (id == kNil)
+			return nullptr;
+		TObj* obj = new (pool[id].storage) TObj(std::forward<Args>(args)...);
+		liveWords[id >> 6].fetch_or(uint64_t(1) << (id & 63), std::memory_order_release);
+		inUse.fetch_add(1, std::memory_order_relaxed);
+		return obj;
+	}
+
+	template<typename... Args>
+	TObj* Alloc(Args&&... args)
+	{
+		TObj* obj = TryAlloc(std::forward<Args>(args)...);
+		if (!obj)
+			throw std::length_error("pool exhausted");
+		return obj;
+	}
+
+	void Dispose(TObj* obj)
+	{
+		uint32_t id = (uint32_t) GetID(obj);
+		uint64_t bit = uint64_t(1) << (id & 63);
+		if (!(liveWords[id >> 6].fetch_and(~bit, std::memory_order_acq_rel) & bit))
+			throw std::invalid_argument("obj isn't allocated");
+		obj->~TObj();
+		inUse.fetch_sub(1, std::memory_order_relaxed);
+		Push(id);
+	}
+
+	TId GetID(const TObj* obj) const
+	{
+		intptr_t id = (reinterpret_cast<const unsigned char*>(obj) - pool[0].storage) / intptr_t(sizeof(Slot));
+		if (id < 0 || id >= MAX || reinterpret_cast<const unsigned char*>(obj) != pool[id].storage)
+			throw std::invalid_argument("obj isn't stored in pool");
+		return (TId) id;
+	}
+
+	// Calls fn(TObj&) on every object that's live when its bitmap word is read.
+	// Only call this while no other thread disposes of objects.
+	template<typename F>
+	void ForEachLive(F&& fn)
+	{
+		for (auto& word : liveWords)
+		{
+			int base = int(&word - &liveWords[0]) * 64;
+			for (uint64_t bits = word.load(std::memory_order_acquire); bits != 0; bits &= bits - 1)
+				fn(*At(base + PoolLowestSetBit(bits)));
+		}
+	}
+
+	int GetNumInUse() const
+	{ return inUse.load(std::memory_order_relaxed); }
 };
 
 }
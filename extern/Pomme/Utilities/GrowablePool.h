@@ -1,22 +1,93 @@
 #pragma once
 
+#include <memory>
+#include <stdexcept>
 #include <vector>
 
 namespace Pomme
 {
 
+	// Number of bits needed to represent n, like C++20's std::bit_width.
+	constexpr int PoolBitWidth(unsigned n)
+	{
+		int bits = 0;
+		for (; n != 0; n >>= 1)
+			bits++;
+		return bits;
+	}
+
+	// Pool of up to MAX objects, addressed by small integer IDs.
+	//
+	// Objects live in fixed-size pages that are allocated on demand and never
+	// freed or moved, so references to them stay valid.
+	//
+	// An ID packs a slot index (low bits) with the slot's generation (the
+	// remaining non-sign bits of TId). The generation is bumped every time the
+	// slot is disposed of, so a stale ID to a reused slot is rejected in O(1).
+	// Free slots are reused in FIFO order to make generations last longer.
+	//
+	// Live IDs are also kept in a dense array for fast iteration.
 	template<typename TObj, typename TId, int MAX>
 	class GrowablePool
 	{
-		std::vector<TObj> pool;
-		std::vector<bool> isInUse;
-		std::vector<TId> freeIDs;
-		TId inUse, inUsePeak;
+		static constexpr int kIndexBits = PoolBitWidth(unsigned(MAX - 1));
+		static constexpr int kGenerationBits = int(sizeof(TId) * 8 - 1) - kIndexBits;
+		static constexpr int kIndexMask = (1 << kIndexBits) - 1;
+		static constexpr int kGenerationMask = (1 << kGenerationBits) - 1;
+
+		static_assert(kGenerationBits >= 2, "TId too narrow for MAX: no room for generation bits");
+
+		static constexpr int kPageShift = 6;
+		static constexpr int kPageSize = 1 << kPageShift;
+		static constexpr int kNumPages = (MAX + kPageSize - 1) / kPageSize;
+
+		static constexpr int kNil = -1;
+
+		struct Slot
+		{
+			TObj obj;
+			TId liveId;			// ID that currently refers to this slot, or -1 if free
+			int generation;
+			int nextFree;		// free slots only: next slot index in the free queue
+			int denseIndex;		// live slots only: position in liveIDs
+		};
+
+		struct Page
+		{
+			Slot slots[kPageSize];
+		};
+
+		std::unique_ptr<Page> pages[kNumPages];
+		std::vector<TId> liveIDs;
+		int numSlots;
+		int freeHead, freeTail;
+		TId inUsePeak;
+
+		Slot& GetSlot(int index)
+		{
+			return pages[index >> kPageShift]->slots[index & (kPageSize - 1)];
+		}
+
+		const Slot& GetSlot(int index) const
+		{
+			return pages[index >> kPageShift]->slots[index & (kPageSize - 1)];
+		}
+
+		int NewSlot()
+		{
+			int index = numSlots++;
+			if (!pages[index >> kPageShift])
+				pages[index >> kPageShift] = std::make_unique<Page>();
+			GetSlot(index).generation = 0;
+			return index;
+		}
 
 	public:
 		GrowablePool()
 		{
-			inUse = 0;
+			numSlots = 0;
+			freeHead = kNil;
+			freeTail = kNil;
 			inUsePeak = 0;
 		}
 
@@ -24,67 +95,100 @@ namespace Pomme
 		{
 			if (IsFull()) throw std::length_error("too many items allocated");
 
-			inUse++;
-			if (inUse > inUsePeak)
+			int index;
+			if (freeHead != kNil)
 			{
-				inUsePeak = inUse;
+				index = freeHead;
+				freeHead = GetSlot(index).nextFree;
+				if (freeHead == kNil)
+					freeTail = kNil;
 			}
-
-			if (!freeIDs.empty())
+			else
 			{
-				auto id = freeIDs.back();
-				freeIDs.pop_back();
-				isInUse[id] = true;
-				return id;
+				index = NewSlot();
 			}
-			else
+
+			Slot& slot = GetSlot(index);
+			TId id = TId((slot.generation << kIndexBits) | index);
+			slot.liveId = id;
+			slot.denseIndex = (int) liveIDs.size();
+			liveIDs.push_back(id);
+
+			if ((TId) liveIDs.size() > inUsePeak)
 			{
-				pool.emplace_back();
-				isInUse.push_back(true);
-				return TId(pool.size() - 1);
+				inUsePeak = (TId) liveIDs.size();
 			}
+
+			return id;
 		}
 
 		void Dispose(TId id)
 		{
 			if (!IsAllocated(id)) throw std::invalid_argument("id isn't allocated");
-			inUse--;
-			freeIDs.push_back(id);
-			isInUse[id] = false;
-			Compact();
-		}
 
-		void Compact()
-		{
-			while (!freeIDs.empty() && freeIDs.back() == (TId) pool.size() - 1)
-			{
-				freeIDs.pop_back();
-				pool.pop_back();
-				isInUse.pop_back();
-			}
+			const int index = id & kIndexMask;
+			Slot& slot = GetSlot(index);
+
+			slot.obj = TObj();
+			slot.liveId = -1;
+			slot.generation = (slot.generation + 1) & kGenerationMask;
+
+			// Swap-remove from the dense array
+			TId movedId = liveIDs.back();
+			liveIDs[slot.denseIndex] = movedId;
+			GetSlot(movedId & kIndexMask).denseIndex = slot.denseIndex;
+			liveIDs.pop_back();
+
+			// Append to the free queue
+			slot.nextFree = kNil;
+			if (freeTail != kNil)
+				GetSlot(freeTail).nextFree = index;
+			else
+				freeHead = index;
+			freeTail = index;
 		}
 
 		TObj& operator[](TId id)
 		{
 			if (!IsAllocated(id)) throw std::invalid_argument("id isn't allocated");
-			return pool[id];
+			return GetSlot(id & kIndexMask).obj;
 		}
 
 		const TObj& operator[](TId id) const
 		{
 			if (!IsAllocated(id)) throw std::invalid_argument("id isn't allocated");
-			return pool[id];
+			return GetSlot(id & kIndexMask).obj;
+		}
+
+		// Returns nullptr if the ID is stale or was never allocated.
+		TObj* TryGet(TId id)
+		{
+			if (!IsAllocated(id)) return nullptr;
+			return &GetSlot(id & kIndexMask).obj;
 		}
 
 		bool IsFull() const
 		{
-			return inUse >= MAX;
+			return liveIDs.size() >= (size_t) MAX;
 		}
 
 		bool IsAllocated(TId id) const
 		{
-			return id >= 0 && (unsigned) id < pool.size() && isInUse[id];
+			return id >= 0 && (id & kIndexMask) < numSlots && GetSlot(id & kIndexMask).liveId == id;
+		}
+
+		// Calls fn(TId, TObj&) on every live object. fn must not allocate or dispose.
+		template<typename F>
+		void ForEachLive(F&& fn)
+		{
+			for (TId id : liveIDs)
+				fn(id, GetSlot(id & kIndexMask).obj);
+		}
+
+		const std::vector<TId>& GetLiveIDs() const
+		{
+			return liveIDs;
 		}
 	};
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,162 @@
+// Benchmark: alloc/free throughput of FixedPool (behind a mutex, as it isn't
+// thread-safe) and LockFreeFixedPool, with 1 to 8 threads hammering one pool.
+//
+// Not part of the game build. Build and run by hand, from extern/Pomme:
+//
+//     g++ -std=c++17 -O2 -DNDEBUG -I. Utilities/bench/FixedPoolBench.cpp -o FixedPoolBench -lpthread
+//     ./FixedPoolBench
+//
+// Add -fsanitize=thread (or address) to check the pools under contention.
+
+#include "Utilities/FixedPool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace Pomme;
+
+static constexpr int kPoolSize = 4096;
+static constexpr int kHeldPerThread = 32;		// objects each thread holds at once
+static constexpr int kRoundsPerThread = 100'000;
+
+struct Object
+{
+	int owner;
+	int serial;
+	char payload[24];
+
+	Object(int owner, int serial)
+		: owner(owner)
+		, serial(serial)
+		, payload{}
+	{
+	}
+};
+
+struct LockedPool
+{
+	static constexpr const char* kName = "FixedPool + mutex";
+
+	FixedPool<Object, uint16_t, kPoolSize> pool;
+	std::mutex mutex;
+
+	Object* Alloc(int owner, int serial)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return pool.Alloc(owner, serial);
+	}
+
+	void Dispose(Object* obj)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pool.Dispose(obj);
+	}
+
+	int GetNumInUse() const
+	{ return pool.GetNumInUse(); }
+};
+
+struct LockFreePool
+{
+	static constexpr const char* kName = "LockFreeFixedPool";
+
+	LockFreeFixedPool<Object, uint16_t, kPoolSize> pool;
+
+	Object* Alloc(int owner, int serial)
+	{ return pool.Alloc(owner, serial); }
+
+	void Dispose(Object* obj)
+	{ pool.Dispose(obj); }
+
+	int GetNumInUse() const
+	{ return pool.GetNumInUse(); }
+};
+
+// Each thread repeatedly fills its hand with objects, checks that nobody else
+// was handed the same ones, and frees them in a different order than it got
+// them. Returns millions of alloc+free pairs per second, or -1 on corruption.
+template<typename TPool>
+static double Run(int numThreads)
+{
+	TPool pool;
+	bool corrupted = false;
+	std::mutex corruptedMutex;
+
+	auto worker = [&](int owner)
+	{
+		Object* held[kHeldPerThread];
+		for (int round = 0; round < kRoundsPerThread; round++)
+		{
+			for (int i = 0; i < kHeldPerThread; i++)
+				held[i] = pool.Alloc(owner, round * kHeldPerThread + i);
+
+			for (int i = 0; i < kHeldPerThread; i++)
+			{
+				// 7 is coprime with kHeldPerThread, so this visits every slot once
+				Object* obj = held[(i * 7) % kHeldPerThread];
+				if (obj->owner != owner)
+				{
+					std::lock_guard<std::mutex> lock(corruptedMutex);
+					corrupted = true;
+				}
+				pool.Dispose(obj);
+			}
+		}
+	};
+
+	const auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads; t++)
+		threads.emplace_back(worker, t);
+	for (auto& thread : threads)
+		thread.join();
+	const auto end = std::chrono::steady_clock::now();
+
+	if (corrupted || pool.GetNumInUse() != 0)
+		return -1;
+
+	const double pairs = double(numThreads) * kRoundsPerThread * kHeldPerThread;
+	return pairs / std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+int main()
+{
+	// Single-threaded reference, with no lock at all
+	{
+		FixedPool<Object, uint16_t, kPoolSize> pool;
+		Object* held[kHeldPerThread];
+		const auto start = std::chrono::steady_clock::now();
+		for (int round = 0; round < kRoundsPerThread; round++)
+		{
+			for (int i = 0; i < kHeldPerThread; i++)
+				held[i] = pool.Alloc(0, i);
+			for (int i = kHeldPerThread - 1; i >= 0; i--)
+				pool.Dispose(held[i]);
+		}
+		const auto end = std::chrono::steady_clock::now();
+		printf("FixedPool, 1 thread, no lock: %.1f M alloc+free/s\n\n",
+			double(kRoundsPerThread) * kHeldPerThread / std::chrono::duration<double, std::micro>(end - start).count());
+	}
+
+	printf("%-8s%22s%22s   (M alloc+free/s)\n", "threads", LockedPool::kName, LockFreePool::kName);
+
+	bool ok = true;
+	for (int numThreads : {1, 2, 4, 8})
+	{
+		const double locked = Run<LockedPool>(numThreads);
+		const double lockFree = Run<LockFreePool>(numThreads);
+		ok = ok && locked >= 0 && lockFree >= 0;
+		printf("%-8d%22.1f%22.1f\n", numThreads, locked, lockFree);
+	}
+
+	if (!ok)
+	{
+		printf("CORRUPTED: an object was handed to two threads, or the in-use count is off\n");
+		return 1;
+	}
+
+	return 0;
+}
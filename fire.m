@@ -42,6 +42,8 @@ void ProcessAndDrawFire (GWorldPtr theGWorld)
     PixMapHandle		dstPixMap;
     register unsigned char	*dst;
     unsigned long		dstRowsBytes;
+    short			firstDrawnRow = -1, lastDrawnRow = -1;
+    Rect			drawnRect;
     
     bool			anySheepBurning = 0;
     char			randoms[256];
@@ -200,6 +202,9 @@ void ProcessAndDrawFire (GWorldPtr theGWorld)
             
             if (fire[offset] > 31)
             {
+                if (firstDrawnRow < 0) firstDrawnRow = i;
+                lastDrawnRow = i;
+                
                 if (fire[offset] > 100) // > 100 is fire, < 101 but nonzero is smoke
                 {
                     dst[(j << 1) + dstRowsBytes] = FIRE_COLOUR_HI + ( fire[offset] >> 6 );
@@ -224,6 +229,15 @@ void ProcessAndDrawFire (GWorldPtr theGWorld)
         
     }
     
+    // the pixels were written directly, so tell Pomme which rows need presenting
+    if (firstDrawnRow >= 0)
+    {
+        drawnRect = theGWorld->portRect;
+        drawnRect.top = theGWorld->portRect.top + firstDrawnRow;
+        drawnRect.bottom = theGWorld->portRect.top + lastDrawnRow + 1;
+        DamagePortRegion(&drawnRect);
+    }
+    
     UnlockPixels(dstPixMap);
     
     SetGWorld(storePort, storeDevice);
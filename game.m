@@ -746,7 +746,7 @@ void FireWeapon (Point thePoint)
     Point			collisionPoint;
     unsigned long		rowBytes;
     short			offset;
-    Ptr			maskPixBaseAddress;
+    const char		*maskPixBaseAddress;
     short			layer; // if a sheeep and some scenery are on the same layer, the sheep is in front
     short			numHit = 0, hitScenery = 0;
     
@@ -792,7 +792,7 @@ void FireWeapon (Point thePoint)
                 {
                     LockPixels(collisionMask);
                     rowBytes = (**collisionMask).rowBytes & 0x3FFF;
-                    maskPixBaseAddress = GetPixBaseAddr(collisionMask);
+                    maskPixBaseAddress = GetPixBaseAddrForReading(collisionMask);
                     
                     offset = collisionPoint.h / 8 + collisionPoint.v * rowBytes;
                     
@@ -865,7 +865,7 @@ void FireWeapon (Point thePoint)
                 {
                     LockPixels(collisionMask);
                     rowBytes = (**collisionMask).rowBytes & 0x3FFF;
-                    maskPixBaseAddress = GetPixBaseAddr(collisionMask);
+                    maskPixBaseAddress = GetPixBaseAddrForReading(collisionMask);
                     
                     offset = collisionPoint.h / 8 + collisionPoint.v * rowBytes;
                     
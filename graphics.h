@@ -22,7 +22,6 @@ void ClearGWorld (GWorldPtr theGWorld, short colour);
 void		DrawInterface			(GWorldPtr theGWorld);
 void		DrawBackground			(GWorldPtr theGWorld);
 void		DrawStuff			(GWorldPtr theGWorld);
-void		DrawSheep			(GWorldPtr theGWorld, short layer);
 void		DrawScenery			(GWorldPtr theGWorld, short layer);
 void		DrawScoreEffects		(GWorldPtr theGWorld);
 void		DrawShotEffects			(GWorldPtr theGWorld);
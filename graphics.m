@@ -20,6 +20,7 @@ extern GlobalStuff *g;
 extern void PlaySound(short channel, Handle sound);
 //extern bool InVotingPeriod(void);
 extern short GetChainLevel(void);
+extern void CleanUp(bool instaQuit);
 
 // ============================================================================
 // Compatibility functions for APIs not in Pomme
@@ -262,21 +263,20 @@ void ClearGWorld (GWorldPtr theGWorld, short colour)
 }
 
 
-void DrawBackground (GWorldPtr theGWorld)
+// The deepest scenery layer is drawn before any sheep, so it's cached along
+// with the background in g->backgroundLayer, and DrawStuff skips it
+#define kStaticSceneryLayer	5
+
+static void DrawBackgroundLayer (GWorldPtr layerGWorld)
 {
     PixMapHandle	srcPixMap, dstPixMap;
-    GDHandle		storeDevice;
-    CGrafPtr		storePort;
     Rect		bounds;
     
     srcPixMap = GetGWorldPixMap(g->theLevel->theBackground->theGWorld);
-    dstPixMap = GetGWorldPixMap(theGWorld);
+    dstPixMap = GetGWorldPixMap(layerGWorld);
     
     GetPixBounds(srcPixMap, &bounds);
     
-    GetGWorld(&storePort,&storeDevice);
-    SetGWorld(theGWorld, NULL);
-    
     LockPixels(srcPixMap);
     LockPixels(dstPixMap);
     
@@ -290,130 +290,154 @@ void DrawBackground (GWorldPtr theGWorld)
     UnlockPixels(srcPixMap);
     UnlockPixels(dstPixMap);
     
+    DrawScenery(layerGWorld, kStaticSceneryLayer);
+}
+
+void DrawBackground (GWorldPtr theGWorld)
+{
+    GDHandle		storeDevice;
+    CGrafPtr		storePort;
+    static Level	*layerLevel = NULL;
+    
+    // The layer only tracks changes to the GWorlds it was drawn from, not which ones those are
+    if (g->theLevel != layerLevel)
+    {
+        InvalidateStaticLayer(g->backgroundLayer);
+        layerLevel = g->theLevel;
+    }
+    
+    if (BeginStaticLayer(g->backgroundLayer))
+    {
+        DrawBackgroundLayer(GetStaticLayerGWorld(g->backgroundLayer));
+        EndStaticLayer(g->backgroundLayer);
+    }
+    
+    GetGWorld(&storePort,&storeDevice);
+    SetGWorld(theGWorld, NULL);
+    
+    DrawStaticLayer(g->backgroundLayer, &g->swapBounds);
+    
     SetGWorld(storePort,storeDevice);
 }
 
-void DrawStuff (GWorldPtr theGWorld)
+// Picks the sprite and mask a sheep is drawn with, and the part of them to draw
+static void GetSheepSprite (SheepToken *theSheep, GWorldPtr *sprite, GWorldPtr *mask, Rect *srcRect)
 {
-    short i = 5;
+    if (theSheep->timesShot)
+    {
+        *sprite = theSheep->deadSprite;
+        *mask = theSheep->deadSpriteMaskWithOutline;
+        *srcRect = theSheep->deadBounds;
+        return;
+    }
     
-    while (i >= 0)
+    if (theSheep->frame == 1)
     {
-        DrawScenery(theGWorld, i);
-        DrawSheep(theGWorld, i);
-        i--;
+        if (theSheep->velocity.x < 0)
+        {
+            *sprite = g->theSheepType.liveSpriteRunLeftA;
+            *mask = g->theSheepType.liveSpriteRunLeftMaskA;
+        }else{
+            *sprite = g->theSheepType.liveSpriteRunRightA;
+            *mask = g->theSheepType.liveSpriteRunRightMaskA;
+        }
     }
+    else
+    {
+        if (theSheep->velocity.x < 0)
+        {
+            *sprite = g->theSheepType.liveSpriteRunLeftB;
+            *mask = g->theSheepType.liveSpriteRunLeftMaskB;
+        }else{
+            *sprite = g->theSheepType.liveSpriteRunRightB;
+            *mask = g->theSheepType.liveSpriteRunRightMaskB;
+        }
+    }
+    
+    GetPixBounds(GetGWorldPixMap(*sprite), srcRect);
 }
 
-void DrawSheep (GWorldPtr theGWorld, short layer)
+// Batch layers go front to back, the other way round from scenery and sheep
+// layers. Within a layer, scenery is drawn before sheep.
+#define kNumLayers		6
+#define BatchLayer(layer, isSheep)	((kNumLayers - 1 - (layer)) * 2 + (isSheep))
+
+static SpriteBatchItem	*stuffBatch = NULL;
+static long		stuffBatchCapacity = 0;
+
+static SpriteBatchItem *AddToStuffBatch (long *count)
+{
+    SpriteBatchItem	*grown;
+    long		newCapacity;
+    
+    if (*count == stuffBatchCapacity)
+    {
+        newCapacity = stuffBatchCapacity ? stuffBatchCapacity * 2 : 64;
+        grown = (SpriteBatchItem *)NewPtr(newCapacity * sizeof(SpriteBatchItem));
+        if (!grown)
+        {
+            NSLog(@"AddToStuffBatch: Failed to grow the sprite batch to %ld items", newCapacity);
+            CleanUp(true);		// quits
+            return NULL;
+        }
+        stuffBatchCapacity = newCapacity;
+        if (stuffBatch)
+        {
+            BlockMove(stuffBatch, grown, *count * sizeof(SpriteBatchItem));
+            DisposePtr((Ptr)stuffBatch);
+        }
+        stuffBatch = grown;
+    }
+    
+    return &stuffBatch[(*count)++];
+}
+
+// Draws the scenery (apart from the layer cached with the background) and the
+// sheep, walking each list once, as a single sprite batch
+void DrawStuff (GWorldPtr theGWorld)
 {
-    PixMapHandle	srcPixMap, mskPixMap, dstPixMap;
-    Rect		srcRect, dstRect;
     GDHandle		storeDevice;
     CGrafPtr		storePort;
+    SceneryToken	*thisToken;
     SheepToken		*thisSheep;
+    SpriteBatchItem	*item;
+    Rect		srcRect;
+    long		count = 0;
     
-    if (g->baseSheep)
+    for (thisToken = g->theLevel->baseSceneryToken; thisToken; thisToken = thisToken->next)
     {
-        thisSheep = g->baseSheep;
-        
-        GetGWorld(&storePort,&storeDevice);
-        SetGWorld(theGWorld, NULL);
+        if (thisToken->layer < 0 || thisToken->layer >= kNumLayers || thisToken->layer == kStaticSceneryLayer)
+            continue;
         
-        dstPixMap = GetGWorldPixMap(theGWorld);
-        LockPixels(dstPixMap);
+        item = AddToStuffBatch(&count);
+        item->src = thisToken->type->spriteGWorld;
+        item->mask = thisToken->type->maskGWorld;
+        GetPixBounds(GetGWorldPixMap(item->src), &srcRect);
+        item->srcRect = srcRect;
+        item->dstPoint.h = (short)thisToken->position.x - (short)(srcRect.right/2);
+        item->dstPoint.v = (short)thisToken->position.y - (short)(srcRect.bottom/2);
+        item->layer = BatchLayer(thisToken->layer, 0);
+    }
+    
+    for (thisSheep = g->baseSheep; thisSheep; thisSheep = thisSheep->next)
+    {
+        if (thisSheep->layer < 0 || thisSheep->layer >= kNumLayers)
+            continue;
         
-        while (thisSheep)
-        {
-            if (thisSheep->layer == layer)
-            {
-                if (!thisSheep->timesShot)
-                {    
-                    if (thisSheep->frame == 1)
-                    {
-                        if (thisSheep->velocity.x < 0)
-                        {
-                            srcPixMap = GetGWorldPixMap(g->theSheepType.liveSpriteRunLeftA);
-                            mskPixMap = GetGWorldPixMap(g->theSheepType.liveSpriteRunLeftMaskA);
-                            GetPixBounds(srcPixMap, &srcRect);
-                        }else{
-                            srcPixMap = GetGWorldPixMap(g->theSheepType.liveSpriteRunRightA);
-                            mskPixMap = GetGWorldPixMap(g->theSheepType.liveSpriteRunRightMaskA);
-                            
-                            GetPixBounds(srcPixMap, &srcRect);
-                        }
-                    }
-                    else
-                    {
-                        if (thisSheep->velocity.x < 0)
-                        {
-                            srcPixMap = GetGWorldPixMap(g->theSheepType.liveSpriteRunLeftB);
-                            mskPixMap = GetGWorldPixMap(g->theSheepType.liveSpriteRunLeftMaskB);
-                            GetPixBounds(srcPixMap, &srcRect);
-                        }else{
-                            srcPixMap = GetGWorldPixMap(g->theSheepType.liveSpriteRunRightB);
-                            mskPixMap = GetGWorldPixMap(g->theSheepType.liveSpriteRunRightMaskB);
-                            GetPixBounds(srcPixMap, &srcRect);
-                        }
-                    }
-                }
-                else
-                {
-                    srcPixMap = GetGWorldPixMap(thisSheep->deadSprite);
-                    mskPixMap = GetGWorldPixMap(thisSheep->deadSpriteMaskWithOutline);
-                    srcRect = thisSheep->deadBounds;
-                    
-                }
-                
-                dstRect.left = (short)thisSheep->position.x - (short)srcRect.right/2;		// try taking the (short)s out
-                dstRect.right = (short)thisSheep->position.x + (short)srcRect.right/2;		// for a rather odd bug ;)
-                dstRect.top = (short)thisSheep->position.y - (short)srcRect.bottom/2;
-                dstRect.bottom = (short)thisSheep->position.y + (short)srcRect.bottom/2;
-                
-                if (srcRect.right & 1) dstRect.right++;
-                if (srcRect.bottom & 1) dstRect.bottom++;
-                
-                if (dstRect.left < 0)
-                {
-                    srcRect.left -= dstRect.left;
-                    dstRect.left = 0;
-                }
-                else if (dstRect.right > 620)
-                {
-                    srcRect.right -= dstRect.right - 620;
-                    dstRect.right = 620;
-                }
-                
-                if (dstRect.top < 0)
-                {
-                    srcRect.top -= dstRect.top;
-                    dstRect.top = 0;
-                }
-                else if (dstRect.bottom > 420)
-                {
-                    srcRect.bottom -= dstRect.bottom - 420;
-                    dstRect.bottom = 420;
-                }
-                
-                LockPixels(srcPixMap);
-                LockPixels(mskPixMap);
-                
-                CopyMask(   (BitMap *)*srcPixMap,
-                            (BitMap *)*mskPixMap,
-                            (BitMap *)*dstPixMap,	// already locked
-                            &srcRect,
-                            &srcRect,
-                            &dstRect);
-                            
-                UnlockPixels(srcPixMap);
-                UnlockPixels(mskPixMap);
-            }
-            
-            thisSheep = thisSheep->next;
-        }
-        UnlockPixels(dstPixMap);
-        SetGWorld(storePort,storeDevice);
+        item = AddToStuffBatch(&count);
+        GetSheepSprite(thisSheep, &item->src, &item->mask, &srcRect);
+        item->srcRect = srcRect;
+        item->dstPoint.h = (short)thisSheep->position.x - (short)srcRect.right/2;
+        item->dstPoint.v = (short)thisSheep->position.y - (short)srcRect.bottom/2;
+        item->layer = BatchLayer(thisSheep->layer, 1);
     }
+    
+    GetGWorld(&storePort,&storeDevice);
+    SetGWorld(theGWorld, NULL);
+    
+    DrawSpriteBatch(stuffBatch, count);
+    
+    SetGWorld(storePort,storeDevice);
 }
 
 void DrawScenery (GWorldPtr theGWorld, short layer)
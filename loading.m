@@ -122,9 +122,8 @@ void LoadPicture(CFStringRef name, GWorldPtr *theGWorld, bool flipped)
             unsigned char b = srcData[srcOffset + 2];
             unsigned char a = srcData[srcOffset + 3];
             
-            // Pomme expects ARGB format
-            // On little-endian systems, store as BGRA for correct byte order
-            destPixels[destOffset] = (a << 24) | (r << 16) | (g << 8) | b;
+            // Pomme pixmaps hold ARGB in big-endian byte order on every host
+            destPixels[destOffset] = CFSwapInt32HostToBig((a << 24) | (r << 16) | (g << 8) | b);
         }
     }
     
@@ -217,9 +216,9 @@ void LoadMask(CFStringRef name, GWorldPtr *theGWorld, bool flipped)
             // Get grayscale value (use red channel or average)
             unsigned char gray = srcData[srcOffset];  // Red channel
             
-            // Set bit if pixel is "white" (above threshold)
-            // Masks typically have white = transparent, black = opaque
-            if (gray > 128) {
+            // Set bit if pixel is black: as in QuickDraw, a set mask bit
+            // means opaque (CopyMask copies it), a clear bit transparent
+            if (gray < 128) {
                 int byteIndex = x / 8;
                 int bitIndex = 7 - (x % 8);  // MSB first
                 destRow[byteIndex] |= (1 << bitIndex);
@@ -458,6 +457,10 @@ void LoadGlobalGraphics(void)
     if (err)
         CleanUp(true);
     
+    err = NewStaticLayer(&g->backgroundLayer, 16, &g->swapBounds, 0);
+    if (err)
+        CleanUp(true);
+    
 }
 
 void LoadEveryThingElse(void)
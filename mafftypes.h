@@ -387,6 +387,7 @@ typedef struct GlobalStuff
     Rect		fireBounds;		// swapbounds inset by 1 for calc purposes
     
     GWorldPtr		swapGWorld;		// back buffer
+    StaticLayerPtr	backgroundLayer;	// background and deepest scenery, redrawn only when they change
     
     bool		fireSwap;
     unsigned char	fireArray[260400];	// 620 * 420